@@ -1,18 +1,28 @@
+#define _GNU_SOURCE  // recvmmsg
+
 #include <errno.h>
 #include <fcntl.h>
 #include <getopt.h>
+#include <linux/filter.h>
 #include <netinet/in.h>
 #include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/eventfd.h>
 #include <sys/un.h>
 #include <syslog.h>
 
 #include "bier-sender.h"
+#include "include/bier-log.h"
 #include "include/bier.h"
+#include "include/bitstring.h"
+#include "include/pktbuf.h"
 #include "include/qcbor-encoding.h"
+#include "include/rcu.h"
 
 /**
  * @brief BIER daemon. Emulates a BIER forwarding router that receives packets from an IP socket or a UNIX socket.
- * It can be connected to applications using the UNIX socket. The number of applications are limited to 10 for a same BFR.
+ * It can be connected to applications using the UNIX socket. The registry of the applications grows as they bind.
  * This daemon can also act as a BFIR and a BFER.
  */
 
@@ -22,17 +32,11 @@
  * 
  * @param bier_payload Structure to free.
  */
-void free_bier_payload(bier_payload_t *bier_payload) {
-    free(bier_payload->bitstring);
-    free(bier_payload->payload);
-    free(bier_payload);
-}
-
 mc_mapping_t *fill_mc_mapping(char *mapping_filename) {
     FILE *file = fopen(mapping_filename, "r");
     if (!file) {
-        perror("fill_mc_mapping fopen");
-        fprintf(stderr, "The file: %s\n", mapping_filename);
+        log_perror("fill_mc_mapping fopen");
+        log_err("The file: %s", mapping_filename);
         return NULL;
     }
 
@@ -49,13 +53,13 @@ mc_mapping_t *fill_mc_mapping(char *mapping_filename) {
     }
 
     if (fseek(file, 0, SEEK_SET) == -1) {
-        perror("fill_mc_mapping fseek");
+        log_perror("fill_mc_mapping fseek");
         goto fill_mc_mapping_error;
     }
 
     mc_mapping_t *mapping = (mc_mapping_t *)malloc(sizeof(mc_mapping_t));
     if (!mapping) {
-        perror("fill_mc_mapping malloc");
+        log_perror("fill_mc_mapping malloc");
         goto fill_mc_mapping_error;
     }
 
@@ -63,14 +67,14 @@ mc_mapping_t *fill_mc_mapping(char *mapping_filename) {
     mapping->entries =
         (struct mc_entry *)malloc(sizeof(struct mc_entry) * nb_entries);
     if (!mapping->entries) {
-        perror("fill_mc_mapping malloc");
+        log_perror("fill_mc_mapping malloc");
         goto fill_mc_mapping_error_2;
     }
     memset(mapping->entries, 0, sizeof(struct mc_entry) * nb_entries);
 
     for (int i = 0; i < nb_entries; ++i) {
         if ((readed = getline(&line, &len, file)) == -1) {
-            perror("fill_mc_mapping getline");
+            log_perror("fill_mc_mapping getline");
             goto fill_mc_mapping_error_3;
         }
 
@@ -79,7 +83,7 @@ mc_mapping_t *fill_mc_mapping(char *mapping_filename) {
         int bifr_id;
 
         if (sscanf(line, "%s %s %d", mc_addr, src_addr, &bifr_id) < 0) {
-            perror("fill_mc_mapping sscanf");
+            log_perror("fill_mc_mapping sscanf");
             goto fill_mc_mapping_error_3;
         }
 
@@ -87,14 +91,14 @@ mc_mapping_t *fill_mc_mapping(char *mapping_filename) {
         // Parse into IPv6 address
         if (inet_pton(AF_INET6, mc_addr,
                       mapping->entries[i].mc_addr.mc_addr6.s6_addr) != 1) {
-            perror("fill_mc_mapping inet_pton");
+            log_perror("fill_mc_mapping inet_pton");
             goto fill_mc_mapping_error_3;
         }
         mapping->entries[i].family = AF_INET6;
 
         if (inet_pton(AF_INET6, src_addr,
                       mapping->entries[i].src_addr.src_addr6.s6_addr) != 1) {
-            perror("fill_mc_mapping inet_pton src mc");
+            log_perror("fill_mc_mapping inet_pton src mc");
             goto fill_mc_mapping_error_3;
         }
 
@@ -116,11 +120,74 @@ fill_mc_mapping_error:
     return NULL;
 }
 
+// Size of a buffer of the RX ring, i.e., maximum size of a packet
+#define BIER_RX_BUFFER_SIZE 1500
+#define BIER_RX_DEFAULT_BATCH 32
+#define BIER_RX_MAX_BATCH 1024
+#define BIER_MAX_WORKERS 64
+// Period of the reclamation of the structures retired by the main thread
+// while forwarding threads still hold them
+#define BIER_RCU_RECLAIM_PERIOD_MS 10
+// Room for the largest BIER header in front of the messages of the
+// applications, rounded to keep the messages aligned
+#define BIER_UNIX_HEADROOM ((BIER_TX_HEADER_SIZE + 63) & ~63)
+
+/**
+ * @brief Opens and binds the UNIX socket answering the requests for the
+ * counters of the daemon
+ *
+ * @param path path of the UNIX socket
+ * @return int the socket, or -1 on error
+ */
+int open_stats_socket(char *path) {
+    int stats_socket = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (stats_socket == -1) {
+        log_perror("Stats UNIX socket");
+        return -1;
+    }
+    struct sockaddr_un stats_local = {};
+    stats_local.sun_family = AF_UNIX;
+    strncpy(stats_local.sun_path, path, sizeof(stats_local.sun_path) - 1);
+    if (remove(path) == -1 && errno != ENOENT) {
+        log_perror("Remove stats socket path");
+        close(stats_socket);
+        return -1;
+    }
+    if (bind(stats_socket, (struct sockaddr *)&stats_local,
+             sizeof(struct sockaddr_un)) == -1) {
+        log_perror("Bind stats socket");
+        close(stats_socket);
+        return -1;
+    }
+    log_info("Statistics available on %s", path);
+    return stats_socket;
+}
+
+/**
+ * @brief Answers a request received on the stats socket. The content of the
+ * request is ignored
+ */
+void answer_stats_request(int stats_socket, bier_bift_t *bier) {
+    uint8_t request[64];
+    struct sockaddr_un requester = {};
+    socklen_t addrlen = sizeof(requester);
+    if (recvfrom(stats_socket, request, sizeof(request), MSG_DONTWAIT,
+                 (struct sockaddr *)&requester, &addrlen) < 0) {
+        log_perror("recvfrom stats request");
+        return;
+    }
+    if (addrlen <= sizeof(sa_family_t)) {
+        log_warn("Stats request from an unbound socket, cannot answer");
+        return;
+    }
+    send_bier_stats(stats_socket, bier, &requester, addrlen);
+}
+
 void usage(char *prog_name) {
     fprintf(stderr, "USAGE:\n");
     fprintf(stderr, "    %s [OPTIONS] -c <> -b <> -a <> -m <> -g <>\n", prog_name);
     fprintf(stderr,
-            "    -c config file: static BIFT configuration file path\n");
+            "    -c config file: static BIFT configuration file path, reloaded on SIGHUP without dropping the bound applications\n");
     fprintf(stderr,
             "    -b bier socket addr: path to the UNIX socket path of the BIER daemon\n");
     fprintf(stderr,
@@ -129,6 +196,17 @@ void usage(char *prog_name) {
             "    -m mapping path: mapping from IP address to BFR-id\n");
     fprintf(stderr, "    -g group path: path to the file containing the multicast groups and the corresponding source BFR-ids\n");
     fprintf(stderr, "    -i: use IPv4 instead of IPv6 if added\n");
+    fprintf(stderr,
+            "    -B batch size: maximum number of packets received from the BIER socket with a single system call (default %d, max %d)\n",
+            BIER_RX_DEFAULT_BATCH, BIER_RX_MAX_BATCH);
+    fprintf(stderr,
+            "    -s stats socket path: path to a UNIX socket answering any datagram with the CBOR encoded counters of the daemon (disabled if not set)\n");
+    fprintf(stderr,
+            "    -l log level: initial syslog level, from 0 (LOG_EMERG) to 7 (LOG_DEBUG) (default %d). SIGUSR1/SIGUSR2 raise/lower it at runtime\n",
+            BIER_LOG_DEFAULT_LEVEL);
+    fprintf(stderr,
+            "    -w workers: number of forwarding threads, each pinned to a CPU and receiving the packets of the BIER network processed by the CPUs with the same index modulo the number of threads (default 0: the main thread forwards, max %d)\n",
+            BIER_MAX_WORKERS);
 }
 
 typedef struct {
@@ -137,7 +215,11 @@ typedef struct {
     char application_socket_path[NAME_MAX];
     char ip_2_id_mapping[NAME_MAX];
     char mc_group_mapping[NAME_MAX];
+    char stats_socket_path[NAME_MAX];  // Empty if no stats socket
     bool use_ipv4;
+    unsigned int rx_batch_size;
+    int log_level;
+    int nb_workers;
 } args_t;
 
 void parse_args(args_t *args, int argc, char *argv[]) {
@@ -146,8 +228,10 @@ void parse_args(args_t *args, int argc, char *argv[]) {
     bool has_config_file, has_bier_socket_path, has_application_socket_path,
         has_ip_2_id_mapping, has_mc_group_mapping;
     args->use_ipv4 = false;
+    args->rx_batch_size = BIER_RX_DEFAULT_BATCH;
+    args->log_level = BIER_LOG_DEFAULT_LEVEL;
 
-    while ((opt = getopt(argc, argv, "c:b:a:m:g:i")) != -1) {
+    while ((opt = getopt(argc, argv, "c:b:a:m:g:iB:l:s:w:")) != -1) {
         switch (opt) {
             case 'c': {
                 strcpy(args->config_file, optarg);
@@ -178,6 +262,36 @@ void parse_args(args_t *args, int argc, char *argv[]) {
                 args->use_ipv4 = true;
                 break;
             }
+            case 'B': {
+                int batch_size = atoi(optarg);
+                if (batch_size <= 0 || batch_size > BIER_RX_MAX_BATCH) {
+                    log_err("Invalid batch size: %s", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                args->rx_batch_size = batch_size;
+                break;
+            }
+            case 's': {
+                strcpy(args->stats_socket_path, optarg);
+                break;
+            }
+            case 'l': {
+                args->log_level = atoi(optarg);
+                if (args->log_level < LOG_EMERG || args->log_level > LOG_DEBUG) {
+                    log_err("Invalid log level: %s", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            }
+            case 'w': {
+                args->nb_workers = atoi(optarg);
+                if (args->nb_workers < 0 ||
+                    args->nb_workers > BIER_MAX_WORKERS) {
+                    log_err("Invalid number of workers: %s", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            }
             default: {
                 usage(argv[0]);
                 exit(EXIT_FAILURE);
@@ -187,9 +301,8 @@ void parse_args(args_t *args, int argc, char *argv[]) {
 
     if (!(has_config_file && has_bier_socket_path &&
           has_application_socket_path && has_ip_2_id_mapping)) {
-        fprintf(stderr,
-                "Missing arguments: config? %u, bier? %u, application? %u, "
-                "mapping? %u\n",
+        log_err("Missing arguments: config? %u, bier? %u, application? %u, "
+                "mapping? %u",
                 has_config_file, has_bier_socket_path,
                 has_application_socket_path, has_ip_2_id_mapping);
         exit(EXIT_FAILURE);
@@ -220,15 +333,15 @@ int64_t get_id_from_address(sockaddr_uniform_t *addr, bier_addr2bifr_t *mapping,
 bier_addr2bifr_t *read_addr_mapping(char *filename, bool use_ipv4) {
     FILE *file = fopen(filename, "r");
     if (!file) {
-        fprintf(stderr, "Filename: %s\n", filename);
-        perror("read_addr_mapping");
+        log_err("Filename: %s", filename);
+        log_perror("read_addr_mapping");
         return NULL;
     }
 
     bier_addr2bifr_t *mapping =
         (bier_addr2bifr_t *)malloc(sizeof(bier_addr2bifr_t));
     if (!mapping) {
-        perror("read_addr_mapping malloc");
+        log_perror("read_addr_mapping malloc");
         return NULL;
     }
     memset(mapping, 0, sizeof(bier_addr2bifr_t));
@@ -246,7 +359,7 @@ bier_addr2bifr_t *read_addr_mapping(char *filename, bool use_ipv4) {
     }
 
     if (fseek(file, 0, SEEK_SET) == -1) {
-        perror("fseek");
+        log_perror("fseek");
         return NULL;
     }
 
@@ -254,12 +367,12 @@ bier_addr2bifr_t *read_addr_mapping(char *filename, bool use_ipv4) {
     mapping->addrs =
         (in_addr_common_t *)malloc(sizeof(in_addr_common_t) * nb_entries);
     if (!mapping->addrs) {
-        perror("read_addr_mapping_atoi malloc2");
+        log_perror("read_addr_mapping_atoi malloc2");
         return NULL;
     }
     mapping->bfr_ids = (uint64_t *)malloc(sizeof(uint64_t) * nb_entries);
     if (!mapping->bfr_ids) {
-        perror("read_addr_mapping_atoi malloc3");
+        log_perror("read_addr_mapping_atoi malloc3");
         return NULL;
     }
     memset(mapping->addrs, 0, sizeof(in_addr_common_t) * nb_entries);
@@ -267,7 +380,7 @@ bier_addr2bifr_t *read_addr_mapping(char *filename, bool use_ipv4) {
 
     for (int i = 0; i < nb_entries; ++i) {
         if ((readed = getline(&line, &len, file)) == -1) {
-            perror("read_addr_mapping getline3");
+            log_perror("read_addr_mapping getline3");
             return NULL;
         }
         char addr[100];
@@ -275,7 +388,7 @@ bier_addr2bifr_t *read_addr_mapping(char *filename, bool use_ipv4) {
         uint32_t prlength;
 
         if (sscanf(line, "%lu %[^/]/%d\n", &id, addr, &prlength) < 0) {
-            perror("sscanf");
+            log_perror("sscanf");
             return NULL;
         }
 
@@ -287,9 +400,8 @@ bier_addr2bifr_t *read_addr_mapping(char *filename, bool use_ipv4) {
             err = inet_pton(AF_INET6, addr, &mapping->addrs[i].v6.s6_addr);
         }
         if (err != 1) {
-            perror("inet_pton");
-            fprintf(stderr, "Cannot convert to address: %s\n", addr);
-            fprintf(stderr, "Comprends aps %s - %u\n", addr, prlength);
+            log_perror("inet_pton");
+            log_err("Cannot convert to address: %s", addr);
             return NULL;
         }
 
@@ -304,45 +416,615 @@ bier_addr2bifr_t *read_addr_mapping(char *filename, bool use_ipv4) {
     return mapping;
 }
 
-int process_unix_message_is_payload(void *bier_payload_void, bier_bift_t *bier,
-                                    bier_all_apps_t *all_apps, bool use_ipv4) {
-    bier_payload_t *bier_payload = (bier_payload_t *)bier_payload_void;
-    fprintf(stderr, "BIER payload of %lu bytes\n",
-            bier_payload->payload_length);
-    fprintf(stderr, "BIER bitstring: ");
-    for (int i = 0; i < bier_payload->bitstring_length; ++i) {
-        fprintf(stderr, "%x ", bier_payload->bitstring[i]);
-    }
-    fprintf(stderr, "\n");
-    // TODO: proto must be sent also, and BIFT-ID based on TE?
-    bier_header_t *bh =
-        init_bier_header((const uint64_t *)bier_payload->bitstring,
-                         bier_payload->bitstring_length * 8,
-                         bier_payload->proto, bier_payload->use_bier_te);
-    // TODO: check error
-    my_packet_t *packet = encap_bier_packet(bh, bier_payload->payload_length,
-                                            bier_payload->payload);
-    memset(&all_apps->src, 0, sizeof(all_apps->src));
-    int err = bier_processing(packet->packet, packet->packet_length, bier,
-                              all_apps, use_ipv4);
-    if (err < 0) {
-        fprintf(stderr,
-                "Error when processing the BIER packet at the "
-                "router... exiting...\n");
-        my_packet_free(packet);  // TODO: the frees are not logical here
+/**
+ * @brief Ring of preallocated buffers used to receive packets from the BIER
+ * socket with a single recvmmsg call
+ */
+typedef struct {
+    unsigned int batch_size;
+    uint8_t *buffers;  // batch_size buffers of BIER_RX_BUFFER_SIZE bytes
+    struct mmsghdr *msgs;
+    struct iovec *iovecs;
+    sockaddr_uniform_t *srcs;
+    bier_rx_packet_t *packets;
+} bier_rx_ring_t;
+
+void free_rx_ring(bier_rx_ring_t *ring) {
+    free(ring->buffers);
+    free(ring->msgs);
+    free(ring->iovecs);
+    free(ring->srcs);
+    free(ring->packets);
+    free(ring);
+}
+
+bier_rx_ring_t *init_rx_ring(unsigned int batch_size) {
+    bier_rx_ring_t *ring = (bier_rx_ring_t *)calloc(1, sizeof(bier_rx_ring_t));
+    if (!ring) {
+        log_perror("calloc rx ring");
+        return NULL;
+    }
+    ring->batch_size = batch_size;
+    ring->buffers = (uint8_t *)malloc(sizeof(uint8_t) * BIER_RX_BUFFER_SIZE *
+                                      batch_size);
+    ring->msgs = (struct mmsghdr *)calloc(batch_size, sizeof(struct mmsghdr));
+    ring->iovecs = (struct iovec *)calloc(batch_size, sizeof(struct iovec));
+    ring->srcs =
+        (sockaddr_uniform_t *)calloc(batch_size, sizeof(sockaddr_uniform_t));
+    ring->packets =
+        (bier_rx_packet_t *)calloc(batch_size, sizeof(bier_rx_packet_t));
+    if (!ring->buffers || !ring->msgs || !ring->iovecs || !ring->srcs ||
+        !ring->packets) {
+        log_perror("malloc rx ring");
+        free_rx_ring(ring);
+        return NULL;
+    }
+
+    for (unsigned int i = 0; i < batch_size; ++i) {
+        ring->iovecs[i].iov_base = &ring->buffers[i * BIER_RX_BUFFER_SIZE];
+        ring->iovecs[i].iov_len = BIER_RX_BUFFER_SIZE;
+        ring->msgs[i].msg_hdr.msg_iov = &ring->iovecs[i];
+        ring->msgs[i].msg_hdr.msg_iovlen = 1;
+        ring->msgs[i].msg_hdr.msg_name = &ring->srcs[i];
+    }
+    return ring;
+}
+
+/**
+ * @brief Receive a batch of at most ring->batch_size packets waiting on the
+ * BIER socket *fd* and process it at once with bier_processing_batch
+ *
+ * @return int the number of received packets, 0 if the socket would block,
+ * -1 if the socket returned an error
+ */
+int receive_bier_batch(int fd, bier_rx_ring_t *ring, bier_bift_t *bier,
+                       bier_all_apps_t *all_apps, bier_addr2bifr_t *mapping,
+                       bool use_ipv4) {
+    socklen_t remote_len =
+        use_ipv4 ? sizeof(struct sockaddr_in) : sizeof(struct sockaddr_in6);
+    int nb_msgs;
+    do {
+        // The length of the source address is overwritten by each call
+        for (unsigned int i = 0; i < ring->batch_size; ++i) {
+            ring->msgs[i].msg_hdr.msg_namelen = remote_len;
+        }
+        nb_msgs =
+            recvmmsg(fd, ring->msgs, ring->batch_size, MSG_DONTWAIT, NULL);
+    } while (nb_msgs < 0 && errno == EINTR);
+    if (nb_msgs < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return 0;
+        }
+        log_perror("recvmmsg");
+        return -1;
+    }
+
+    unsigned int nb_packets = 0;
+    for (int i = 0; i < nb_msgs; ++i) {
+        uint8_t *buffer = ring->iovecs[i].iov_base;
+        size_t length = ring->msgs[i].msg_len;
+        if (ring->msgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+            log_err("Dropping a truncated packet");
+            continue;
+        }
+        // With IPv4 the raw socket also gives the IPv4 header
+        if (use_ipv4) {
+            size_t ip_header_length = (buffer[0] & 0xf) * 4;
+            if (length < ip_header_length) {
+                continue;
+            }
+            buffer += ip_header_length;
+            length -= ip_header_length;
+        }
+        bier_rx_packet_t *packet = &ring->packets[nb_packets++];
+        packet->buffer = buffer;
+        packet->length = length;
+        memcpy(&packet->src, &ring->srcs[i], sizeof(sockaddr_uniform_t));
+        packet->src_bfr_id =
+            get_id_from_address(&ring->srcs[i], mapping, use_ipv4);
+    }
+    log_debug("Received a batch of %d packets", nb_msgs);
+    bier_processing_batch(ring->packets, nb_packets, bier, all_apps,
+                          use_ipv4);
+    return nb_msgs;
+}
+
+/**
+ * @brief Receive all packets waiting on the BIER socket *fd*, by batches of
+ * at most ring->batch_size packets, until the socket would block
+ *
+ * @return int -1 if the socket returned an error, 0 otherwise
+ */
+int receive_bier_packets(int fd, bier_rx_ring_t *ring, bier_bift_t *bier,
+                         bier_all_apps_t *all_apps, bier_addr2bifr_t *mapping,
+                         bool use_ipv4) {
+    int nb_msgs;
+    while ((nb_msgs = receive_bier_batch(fd, ring, bier, all_apps, mapping,
+                                         use_ipv4)) > 0) {
+    }
+    return nb_msgs;
+}
+
+/**
+ * @brief State shared by the main thread and the forwarding threads
+ */
+typedef struct {
+    bier_rcu_t rcu;  // One reader per forwarding thread
+    // Applications read by the forwarding threads. The main thread publishes
+    // a new snapshot each time an application binds or leaves
+    _Atomic(bier_all_apps_t *) apps;
+    bier_addr2bifr_t *mapping;  // Only read
+    bool use_ipv4;
+    int stop_efd;  // Readable once the forwarding threads must stop
+} bier_workers_shared_t;
+
+/**
+ * @brief Forwarding thread. It receives its share of the packets of the BIER
+ * network on its own raw socket, and sends their replicas and local deliveries
+ * itself. The BIFTs are shared and only read
+ */
+typedef struct {
+    int idx;
+    int cpu;  // CPU the thread is pinned to
+    pthread_t thread;
+    bool started;
+    bier_bift_t *bier;  // View with the socket, TX queue and counters
+    bier_rx_ring_t *rx_ring;
+    // Deliveries of the thread. The registry and the demux table point to the
+    // snapshot taken at the start of each batch
+    bier_all_apps_t apps;
+    bier_workers_shared_t *shared;
+} bier_worker_t;
+
+/**
+ * @brief Attaches a classic BPF program to *socket*, replacing the previous
+ * one
+ *
+ * @return int 0 on success, -1 otherwise
+ */
+int attach_socket_filter(int socket, struct sock_filter *code,
+                         unsigned short nb_instructions) {
+    struct sock_fprog prog = {nb_instructions, code};
+    if (setsockopt(socket, SOL_SOCKET, SO_ATTACH_FILTER, &prog,
+                   sizeof(prog)) < 0) {
+        log_perror("setsockopt SO_ATTACH_FILTER");
         return -1;
     }
-    free_bier_payload(bier_payload);
-    release_bier_header(bh);
-    my_packet_free(packet);
     return 0;
 }
 
+/**
+ * @brief Restricts the raw socket of the worker *idx* to the packets
+ * processed by the CPUs whose index modulo *nb_workers* is *idx*. Every raw
+ * socket receives a copy of each BIER packet, which the filter drops before it
+ * is queued on the sockets of the other workers
+ */
+int attach_worker_filter(int socket, int idx, int nb_workers) {
+    struct sock_filter code[] = {
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_CPU),
+        BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, nb_workers),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, idx, 0, 1),
+        BPF_STMT(BPF_RET | BPF_K, UINT32_MAX),
+        BPF_STMT(BPF_RET | BPF_K, 0),
+    };
+    return attach_socket_filter(socket, code, sizeof(code) / sizeof(code[0]));
+}
+
+/**
+ * @brief Publishes a snapshot of *all_apps* for the forwarding threads. The
+ * previous one is freed once no thread holds it anymore
+ *
+ * @return int 0 on success, -1 otherwise. The threads keep the previous
+ * snapshot on error
+ */
+int publish_apps_snapshot(bier_workers_shared_t *shared,
+                          bier_all_apps_t *all_apps) {
+    bier_all_apps_t *snapshot = bier_apps_snapshot(all_apps);
+    if (!snapshot) {
+        return -1;
+    }
+    bier_all_apps_t *previous = atomic_exchange(&shared->apps, snapshot);
+    return bier_rcu_retire(&shared->rcu, previous, bier_apps_snapshot_free);
+}
+
+void *worker_main(void *arg) {
+    bier_worker_t *worker = (bier_worker_t *)arg;
+    bier_workers_shared_t *shared = worker->shared;
+    struct pollfd pfds[2] = {
+        {.fd = worker->bier->socket, .events = POLLIN},
+        {.fd = shared->stop_efd, .events = POLLIN},
+    };
+    log_info("Forwarding thread %d on CPU %d", worker->idx, worker->cpu);
+    while (1) {
+        // The main thread does not wait for a blocked thread
+        bier_rcu_offline(&shared->rcu, worker->idx);
+        if (poll(pfds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            log_perror("Poll worker");
+            break;
+        }
+        if (pfds[1].revents & POLLIN) {
+            break;
+        }
+        bier_rcu_online(&shared->rcu, worker->idx);
+        int nb_msgs;
+        do {
+            const bier_all_apps_t *snapshot = atomic_load(&shared->apps);
+            worker->apps.application_socket = snapshot->application_socket;
+            worker->apps.apps = snapshot->apps;
+            worker->apps.capacity = snapshot->capacity;
+            worker->apps.demux = snapshot->demux;
+            nb_msgs = receive_bier_batch(worker->bier->socket, worker->rx_ring,
+                                         worker->bier, &worker->apps,
+                                         shared->mapping, shared->use_ipv4);
+            // The snapshot is not used after the batch
+            bier_rcu_quiescent(&shared->rcu, worker->idx);
+        } while (nb_msgs > 0);
+        if (nb_msgs < 0) {
+            log_err("Forwarding thread %d stops", worker->idx);
+            break;
+        }
+    }
+    bier_rcu_offline(&shared->rcu, worker->idx);
+    return NULL;
+}
+
+/**
+ * @brief Stops and frees the forwarding threads
+ */
+void stop_workers(bier_worker_t *workers, int nb_workers, bier_bift_t *bier,
+                  bier_workers_shared_t *shared) {
+    // The eventfd stays readable, which wakes all the threads
+    eventfd_write(shared->stop_efd, 1);
+    for (int i = 0; i < nb_workers; ++i) {
+        bier_worker_t *worker = &workers[i];
+        if (worker->started) {
+            pthread_join(worker->thread, NULL);
+        }
+        if (worker->rx_ring) {
+            free_rx_ring(worker->rx_ring);
+        }
+        if (worker->bier) {
+            free_bier_bift_view(worker->bier);
+        }
+        free(worker->apps.deliveries);
+    }
+    bier->nb_workers = 0;
+    free(workers);
+}
+
+/**
+ * @brief Starts *nb_workers* forwarding threads, each pinned to one of the
+ * CPUs the daemon may run on. The raw socket of *bier* stops receiving the
+ * packets of the BIER network, and is only used to send the packets of the
+ * applications
+ *
+ * @return bier_worker_t* the threads, NULL on error
+ */
+bier_worker_t *start_workers(int nb_workers, unsigned int rx_batch_size,
+                             bier_bift_t *bier,
+                             bier_workers_shared_t *shared) {
+    bier_worker_t *workers =
+        (bier_worker_t *)calloc(nb_workers, sizeof(bier_worker_t));
+    if (!workers) {
+        log_perror("calloc workers");
+        return NULL;
+    }
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0) {
+        log_perror("sched_getaffinity");
+        free(workers);
+        return NULL;
+    }
+    int nb_cpus = CPU_COUNT(&allowed);
+    for (int i = 0; i < nb_workers; ++i) {
+        bier_worker_t *worker = &workers[i];
+        worker->idx = i;
+        worker->shared = shared;
+        worker->cpu = -1;
+        for (int cpu = 0, n = i % nb_cpus; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &allowed) && n-- == 0) {
+                worker->cpu = cpu;
+                break;
+            }
+        }
+        int socket = bier_open_socket(bier);
+        if (socket < 0) {
+            goto start_workers_error;
+        }
+        if (attach_worker_filter(socket, i, nb_workers) < 0) {
+            close(socket);
+            goto start_workers_error;
+        }
+        worker->bier = bier_bift_worker_view(bier, socket);
+        if (!worker->bier) {
+            goto start_workers_error;
+        }
+        worker->rx_ring = init_rx_ring(rx_batch_size);
+        if (!worker->rx_ring) {
+            goto start_workers_error;
+        }
+    }
+
+    for (int i = 0; i < nb_workers; ++i) {
+        bier_worker_t *worker = &workers[i];
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        cpu_set_t cpu;
+        CPU_ZERO(&cpu);
+        CPU_SET(worker->cpu, &cpu);
+        pthread_attr_setaffinity_np(&attr, sizeof(cpu), &cpu);
+        int err = pthread_create(&worker->thread, &attr, worker_main, worker);
+        pthread_attr_destroy(&attr);
+        if (err != 0) {
+            errno = err;
+            log_perror("pthread_create");
+            goto start_workers_error;
+        }
+        worker->started = true;
+    }
+
+    // Every packet is received by the forwarding threads
+    struct sock_filter drop_all = BPF_STMT(BPF_RET | BPF_K, 0);
+    if (attach_socket_filter(bier->socket, &drop_all, 1) < 0) {
+        goto start_workers_error;
+    }
+    return workers;
+
+start_workers_error:
+    stop_workers(workers, nb_workers, bier, shared);
+    return NULL;
+}
+
+/**
+ * @brief Copies of a packet from an application, one per set of its
+ * bitstring with a bit set. The bitstring of the application holds the
+ * BFR-IDs of the sub-domain of its BIER BIFT from the BFR-ID 1, and is split
+ * in sets of the bitstring length of this BIFT. The bitstring is not split for
+ * a BIER-TE BIFT or an unknown BIFT, whose packets are dropped: it is padded
+ * with zeros or truncated to the length of the BIFT
+ */
+typedef struct {
+    uint32_t bitstring_length;  // Length of the bitstring of the copies in bits
+    uint32_t nb_sets;           // Sets in the bitstring of the application
+    uint32_t si;                // Next set to look at
+    int sd;                     // Sub-domain, -1 if the bitstring is not split
+    uint32_t bift_id;           // BIFT of the application
+    // Copied first since the BIER headers may overwrite the bitstring of the
+    // application
+    uint64_t bitstring[BIER_MAX_BITSTRING_LENGTH / 64];
+} app_sets_t;
+
+/**
+ * @brief Initializes the copies of a packet from an application
+ *
+ * @return int 0 on success, -1 if the bitstring length is negative or a bit of
+ * the application is past the bitstring length of its BIFT, or past the
+ * BFR-ID BIER_MAX_BITSTRING_LENGTH
+ */
+static int init_app_sets(app_sets_t *sets, const bier_payload_t *bier_payload,
+                         const bier_bift_table_t *table) {
+    memset(sets, 0, sizeof(app_sets_t));
+    if (bier_payload->bitstring_length < 0) {
+        log_err("Negative bitstring length from the application");
+        return -1;
+    }
+    size_t payload_length = (size_t)bier_payload->bitstring_length;
+    sets->bift_id = bier_payload->use_bier_te;  // BIFT-ID of the application
+    sets->sd = -1;
+    sets->nb_sets = 1;
+    sets->bitstring_length = payload_length * 8;
+    int idx = bier_bift_find(table, sets->bift_id);
+    if (idx >= 0) {
+        const bier_bift_type_t *bift = &table->b[idx];
+        sets->bitstring_length = bier_bift_bitstring_length(table, bift->bift_id);
+        sets->sd = bift->t == BIER ? bift->sd : -1;
+    }
+    size_t max_length = sets->sd < 0 ? sets->bitstring_length / 8
+                                     : sizeof(sets->bitstring);
+    if (max_length > sizeof(sets->bitstring)) {
+        max_length = sizeof(sets->bitstring);
+    }
+    size_t length = payload_length;
+    if (length > max_length) {
+        length = max_length;
+        for (size_t i = length; i < payload_length; ++i) {
+            if (bier_payload->bitstring[i]) {
+                log_err("The bitstring of the application does not fit in "
+                        "%lu bits", max_length * 8);
+                return -1;
+            }
+        }
+    }
+    memcpy(sets->bitstring, bier_payload->bitstring, length);
+    if (sets->sd >= 0) {
+        size_t set_size = sets->bitstring_length / 8;
+        sets->nb_sets = (length + set_size - 1) / set_size;
+    }
+    return 0;
+}
+
+/**
+ * @brief Next copy of a packet from an application
+ *
+ * @param si set to the set of the bitstring of the application in the copy
+ * @return uint32_t the BIFT-ID of the copy, 0 if there is no copy left
+ */
+static uint32_t next_app_set(app_sets_t *sets, const bier_bift_table_t *table,
+                             uint32_t *si) {
+    uint32_t set_max_idx = sets->bitstring_length / 64;
+    while (sets->si < sets->nb_sets) {
+        *si = sets->si++;
+        if (sets->sd < 0) {
+            return sets->bift_id;
+        }
+        if (bitstring_is_zero(&sets->bitstring[*si * set_max_idx],
+                              set_max_idx)) {
+            continue;
+        }
+        int idx = bier_bift_find_set(table, sets->sd, *si,
+                                     sets->bitstring_length);
+        if (idx < 0) {
+            log_err("No BIFT for the set %u of the sub-domain %d, its BFR-IDs "
+                    "are not reached", *si, sets->sd);
+            continue;
+        }
+        return table->b[idx].bift_id;
+    }
+    return 0;
+}
+
+/**
+ * @brief Encapsulates the payload of an application in the BIER header of the
+ * set *si* of its bitstring, built in *buffer* in front of the payload. The
+ * entropy is set from the flow of the payload
+ *
+ * @return uint8_t* start of the BIER packet, NULL if the headroom is too small
+ * or the bitstring length is invalid
+ */
+static uint8_t *encap_app_set(uint8_t *buffer,
+                              const bier_payload_t *bier_payload,
+                              const app_sets_t *sets, uint32_t bift_id,
+                              uint32_t si) {
+    if (bier_bsl_encode(sets->bitstring_length) < 0) {
+        log_err("Invalid bitstring length: %u", sets->bitstring_length);
+        return NULL;
+    }
+    uint8_t *packet = encap_bier_packet_in_headroom(
+        buffer, bier_payload->payload,
+        (uint8_t *)&sets->bitstring[si * (sets->bitstring_length / 64)],
+        sets->bitstring_length, bier_payload->proto, bift_id);
+    if (packet) {
+        set_entropy(packet, bier_flow_entropy(bier_payload->payload,
+                                              bier_payload->payload_length,
+                                              bier_payload->proto));
+    }
+    return packet;
+}
+
+/**
+ * @brief Sends in the BIER network a packet from an application. The BIER
+ * header is built in front of the payload, in the headroom of the UNIX buffer
+ *
+ * @param bier_payload decoded message, pointing inside the UNIX buffer
+ * @param unix_buffer start of the UNIX buffer, including its headroom
+ */
+void process_unix_message_is_payload(bier_payload_t *bier_payload,
+                                     uint8_t *unix_buffer, bier_bift_t *bier,
+                                     bier_all_apps_t *all_apps, bool use_ipv4) {
+    log_debug("BIER payload of %lu bytes", bier_payload->payload_length);
+    log_hex(LOG_DEBUG, "BIER bitstring:", bier_payload->bitstring,
+            bier_payload->bitstring_length);
+    const bier_bift_table_t *table = bier_bift_table(bier);
+    app_sets_t sets;
+    if (init_app_sets(&sets, bier_payload, table) < 0) {
+        // Only this message is dropped
+        return;
+    }
+    uint32_t bift_id, si;
+    while ((bift_id = next_app_set(&sets, table, &si)) != 0) {
+        // The copies share the headroom, the previous one is already sent
+        uint8_t *packet =
+            encap_app_set(unix_buffer, bier_payload, &sets, bift_id, si);
+        if (!packet) {
+            // Only this message is dropped
+            return;
+        }
+        size_t packet_length =
+            bier_payload->payload + bier_payload->payload_length - packet;
+        memset(&all_apps->src, 0, sizeof(all_apps->src));
+        // A dropped copy is counted in the statistics of the BIFTs
+        if (bier_processing(packet, packet_length, bier, all_apps, use_ipv4) <
+            0) {
+            log_debug("Dropped the copy of the application packet in BIFT %u",
+                      bift_id);
+        }
+    }
+}
+
+// Maximum number of frames of a message processed together
+#define BIER_UNIX_BATCH 64
+
+/**
+ * @brief Processes the binary frames packed back to back in a message of an
+ * application (see sendmmsg_bier). Each packet is encapsulated in front of
+ * its payload and all the replicas of the message are sent together, except
+ * for a packet sent in several sets. Stops at the first malformed frame
+ *
+ * @param buffer start of the headroom in front of *data*
+ * @param data the frames
+ * @param length length of *data*. A packet whose processing fails is dropped
+ * and counted in the statistics of the BIFTs, the next ones are processed
+ */
+void process_unix_frames(uint8_t *buffer, uint8_t *data, size_t length,
+                        bier_bift_t *bier, bier_all_apps_t *all_apps,
+                        bool use_ipv4) {
+    const bier_bift_table_t *table = bier_bift_table(bier);
+    bier_rx_packet_t packets[BIER_UNIX_BATCH];
+    unsigned int nb_packets = 0;
+    size_t offset = 0;
+    while (offset < length) {
+        bier_payload_t bier_payload;
+        if (decode_bier_frame(&data[offset], length - offset, &bier_payload) <
+            0) {
+            break;
+        }
+        uint8_t *frame = &data[offset];
+        uint8_t *frame_end = bier_payload.payload + bier_payload.payload_length;
+        offset = frame_end - data;
+        // The BIER header takes the place of the frame header and of the
+        // bitstring of the application. If the bitstring of the BIFT is
+        // longer, it overwrites the end of the previous frame, which must be
+        // processed first
+        app_sets_t sets;
+        if (init_app_sets(&sets, &bier_payload, table) < 0) {
+            continue;  // Only this packet is dropped
+        }
+        if (bier_payload.payload - (12 + sets.bitstring_length / 8) < frame &&
+            nb_packets > 0) {
+            bier_processing_batch(packets, nb_packets, bier, all_apps,
+                                  use_ipv4);
+            nb_packets = 0;
+        }
+        uint32_t bift_id, si;
+        bool first_copy = true;
+        while ((bift_id = next_app_set(&sets, table, &si)) != 0) {
+            // The copies of a packet share its headroom, the previous one is
+            // sent first
+            if (!first_copy && nb_packets > 0) {
+                bier_processing_batch(packets, nb_packets, bier, all_apps,
+                                      use_ipv4);
+                nb_packets = 0;
+            }
+            first_copy = false;
+            uint8_t *packet =
+                encap_app_set(buffer, &bier_payload, &sets, bift_id, si);
+            if (!packet) {
+                break;  // Only this packet is dropped
+            }
+            bier_rx_packet_t *rx_packet = &packets[nb_packets++];
+            memset(rx_packet, 0, sizeof(bier_rx_packet_t));
+            rx_packet->buffer = packet;
+            rx_packet->length = frame_end - packet;
+            if (nb_packets == BIER_UNIX_BATCH) {
+                bier_processing_batch(packets, nb_packets, bier, all_apps,
+                                      use_ipv4);
+                nb_packets = 0;
+            }
+        }
+    }
+    if (nb_packets > 0) {
+        bier_processing_batch(packets, nb_packets, bier, all_apps, use_ipv4);
+    }
+}
+
 int get_bifr_id_from_mc_addr(int family, uint8_t *mc_addr,
                              mc_mapping_t *mapping) {
     // TODO: currently only support for IPv6
     if (family != AF_INET6) {
-        fprintf(stderr, "Currently only supports IPv6");
+        log_err("Currently only supports IPv6");
         return -1;
     }
 
@@ -353,21 +1035,15 @@ int get_bifr_id_from_mc_addr(int family, uint8_t *mc_addr,
         }
     }
 
-    fprintf(stderr, "Did not found the BIFR ID of the address: ");
-    for (int i = 0; i < 16; ++i) {
-        fprintf(stderr, "%x ", mc_addr[i]);
-    }
-    fprintf(stderr, "\n");
+    log_hex(LOG_ERR, "Did not found the BIFR ID of the address:", mc_addr, 16);
     return -1;
 }
 
-int send_multicast_join_or_leave(bier_bind_t *bind, mc_mapping_t *mapping, bier_bift_t *bier, bier_all_apps_t *all_apps, int idx_map, bool use_ipv4, bool is_join) {
-    bier_application_t *app = &all_apps->apps[idx_map];
-    
+int send_multicast_join_or_leave(bier_bind_t *bind, mc_mapping_t *mapping, bier_bift_t *bier, bier_all_apps_t *all_apps, bier_application_t *app, bool use_ipv4, bool is_join) {
+
     // TODO: currently only support IPv6 multicast destination
     if (app->mc_addr_family != AF_INET6) {
-        fprintf(stderr,
-                "Does not support more than IPv6 destination address\n");
+        log_err("Does not support more than IPv6 destination address");
         return -1;
     }
 
@@ -378,9 +1054,28 @@ int send_multicast_join_or_leave(bier_bind_t *bind, mc_mapping_t *mapping, bier_
     if (idx_mapping < 0) {
         return -1;
     }
-    fprintf(stderr, "P2\n");
     int bfir_id = mapping->entries[idx_mapping].bifr_id;
-    uint64_t bitstring = 1 << (bfir_id - 1);  // 0-indexed
+    // The notification is sent in the sub-domain and with the BSL of the first
+    // BIFT, in the set of the BFIR
+    const bier_bift_table_t *table = bier_bift_table(bier);
+    const bier_bift_type_t *bift = &table->b[0];
+    uint32_t bitstring_length =
+        bier_bift_bitstring_length(table, bift->bift_id);
+    uint32_t si = bfir_id > 0 ? (bfir_id - 1) / bitstring_length : 0;
+    int idx = -1;
+    if (bfir_id > 0 && bift->t == BIER) {
+        idx = bier_bift_find_set(table, bift->sd, si, bitstring_length);
+    } else if (bfir_id > 0 && si == 0) {
+        idx = 0;
+    }
+    if (idx < 0) {
+        log_err("No BIFT for the set of the BFIR %d", bfir_id);
+        return -1;
+    }
+    uint32_t bp = (bfir_id - 1) % bitstring_length;
+    uint64_t bitstring[bitstring_length / 64];
+    memset(bitstring, 0, sizeof(bitstring));
+    bitstring[bp / 64] = (uint64_t)1 << (bp % 64);
     // The local BFER updated its internal database
     // Send a packet to the BIFR of the multicast group
     // to notify an update in the bitstring
@@ -389,7 +1084,6 @@ int send_multicast_join_or_leave(bier_bind_t *bind, mc_mapping_t *mapping, bier_
     // instead.
     // TODO: this should follow the IETF draft, especially the number of
     // repetitions of a packet
-    fprintf(stderr, "P3\n");
     struct in6_addr src, dst;
     memcpy(src.s6_addr, bier->local.v6.sin6_addr.s6_addr,
             sizeof(src.s6_addr));
@@ -403,13 +1097,13 @@ int send_multicast_join_or_leave(bier_bind_t *bind, mc_mapping_t *mapping, bier_
     int32_t payload[2];
     payload[0] = is_join ? 1 : 2;
     // TODO: not sure about this line
-    payload[1] = bier->b->bier->local_bfr_id;  // Local BFR-ID
+    payload[1] = bier_bift_table(bier)->b->bier->local_bfr_id;  // Local BFR-ID
 
-    bier_header_t *bh = init_bier_header(&bitstring, 64, BIERPROTO_IPV6, 1);
+    bier_header_t *bh = init_bier_header(bitstring, bitstring_length,
+                                         BIERPROTO_IPV6, table->b[idx].bift_id);
     if (!bh) {
         return -1;
     }
-    fprintf(stderr, "P4\n");
 
     my_packet_t *packet = create_bier_ipv6_from_payload(
         bh, &src, &dst, sizeof(payload), (uint8_t *)payload);
@@ -418,70 +1112,53 @@ int send_multicast_join_or_leave(bier_bind_t *bind, mc_mapping_t *mapping, bier_
         return -1;
     }
 
-    fprintf(stderr,
-            "Will send a packet to the BFIR %d to set the bit in the "
-            "bitstring. Bitstring is: %lx\n",
-            bfir_id, bitstring);
+    log_debug("Will send a packet to the BFIR %d to set the bit in the "
+              "bitstring of %u bits",
+              bfir_id, bitstring_length);
     int err = bier_processing(packet->packet, packet->packet_length, bier,
                                 all_apps, use_ipv4);
+    // The buffers go back to the pool of the thread
+    my_packet_free(packet);
+    release_bier_header(bh);
     if (err < 0) {
-        fprintf(stderr, "Error when sending the BIER BINDING\n");
+        log_err("Error when sending the BIER BINDING");
         return -1;
     }
-
-    my_packet_free(packet);
-    release_bier_header(bh);
+    return 0;
 }
 
 int process_unix_message_is_bind_join(bier_bind_t *bind, bier_all_apps_t *all_apps,
                                       bier_bift_t *bier, mc_mapping_t *mapping,
                                       bool use_ipv4) {
-    fprintf(stderr, "Message is a bind JOIN\n");
-    if (all_apps->nb_apps >= BIER_MAX_APPS) {
-        fprintf(stderr, "Cannot add another application to BIER");
-        return -1;
-    }
-    fprintf(stderr,
-            "Received a bind message for proto %d and UNIX path %s. Is "
-            "listener? %u JOIN ? %u\n",
-            bind->proto, bind->unix_path, bind->is_listener, bind->is_join);
-    // struct sockaddr_in6 *addr = (struct sockaddr_in6 *)&bind->mc_sockaddr;
-    // fprintf(stderr, "Bound to: ");
-    // for (int j = 0; j < 16; ++j) {
-    //     fprintf(stderr, "%x ", addr->sin6_addr.s6_addr[j]);
-    // }
-    fprintf(stderr, "\n");
-    // Search for empty space in the array
-    int idx_map;
-    for (idx_map = 0; idx_map < BIER_MAX_APPS; ++idx_map) {
-        if (!all_apps->apps[idx_map].is_active) {
-            break; // Found an empty space
-        }
-    }
-    if (idx_map == BIER_MAX_APPS) {
-        fprintf(stderr, "Should not happen: more apps than stated\n");
+    log_debug("Message is a bind JOIN");
+    log_debug("Received a bind message for proto %d and UNIX path %s. Is "
+              "listener? %u JOIN ? %u",
+              bind->proto, bind->unix_path, bind->is_listener, bind->is_join);
+    bier_application_t *app;
+    bier_app_handle_t handle = bier_app_register(all_apps, &app);
+    if (handle == BIER_APP_INVALID_HANDLE) {
+        log_err("Cannot add another application to BIER");
         return -1;
     }
-    bier_application_t *app = &all_apps->apps[idx_map];
-    memset(app, 0, sizeof(bier_application_t));
     app->proto = bind->proto;
     app->app_addr.sun_family = AF_UNIX;
     strcpy(app->app_addr.sun_path, bind->unix_path);
     app->addrlen = sizeof(struct sockaddr_un);
     app->is_listener = bind->is_listener;
-    app->is_active = true;
+    app->use_frames = bind->use_frames;
+    app->shm = bier_shm_find(all_apps, bind->unix_path);
 
     // Sanity check
     if (bind->mc_sockaddr.v6.sin6_family != AF_INET6 &&
         bind->mc_sockaddr.v4.sin_family != AF_INET) {
-        fprintf(stderr, "Does not support other family than IPv6 and IPV4\n");
+        log_err("Does not support other family than IPv6 and IPV4");
+        bier_app_unregister(all_apps, handle);
         return -1;
     }
 
     // TODO: note that this could be a source of bug
     bool mc_dst_is_ipv4 = bind->mc_sockaddr.v6.sin6_family == AF_INET;
 
-    fprintf(stderr, "P1\n");
     if (mc_dst_is_ipv4) {
         app->mc_addr_family = AF_INET;
         memcpy(&app->mc_addr.mc_ipv4.s_addr,
@@ -493,52 +1170,55 @@ int process_unix_message_is_bind_join(bier_bind_t *bind, bier_all_apps_t *all_ap
                &bind->mc_sockaddr.v6.sin6_addr.s6_addr,
                sizeof(bind->mc_sockaddr.v6.sin6_addr.s6_addr));
     }
-    fprintf(stderr, "P1,5\n");
+    if (bier_demux_add(&all_apps->demux, app->proto, app->mc_addr_family,
+                       &app->mc_addr, handle) < 0) {
+        bier_app_unregister(all_apps, handle);
+        return -1;
+    }
 
     if (bind->is_listener) {
-        if (send_multicast_join_or_leave(bind, mapping, bier, all_apps, idx_map, use_ipv4, true) < 0) {
+        if (send_multicast_join_or_leave(bind, mapping, bier, all_apps, app, use_ipv4, true) < 0) {
             return -1;
         }
     }
-    free(bind);
-    ++all_apps->nb_apps;
     return 0;
 }
 
 int process_unix_message_is_bind_leave(bier_bind_t *bind, bier_all_apps_t *all_apps,
                                       bier_bift_t *bier, mc_mapping_t *mapping,
                                       bool use_ipv4) {
-    fprintf(stderr, "Message is a bind LEAVE\n");
-    // Simply set the address as not active once we find it
-    int idx = -1;
-    for (int i = 0; i < BIER_MAX_APPS; ++i) {
-        if (!all_apps->apps[i].is_active) {
-            continue;
-        }
-        if (all_apps->apps[i].proto == bind->proto && all_apps->apps[i].is_listener == bind->is_listener) {
-            // Also verify the IPv6 multicast address
-            int addr_res;
-            if (use_ipv4) {
-                addr_res = memcmp(&all_apps->apps[i].mc_addr.mc_ipv4.s_addr, &bind->mc_sockaddr.v4.sin_addr.s_addr, sizeof(bind->mc_sockaddr.v4.sin_addr.s_addr));
-            } else {
-                addr_res = memcmp(all_apps->apps[i].mc_addr.mc_ipv6.s6_addr, bind->mc_sockaddr.v6.sin6_addr.s6_addr, sizeof(bind->mc_sockaddr.v6.sin6_addr.s6_addr));
-            }
-            if (addr_res == 0) {
-                idx = i;
-                break;
-            }
+    log_debug("Message is a bind LEAVE");
+    // The application is the subscriber of the group bound to the UNIX path
+    // of the message. The group has the family used by the join
+    bool mc_dst_is_ipv4 = bind->mc_sockaddr.v6.sin6_family == AF_INET;
+    int family = mc_dst_is_ipv4 ? AF_INET : AF_INET6;
+    const void *group = mc_dst_is_ipv4
+                            ? (void *)&bind->mc_sockaddr.v4.sin_addr
+                            : (void *)&bind->mc_sockaddr.v6.sin6_addr;
+    const bier_demux_entry_t *entry =
+        bier_demux_lookup(&all_apps->demux, bind->proto, family, group);
+    bier_app_handle_t handle = BIER_APP_INVALID_HANDLE;
+    for (int i = 0; entry && i < entry->nb_apps; ++i) {
+        bier_application_t *app = bier_app_get(all_apps, entry->apps[i]);
+        if (app && app->is_listener == bind->is_listener &&
+            strcmp(app->app_addr.sun_path, bind->unix_path) == 0) {
+            handle = entry->apps[i];
+            break;
         }
     }
-    if (idx == -1) {
-        fprintf(stderr, "Cannot find the right group in bind LEAVE\n");
+    if (handle == BIER_APP_INVALID_HANDLE) {
+        log_err("Cannot find the right group in bind LEAVE");
         return -1;
     }
 
-    // With the index, we just need to set the address as inactive
-    all_apps->apps[idx].is_active = false;
+    // The slot stays readable until the next registration
+    bier_application_t *app = bier_app_get(all_apps, handle);
+    bier_demux_remove(&all_apps->demux, app->proto, app->mc_addr_family,
+                      &app->mc_addr, handle);
+    bier_app_unregister(all_apps, handle);
 
-    if (all_apps->apps[idx].is_listener) {
-        if (send_multicast_join_or_leave(bind, mapping, bier, all_apps, idx, use_ipv4, false) < 0) {
+    if (app->is_listener) {
+        if (send_multicast_join_or_leave(bind, mapping, bier, all_apps, app, use_ipv4, false) < 0) {
             return -1;
         }
     }
@@ -551,20 +1231,306 @@ int process_unix_message_is_bind(void *message, bier_all_apps_t *all_apps,
                                  bier_bift_t *bier, mc_mapping_t *mapping,
                                  bool use_ipv4) {
     bier_bind_t *bind = (bier_bind_t *)message;
+    int err;
     if (bind->is_join) {
-        process_unix_message_is_bind_join(bind, all_apps, bier, mapping, use_ipv4);
+        err = process_unix_message_is_bind_join(bind, all_apps, bier, mapping,
+                                                use_ipv4);
     } else {
-        process_unix_message_is_bind_leave(bind, all_apps, bier, mapping, use_ipv4);
+        err = process_unix_message_is_bind_leave(bind, all_apps, bier, mapping,
+                                                 use_ipv4);
     }
+    free(bind);
+    return err;
 }
 
-int main(int argc, char *argv[]) {
-    // Enable logs by default.
-    openlog(NULL, LOG_DEBUG | LOG_PID | LOG_PERROR, LOG_USER);
+// Maximum number of messages of a shared memory channel processed at once,
+// so that an application cannot starve the others
+#define BIER_SHM_BATCH 64
+// Indexes of the reload eventfds and of the first shared memory channel in
+// the poll fds
+#define BIER_PFDS_RELOAD_REQUEST 3
+#define BIER_PFDS_RELOAD_DONE 4
+#define BIER_PFDS_SHM 5
+
+/**
+ * @brief Processes the messages of the shared memory channel of an
+ * application, as if they were received on the UNIX socket
+ *
+ * @return int -1 if the channel is corrupted and must be detached, 0
+ * otherwise
+ */
+int process_shm_channel(bier_shm_channel_t *channel, bier_bift_t *bier,
+                        bier_all_apps_t *all_apps, bool use_ipv4) {
+    for (int nb_processed = 0;; ++nb_processed) {
+        if (!bier_shm_ring_is_valid(&channel->rx)) {
+            log_err("Corrupted shared memory ring of %s", channel->unix_path);
+            return -1;
+        }
+        uint32_t msg_length;
+        uint8_t *msg = bier_shm_ring_peek(&channel->rx, &msg_length);
+        if (!msg) {
+            // Consumes the previous wakeups before announcing that we sleep
+            eventfd_t value;
+            eventfd_read(channel->rx.efd, &value);
+            if (bier_shm_ring_prepare_sleep(&channel->rx)) {
+                return 0;
+            }
+            continue;
+        }
+        if (nb_processed == BIER_SHM_BATCH) {
+            // Polled again after the other file descriptors
+            eventfd_write(channel->rx.efd, 1);
+            return 0;
+        }
+        // The BIER headers are built in the headroom of the slot
+        process_unix_frames(msg - BIER_SHM_HEADROOM, msg, msg_length, bier,
+                            all_apps, use_ipv4);
+        bier_shm_ring_release(&channel->rx);
+    }
+}
 
+/**
+ * @brief Attaches or detaches the shared memory channel of an application. The
+ * descriptors received with an attach message are owned by the channel
+ *
+ * @param request the decoded message
+ * @param fds the descriptors received with the message
+ * @param nb_fds number of descriptors in *fds*
+ * @return int 0 on success, -1 otherwise
+ */
+int process_unix_message_is_shm(bier_shm_request_t *request, int *fds,
+                                int nb_fds, bier_bift_t *bier,
+                                bier_all_apps_t *all_apps, bool use_ipv4) {
+    int err = 0;
+    if (!request->attach) {
+        if (bier_shm_detach(all_apps, request->unix_path) < 0) {
+            log_err("No shared memory channel for %s", request->unix_path);
+            err = -1;
+        }
+    } else if (nb_fds != 3) {
+        log_err("Shared memory attach with %d file descriptors", nb_fds);
+        err = -1;
+    } else {
+        bier_shm_channel_t *channel =
+            bier_shm_attach(all_apps, request, fds[0], fds[1], fds[2]);
+        nb_fds = 0;  // Owned or closed by bier_shm_attach
+        // Packets may have been queued before the channel was attached
+        if (!channel) {
+            err = -1;
+        } else if (process_shm_channel(channel, bier, all_apps, use_ipv4) <
+                   0) {
+            bier_shm_detach(all_apps, channel->unix_path);
+            err = -1;
+        }
+    }
+    for (int i = 0; i < nb_fds; ++i) {
+        close(fds[i]);
+    }
+    free(request);
+    return err;
+}
+
+// Written by the SIGHUP handler to request a reload of the configuration
+static int reload_request_efd = -1;
+
+static void reload_signal_handler(int sig) {
+    (void)sig;
+    int saved_errno = errno;
+    eventfd_write(reload_request_efd, 1);
+    errno = saved_errno;
+}
+
+/**
+ * @brief Reload of the configuration. The new BIFTs are read by a background
+ * thread while the main thread keeps forwarding with the current ones, then
+ * published at once. The applications stay bound
+ */
+typedef struct {
+    char config_file[NAME_MAX];  // File of the next reload
+    // File read by the thread, not changed while it runs
+    char thread_config_file[NAME_MAX];
+    bool use_ipv4;
+    pthread_t thread;
+    bool in_progress;
+    bool pending;  // Requested again during the reload
+    int done_efd;  // Readable once the thread is done
+    bier_bift_table_t *table;  // Read by the thread, NULL on error
+    sockaddr_uniform_t local;
+} bier_reload_t;
+
+void *reload_main(void *arg) {
+    bier_reload_t *reload = (bier_reload_t *)arg;
+    reload->table = read_bift_table(reload->thread_config_file,
+                                    reload->use_ipv4, &reload->local);
+    eventfd_write(reload->done_efd, 1);
+    return NULL;
+}
+
+/**
+ * @brief Starts reading *config_file* in the background, or after the reload
+ * in progress
+ *
+ * @param config_file the configuration, NULL or empty to keep the last one
+ * @return int 0 on success, -1 otherwise
+ */
+int start_reload(bier_reload_t *reload, const char *config_file) {
+    if (config_file && config_file[0] != '\0') {
+        strncpy(reload->config_file, config_file,
+                sizeof(reload->config_file) - 1);
+    }
+    if (reload->in_progress) {
+        reload->pending = true;
+        return 0;
+    }
+    log_info("Reloading the configuration from %s", reload->config_file);
+    // A RELOAD message may change config_file while the thread reads its copy
+    memcpy(reload->thread_config_file, reload->config_file,
+           sizeof(reload->thread_config_file));
+    int err = pthread_create(&reload->thread, NULL, reload_main, reload);
+    if (err != 0) {
+        errno = err;
+        log_perror("pthread_create reload");
+        return -1;
+    }
+    reload->in_progress = true;
+    reload->pending = false;
+    return 0;
+}
+
+/**
+ * @brief Publishes the BIFTs read by the reload thread. The previous ones are
+ * freed once the forwarding threads no longer hold them, and the current ones
+ * are kept if the new configuration cannot be read
+ *
+ * @return int 0 on success, -1 otherwise
+ */
+int finish_reload(bier_reload_t *reload, bier_bift_t *bier, bier_rcu_t *rcu) {
+    eventfd_t value;
+    eventfd_read(reload->done_efd, &value);
+    pthread_join(reload->thread, NULL);
+    reload->in_progress = false;
+    int err = 0;
+    if (!reload->table) {
+        log_err("Cannot reload the configuration, the current one is kept");
+        err = -1;
+    } else {
+        // The raw sockets stay bound to the address given at startup
+        size_t addr_len = reload->use_ipv4 ? sizeof(struct sockaddr_in)
+                                           : sizeof(struct sockaddr_in6);
+        if (memcmp(&reload->local, &bier->local, addr_len) != 0) {
+            log_warn("The local address of the new configuration is ignored "
+                     "until the daemon restarts");
+        }
+        // The counters of the BIFTs still configured are kept
+        bier_bift_keep_stats(bier, reload->table);
+        bier_bift_table_t *previous = bier_bift_publish(bier, reload->table);
+        reload->table = NULL;
+        err = bier_rcu_retire(rcu, previous, free_bier_bift_table);
+        log_info("Configuration reloaded");
+    }
+    if (reload->pending && start_reload(reload, NULL) < 0) {
+        err = -1;
+    }
+    return err;
+}
+
+/**
+ * @brief Publishes the BIFTs changed by *delta*. The replaced structures are
+ * freed once the forwarding threads no longer hold them. A reload in progress
+ * replaces the changes once it completes
+ *
+ * @return int 0 on success, -1 otherwise
+ */
+int apply_bift_delta(const bier_delta_t *delta, bier_bift_t *bier,
+                     bier_rcu_t *rcu, bool use_ipv4) {
+    bier_delta_garbage_t *garbage = NULL;
+    bier_bift_table_t *table = bier_bift_apply_delta(bier_bift_table(bier),
+                                                     delta, use_ipv4, &garbage);
+    if (!table) {
+        log_err("Cannot apply the delta of BIFT %u, it is ignored",
+                delta->bift_id);
+        return -1;
+    }
+    bier_bift_publish(bier, table);
+    log_info("Applied %d changes to BIFT %u", delta->nb_ops, delta->bift_id);
+    return bier_rcu_retire(rcu, garbage, free_bier_delta_garbage);
+}
+
+/**
+ * @brief Receives a message of the UNIX socket with the file descriptors
+ * passed along, at most 3
+ *
+ * @param fds set to the received descriptors, to close if unused
+ * @param nb_fds set to the number of received descriptors
+ * @return ssize_t length of the message, -1 on error
+ */
+ssize_t recv_unix_message(int socket, uint8_t *buffer, size_t length,
+                          int fds[3], int *nb_fds) {
+    struct iovec iov = {buffer, length};
+    union {
+        char buf[CMSG_SPACE(3 * sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    *nb_fds = 0;
+    ssize_t nb_read = recvmsg(socket, &msg, MSG_CMSG_CLOEXEC);
+    if (nb_read < 0) {
+        return -1;
+    }
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg;
+         cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+            continue;
+        }
+        int nb_received = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        int received[nb_received];
+        memcpy(received, CMSG_DATA(cmsg), sizeof(received));
+        for (int i = 0; i < nb_received; ++i) {
+            if (*nb_fds < 3) {
+                fds[(*nb_fds)++] = received[i];
+            } else {
+                close(received[i]);
+            }
+        }
+    }
+    return nb_read;
+}
+
+/**
+ * @brief Resizes the poll fds to follow the shared memory channels, polled
+ * after the sockets
+ *
+ * @return struct pollfd* the poll fds, NULL on error
+ */
+struct pollfd *update_pfds(struct pollfd *pfds, int *nfds,
+                           bier_all_apps_t *all_apps) {
+    int new_nfds = BIER_PFDS_SHM + all_apps->nb_shm_channels;
+    struct pollfd *new_pfds =
+        (struct pollfd *)realloc(pfds, sizeof(struct pollfd) * new_nfds);
+    if (!new_pfds) {
+        log_perror("realloc pfds");
+        return NULL;
+    }
+    for (int i = 0; i < all_apps->nb_shm_channels; ++i) {
+        new_pfds[BIER_PFDS_SHM + i].fd = all_apps->shm_channels[i]->rx.efd;
+        new_pfds[BIER_PFDS_SHM + i].events = POLLIN;
+        new_pfds[BIER_PFDS_SHM + i].revents = 0;
+    }
+    *nfds = new_nfds;
+    return new_pfds;
+}
+
+int main(int argc, char *argv[]) {
     args_t args;
     parse_args(&args, argc, argv);
 
+    // SIGUSR1/SIGUSR2 raise/lower the log level
+    bier_log_init(args.log_level);
+
     bier_bift_t *bier = read_config_file(args.config_file, args.use_ipv4);
     if (!bier) {
         exit(EXIT_FAILURE);
@@ -580,14 +1546,14 @@ int main(int argc, char *argv[]) {
     // BIER network
     int listening_socket = socket(AF_UNIX, SOCK_DGRAM, 0);
     if (listening_socket == -1) {
-        perror("Listening UNIX socket");
+        log_perror("Listening UNIX socket");
         exit(EXIT_FAILURE);
     }
 
     bier_all_apps_t *all_apps =
         (bier_all_apps_t *)malloc(sizeof(bier_all_apps_t));
     if (!all_apps) {
-        perror("malloc all apps");
+        log_perror("malloc all apps");
         exit(EXIT_FAILURE);
     }
     memset(all_apps, 0, sizeof(bier_all_apps_t));
@@ -602,7 +1568,7 @@ int main(int argc, char *argv[]) {
     // application
     int sending_socket = socket(AF_UNIX, SOCK_DGRAM, 0);
     if (sending_socket == -1) {
-        perror("Sending UNIX socket");
+        log_perror("Sending UNIX socket");
         close(listening_socket);
         exit(EXIT_FAILURE);
     }
@@ -614,7 +1580,7 @@ int main(int argc, char *argv[]) {
 
     // https://medium.com/swlh/getting-started-with-unix-domain-sockets-4472c0db4eb1
     if (remove(args.bier_socket_path) == -1 && errno != ENOENT) {
-        perror("Remove unix socket path");
+        log_perror("Remove unix socket path");
         close(sending_socket);
         close(listening_socket);
         exit(EXIT_FAILURE);
@@ -622,18 +1588,49 @@ int main(int argc, char *argv[]) {
 
     if (bind(sending_socket, (struct sockaddr *)&unix_local,
              sizeof(struct sockaddr_un)) == -1) {
-        perror("Bind unix socket");
+        log_perror("Bind unix socket");
         close(sending_socket);
         close(listening_socket);
         exit(EXIT_FAILURE);
     }
-    fprintf(stderr, "Bound to UNIX socket to listen to application packets!\n");
+    log_info("Bound to UNIX socket to listen to application packets!");
+
+    // Optional socket answering the requests for the counters
+    int stats_socket = -1;
+    if (args.stats_socket_path[0] != '\0') {
+        stats_socket = open_stats_socket(args.stats_socket_path);
+        if (stats_socket < 0) {
+            close(sending_socket);
+            close(listening_socket);
+            exit(EXIT_FAILURE);
+        }
+    }
 
-    // Allocate poll fds
-    int nfds = 2;
+    // SIGHUP and RELOAD messages reload the configuration
+    bier_reload_t reload = {};
+    strcpy(reload.config_file, args.config_file);
+    reload.use_ipv4 = args.use_ipv4;
+    reload.done_efd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    reload_request_efd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (reload.done_efd < 0 || reload_request_efd < 0) {
+        log_perror("eventfd reload");
+        exit(EXIT_FAILURE);
+    }
+    struct sigaction reload_action = {};
+    reload_action.sa_handler = reload_signal_handler;
+    reload_action.sa_flags = SA_RESTART;
+    sigemptyset(&reload_action.sa_mask);
+    if (sigaction(SIGHUP, &reload_action, NULL) < 0) {
+        log_perror("sigaction reload");
+        exit(EXIT_FAILURE);
+    }
+
+    // Allocate poll fds. The stats socket is ignored by poll if disabled, and
+    // the shared memory channels are added when attached
+    int nfds = BIER_PFDS_SHM;
     struct pollfd *pfds = (struct pollfd *)calloc(nfds, sizeof(struct pollfd));
     if (!pfds) {
-        perror("Calloc pfds");
+        log_perror("Calloc pfds");
         close(sending_socket);
         close(listening_socket);
         exit(EXIT_FAILURE);
@@ -641,137 +1638,253 @@ int main(int argc, char *argv[]) {
 
     pfds[0].fd = bier->socket;
     pfds[1].fd = sending_socket;
+    pfds[2].fd = stats_socket;
+    pfds[BIER_PFDS_RELOAD_REQUEST].fd = reload_request_efd;
+    pfds[BIER_PFDS_RELOAD_DONE].fd = reload.done_efd;
 
-    pfds[0].events = POLLIN;
-    pfds[1].events = POLLIN;
-
-    // BIER socket buffer
-    uint16_t buffer_size = 1500;
-    uint8_t *buffer = (uint8_t *)malloc(sizeof(uint8_t) * buffer_size);
+    for (int i = 0; i < nfds; ++i) {
+        pfds[i].events = POLLIN;
+    }
 
-    sockaddr_uniform_t remote = {};
-    socklen_t remote_len;
-    if (args.use_ipv4) {
-        remote_len = sizeof(struct sockaddr_in);
-    } else {
-        remote_len = sizeof(struct sockaddr_in6);
+    // BIER socket buffers
+    bier_rx_ring_t *rx_ring = init_rx_ring(args.rx_batch_size);
+    if (!rx_ring) {
+        close(sending_socket);
+        close(listening_socket);
+        exit(EXIT_FAILURE);
     }
 
-    // UNIX socket buffer
-    size_t unix_buffer_size = sizeof(uint8_t) * (4096);
-    uint8_t *unix_buffer = (uint8_t *)malloc(unix_buffer_size);
+    // UNIX socket buffer. The BIER header of the packets from the applications
+    // is built in the headroom, in front of their payload
+    size_t unix_buffer_size = sizeof(uint8_t) * BIER_UNIX_MAX_MESSAGE_SIZE;
+    uint8_t *unix_buffer =
+        (uint8_t *)malloc(BIER_UNIX_HEADROOM + unix_buffer_size);
     if (!unix_buffer) {
-        perror("malloc unix buffer");
+        log_perror("malloc unix buffer");
+    }
+    memset(unix_buffer, 0, BIER_UNIX_HEADROOM + unix_buffer_size);
+    uint8_t *unix_data = &unix_buffer[BIER_UNIX_HEADROOM];
+
+    // Forwarding threads, if any, receive the packets of the BIER network in
+    // place of the main thread. The BIFTs replaced by a reload are freed
+    // once they are done with them
+    bier_workers_shared_t workers_shared = {};
+    workers_shared.stop_efd = -1;
+    bier_worker_t *workers = NULL;
+    if (bier_rcu_init(&workers_shared.rcu, args.nb_workers) < 0) {
+        goto error;
+    }
+    if (args.nb_workers > 0) {
+        workers_shared.mapping = mapping;
+        workers_shared.use_ipv4 = args.use_ipv4;
+        workers_shared.stop_efd = eventfd(0, EFD_CLOEXEC);
+        if (workers_shared.stop_efd < 0) {
+            log_perror("eventfd workers");
+            goto error;
+        }
+        if (publish_apps_snapshot(&workers_shared, all_apps) < 0) {
+            goto error;
+        }
+        workers = start_workers(args.nb_workers, args.rx_batch_size, bier,
+                                &workers_shared);
+        if (!workers) {
+            goto error;
+        }
+        pfds[0].fd = -1;
     }
-    memset(unix_buffer, 0, unix_buffer_size);
 
     while (1) {
-        fprintf(stderr, "About to poll...\n");
-        int ready = poll(pfds, nfds, -1);
+        log_debug("About to poll...");
+        // Retired snapshots and BIFTs are freed once the forwarding threads
+        // are done with them
+        int timeout = bier_rcu_reclaim(&workers_shared.rcu)
+                          ? BIER_RCU_RECLAIM_PERIOD_MS
+                          : -1;
+        int ready = poll(pfds, nfds, timeout);
         if (ready == -1) {
-            perror("Poll");
+            log_perror("Poll");
             break;
         }
 
-        fprintf(stderr, "Ready: %d\n", ready);
-        for (int i = 0; i < nfds; ++i) {
+        log_debug("Ready: %d", ready);
+        // Set when a shared memory channel is attached or detached
+        bool pfds_changed = false;
+        for (int i = 0; i < nfds && !pfds_changed; ++i) {
             if (pfds[i].revents & POLLIN) {
-                fprintf(stderr, "Got a message from %d!\n", i);
+                log_debug("Got a message from %d!", i);
                 if (i == 1) {
-                    fprintf(stderr, "UNIX socket\n");
-                    // TODO:
-                    ssize_t nb_read =
-                        recv(pfds[i].fd, unix_buffer, unix_buffer_size, 0);
+                    log_debug("UNIX socket");
+                    int fds[3];
+                    int nb_fds;
+                    ssize_t nb_read = recv_unix_message(
+                        pfds[i].fd, unix_data, unix_buffer_size, fds, &nb_fds);
                     if (nb_read < 0) {
-                        perror("read");
+                        log_perror("read");
                         break;
                     }
-                    fprintf(stderr, "Received a message of length: %lu\n",
-                            nb_read);
+                    log_debug("Received a message of length: %lu", nb_read);
 
+                    // Data packets, as binary frames or CBOR, are decoded
+                    // as views inside the UNIX buffer
                     bier_message_type type;
-                    void *decoded_message =
-                        decode_application_message(unix_buffer, nb_read, &type);
+                    bier_payload_t bier_payload;
+                    void *decoded_message = NULL;
+                    if (!is_bier_frame(unix_data, nb_read)) {
+                        decoded_message = decode_application_message(
+                            unix_data, nb_read, &type, &bier_payload);
+                    }
+                    // Only SHM messages pass file descriptors
+                    if (nb_fds > 0 && (!decoded_message || type != SHM)) {
+                        for (int j = 0; j < nb_fds; ++j) {
+                            close(fds[j]);
+                        }
+                        nb_fds = 0;
+                    }
+                    if (is_bier_frame(unix_data, nb_read)) {
+                        process_unix_frames(unix_buffer, unix_data, nb_read,
+                                            bier, all_apps, args.use_ipv4);
+                        continue;
+                    }
                     if (!decoded_message) {
-                        fprintf(stderr, "Confirmed\n");
+                        log_err("Cannot decode the application message");
                         break;
                     }
 
                     switch (type) {
                         case PACKET: {
-                            if (process_unix_message_is_payload(
-                                    decoded_message, bier, all_apps,
-                                    args.use_ipv4) < 0) {
-                                goto error;
-                            }
+                            // A dropped packet does not affect the others
+                            process_unix_message_is_payload(
+                                decoded_message, unix_buffer, bier, all_apps,
+                                args.use_ipv4);
                             break;
                         }
                         case BIND: {
+                            // A failed bind only affects its application
                             if (process_unix_message_is_bind(
                                     decoded_message, all_apps, bier,
                                     mc2id_mapping, args.use_ipv4) < 0) {
+                                log_err("Cannot process the bind message");
+                            }
+                            if (workers && publish_apps_snapshot(
+                                               &workers_shared, all_apps) < 0) {
                                 goto error;
                             }
                             break;
                         }
+                        case RELOAD: {
+                            bier_reload_request_t *request = decoded_message;
+                            start_reload(&reload, request->config_path);
+                            free(request);
+                            break;
+                        }
+                        case DELTA: {
+                            // An invalid delta keeps the current BIFTs
+                            bier_delta_t *delta = decoded_message;
+                            apply_bift_delta(delta, bier, &workers_shared.rcu,
+                                             args.use_ipv4);
+                            free(delta);
+                            break;
+                        }
+                        case SHM: {
+                            // The forwarding threads cannot produce on the
+                            // channel, see bier_apps_snapshot
+                            bier_shm_request_t *request = decoded_message;
+                            if (workers && request->attach) {
+                                log_warn("Forwarding threads running: packets "
+                                         "from the BIER network are delivered "
+                                         "to %s on the UNIX socket, not on "
+                                         "its shared memory channel",
+                                         request->unix_path);
+                            }
+                            // The other applications are not affected by a
+                            // failed attach
+                            process_unix_message_is_shm(
+                                decoded_message, fds, nb_fds, bier, all_apps,
+                                args.use_ipv4);
+                            pfds_changed = true;
+                            break;
+                        }
                         default: {
-                            fprintf(stderr, "confirmed");
+                            log_err("Unknown application message type");
                             goto error;
                         }
                     }
-                } else {
-                    fprintf(stderr, "BIER socket\n");
-                    memset(buffer, 0, sizeof(uint8_t) * buffer_size);
-                    char buff[100];
-                    size_t length = recvfrom(
-                        pfds[i].fd, buffer, sizeof(uint8_t) * buffer_size, 0,
-                        (struct sockaddr *)&remote, &remote_len);
-                    const void *err;
-                    if (args.use_ipv4) {
-                        err = inet_ntop(AF_INET, &remote.v4.sin_addr.s_addr,
-                                        buff, sizeof(buff));
-                    } else {
-                        err = inet_ntop(AF_INET6, remote.v6.sin6_addr.s6_addr,
-                                        buff, sizeof(buff));
+                } else if (i == 2) {
+                    answer_stats_request(pfds[i].fd, bier);
+                } else if (i == BIER_PFDS_RELOAD_REQUEST) {
+                    eventfd_t value;
+                    eventfd_read(pfds[i].fd, &value);
+                    start_reload(&reload, NULL);
+                } else if (i == BIER_PFDS_RELOAD_DONE) {
+                    // A failed reload keeps the current configuration
+                    finish_reload(&reload, bier, &workers_shared.rcu);
+                } else if (i >= BIER_PFDS_SHM) {
+                    // A broken channel is detached, the application can still
+                    // use the UNIX socket
+                    bier_shm_channel_t *channel =
+                        all_apps->shm_channels[i - BIER_PFDS_SHM];
+                    if (process_shm_channel(channel, bier, all_apps,
+                                            args.use_ipv4) < 0) {
+                        bier_shm_detach(all_apps, channel->unix_path);
+                        pfds_changed = true;
                     }
-                    if (!err) {
-                        fprintf(stderr,
-                                "Cannot convert the received address to human "
-                                "form\n");
-                        perror("inet_ntop bfr");
+                } else {
+                    log_debug("BIER socket");
+                    if (receive_bier_packets(pfds[i].fd, rx_ring, bier,
+                                             all_apps, mapping,
+                                             args.use_ipv4) < 0) {
                         break;
                     }
-
-                    memcpy(&all_apps->src, &remote, sizeof(sockaddr_uniform_t));
-                    all_apps->src_bfr_id =
-                        get_id_from_address(&remote, mapping, args.use_ipv4);
-                    // fprintf(stderr, "THE ID is %d\n", to_app.src_bfr_id);
-                    // With IPv4 it seems that we also get the IPv4 header
-                    if (args.use_ipv4) {
-                        bier_processing(&buffer[20], length - 20, bier,
-                                        all_apps, args.use_ipv4);
-                    } else {
-                        bier_processing(buffer, length, bier, all_apps,
-                                        args.use_ipv4);
-                    }
-
-                } 
+                }
             } else if (pfds[i].revents != 0) {
-                printf("  fd=%d; events: %s%s%s\n", pfds[i].fd,
-                       (pfds[i].revents & POLLIN) ? "POLLIN " : "",
-                       (pfds[i].revents & POLLHUP) ? "POLLHUP " : "",
-                       (pfds[i].revents & POLLERR) ? "POLLERR " : "");
+                log_debug("  fd=%d; events: %s%s%s", pfds[i].fd,
+                          (pfds[i].revents & POLLIN) ? "POLLIN " : "",
+                          (pfds[i].revents & POLLHUP) ? "POLLHUP " : "",
+                          (pfds[i].revents & POLLERR) ? "POLLERR " : "");
             }
         }
+        if (pfds_changed) {
+            struct pollfd *new_pfds = update_pfds(pfds, &nfds, all_apps);
+            if (!new_pfds) {
+                goto error;
+            }
+            pfds = new_pfds;
+        }
     }
 
 error:
-    free(buffer);
+    if (reload.in_progress) {
+        pthread_join(reload.thread, NULL);
+        if (reload.table) {
+            free_bier_bift_table(reload.table);
+        }
+    }
+    if (workers) {
+        stop_workers(workers, args.nb_workers, bier, &workers_shared);
+    }
+    bier_rcu_destroy(&workers_shared.rcu);
+    if (atomic_load(&workers_shared.apps)) {
+        bier_apps_snapshot_free(atomic_load(&workers_shared.apps));
+    }
+    if (workers_shared.stop_efd >= 0) {
+        close(workers_shared.stop_efd);
+    }
+    signal(SIGHUP, SIG_DFL);
+    close(reload_request_efd);
+    close(reload.done_efd);
+    free(pfds);
+    free_rx_ring(rx_ring);
     free(unix_buffer);
-    fprintf(stderr, "Closing the program on router\n");
+    bier_pktbuf_thread_pool_free();
+    log_info("Closing the program on router");
     free_bier_bft(bier);
     free(mc2id_mapping->entries);
     free(mc2id_mapping);
+    bier_apps_free(all_apps);
+    free(all_apps);
     close(sending_socket);
     close(listening_socket);
+    if (stats_socket >= 0) {
+        close(stats_socket);
+    }
 }
@@ -0,0 +1,67 @@
+#ifndef BIER_LOG_H
+#define BIER_LOG_H
+
+#include <signal.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <syslog.h>
+
+/**
+ * @brief Logging of the BIER daemon and library, routed through syslog.
+ *
+ * Messages above the compile-time level BIER_LOG_LEVEL are removed by the
+ * compiler, e.g., `make BIER_LOG_LEVEL=LOG_WARNING` for release builds keeps
+ * no per-packet log on the forwarding path. The remaining messages are
+ * filtered with the runtime level `bier_log_level`, which is raised by SIGUSR1
+ * and lowered by SIGUSR2 once bier_log_init has been called.
+ */
+
+#ifndef BIER_LOG_LEVEL
+#define BIER_LOG_LEVEL LOG_DEBUG
+#endif
+
+#define BIER_LOG_DEFAULT_LEVEL LOG_INFO
+
+extern volatile sig_atomic_t bier_log_level;
+
+#define bier_log_enabled(level) \
+    ((level) <= BIER_LOG_LEVEL && (level) <= bier_log_level)
+
+#define bier_log(level, ...)              \
+    do {                                  \
+        if (bier_log_enabled(level)) {    \
+            syslog((level), __VA_ARGS__); \
+        }                                 \
+    } while (0)
+
+#define log_err(...) bier_log(LOG_ERR, __VA_ARGS__)
+#define log_warn(...) bier_log(LOG_WARNING, __VA_ARGS__)
+#define log_info(...) bier_log(LOG_INFO, __VA_ARGS__)
+#define log_debug(...) bier_log(LOG_DEBUG, __VA_ARGS__)
+// Same as perror
+#define log_perror(message) log_err("%s: %m", (message))
+
+#define log_hex(level, message, data, length)                       \
+    do {                                                            \
+        if (bier_log_enabled(level)) {                              \
+            bier_log_hexdump((level), (message), (data), (length)); \
+        }                                                           \
+    } while (0)
+
+/**
+ * @brief Open the syslog connection (also printed on stderr) and install the
+ * signal handlers changing the runtime log level. Applications linking
+ * libbier.a call it too, otherwise the errors of the library only reach syslog
+ *
+ * @param level initial runtime log level
+ */
+void bier_log_init(int level);
+
+/**
+ * @brief Log *message* followed by the *length* bytes of *data* in hexadecimal.
+ * Use log_hex instead to skip the formatting if the level is disabled
+ */
+void bier_log_hexdump(int level, const char *message, const uint8_t *data,
+                      size_t length);
+
+#endif  // BIER_LOG_H
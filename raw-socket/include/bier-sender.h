@@ -16,14 +16,6 @@
 #include "bier.h"
 #include "udp-checksum.h"
 
-/**
- * @brief Personal representation of a packet
- */
-typedef struct {
-    uint8_t *packet;
-    uint32_t packet_length;
-} my_packet_t;
-
 /**
  * @brief Personal representatio of a BIER header. The content of the header
  * should not be accessed directly.
@@ -64,13 +56,16 @@ typedef struct {
  * @brief Creates a BIER header with every field set to 0 except the bitstring,
  * the BSL and the proto fields
  *
- * @param bitstring the bitstring of the packet, as an array of size
- * *bitstring_length* of uint64_t values
- * @param bitstring_length the length of the *bitstring* array, in uint64_t unit
+ * @param bitstring the bitstring of the packet, as an array of
+ * *bitstring_length* / 64 uint64_t values in host byte order. The element 0
+ * holds the BFR-IDs 1 to 64
+ * @param bitstring_length the length of the bitstring, in bits
  * @param bier_proto the value of the "proto" field of the BIER header (i.e.,
  * the next header)
  * @return bier_header_t* structure containing the ->_packet of ->header_length
- * bytes (including the bitstring)
+ * bytes (including the bitstring), NULL on error. Both are in a buffer of the
+ * packet buffer pool of the calling thread (see pktbuf.h), released by the
+ * same thread with release_bier_header
  */
 bier_header_t *init_bier_header(const uint64_t *bitstring,
                                 const uint32_t bitstring_length,
@@ -98,15 +93,16 @@ void set_bh_proto(bier_header_t *bh, uint8_t proto);
  *
  * @param bh BIER header pointer
  * @param bitstring_length the current length of the bitstring of the BIER
- * header
- * @param bitstring array of uint64_t values containing the bitstring, array of
- * length *bitstring_length* uint64_t elements
+ * header, in bits
+ * @param bitstring array of *bitstring_length* / 64 uint64_t values in host
+ * byte order containing the bitstring (see init_bier_header)
  */
 void update_bh_bitstring(bier_header_t *bh, const uint32_t bitstring_length,
                          uint64_t *bitstring);
 
 /**
- * @brief Release the memory associated with the my_packet_t structure
+ * @brief Release the memory associated with the my_packet_t structure, from
+ * the thread which created it
  *
  * @param my_packet pointer to the custom packet
  */
@@ -119,11 +115,72 @@ void my_packet_free(my_packet_t *pkt);
  * @param bh the BIER header structure
  * @param payload_length the length of the payload to encapsulate
  * @param payload the payload
- * @return my_packet_t* a new custom packet encapsulated in a BIER header
+ * @return my_packet_t* a new custom packet encapsulated in a BIER header, in
+ * a buffer of the pool of the calling thread. NULL if the pool is exhausted or
+ * the payload is longer than BIER_PKTBUF_DATA_ROOM. A packet built by the
+ * caller is encapsulated without copy with encap_bier_packet_in_place
  */
 my_packet_t *encap_bier_packet(bier_header_t *bh, const uint32_t payload_length,
                                uint8_t *payload);
 
+/**
+ * @brief Creates a packet of *length* bytes, filled by the caller, in a buffer
+ * of the packet buffer pool of the calling thread. The headroom of the buffer
+ * is left in front of the packet for encap_bier_packet_in_place
+ *
+ * @return my_packet_t* the packet, released with my_packet_free. NULL if the
+ * pool is exhausted or *length* is over BIER_PKTBUF_DATA_ROOM
+ */
+my_packet_t *my_packet_alloc(const uint32_t length);
+
+/**
+ * @brief Encapsulate *my_packet* in the BIER header *bh*, written in the
+ * headroom of its buffer: the packet is not copied. The outer IP header is
+ * added by the raw socket of the daemon
+ *
+ * @param bh the BIER header structure
+ * @param my_packet a packet from my_packet_alloc, or returned by a function
+ * of this file, whose length was not changed by the caller
+ * @return my_packet_t* *my_packet*, now starting at the BIER header. NULL if
+ * the headroom is too small, *my_packet* is then left untouched
+ */
+my_packet_t *encap_bier_packet_in_place(const bier_header_t *bh,
+                                        my_packet_t *my_packet);
+
+/**
+ * @brief Encapsulate *payload* in a BIER header written in the bytes preceding
+ * it, without allocation. The bytes between *buffer* and *payload* are
+ * overwritten, hence *bitstring* may point there
+ *
+ * @param buffer start of the memory available in front of *payload*
+ * @param payload the payload to encapsulate
+ * @param bitstring the bitstring in the format of init_bier_header, not
+ * necessarily aligned
+ * @param bitstring_length the length of the bitstring, in bits
+ * @param bier_proto the value of the "proto" field of the BIER header
+ * @param bift_id the BIFT-ID of the BIER header
+ * @return uint8_t* start of the BIER packet, NULL if the bitstring length is
+ * invalid or the headroom is too small
+ */
+uint8_t *encap_bier_packet_in_headroom(uint8_t *buffer, uint8_t *payload,
+                                       const uint8_t *bitstring,
+                                       uint32_t bitstring_length,
+                                       uint8_t bier_proto, int bift_id);
+
+/**
+ * @brief Entropy of the BIER header of a packet sent by this BFIR, hashed from
+ * the flow of the payload so that the packets of a flow take the same ECMP
+ * path. The flow is given by the addresses, the protocol and the ports of an
+ * IPv4 or IPv6 payload. Other payloads have no flow and get an entropy of 0
+ *
+ * @param payload the payload following the BIER header
+ * @param payload_length length of *payload*
+ * @param bier_proto the value of the "proto" field of the BIER header
+ * @return uint32_t the 20 bits entropy, to set with set_entropy
+ */
+uint32_t bier_flow_entropy(const uint8_t *payload, size_t payload_length,
+                           uint8_t bier_proto);
+
 /**
  * @brief Create a dummy packet from an application payload. The payload is
  * encapsulated in a UDP header within an IPv6 header, and finally in a BIER
@@ -135,7 +192,9 @@ my_packet_t *encap_bier_packet(bier_header_t *bh, const uint32_t payload_length,
  * @param mc_dst IPv6 multicast destination of the encapsulared IPv6 header
  * @param payload_length length of the application payload to encapsulate
  * @param payload application payload
- * @return my_packet_t* pointer to the custom packet
+ * @return my_packet_t* pointer to the custom packet, built in place in a
+ * buffer of the pool of the calling thread. NULL on error, see
+ * encap_bier_packet
  */
 my_packet_t *create_bier_ipv6_from_payload(bier_header_t *bh,
                                            struct in6_addr *mc_src,
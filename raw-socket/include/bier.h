@@ -11,6 +11,7 @@
 #include <netinet/ip6.h>
 #include <netinet/udp.h>
 #include <signal.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -21,6 +22,7 @@
 #include <sys/un.h>
 #include <unistd.h>
 #include "public/common.h"
+#include "public/shm.h"
 
 #ifndef NAME_MAX
 #define NAME_MAX 256
@@ -53,23 +55,46 @@
         d8[9] &= 0xc0;              \
         d8[9] |= (proto & 0x3f);    \
     }
+#define get_bier_bsl(d) (((uint8_t *)(d))[5] >> 4)
 #define set_bier_bsl(d, bsl)        \
     {                               \
         uint8_t *d8 = (uint8_t *)d; \
         d8[5] &= 0x0f;              \
         d8[5] |= (bsl << 4);        \
     }
-#define get_entropy(d) (((uint16_t *)d)[5])
-#define set_entropy(d, v)                  \
-    {                                      \
-        uint16_t *____d16 = (uint16_t *)d; \
-        ____d16[5] = v;                    \
+// The 20 bits entropy follows the BSL: low nibble of byte 5, bytes 6 and 7
+#define get_entropy(d)                                   \
+    ((((uint32_t)((uint8_t *)(d))[5] & 0x0f) << 16) |    \
+     ((uint32_t)((uint8_t *)(d))[6] << 8) | ((uint8_t *)(d))[7])
+#define set_entropy(d, v)                    \
+    {                                        \
+        uint8_t *____d8 = (uint8_t *)d;      \
+        ____d8[5] &= 0xf0;                   \
+        ____d8[5] |= ((v) >> 16) & 0x0f;     \
+        ____d8[6] = ((v) >> 8) & 0xff;       \
+        ____d8[7] = (v) & 0xff;              \
     }
 
 /**
- * @brief Bits operations on the bitstring
+ * @brief BSL field of the BIER header for a bitstring of *bitstring_length*
+ * bits, -1 if it is not a length of RFC 8296
  */
-typedef enum { bitwise_u64_and_not, bitwise_u64_and } bitstring_operation;
+static inline int bier_bsl_encode(uint32_t bitstring_length) {
+    if (bitstring_length < BIER_MIN_BITSTRING_LENGTH ||
+        bitstring_length > BIER_MAX_BITSTRING_LENGTH ||
+        (bitstring_length & (bitstring_length - 1)) != 0) {
+        return -1;
+    }
+    return __builtin_ctz(bitstring_length) - 5;
+}
+
+/**
+ * @brief Length in bits of the bitstring of the BSL field *bsl*, 0 if the BSL
+ * is reserved
+ */
+static inline uint32_t bier_bsl_decode(uint8_t bsl) {
+    return bsl >= 1 && bsl <= 7 ? (uint32_t)32 << bsl : 0;
+}
 
 typedef enum {
     BIER = 1,
@@ -95,6 +120,18 @@ typedef struct {
     bier_bft_entry_ecmp_t **ecmp_entry;
 } bier_bft_entry_t;
 
+/**
+ * @brief Shared memory channel attached by an application, see public/shm.h.
+ * The daemon consumes `rx` and produces `tx`
+ */
+typedef struct {
+    char unix_path[NAME_MAX];  // UNIX socket of the application
+    void *mem;
+    size_t mem_size;
+    bier_shm_ring_t rx;  // From the application
+    bier_shm_ring_t tx;  // To the application
+} bier_shm_channel_t;
+
 typedef struct {
     uint16_t proto; // Protocol following the BIER header
     socklen_t addrlen;
@@ -105,19 +142,291 @@ typedef struct {
     } mc_addr; // Application expects to receive packets from it
     int mc_addr_family; // AF_INET or AF_INET6
     bool is_listener;
+    bool use_frames;  // Packets are delivered as binary frames, not CBOR
+    bier_shm_channel_t *shm;  // Packets are delivered through it if not NULL
     bool is_active;
+    uint32_t generation;  // Incremented each time the slot is released
+    uint32_t next_free;   // Next free slot + 1 in the free list, 0 for none
 } bier_application_t;
 
-#define BIER_MAX_APPS 10
+/**
+ * @brief Reference to a registered application: its slot in
+ * bier_all_apps_t::apps and the generation of the slot. A handle becomes
+ * stale once the application is unregistered, even if the slot is reused
+ */
+typedef uint64_t bier_app_handle_t;
+
+#define BIER_APP_INVALID_HANDLE UINT64_MAX
+#define bier_app_handle(idx, generation) \
+    (((uint64_t)(generation) << 32) | (uint32_t)(idx))
+#define bier_app_handle_idx(handle) ((uint32_t)(handle))
+#define bier_app_handle_generation(handle) ((uint32_t)((handle) >> 32))
 
+/**
+ * @brief Applications bound to the same (BIER proto, multicast group). The
+ * group is all zeros for BIERPROTO_RESERVED_RAW, whose packets are delivered
+ * regardless of their destination
+ */
+typedef struct {
+    uint16_t proto;
+    int family;         // AF_INET or AF_INET6, 0 for raw
+    uint8_t group[16];  // IPv4 groups only use the first 4 bytes
+    int nb_apps;        // 0 if the entry is empty
+    int capacity;
+    bier_app_handle_t *apps;
+} bier_demux_entry_t;
+
+/**
+ * @brief Open addressing hash table with linear probing from (BIER proto,
+ * multicast group) to the subscribed applications. A zeroed table is empty
+ * and valid
+ */
+typedef struct {
+    uint32_t nb_buckets;  // Power of 2
+    uint32_t nb_entries;
+    bier_demux_entry_t *buckets;
+} bier_demux_t;
+
+/**
+ * @brief Frames waiting to be sent to an application, see
+ * bier_app_deliveries_flush
+ */
+typedef struct bier_app_delivery bier_app_delivery_t;
+
+/**
+ * @brief Registry of the applications. The slots of `apps` are reused through
+ * a free list and the array doubles when it is full. A zeroed registry is
+ * empty and valid
+ */
 typedef struct {
     int application_socket;
-    bier_application_t apps[BIER_MAX_APPS];
+    bier_application_t *apps;
+    uint32_t capacity;   // Number of slots of `apps`
+    uint32_t free_head;  // First free slot + 1, 0 if there is none
+    bier_demux_t demux;  // Index of `apps` for local delivery
     sockaddr_uniform_t src; // Source of the encapsulation header
     int src_bfr_id;
     int nb_apps; // Number of apps already using BIER
+    bier_shm_channel_t **shm_channels;  // Attached shared memory channels
+    int nb_shm_channels;
+    // Deliveries of binary frames coalesced per application until the end of
+    // the batch. Allocated on first use
+    bier_app_delivery_t *deliveries;
+    int nb_deliveries;
 } bier_all_apps_t;
 
+/**
+ * @brief Reserves a zeroed slot for a new application, marked as active
+ *
+ * @param all_apps the registry
+ * @param app set to the slot of the application. Only valid until the next
+ * call to bier_app_register
+ * @return bier_app_handle_t the handle of the application,
+ * BIER_APP_INVALID_HANDLE on error
+ */
+bier_app_handle_t bier_app_register(bier_all_apps_t *all_apps,
+                                    bier_application_t **app);
+
+/**
+ * @brief Releases the slot of the application. Its handle becomes stale
+ *
+ * @return int 0 on success, -1 if the handle is stale
+ */
+int bier_app_unregister(bier_all_apps_t *all_apps, bier_app_handle_t handle);
+
+/**
+ * @brief The application referenced by *handle*, NULL if the handle is stale
+ */
+static inline bier_application_t *bier_app_get(bier_all_apps_t *all_apps,
+                                               bier_app_handle_t handle) {
+    uint32_t idx = bier_app_handle_idx(handle);
+    if (idx >= all_apps->capacity) {
+        return NULL;
+    }
+    bier_application_t *app = &all_apps->apps[idx];
+    if (!app->is_active ||
+        app->generation != bier_app_handle_generation(handle)) {
+        return NULL;
+    }
+    return app;
+}
+
+/**
+ * @brief Attaches the shared memory channel of the application bound to
+ * *unix_path*. The applications registered with this path, now or later,
+ * receive their packets through the channel. The descriptors are owned by the
+ * channel, or closed on error
+ *
+ * @param all_apps the registry
+ * @param request the SHM message of the application
+ * @param memfd the memory holding the rings, see bier_shm_size
+ * @param efd_rx eventfd of the ring from the application
+ * @param efd_tx eventfd of the ring to the application
+ * @return bier_shm_channel_t* the channel, NULL on error
+ */
+bier_shm_channel_t *bier_shm_attach(bier_all_apps_t *all_apps,
+                                    const bier_shm_request_t *request,
+                                    int memfd, int efd_rx, int efd_tx);
+
+/**
+ * @brief Detaches the shared memory channel of *unix_path*. Its applications
+ * are back to the UNIX socket
+ *
+ * @return int 0 on success, -1 if no channel is attached for *unix_path*
+ */
+int bier_shm_detach(bier_all_apps_t *all_apps, const char *unix_path);
+
+/**
+ * @brief The channel attached for *unix_path*, NULL if there is none
+ */
+bier_shm_channel_t *bier_shm_find(bier_all_apps_t *all_apps,
+                                  const char *unix_path);
+
+/**
+ * @brief Frees the registry, its demux table and its shared memory channels
+ */
+void bier_apps_free(bier_all_apps_t *all_apps);
+
+/**
+ * @brief Copies the applications and the demux table of *all_apps* for the
+ * forwarding threads. The copy is never modified: a change of the registry is
+ * published as a new snapshot. The shared memory channels are single
+ * producer, the applications of the snapshot receive their packets on the
+ * UNIX socket
+ *
+ * @return bier_all_apps_t* the snapshot, NULL on error
+ */
+bier_all_apps_t *bier_apps_snapshot(const bier_all_apps_t *all_apps);
+
+/**
+ * @brief Frees a snapshot created by bier_apps_snapshot. Takes a void pointer
+ * to be retired with bier_rcu_retire
+ */
+void bier_apps_snapshot_free(void *snapshot);
+
+/**
+ * @brief Subscribes the application *app* to (*proto*, *group*)
+ *
+ * @param demux the demux table
+ * @param proto BIER proto of the packets
+ * @param family AF_INET or AF_INET6, ignored for BIERPROTO_RESERVED_RAW
+ * @param group the multicast group, ignored for BIERPROTO_RESERVED_RAW
+ * @param app the application
+ * @return int 0 on success, -1 otherwise
+ */
+int bier_demux_add(bier_demux_t *demux, uint16_t proto, int family,
+                   const void *group, bier_app_handle_t app);
+
+/**
+ * @brief Unsubscribes the application *app* from (*proto*, *group*)
+ *
+ * @return int 0 on success, -1 if the application was not subscribed
+ */
+int bier_demux_remove(bier_demux_t *demux, uint16_t proto, int family,
+                      const void *group, bier_app_handle_t app);
+
+/**
+ * @brief All applications subscribed to (*proto*, *group*)
+ *
+ * @return const bier_demux_entry_t* the subscribers, NULL if there is none
+ */
+const bier_demux_entry_t *bier_demux_lookup(const bier_demux_t *demux,
+                                            uint16_t proto, int family,
+                                            const void *group);
+
+void bier_demux_free(bier_demux_t *demux);
+
+/**
+ * @brief Socket address of a BFR neighbour, without the padding of
+ * `sockaddr_uniform_t` so that several of them fit in a cache line
+ */
+typedef union {
+    struct sockaddr_in6 v6;
+    struct sockaddr_in v4;
+} bier_nei_addr_t;
+
+/**
+ * @brief Reasons for dropping a packet or a replica
+ */
+typedef enum {
+    BIER_DROP_UNKNOWN_BIFT_ID,  // No BIFT with the BIFT-ID of the packet
+    BIER_DROP_UNKNOWN_BFR,      // Bit set without entry in the BFT
+    BIER_DROP_SEND_FAILURE,     // The replica could not be sent
+    BIER_DROP_NO_APP,           // Local delivery without application
+    BIER_DROP_BSL_MISMATCH,     // BSL of the packet is not the one of the BIFT
+    BIER_DROP_MAX,
+} bier_drop_reason_t;
+
+/**
+ * @brief Counters of a BIFT. They are updated with relaxed atomic operations
+ * on the forwarding path and can be read at any time without lock
+ */
+typedef struct {
+    _Atomic uint64_t packets_in;
+    _Atomic uint64_t replicas_out;
+    _Atomic uint64_t local_deliveries;
+    _Atomic uint64_t drops[BIER_DROP_MAX];
+} bier_bift_stats_t;
+
+/**
+ * @brief Counters of the replicas sent to a neighbour
+ */
+typedef struct {
+    _Atomic uint64_t tx_packets;
+    _Atomic uint64_t tx_bytes;
+} bier_nei_stats_t;
+
+#define bier_stats_add(counter, value) \
+    atomic_fetch_add_explicit(&(counter), (value), memory_order_relaxed)
+#define bier_stats_inc(counter) bier_stats_add(counter, 1)
+#define bier_stats_read(counter) \
+    atomic_load_explicit(&(counter), memory_order_relaxed)
+
+/**
+ * @brief Compiled BIER Forwarding Table, the only structure read by the
+ * forwarding path. It is built from `bier_internal_t::bft` when loading the
+ * configuration. All arrays are carved in a single cache-line aligned slab and
+ * all bitmasks are in host byte order, with word 0 holding the BFR-IDs 1 to 64.
+ *
+ * A distinct neighbour gets the union of the forwarding bitmasks of the
+ * BFR-IDs reached only through it, so that a packet is replicated once per
+ * neighbour and not once per BFER. BFR-IDs with ECMP entries are left out of
+ * those bitmasks because their neighbour depends on the packet.
+ */
+typedef struct {
+    uint32_t bitstring_max_idx;  // Length of a bitstring in 64 bits words
+    uint32_t nb_bfr;             // Number of BFR-IDs in the table
+    uint32_t ecmp_stride;        // Max number of ECMP entries of a BFR-ID
+    uint32_t nb_neighbours;      // Number of distinct neighbours
+    int local_idx;               // 0-indexed BFR-ID of the local router
+    uint64_t *known_bitmask;     // BFR-IDs with an entry in the BFT
+    uint64_t *ecmp_bitmask;      // BFR-IDs with more than one ECMP entry
+    uint64_t *local_bitmask;     // Bits cleared after a local delivery
+    uint64_t *nei_bitmask;       // [nb_neighbours][bitstring_max_idx]
+    bier_nei_addr_t *nei_addr;   // [nb_neighbours]
+    uint8_t *nb_ecmp;            // [nb_bfr] Number of ECMP entries per BFR-ID
+    uint32_t *ecmp_nei;          // [nb_bfr][ecmp_stride] Neighbour index
+    uint64_t *ecmp_fbm;  // [nb_bfr][ecmp_stride][bitstring_max_idx] F-BMs
+    // [ecmp_stride + 1][BIER_ECMP_SELECT_SIZE] ECMP entry chosen for a number
+    // of entries and an entropy slot, see bier_ecmp_slot
+    uint8_t *ecmp_select;
+    void *slab;          // Memory holding all the arrays above
+    // [nb_neighbours] Written on the forwarding path, hence not in the slab
+    bier_nei_stats_t *nei_stats;
+} bier_bft_compiled_t;
+
+#define BIER_ECMP_SELECT_BITS 8
+#define BIER_ECMP_SELECT_SIZE (1 << BIER_ECMP_SELECT_BITS)
+
+/**
+ * @brief Slot of bier_bft_compiled_t::ecmp_select for the entropy of a
+ * packet. The entropy is mixed first because a BFIR may fill it with
+ * consecutive values
+ */
+static inline uint32_t bier_ecmp_slot(uint32_t entropy) {
+    return (entropy * 0x9e3779b1u) >> (32 - BIER_ECMP_SELECT_BITS);
+}
+
 /**
  * @brief Representation of the state of a BIER Forwarding Router
  */
@@ -126,38 +435,276 @@ typedef struct {
     int local_bfr_id;  // BFR-ID of the router in the network
     int nb_bft_entry;  // Number of entries in the BIER Forwarding Table
     uint32_t bitstring_length;  // Represents the "BSL" in bits
+    // Set Identifier: the BFR-ID of the bit `bp` (0-indexed) of the bitstring
+    // is si * bitstring_length + bp + 1. The entries of `bft` are indexed by
+    // bit
+    uint32_t si;
     bier_bft_entry_t **bft;     // Table of length `nb_bft_entry` containing all
                                 // entries of the BIER Forwarding Table
+    bier_bft_compiled_t *compiled;  // Built from `bft`, used to forward
 } bier_internal_t;
 
 typedef struct {
     uint32_t bift_id;
-    int local_bfr_id;
+    int local_bfr_id;  // BP of the router, 1-indexed
     uint32_t bitstring_length;
     uint64_t *global_bitstring;
     int nb_adjacencies;
     sockaddr_uniform_t *bfr_nei_addr;
     int *adj_to_bp;
+    bier_nei_stats_t *nei_stats;  // [nb_adjacencies]
+    // Index of the adjacencies per BP, built by index_bier_te. The adjacencies
+    // of the 0-indexed BP `bp` are bp_adj[bp_adj_start[bp]..bp_adj_start[bp+1]]
+    uint64_t *adj_bitmask;  // BPs with at least one adjacency
+    uint32_t *bp_adj_start;  // [bitstring_length + 1]
+    uint32_t *bp_adj;        // [nb_adjacencies] Adjacencies sorted by BP
 } bier_te_internal_t;
 
 typedef struct {
     bier_type t;
+    uint32_t bift_id;  // BIFT-ID of the packets of this BIFT
+    uint8_t sd;        // Sub-domain
+    uint8_t si;        // Set Identifier, always 0 for BIER-TE
+    // Counters of the BIFT in bier_bift_t::stats, kept by BIFT-ID across
+    // reloads, see bier_bift_keep_stats
+    uint32_t stats_idx;
     union {
         bier_internal_t *bier;
         bier_te_internal_t *bier_te;
     };
 } bier_bift_type_t;
 
+#define BIER_TX_QUEUE_SIZE 64
+// Size of a header buffer of the TX queue: BIER header with a BSL of 4096
+#define BIER_TX_HEADER_SIZE (12 + BIER_MAX_BITSTRING_LENGTH / 8)
+
+/**
+ * @brief Replicas waiting to be sent on the raw socket. The replicas of a
+ * packet (or of a batch of packets) are queued and sent with a single
+ * sendmmsg call when the queue is flushed. Each replica is sent from two
+ * buffers: its own BIER header, and the payload shared by all the replicas of
+ * the packet, which is never copied
+ */
+typedef struct {
+    int socket;
+    unsigned int capacity;
+    unsigned int nb_queued;
+    struct mmsghdr *msgs;
+    struct iovec *iovecs;  // Two per replica: header and payload
+    bier_nei_addr_t *dsts;
+    // Counters updated once the replica is sent
+    bier_nei_stats_t **nei_stats;
+    bier_bift_stats_t **bift_stats;
+    uint8_t *headers;  // capacity buffers of BIER_TX_HEADER_SIZE bytes
+} bier_tx_queue_t;
+
+// Maximum number of BIFTs of a configuration. The counters of the BIFTs are
+// allocated for this number, so that a reload does not resize them
+#define BIER_MAX_BIFT 64
+
+// The 20 bits of a BIFT-ID are split in two levels of the index of the BIFTs
+#define BIER_BIFT_ID_BITS 20
+#define BIER_BIFT_RADIX_BITS (BIER_BIFT_ID_BITS / 2)
+#define BIER_BIFT_RADIX_SIZE (1 << BIER_BIFT_RADIX_BITS)
+
+/**
+ * @brief BIFTs of a configuration. A table is never modified once published:
+ * a reload publishes a new table, see bier_bift_publish
+ *
+ * The BIFTs are found from the BIFT-ID of a packet with a two-level radix
+ * index: the high bits of the BIFT-ID select a leaf, whose slot for the low
+ * bits holds the index in `b` + 1, or 0 for an unknown BIFT-ID. Only the
+ * leaves of the configured BIFT-IDs are allocated, so sparse BIFT-IDs cost
+ * one leaf each at most
+ */
 typedef struct {
+    int nb_bift;  // Number of different BIFT in the configuration
+    bier_bift_type_t *b;
+    uint8_t *bift_idx[BIER_BIFT_RADIX_SIZE];  // Leaves of the index
+} bier_bift_table_t;
+
+/**
+ * @brief Index in bier_bift_table_t::b, which is also the index of the
+ * counters, of the BIFT *bift_id*
+ *
+ * @return int the index, -1 if the BIFT-ID is unknown
+ */
+static inline int bier_bift_find(const bier_bift_table_t *table,
+                                 uint32_t bift_id) {
+    const uint8_t *leaf =
+        table->bift_idx[(bift_id >> BIER_BIFT_RADIX_BITS) &
+                        (BIER_BIFT_RADIX_SIZE - 1)];
+    if (!leaf || bift_id >> BIER_BIFT_ID_BITS) {
+        return -1;
+    }
+    return (int)leaf[bift_id & (BIER_BIFT_RADIX_SIZE - 1)] - 1;
+}
+
+/**
+ * @brief Index in bier_bift_table_t::b of the BIER BIFT of the set *si* of
+ * the sub-domain *sd* with bitstrings of *bitstring_length* bits
+ *
+ * @return int the index, -1 if there is none
+ */
+int bier_bift_find_set(const bier_bift_table_t *table, uint8_t sd, uint32_t si,
+                       uint32_t bitstring_length);
+
+typedef struct bier_bift {
     union {
         struct sockaddr_in6 v6;
         struct sockaddr_in v4;
     } local; // Socket address with the loopback address of the router
     int socket;   // Socket to send and receive packets
-    int nb_bift;  // Number of different BIFT in the configuration
-    bier_bift_type_t *b;
+    bier_tx_queue_t *tx;  // Replicas to send on `socket`
+    // Current BIFTs, only read through bier_bift_table. Set in `origin`
+    _Atomic(bier_bift_table_t *) table;
+    struct bier_bift *origin;  // BIFTs of the daemon, itself if not a view
+    // [BIER_MAX_BIFT] Counters of the BIFTs, see bier_bift_type_t::stats_idx
+    bier_bift_stats_t *stats;
+    bier_bift_stats_t unknown_bift_stats;  // Packets without a known BIFT
+    // Views of the forwarding threads, whose counters are added to ours when
+    // read. NULL in a view, see bier_bift_worker_view
+    struct bier_bift **workers;
+    int nb_workers;
 } bier_bift_t;
 
+/**
+ * @brief The current BIFTs of *bier*. A forwarding thread must not use them
+ * after its next quiescent state, see rcu.h
+ */
+static inline bier_bift_table_t *bier_bift_table(const bier_bift_t *bier) {
+    return atomic_load_explicit(&bier->origin->table, memory_order_acquire);
+}
+
+/**
+ * @brief Replaces the BIFTs of *bier* by *table*. The packets processed from
+ * now on use *table*, the packets being processed keep the previous BIFTs
+ *
+ * @return bier_bift_table_t* the previous BIFTs, to free with
+ * free_bier_bift_table once no forwarding thread can hold them
+ */
+bier_bift_table_t *bier_bift_publish(bier_bift_t *bier,
+                                     bier_bift_table_t *table);
+
+/**
+ * @brief Gives to each BIFT of *table*, before it is published, the counters
+ * of the current BIFT of *bier* with the same BIFT-ID. The other BIFTs get
+ * counters that no current BIFT uses if possible, which are reset
+ */
+void bier_bift_keep_stats(bier_bift_t *bier, bier_bift_table_t *table);
+
+/**
+ * @brief Length in bits of the bitstrings of the BIFT *bift_id*
+ *
+ * @return uint32_t the length, 0 if the BIFT is unknown
+ */
+uint32_t bier_bift_bitstring_length(const bier_bift_table_t *table,
+                                    uint32_t bift_id);
+
+/**
+ * @brief Structures replaced by bier_bift_apply_delta
+ */
+typedef struct bier_delta_garbage bier_delta_garbage_t;
+
+/**
+ * @brief Applies the changes of *delta* to a copy of *table*, which is left
+ * untouched. The copy shares the BIFTs and the entries that are not changed,
+ * so that only the changed entries are copied. The compiled table of a BIER
+ * BIFT is still built again once for the whole delta: changing a BIER BIFT
+ * costs O(nb_bft_entry x (ECMP members x neighbours + bitstring words)),
+ * whatever the number of operations, plus the copy of its entry pointers and
+ * the carry-over of its neighbour counters in O(neighbours^2)
+ *
+ * @param garbage set to the structures of *table* that are no longer used by
+ * the copy once it is published, to free with free_bier_delta_garbage instead
+ * of free_bier_bift_table
+ * @return bier_bift_table_t* the new BIFTs, NULL if a change is invalid or on
+ * error
+ */
+bier_bift_table_t *bier_bift_apply_delta(const bier_bift_table_t *table,
+                                         const bier_delta_t *delta,
+                                         bool use_ipv4,
+                                         bier_delta_garbage_t **garbage);
+
+/**
+ * @brief Frees the structures replaced by a delta. Takes a void pointer to be
+ * retired with bier_rcu_retire
+ */
+void free_bier_delta_garbage(void *garbage);
+
+/**
+ * @brief Opens a raw BIER socket bound to the local address of *bier*
+ *
+ * @return int the socket, -1 on error
+ */
+int bier_open_socket(const bier_bift_t *bier);
+
+/**
+ * @brief Creates the view of *bier* used by a forwarding thread. The view
+ * shares the BIFTs of *bier*, which are only read, and has its own socket, TX
+ * queue and BIFT counters. The neighbour counters are stored in the shared
+ * BIFTs and updated atomically by all the threads, so their cache lines are
+ * written by several threads. The view is registered in *bier* for the
+ * statistics and must be freed with free_bier_bift_view before *bier*
+ *
+ * @param bier the BIFTs of the daemon
+ * @param socket the raw socket of the thread, owned by the view
+ * @return bier_bift_t* the view, NULL on error
+ */
+bier_bift_t *bier_bift_worker_view(bier_bift_t *bier, int socket);
+
+void free_bier_bift_view(bier_bift_t *view);
+
+/**
+ * @brief Create a TX queue of *capacity* replicas sent on *socket*
+ *
+ * @return bier_tx_queue_t* the queue, NULL on error
+ */
+bier_tx_queue_t *init_tx_queue(int socket, unsigned int capacity);
+
+void free_tx_queue(bier_tx_queue_t *tx);
+
+/**
+ * @brief Get the header buffer of the next replica of the queue. The queue is
+ * flushed if it is full. The replica is only queued once bier_tx_queue_commit
+ * is called, otherwise the buffer is reused by the next call
+ *
+ * @param tx the TX queue
+ * @param header_length length of the BIER header of the replica
+ * @return uint8_t* buffer of at least *header_length* bytes, NULL if the
+ * header is too long
+ */
+uint8_t *bier_tx_queue_slot(bier_tx_queue_t *tx, size_t header_length);
+
+/**
+ * @brief Queue the replica whose header is written in the buffer returned by
+ * the last call to bier_tx_queue_slot. The payload is not copied: it must
+ * remain valid until the queue is flushed
+ *
+ * @param tx the TX queue
+ * @param header_length length of the BIER header of the replica
+ * @param payload payload following the BIER header, shared between replicas
+ * @param payload_length length of *payload*
+ * @param dst destination of the replica
+ * @param dst_len length of *dst*
+ * @param nei_stats counters of the neighbour *dst*, may be NULL
+ * @param bift_stats counters of the BIFT of the replica, may be NULL
+ */
+void bier_tx_queue_commit(bier_tx_queue_t *tx, size_t header_length,
+                          const uint8_t *payload, size_t payload_length,
+                          const struct sockaddr *dst, socklen_t dst_len,
+                          bier_nei_stats_t *nei_stats,
+                          bier_bift_stats_t *bift_stats);
+
+/**
+ * @brief Send all queued replicas. A replica that cannot be sent is reported
+ * and dropped without preventing the others from being sent
+ *
+ * @param tx the TX queue
+ * @return int number of replicas that could not be sent
+ */
+int bier_tx_queue_flush(bier_tx_queue_t *tx);
+
 /**
  * @brief Local processing function when the router receives a packet belonging
  * to itself.
@@ -178,6 +725,30 @@ typedef struct {
                                       void *args);
 } bier_local_processing_t;
 
+/**
+ * @brief Read the BIFTs of a BIER static configuration file, without opening
+ * any socket. Used to load the configuration and to reload it
+ *
+ * Each BIFT starts with a line "type [bift-id sd si]". Without the BIFT-ID,
+ * the sub-domain and the SI, the BIFTs get the BIFT-IDs 1, 2, ... in order,
+ * in the sub-domain 0 and the set 0. The local BFR-ID of a BIER BIFT is the
+ * BFR-ID of the router in the sub-domain, whatever the set of the BIFT, and
+ * its entries are given for the bits of the set
+ *
+ * @param config_filepath path to the configuration file
+ * @param use_ipv4 true if BIER must use IPv4 instead of IPv6
+ * @param local set to the local address of the configuration
+ * @return bier_bift_table_t* the BIFTs, NULL on error
+ */
+bier_bift_table_t *read_bift_table(char *config_filepath, bool use_ipv4,
+                                   sockaddr_uniform_t *local);
+
+/**
+ * @brief Release the memory of BIFTs read by read_bift_table. Takes a void
+ * pointer to be retired with bier_rcu_retire
+ */
+void free_bier_bift_table(void *table);
+
 /**
  * @brief Read a BIER static configuration file to construct the local BIER
  * Forwarding Table
@@ -188,6 +759,34 @@ typedef struct {
  */
 bier_bift_t *read_config_file(char *config_filepath, bool use_ipv4);
 
+/**
+ * @brief Compile the entries of a BIER Forwarding Table into the flat layout
+ * used by the forwarding path. Called by `read_config_file` once the BFT is
+ * filled.
+ *
+ * @param bft the BIER Forwarding Table
+ * @param use_ipv4 true if the neighbours are IPv4 addresses
+ * @return bier_bft_compiled_t* the compiled table, NULL on error
+ */
+bier_bft_compiled_t *compile_bier_bft(bier_internal_t *bft, bool use_ipv4);
+
+/**
+ * @brief Build the index of the adjacencies of a BIER-TE BIFT per BP, used by
+ * the forwarding path. Called once the adjacencies are filled or changed,
+ * replacing the previous index
+ *
+ * @param bft the BIER-TE BIFT
+ * @return int 0 on success, -1 on error
+ */
+int index_bier_te(bier_te_internal_t *bft);
+
+/**
+ * @brief Release the memory associated with a compiled BIER Forwarding Table
+ *
+ * @param compiled pointer to the compiled table
+ */
+void free_compiled_bft(bier_bft_compiled_t *compiled);
+
 /**
  * @brief Release the memory associated with the BIER Forwarding Table structure
  *
@@ -199,19 +798,22 @@ void free_bier_bft(bier_bift_t *bft);
  * @brief Process the packet given by *buffer* of length *buffer_length* using
  * the BIER Forwarding Table *bft*. For each packet whose destination is the
  * local router processing the packet, the *bier_local_processing* structure
- * launches the local function of the structure. Each forwarding is done using
- * the *socket_fd* raw socket
+ * launches the local function of the structure. Each replica is queued in
+ * *tx*, and only sent when the queue is flushed
  *
  * @param buffer pointer to the buffer - should start with the BIER header
  * @param buffer_length length of the *buffer*
  * @param bft the BIER Forwarding Table
+ * @param tx the TX queue of the raw socket
+ * @param stats counters of the BIFT
  * @param bier_local_processing structure containing the function and additional
  * arguments to handle a local packet
  * @return int error indication state
  */
 int bier_non_te_processing(uint8_t *buffer, size_t buffer_length,
-                           bier_internal_t *bft, int socket,
-                           bier_all_apps_t *all_apps, bool use_ipv4);
+                           bier_internal_t *bft, bier_tx_queue_t *tx,
+                           bier_bift_stats_t *stats, bier_all_apps_t *all_apps,
+                           bool use_ipv4);
 
 /**
  * @brief Same as bier_processing but using the BIER-TE processing
@@ -223,12 +825,69 @@ int bier_non_te_processing(uint8_t *buffer, size_t buffer_length,
  * @return int error indication state
  */
 int bier_te_processing(uint8_t *buffer, size_t buffer_length,
-                       bier_te_internal_t *bft, int socket,
-                       bier_all_apps_t *all_apps, bool use_ipv4);
+                       bier_te_internal_t *bft, bier_tx_queue_t *tx,
+                       bier_bift_stats_t *stats, bier_all_apps_t *all_apps,
+                       bool use_ipv4);
 
 int bier_processing(uint8_t *buffer, size_t buffer_length, bier_bift_t *bier,
                     bier_all_apps_t *all_apps, bool use_ipv4);
 
+/**
+ * @brief Packet received from the BIER network
+ */
+typedef struct {
+    uint8_t *buffer;  // Start of the BIER header
+    size_t length;    // Length from the BIER header
+    sockaddr_uniform_t src;  // Upstream BFR
+    int src_bfr_id;
+} bier_rx_packet_t;
+
+/**
+ * @brief Process a batch of *nb_packets* packets received together from the
+ * BIER network. Each packet is processed as with bier_processing, with the
+ * source of the packet set in *all_apps* for local delivery. A failure on a
+ * packet does not prevent the processing of the next ones. The replicas and
+ * the local deliveries which cannot be sent are counted in the drops of their
+ * BIFT, they are not processing failures
+ *
+ * @param packets the received packets
+ * @param nb_packets number of packets in *packets*
+ * @param bier the BIER Forwarding Tables
+ * @param all_apps the applications bound to the daemon
+ * @param use_ipv4 true if BIER uses IPv4 instead of IPv6
+ * @return int -1 if the processing of at least one packet failed, 0 otherwise
+ */
+int bier_processing_batch(bier_rx_packet_t *packets, unsigned int nb_packets,
+                          bier_bift_t *bier, bier_all_apps_t *all_apps,
+                          bool use_ipv4);
+
+/**
+ * @brief Sends the frames delivered to the applications since the last call,
+ * each application receiving its frames packed in as few messages as
+ * possible. Called at the end of bier_processing and bier_processing_batch:
+ * the payloads of the delivered packets must remain valid until then
+ *
+ * @param all_apps the applications
+ * @return int -1 if a message could not be sent, 0 otherwise
+ */
+int bier_app_deliveries_flush(bier_all_apps_t *all_apps);
+
+/**
+ * @brief Sends the counters of all BIFTs and of their neighbours to
+ * *dest_addr* as a CBOR map:
+ * {"unknown_bift_id", "bifts": [{"bift_id", "packets_in", "replicas_out",
+ * "local_deliveries", "drop_*", "neighbours": [{"addr", "tx_packets",
+ * "tx_bytes"}]}]}
+ *
+ * @param socket the UNIX socket used to answer
+ * @param bier the BIFTs
+ * @param dest_addr the requester
+ * @param addrlen length of *dest_addr*
+ * @return int 0 on success, -1 otherwise
+ */
+int send_bier_stats(int socket, const bier_bift_t *bier,
+                    const struct sockaddr_un *dest_addr, socklen_t addrlen);
+
 /**
  * @brief Prints to the standard output the content of the BIER Forwarding table
  * `bft`.
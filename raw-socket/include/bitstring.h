@@ -0,0 +1,146 @@
+#ifndef BITSTRING_H
+#define BITSTRING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#ifndef __APPLE__
+#include <endian.h>
+#endif
+
+/**
+ * @brief Kernels operating on whole bitstrings.
+ *
+ * Two representations are used. In a packet, the bitstring is in network byte
+ * order: the bytes of the bitstring form a single big-endian integer of BSL
+ * bits. On the forwarding path, the bitstring is an array of uint64_t words
+ * in host byte order, with word 0 holding the BFR-IDs 1 to 64. This is the
+ * layout of the forwarding bitmasks. Loading/storing converts between both.
+ *
+ * The implementation is chosen at startup depending on the CPU (AVX-512,
+ * AVX2, SSE2 or a portable scalar fallback). Bitstrings of a single word
+ * (BSL 64) are handled inline without going through the dispatch.
+ */
+
+typedef enum {
+    BITSTRING_IMPL_SCALAR,
+    BITSTRING_IMPL_SSE2,
+    BITSTRING_IMPL_AVX2,
+    BITSTRING_IMPL_AVX512,
+    BITSTRING_IMPL_MAX,
+} bitstring_impl_t;
+
+typedef struct {
+    bitstring_impl_t impl;
+    const char *name;
+    bool (*load_and)(uint64_t *dst, const uint8_t *src, const uint64_t *mask,
+                     uint32_t nb_words);
+    bool (*store_and)(uint8_t *dst, const uint64_t *a, const uint64_t *b,
+                      uint32_t nb_words);
+    void (*and_not)(uint64_t *dst, const uint64_t *mask, uint32_t nb_words);
+    bool (*is_zero)(const uint64_t *bitstring, uint32_t nb_words);
+    uint32_t (*popcount)(const uint64_t *bitstring, uint32_t nb_words);
+} bitstring_ops_t;
+
+extern bitstring_ops_t bitstring_ops;
+
+/**
+ * @brief Select the implementation of the kernels. The best implementation
+ * supported by the CPU is selected automatically at startup.
+ *
+ * @param impl the implementation to use
+ * @return int 0 on success, -1 if the CPU does not support `impl`
+ */
+int bitstring_select(bitstring_impl_t impl);
+
+static inline uint64_t bitstring_read_be64(const uint8_t *src) {
+    uint64_t word;
+    memcpy(&word, src, sizeof(uint64_t));
+    return be64toh(word);
+}
+
+static inline void bitstring_write_be64(uint8_t *dst, uint64_t value) {
+    uint64_t word = htobe64(value);
+    memcpy(dst, &word, sizeof(uint64_t));
+}
+
+/**
+ * @brief Load the network byte order bitstring `src` of `nb_words` 64 bits
+ * words in host byte order, and keep only the bits that are set in `mask`.
+ *
+ * @param dst host byte order bitstring
+ * @param src bitstring in the packet
+ * @param mask host byte order bitstring, NULL to keep all the bits
+ * @param nb_words length of the bitstrings in 64 bits words
+ * @return true if no bit of `src` was cleared by `mask`
+ */
+static inline bool bitstring_load_and(uint64_t *dst, const uint8_t *src,
+                                      const uint64_t *mask,
+                                      uint32_t nb_words) {
+    if (nb_words == 1) {
+        uint64_t word = bitstring_read_be64(src);
+        dst[0] = mask ? word & mask[0] : word;
+        return dst[0] == word;
+    }
+    return bitstring_ops.load_and(dst, src, mask, nb_words);
+}
+
+static inline void bitstring_load(uint64_t *dst, const uint8_t *src,
+                                  uint32_t nb_words) {
+    bitstring_load_and(dst, src, NULL, nb_words);
+}
+
+/**
+ * @brief Store in network byte order `a` & `b` in `dst` (fused AND and
+ * byteswap).
+ *
+ * @param dst bitstring in the packet
+ * @param a host byte order bitstring
+ * @param b host byte order bitstring, NULL to store `a` unchanged
+ * @param nb_words length of the bitstrings in 64 bits words
+ * @return true if at least one bit is set in the stored bitstring
+ */
+static inline bool bitstring_store_and(uint8_t *dst, const uint64_t *a,
+                                       const uint64_t *b, uint32_t nb_words) {
+    if (nb_words == 1) {
+        uint64_t word = b ? a[0] & b[0] : a[0];
+        bitstring_write_be64(dst, word);
+        return word != 0;
+    }
+    return bitstring_ops.store_and(dst, a, b, nb_words);
+}
+
+static inline void bitstring_store(uint8_t *dst, const uint64_t *src,
+                                   uint32_t nb_words) {
+    bitstring_store_and(dst, src, NULL, nb_words);
+}
+
+/**
+ * @brief `dst` &= ~`mask` on host byte order bitstrings
+ */
+static inline void bitstring_and_not(uint64_t *dst, const uint64_t *mask,
+                                     uint32_t nb_words) {
+    if (nb_words == 1) {
+        dst[0] &= ~mask[0];
+        return;
+    }
+    bitstring_ops.and_not(dst, mask, nb_words);
+}
+
+static inline bool bitstring_is_zero(const uint64_t *bitstring,
+                                     uint32_t nb_words) {
+    if (nb_words == 1) {
+        return bitstring[0] == 0;
+    }
+    return bitstring_ops.is_zero(bitstring, nb_words);
+}
+
+static inline uint32_t bitstring_popcount(const uint64_t *bitstring,
+                                          uint32_t nb_words) {
+    if (nb_words == 1) {
+        return __builtin_popcountll(bitstring[0]);
+    }
+    return bitstring_ops.popcount(bitstring, nb_words);
+}
+
+#endif  // BITSTRING_H
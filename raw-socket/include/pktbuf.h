@@ -0,0 +1,157 @@
+#ifndef PKTBUF_H
+#define PKTBUF_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "public/common.h"
+
+/**
+ * @brief Fixed-size packet buffers taken from a preallocated pool, so that
+ * building a packet does not call the allocator once the pool exists.
+ *
+ * A buffer keeps a headroom in front of its data, where the headers are
+ * prepended in place with bier_pktbuf_prepend, and a private area for the
+ * structure describing the packet to its user, e.g., a my_packet_t. A pool
+ * is owned by a single thread and its free list is not synchronised: a
+ * buffer must be released by the thread which allocated it.
+ */
+
+// Room for a BIER header with a BSL of 4096, an IPv6 and a UDP header
+#define BIER_PKTBUF_HEADROOM 640
+#define BIER_PKTBUF_DATA_ROOM 2048  // Longest packet after the headroom
+#define BIER_PKTBUF_PRIV_SIZE 64
+#define BIER_PKTBUF_POOL_SIZE 64  // Buffers of the pool of a thread
+
+typedef struct bier_pktbuf_pool bier_pktbuf_pool_t;
+
+typedef struct bier_pktbuf {
+    struct bier_pktbuf *next;  // Next free buffer of the pool
+    bier_pktbuf_pool_t *pool;
+    uint8_t *data;    // Start of the packet in `room`
+    uint32_t length;  // Length of the packet
+    _Alignas(16) uint8_t priv[BIER_PKTBUF_PRIV_SIZE];
+    _Alignas(64) uint8_t room[BIER_PKTBUF_HEADROOM + BIER_PKTBUF_DATA_ROOM];
+} bier_pktbuf_t;
+
+struct bier_pktbuf_pool {
+    bier_pktbuf_t *bufs;  // [nb_bufs] in a single allocation
+    bier_pktbuf_t *free_list;
+    uint32_t nb_bufs;
+    uint32_t nb_free;
+};
+
+/**
+ * @brief Allocates the *nb_bufs* buffers of *pool*, all free
+ *
+ * @return int 0 on success, -1 otherwise
+ */
+int bier_pktbuf_pool_init(bier_pktbuf_pool_t *pool, uint32_t nb_bufs);
+
+/**
+ * @brief Frees the buffers of *pool*, including those not released
+ */
+void bier_pktbuf_pool_destroy(bier_pktbuf_pool_t *pool);
+
+/**
+ * @brief Pool of BIER_PKTBUF_POOL_SIZE buffers of the calling thread, created
+ * on first use
+ *
+ * @return bier_pktbuf_pool_t* the pool, NULL if it cannot be created
+ */
+bier_pktbuf_pool_t *bier_pktbuf_thread_pool(void);
+
+/**
+ * @brief Frees the pool of the calling thread, if any. Its buffers must not
+ * be used anymore
+ */
+void bier_pktbuf_thread_pool_free(void);
+
+/**
+ * @brief Takes a buffer from *pool*, with an empty packet right after the
+ * headroom
+ *
+ * @return bier_pktbuf_t* the buffer, NULL if the pool is exhausted
+ */
+static inline bier_pktbuf_t *bier_pktbuf_alloc(bier_pktbuf_pool_t *pool) {
+    bier_pktbuf_t *buf = pool->free_list;
+    if (!buf) {
+        return NULL;
+    }
+    pool->free_list = buf->next;
+    --pool->nb_free;
+    buf->data = &buf->room[BIER_PKTBUF_HEADROOM];
+    buf->length = 0;
+    return buf;
+}
+
+/**
+ * @brief Gives *buf* back to its pool
+ */
+static inline void bier_pktbuf_release(bier_pktbuf_t *buf) {
+    bier_pktbuf_pool_t *pool = buf->pool;
+    buf->next = pool->free_list;
+    pool->free_list = buf;
+    ++pool->nb_free;
+}
+
+/**
+ * @brief Extends the packet of *buf* by *length* bytes in front of it
+ *
+ * @return uint8_t* the new start of the packet, NULL if the headroom is too
+ * small
+ */
+static inline uint8_t *bier_pktbuf_prepend(bier_pktbuf_t *buf,
+                                           uint32_t length) {
+    if ((size_t)(buf->data - buf->room) < length) {
+        return NULL;
+    }
+    buf->data -= length;
+    buf->length += length;
+    return buf->data;
+}
+
+/**
+ * @brief Extends the packet of *buf* by *length* bytes at its end
+ *
+ * @return uint8_t* the first added byte, NULL if the buffer is too small
+ */
+static inline uint8_t *bier_pktbuf_append(bier_pktbuf_t *buf,
+                                          uint32_t length) {
+    uint8_t *end = buf->data + buf->length;
+    if ((size_t)(&buf->room[sizeof(buf->room)] - end) < length) {
+        return NULL;
+    }
+    buf->length += length;
+    return end;
+}
+
+/**
+ * @brief The buffer whose private area is *priv*
+ */
+static inline bier_pktbuf_t *bier_pktbuf_from_priv(void *priv) {
+    return (bier_pktbuf_t *)((uint8_t *)priv - offsetof(bier_pktbuf_t, priv));
+}
+
+/**
+ * @brief Describes the packet of *buf* with the my_packet_t of its private
+ * area. It must be called again once the packet is extended
+ *
+ * @return my_packet_t* the packet, released with bier_pktbuf_release_my_packet
+ */
+static inline my_packet_t *bier_pktbuf_my_packet(bier_pktbuf_t *buf) {
+    my_packet_t *my_packet = (my_packet_t *)buf->priv;
+    my_packet->packet = buf->data;
+    my_packet->packet_length = buf->length;
+    return my_packet;
+}
+
+/**
+ * @brief Gives the buffer of a packet from bier_pktbuf_my_packet back to its
+ * pool
+ */
+static inline void bier_pktbuf_release_my_packet(my_packet_t *my_packet) {
+    bier_pktbuf_release(bier_pktbuf_from_priv(my_packet));
+}
+
+#endif  // PKTBUF_H
@@ -8,12 +8,16 @@
 
 #include "common.h"
 
+// The library logs through syslog only: applications call bier_log_init (see
+// include/bier-log.h) at start-up to also print its errors on stderr.
+
 typedef struct {
     union {
         struct {
             uint64_t bift_id;  // Inserted in the BIER header of the packet
             size_t bitstring_length;  // Length of the bitstring in bytes
             uint8_t *bitstring;       // Bitstring inserted in the BIER header
+            bool use_frames;  // Send as a binary frame instead of CBOR
         } send_info;
         struct {
             uint64_t upstream_router_bfr_id;
@@ -23,7 +27,8 @@ typedef struct {
 
 /**
  * @brief sendto() like function with a new argument for BIER information
- * instead of a setsockopt()
+ * instead of a setsockopt(). The packet is encoded as a binary frame if
+ * `bier_info->send_info.use_frames` is set, in CBOR otherwise
  *
  * @param socket UNIX socket linked to the BIER daemon *towards* the BIER daemon
  * @param buf payload of the BIER packet
@@ -37,10 +42,96 @@ ssize_t sendto_bier(int socket, const void *buf, size_t len,
                     uint16_t proto, bier_info_t *bier_info);
 
 /**
- * @brief recvfrom() like function using the BIER mechanism
+ * @brief A packet of sendmmsg_bier
+ */
+typedef struct {
+    const void *buf;  // Payload of the BIER packet
+    size_t len;       // Length of `buf` in bytes
+    uint16_t proto;   // The protocol number following the BIER header
+    bier_info_t *bier_info;  // Information inserted in the BIER header
+} bier_mmsghdr_t;
+
+/**
+ * @brief sendmmsg() like function: sends *vlen* packets, each with its own
+ * BIER information, with as few messages as possible. The packets are encoded
+ * as binary frames packed back to back in messages of at most
+ * BIER_UNIX_MAX_MESSAGE_SIZE bytes, and the daemon processes the packets of a
+ * message together
  *
- * @param socket UNIX socket linked to the BIER daemon *towards* the application
- * using the BIER daemon
+ * @param socket UNIX socket linked to the BIER daemon *towards* the BIER daemon
+ * @param msgs the packets
+ * @param vlen number of packets in *msgs*
+ * @return int Number of packets sent, -1 if none could be sent. A packet that
+ * does not fit in a message fails with EMSGSIZE
+ */
+int sendmmsg_bier(int socket, const bier_mmsghdr_t *msgs, unsigned int vlen,
+                  const struct sockaddr *dest_addr, socklen_t addrlen);
+
+/**
+ * @brief A packet of recvmmsg_bier
+ */
+typedef struct {
+    void *buf;   // Buffer receiving the payload of the BIER packet
+    size_t len;  // Length of `buf` in bytes
+    // Address of the upstream BFR, may be NULL. Its length is set in `addrlen`
+    struct sockaddr *src_addr;
+    socklen_t addrlen;
+    bier_info_t bier_info;  // Set to the information of the BIER packet
+    size_t msg_len;         // Set to the length of the payload
+} bier_recv_mmsghdr_t;
+
+/**
+ * @brief Receive state of a UNIX socket linked to the BIER daemon *towards*
+ * the application. The daemon packs several packets delivered together as
+ * binary frames in one message: the frames which were not returned yet are
+ * kept in the context of the socket. Each socket has its own context,
+ * initialised with bier_recv_ctx_init
+ */
+typedef struct {
+    int socket;
+    size_t length;  // Length of the last message received
+    size_t offset;  // Next frame in `buffer`
+    uint8_t buffer[BIER_UNIX_MAX_MESSAGE_SIZE];
+} bier_recv_ctx_t;
+
+/**
+ * @brief Initialises the receive context of *socket*, without pending packet.
+ * Also to call when the socket is replaced, e.g., closed and reopened
+ */
+void bier_recv_ctx_init(bier_recv_ctx_t *ctx, int socket);
+
+/**
+ * @brief True if packets already received from the daemon are kept in *ctx*.
+ * They do not make the socket readable: this must be checked before polling
+ * the socket, and the packets read with recvmmsg_bier or recvfrom_bier first
+ */
+bool bier_recv_pending(const bier_recv_ctx_t *ctx);
+
+/**
+ * @brief recvmmsg() like function: receives up to *vlen* packets in one call.
+ * The packets kept in *ctx* are returned first, then those of the messages
+ * already queued on the socket. The packets of a message which are not
+ * returned are kept in *ctx* for the next call, see bier_recv_pending
+ *
+ * @param ctx receive context of the UNIX socket linked to the BIER daemon
+ * *towards* the application
+ * @param msgs the buffers receiving the packets
+ * @param vlen number of buffers in *msgs*
+ * @param flags flags of recv() for the first message, e.g., MSG_DONTWAIT.
+ * The following messages are never waited for
+ * @return int Number of packets received, -1 on error. A packet larger than
+ * its buffer is dropped, and fails with EMSGSIZE if it is the first one
+ */
+int recvmmsg_bier(bier_recv_ctx_t *ctx, bier_recv_mmsghdr_t *msgs,
+                  unsigned int vlen, int flags);
+
+/**
+ * @brief recvfrom() like function using the BIER mechanism. Both binary frames
+ * (see `bier_bind_t::use_frames`) and CBOR messages are accepted. Same as
+ * recvmmsg_bier with a single packet
+ *
+ * @param ctx receive context of the UNIX socket linked to the BIER daemon
+ * *towards* the application
  * @param buf Buffer that will contain the BIER payload packet (without the BIER
  * header)
  * @param len Length of the buffer
@@ -49,7 +140,7 @@ ssize_t sendto_bier(int socket, const void *buf, size_t len,
  * @param addrlen Length of `src_addr`
  * @return ssize_t Number of bytes read from the UNIX socket
  */
-ssize_t recvfrom_bier(int socket, void *buf, size_t len,
+ssize_t recvfrom_bier(bier_recv_ctx_t *ctx, void *buf, size_t len,
                       struct sockaddr *src_addr, socklen_t *addrlen,
                       bier_info_t *bier_info);
 
@@ -70,4 +161,69 @@ int bind_bier_sender(int socket, const struct sockaddr_un *bier_sock_path,
 
 int unbind_bier(int socket, const struct sockaddr_un *bier_sock_path, bier_bind_t *bier_to);
 
+/**
+ * @brief Shared memory channel between the application and the BIER daemon,
+ * see shm.h. The UNIX socket remains used for the control messages (bind,
+ * unbind), only the packets go through the channel
+ */
+typedef struct bier_shm bier_shm_t;
+
+/**
+ * @brief Creates a shared memory channel and attaches it to the BIER daemon.
+ * Once attached, the daemon delivers the packets of the applications bound to
+ * *unix_path* through the channel instead of the UNIX socket
+ *
+ * @param socket UNIX socket used to forward the message to the BIER daemon
+ * @param bier_sock_path Path to the UNIX socket of the BIER daemon
+ * @param unix_path Path to the UNIX socket of the application, as in
+ * `bier_bind_t::unix_path`
+ * @param nb_slots Number of packets of each ring, a power of 2
+ * @return bier_shm_t* the channel, NULL on error
+ */
+bier_shm_t *bier_shm_open(int socket, const struct sockaddr_un *bier_sock_path,
+                          const char *unix_path, uint32_t nb_slots);
+
+/**
+ * @brief sendto_bier through the shared memory channel. Never blocks
+ *
+ * @return ssize_t `len`, -1 with errno set to EAGAIN if the ring is full or to
+ * EMSGSIZE if the packet does not fit in a slot
+ */
+ssize_t bier_shm_send(bier_shm_t *shm, const void *buf, size_t len,
+                      uint16_t proto, bier_info_t *bier_info);
+
+/**
+ * @brief sendmmsg_bier through the shared memory channel: the packets are
+ * packed back to back in as few slots as possible. Never blocks
+ *
+ * @return int Number of packets sent, -1 with errno set to EAGAIN if the ring
+ * is full or to EMSGSIZE if the first packet does not fit in a slot
+ */
+int bier_shm_sendmmsg(bier_shm_t *shm, const bier_mmsghdr_t *msgs,
+                      unsigned int vlen);
+
+/**
+ * @brief recvfrom_bier through the shared memory channel. Blocks until a
+ * packet is received unless *flags* contains MSG_DONTWAIT
+ *
+ * @return ssize_t Length of the payload, -1 on error or with errno set to
+ * EAGAIN if there is no packet and MSG_DONTWAIT is set
+ */
+ssize_t bier_shm_recv(bier_shm_t *shm, void *buf, size_t len,
+                      struct sockaddr *src_addr, socklen_t *addrlen,
+                      bier_info_t *bier_info, int flags);
+
+/**
+ * @brief File descriptor readable when packets are received, to use with
+ * poll(). It is only notified once bier_shm_recv failed with EAGAIN
+ */
+int bier_shm_get_fd(const bier_shm_t *shm);
+
+/**
+ * @brief Detaches the channel from the BIER daemon and releases it
+ *
+ * @return int 0 if the daemon was notified, -1 otherwise
+ */
+int bier_shm_close(bier_shm_t *shm);
+
 #endif
\ No newline at end of file
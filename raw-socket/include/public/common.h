@@ -3,6 +3,8 @@
 
 #include <netinet/ip6.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 #ifndef NAME_MAX
 #define NAME_MAX 255
@@ -11,6 +13,9 @@
 typedef enum {
     PACKET,
     BIND,
+    SHM,  // Attaches or detaches a shared memory channel, see public/shm.h
+    RELOAD,  // Reloads the configuration of the daemon
+    DELTA,   // Changes entries of a BIFT, see bier_delta_t
 } bier_message_type;
 
 typedef union {
@@ -19,6 +24,14 @@ typedef union {
     struct sockaddr_storage _storage;
 } sockaddr_uniform_t;
 
+/**
+ * @brief Personal representation of a packet
+ */
+typedef struct {
+    uint8_t *packet;
+    uint32_t packet_length;
+} my_packet_t;
+
 typedef struct {
     char unix_path[NAME_MAX];  // Path to the UNIX socket of app using BIER
     uint16_t proto;            // Protocol following the BIER header
@@ -27,8 +40,103 @@ typedef struct {
                        // False if it is a multicast sender (do not warn the sender)
     bool is_join; // True if the bind message concerns an MC join
                   // False if the bind message concerns an MC leave
+    bool use_frames;  // True to receive the packets as binary frames
+                      // False to receive them as CBOR maps
 } bier_bind_t;
 
+typedef struct {
+    char unix_path[NAME_MAX];  // Path to the UNIX socket of app using BIER
+    uint32_t nb_slots;         // Number of slots of each ring
+    bool attach;  // True to attach the channel, false to detach it
+} bier_shm_request_t;
+
+typedef struct {
+    char config_path[NAME_MAX];  // Empty to reload the file given at startup
+} bier_reload_request_t;
+
+/* Incremental changes of a BIFT, encoded as the CBOR map
+ * {"type": DELTA, "bift_id", "ops": [{"op", "bfr_id", "nei", "fbm"}]}.
+ * "nei" is the IPv4 or IPv6 address of the neighbour and "fbm" the forwarding
+ * bitmask in network byte order, of the bitstring length of the BIFT. Both are
+ * optional depending on the operation. For a BIER-TE BIFT, "bfr_id" is the BP
+ * of an adjacency and "fbm" is not used. The operations of a message are
+ * applied in order and published together, or not at all */
+typedef enum {
+    // Adds the ECMP member ("nei", "fbm") to the entry of "bfr_id", created if
+    // needed. Adds the adjacency ("bfr_id", "nei") for BIER-TE
+    BIER_DELTA_ADD,
+    // Replaces the F-BM of the ECMP member through "nei". Replaces the
+    // neighbour of the adjacency "bfr_id" for BIER-TE
+    BIER_DELTA_MODIFY,
+    // Removes the ECMP member through "nei", or the whole entry without
+    // "nei". Removes the adjacency "bfr_id" for BIER-TE
+    BIER_DELTA_DELETE,
+} bier_delta_op_type;
+
+#define BIER_DELTA_MAX_OPS 64
+
+typedef struct {
+    bier_delta_op_type op;
+    uint32_t bfr_id;
+    int nei_family;  // AF_INET or AF_INET6, AF_UNSPEC if not given
+    uint8_t nei[16];
+    const uint8_t *fbm;  // Points inside the decoded message, NULL if not given
+    size_t fbm_length;   // In bytes
+} bier_delta_op_t;
+
+typedef struct {
+    uint32_t bift_id;  // 1-indexed as in the packets
+    int nb_ops;
+    bier_delta_op_t ops[BIER_DELTA_MAX_OPS];
+} bier_delta_t;
+
+/* Binary framing of PACKET messages, used instead of CBOR on the data path.
+ * A frame is a bier_frame_header_t followed by the bitstring (from the
+ * application to the daemon only) and the payload. Fields are in host byte
+ * order since both ends are on the same host. The first byte of a frame is
+ * never the first byte of a CBOR map, hence both encodings share the same
+ * UNIX sockets and the CBOR encoding remains the fallback */
+#define BIER_FRAME_MAGIC 0x42
+#define BIER_FRAME_VERSION 1
+// Maximum size of a message on the UNIX socket of the daemon. Several frames
+// can be packed back to back in a message, see sendmmsg_bier
+#define BIER_UNIX_MAX_MESSAGE_SIZE 4096
+
+typedef struct {
+    uint8_t magic;    // BIER_FRAME_MAGIC
+    uint8_t version;  // BIER_FRAME_VERSION
+    uint8_t type;     // bier_message_type, only PACKET for now
+    uint8_t proto;    // Protocol following the BIER header
+    uint16_t bitstring_length;  // In bytes
+    uint16_t reserved;
+    uint32_t bift_id;
+    uint32_t payload_length;
+    // From the daemon to the application only
+    int64_t upstream_router_bfr_id;
+    uint8_t source_addr[16];  // IPv4 addresses use the first 4 bytes
+} bier_frame_header_t;
+
+_Static_assert(sizeof(bier_frame_header_t) == 40,
+               "The frame header is part of the IPC ABI");
+
+/**
+ * @brief True if *buf* starts with a frame header of a supported version
+ */
+static inline bool is_bier_frame(const void *buf, size_t len) {
+    // *buf* may not be aligned for a frame header, only bytes are read
+    const uint8_t *frame = (const uint8_t *)buf;
+    return len >= sizeof(bier_frame_header_t) &&
+           frame[offsetof(bier_frame_header_t, magic)] == BIER_FRAME_MAGIC &&
+           frame[offsetof(bier_frame_header_t, version)] == BIER_FRAME_VERSION;
+}
+
+/* Bitstring lengths of RFC 8296, in bits. The BIER header encodes a length of
+ * 2^(k + 5) bits as the BSL k. An application may give a bitstring of another
+ * length: the daemon pads it with zeros, or truncates it if the bits past the
+ * bitstring length of the BIFT are not set */
+#define BIER_MIN_BITSTRING_LENGTH 64
+#define BIER_MAX_BITSTRING_LENGTH 4096
+
 /* BIER Next Protocol Identifiers */
 #define BIERPROTO_RESERVED 0
 #define BIERPROTO_MPLS_DOWN 1
@@ -7,16 +7,9 @@
 #include <string.h>
 #include <strings.h>
 
+#include "common.h"
 #include "udp-checksum.h"
 
-/**
- * @brief Personal representation of a packet
- */
-typedef struct {
-    uint8_t *packet;
-    size_t packet_length;
-} my_packet_t;
-
 /**
  * @brief Create an IPv6 packet with a UDP transport header from a defined
  * payload
@@ -25,11 +18,19 @@ typedef struct {
  * @param mc_dst Multicast destination socket address
  * @param payload_length Length of the payload
  * @param payload Payload encapsulated in the IPv6 and UDP header
- * @return my_packet_t*
+ * @return my_packet_t* the packet, in a preallocated buffer of the calling
+ * thread with room for a BIER header in front of it. NULL if the payload is
+ * too long or all the buffers of the thread are in use
  */
 my_packet_t *create_ipv6_from_payload(struct sockaddr_in6 *mc_src,
                                       struct sockaddr_in6 *mc_dst,
                                       const uint32_t payload_length,
                                       const uint8_t *payload);
 
+/**
+ * @brief Gives back the buffer of a packet created by create_ipv6_from_payload,
+ * from the same thread
+ */
+void release_ipv6_packet(my_packet_t *packet);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,120 @@
+#ifndef __BIER_SHM_H__
+#define __BIER_SHM_H__
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Shared memory transport between an application and the BIER daemon.
+ *
+ * The application creates a memfd holding two single-producer single-consumer
+ * rings, one per direction, and an eventfd per direction for the wakeups. The
+ * descriptors are passed to the daemon with SCM_RIGHTS on the UNIX control
+ * socket. Each slot of a ring holds one or more binary frames packed back to
+ * back (see bier_frame_header_t) after some headroom, where the daemon builds
+ * the BIER header in place.
+ *
+ * The consumer sets `consumer_waiting` before sleeping on the eventfd and the
+ * producer only writes the eventfd if it is set, so that a busy ring costs no
+ * system call.
+ */
+
+#define BIER_SHM_SLOT_SIZE 4096
+// Room for the largest BIER header (12 + 512 bytes) in front of the frame
+#define BIER_SHM_HEADROOM 576
+// Slot: length of the frame, headroom, frame
+#define BIER_SHM_MSG_OFFSET (64 + BIER_SHM_HEADROOM)
+#define BIER_SHM_MAX_MSG_SIZE (BIER_SHM_SLOT_SIZE - BIER_SHM_MSG_OFFSET)
+#define BIER_SHM_MAX_SLOTS 65536
+
+/**
+ * @brief Shared state of a ring, at the start of its memory. The indexes are
+ * free running and each one is written by a single side
+ */
+typedef struct {
+    _Alignas(64) _Atomic uint32_t head;  // Next slot written by the producer
+    _Alignas(64) _Atomic uint32_t tail;  // Next slot read by the consumer
+    _Alignas(64) _Atomic uint32_t consumer_waiting;
+} bier_shm_ring_hdr_t;
+
+/**
+ * @brief Local view of a ring. The number of slots is never read from the
+ * shared memory
+ */
+typedef struct {
+    bier_shm_ring_hdr_t *hdr;
+    uint8_t *slots;
+    uint32_t nb_slots;  // Power of 2
+    int efd;            // Written by the producer to wake up the consumer
+} bier_shm_ring_t;
+
+/**
+ * @brief Size of the memfd holding the two rings of *nb_slots* slots
+ */
+size_t bier_shm_size(uint32_t nb_slots);
+
+/**
+ * @brief Sets the views of the two rings stored in *mem*. The first ring goes
+ * from the application to the daemon, the second one from the daemon to the
+ * application
+ *
+ * @param mem the mapped memfd
+ * @param mem_size the size of *mem*
+ * @param nb_slots number of slots of each ring, a power of 2
+ * @param rings the two views, without eventfd
+ * @return int 0 on success, -1 if *mem_size* does not match *nb_slots*
+ */
+int bier_shm_map_rings(void *mem, size_t mem_size, uint32_t nb_slots,
+                       bier_shm_ring_t rings[2]);
+
+/**
+ * @brief Producer: buffer of the next slot, where at most
+ * BIER_SHM_MAX_MSG_SIZE bytes can be written
+ *
+ * @return uint8_t* the buffer, NULL if the ring is full
+ */
+uint8_t *bier_shm_ring_reserve(bier_shm_ring_t *ring);
+
+/**
+ * @brief Producer: publishes the slot returned by bier_shm_ring_reserve and
+ * wakes up the consumer if it is waiting
+ *
+ * @param length number of bytes written in the slot
+ */
+void bier_shm_ring_publish(bier_shm_ring_t *ring, uint32_t length);
+
+/**
+ * @brief Consumer: next message of the ring. The BIER_SHM_HEADROOM bytes in
+ * front of it can be overwritten
+ *
+ * @param length set to the length of the message
+ * @return uint8_t* the message, NULL if the ring is empty
+ */
+uint8_t *bier_shm_ring_peek(bier_shm_ring_t *ring, uint32_t *length);
+
+/**
+ * @brief Consumer: gives back the slot returned by bier_shm_ring_peek to the
+ * producer
+ */
+void bier_shm_ring_release(bier_shm_ring_t *ring);
+
+/**
+ * @brief Consumer: announces that it will sleep on the eventfd. Must be called
+ * before sleeping once the ring is empty
+ *
+ * @return bool true if the consumer can sleep, false if a message arrived in
+ * the meantime
+ */
+bool bier_shm_ring_prepare_sleep(bier_shm_ring_t *ring);
+
+/**
+ * @brief Consumer: checks that the producer did not move its index past the
+ * slots it could have filled
+ *
+ * @return bool false if the ring is corrupted and must not be read anymore
+ */
+bool bier_shm_ring_is_valid(bier_shm_ring_t *ring);
+
+#endif  // __BIER_SHM_H__
@@ -4,6 +4,7 @@
 #include <sys/un.h>
 
 #include "public/common.h"
+#include "public/shm.h"
 #include "qcbor/qcbor.h"
 #include "qcbor/qcbor_decode.h"
 #include "qcbor/qcbor_encode.h"
@@ -43,7 +44,15 @@ typedef struct {
 UsefulBufC encode_bier_payload(UsefulBuf Buffer,
                                const bier_payload_t *bier_payload);
 
-// bier_payload_t *decode_bier_payload(QCBORDecodeContext *ctx);
+/**
+ * @brief Decodes a PACKET message without allocation: the bitstring and the
+ * payload of *bier_payload* point inside *cbor*, which must outlive it
+ *
+ * @param cbor the encoded message
+ * @param bier_payload the decoded message
+ * @return QCBORError QCBOR_SUCCESS if the message is valid
+ */
+QCBORError decode_bier_payload(UsefulBufC cbor, bier_payload_t *bier_payload);
 
 /**
  * @brief Sends a QCBOR encoding of the received BIER packet that must be
@@ -59,15 +68,89 @@ int encode_local_bier_payload(
     int socket, const bier_received_packet_t *bier_received_packet,
     const struct sockaddr_un *dest_addr, socklen_t addrlen);
 
+/**
+ * @brief Fills the header of the frame delivering *bier_received_packet* to an
+ * application
+ */
+void fill_local_bier_frame_header(
+    bier_frame_header_t *frame,
+    const bier_received_packet_t *bier_received_packet);
+
+/**
+ * @brief Same as encode_local_bier_payload with a binary frame. The payload is
+ * sent from the received packet without copy
+ *
+ * @param socket
+ * @param bier_received_packet
+ * @param dest_addr
+ * @param addrlen
+ * @return int Number of bytes sent, -1 on error
+ */
+int encode_local_bier_frame(int socket,
+                            const bier_received_packet_t *bier_received_packet,
+                            const struct sockaddr_un *dest_addr,
+                            socklen_t addrlen);
+
+/**
+ * @brief Same as encode_local_bier_frame through the shared memory *ring*
+ * towards the application. The payload is copied in the next slot
+ *
+ * @param ring the ring from the daemon to the application
+ * @param bier_received_packet
+ * @return int Number of bytes written, -1 with errno set to EAGAIN if the ring
+ * is full or EMSGSIZE if the frame does not fit in a slot
+ */
+int encode_local_bier_frame_shm(
+    bier_shm_ring_t *ring, const bier_received_packet_t *bier_received_packet);
+
+/**
+ * @brief Decodes a PACKET message sent as a binary frame. The bitstring and
+ * the payload of *bier_payload* point inside *app_buf*, which must outlive it
+ *
+ * @param app_buf the received frame, see is_bier_frame
+ * @param len length of *app_buf*
+ * @param bier_payload the decoded message
+ * @return int 0 on success, -1 if the frame is malformed
+ */
+int decode_bier_frame(void *app_buf, ssize_t len,
+                      bier_payload_t *bier_payload);
+
+/**
+ * @brief Decodes the fields of a SHM message from the map entered in *ctx*
+ *
+ * @return bier_shm_request_t* the allocated request, NULL on error
+ */
+bier_shm_request_t *decode_bier_shm_request(QCBORDecodeContext *ctx);
+
+/**
+ * @brief Decodes the fields of a RELOAD message from the map entered in *ctx*
+ *
+ * @return bier_reload_request_t* the allocated request, NULL on error
+ */
+bier_reload_request_t *decode_bier_reload_request(QCBORDecodeContext *ctx);
+
+/**
+ * @brief Decodes the fields of a DELTA message from the map entered in *ctx*.
+ * The forwarding bitmasks point inside the decoded message, which must outlive
+ * the result
+ *
+ * @return bier_delta_t* the allocated changes, NULL on error
+ */
+bier_delta_t *decode_bier_delta(QCBORDecodeContext *ctx);
+
 /**
  * @brief
  *
  * @param app_buf
  * @param len
  * @param msg
- * @return void* Pointer to (allocated) buffer with the decoded data. The caller
- * is responsible to cast in the correct type using the `msg` variable. Returns
- * NULL in case of error during the decoding
+ * @param bier_payload filled if the message is a PACKET, see
+ * decode_bier_payload
+ * @return void* Pointer to the decoded data. The caller is responsible to cast
+ * in the correct type using the `msg` variable. A PACKET is decoded in
+ * *bier_payload*, other messages are allocated. Returns NULL in case of error
+ * during the decoding
  */
 void *decode_application_message(void *app_buf, ssize_t len,
-                                 bier_message_type *msg);
\ No newline at end of file
+                                 bier_message_type *msg,
+                                 bier_payload_t *bier_payload);
\ No newline at end of file
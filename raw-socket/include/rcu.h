@@ -0,0 +1,89 @@
+#ifndef RCU_H
+#define RCU_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief Quiescent state based reclamation for the structures shared between
+ * the main thread of the daemon (the writer) and its forwarding threads (the
+ * readers).
+ *
+ * The writer never modifies a published structure: it publishes a new copy
+ * with an atomic pointer swap and retires the old one. Each reader announces a
+ * quiescent state between two batches of packets, i.e., a point where it holds
+ * no pointer to a shared structure. A retired structure is freed once every
+ * reader went through a quiescent state after it was retired. A reader blocked
+ * in poll is offline and does not delay the reclamation.
+ *
+ * Readers only write their own counter and never wait for the writer.
+ */
+
+/**
+ * @brief State of a reader, on its own cache line
+ */
+typedef struct {
+    _Alignas(64) _Atomic uint64_t epoch;  // Last epoch seen, 0 when offline
+} bier_rcu_reader_t;
+
+typedef struct bier_rcu_deferred bier_rcu_deferred_t;
+
+typedef struct {
+    _Atomic uint64_t epoch;  // Incremented by each retire, starts at 1
+    int nb_readers;
+    bier_rcu_reader_t *readers;    // [nb_readers]
+    bier_rcu_deferred_t *retired;  // Only accessed by the writer
+} bier_rcu_t;
+
+/**
+ * @brief Initializes *rcu* for *nb_readers* readers, all offline
+ *
+ * @return int 0 on success, -1 otherwise
+ */
+int bier_rcu_init(bier_rcu_t *rcu, int nb_readers);
+
+/**
+ * @brief Frees all the retired structures, whatever the state of the readers.
+ * Only called once the readers are stopped
+ */
+void bier_rcu_destroy(bier_rcu_t *rcu);
+
+/**
+ * @brief The reader holds no pointer to a shared structure. Also brings an
+ * offline reader back online: shared structures can be read after the call
+ */
+static inline void bier_rcu_quiescent(bier_rcu_t *rcu, int reader) {
+    // Sequentially consistent with the publication of the writer, see
+    // bier_rcu_retire
+    atomic_store(&rcu->readers[reader].epoch, atomic_load(&rcu->epoch));
+}
+
+#define bier_rcu_online(rcu, reader) bier_rcu_quiescent(rcu, reader)
+
+/**
+ * @brief The reader holds no pointer to a shared structure until the next
+ * call to bier_rcu_online
+ */
+static inline void bier_rcu_offline(bier_rcu_t *rcu, int reader) {
+    atomic_store(&rcu->readers[reader].epoch, 0);
+}
+
+/**
+ * @brief Frees *ptr* with *free_fn* once no reader can hold it. The writer
+ * must have replaced it by a new structure with a sequentially consistent
+ * store before the call
+ *
+ * @return int 0 on success, -1 if it cannot be deferred. *ptr* is then leaked
+ * rather than freed under the readers
+ */
+int bier_rcu_retire(bier_rcu_t *rcu, void *ptr, void (*free_fn)(void *));
+
+/**
+ * @brief Frees the retired structures that no reader can hold anymore
+ *
+ * @return bool true if structures are still waiting for a reader
+ */
+bool bier_rcu_reclaim(bier_rcu_t *rcu);
+
+#endif  // RCU_H
@@ -8,6 +8,7 @@
 #include <syslog.h>
 #include <unistd.h>
 
+#include "include/bier-log.h"
 #include "include/public/bier.h"
 
 /**
@@ -25,6 +26,7 @@ typedef struct {
     char mc_addr[NAME_MAX];
     char bier_unix_path[NAME_MAX];
     int nb_packets_listen;
+    bool use_frames;
 } args_t;
 
 void usage(char *prog_name) {
@@ -38,6 +40,7 @@ void usage(char *prog_name) {
             "    -l listener path: path to the UNIX socket to enable the BIER "
             "daemon to communicate with the receiver\n");
     fprintf(stderr, "    -n nb: number of packets to receive: (default: 1)\n");
+    fprintf(stderr, "    -f: receive the packets as binary frames instead of CBOR\n");
     fprintf(stderr, "    -v: verbose mode");
 }
 
@@ -47,7 +50,7 @@ void parse_args(args_t *args, int argc, char *argv[]) {
     bool has_listening_unix_path, has_mc_addr, has_bier_unix_path;
     args->nb_packets_listen = 1;
 
-    while ((opt = getopt(argc, argv, "l:g:b:n:")) != -1) {
+    while ((opt = getopt(argc, argv, "l:g:b:n:f")) != -1) {
         switch (opt) {
             case 'l': {
                 strcpy(args->listening_unix_path, optarg);
@@ -73,6 +76,10 @@ void parse_args(args_t *args, int argc, char *argv[]) {
                 args->nb_packets_listen = nb;
                 break;
             }
+            case 'f': {
+                args->use_frames = true;
+                break;
+            }
             default: {
                 usage(argv[0]); 
                 break;
@@ -87,8 +94,8 @@ void parse_args(args_t *args, int argc, char *argv[]) {
 }
 
 int main(int argc, char *argv[]) {
-    // Enable logs by default.
-    openlog(NULL, LOG_DEBUG | LOG_PID | LOG_PERROR, LOG_USER);
+    // Enable logs by default, including the ones of the library.
+    bier_log_init(BIER_LOG_DEFAULT_LEVEL);
 
     args_t args;
     parse_args(&args, argc, argv);
@@ -140,6 +147,7 @@ int main(int argc, char *argv[]) {
     bier_bind_t bier_bind = {};
     strcpy(bier_bind.unix_path, args.listening_unix_path);
     bier_bind.proto = BIERPROTO_IPV6;
+    bier_bind.use_frames = args.use_frames;
     struct sockaddr_in6 mc_group = {
         .sin6_family = AF_INET6,
     };
@@ -164,8 +172,10 @@ int main(int argc, char *argv[]) {
     socklen_t addrlen;
     bier_info_t bier_info;
     int nb_received = 0;
+    static bier_recv_ctx_t recv_ctx;
+    bier_recv_ctx_init(&recv_ctx, socket_fd);
     while (nb_received < args.nb_packets_listen) {
-        ssize_t received = recvfrom_bier(socket_fd, packet, sizeof(packet),
+        ssize_t received = recvfrom_bier(&recv_ctx, packet, sizeof(packet),
                                          &src_received, &addrlen, &bier_info);
         syslog(LOG_DEBUG, "Received %lu bytes from %s\n", received,
                src_received_txt);
@@ -10,6 +10,7 @@
 #include <syslog.h>
 #include <unistd.h>
 
+#include "include/bier-log.h"
 #include "include/public/bier.h"
 #include "include/public/multicast.h"
 
@@ -84,6 +85,13 @@ void usage(char *prog_name) {
     fprintf(stderr,
             "    -i bift-id: BIFT-ID to use when sending the packets (default: "
             "1)\n");
+    fprintf(stderr,
+            "    -L bitstring length: length of the bitstring in bits, from 64 "
+            "to 4096. The daemon adapts it to the BSL of the BIFT (default: "
+            "64)\n");
+    fprintf(stderr,
+            "    -S nb slots: exchange the packets with the BIER daemon through "
+            "a shared memory channel of nb slots per direction (power of 2)\n");
     fprintf(stderr, "    -v: verbose mode");
 }
 
@@ -94,6 +102,8 @@ typedef struct {
     char sender_path[NAME_MAX];
     int nb_packets_to_send;
     int bift_id;
+    uint32_t bitstring_length;  // In bits
+    uint32_t shm_nb_slots;  // 0 to use the UNIX socket
     bool verbose;
 } args_t;
 
@@ -103,9 +113,10 @@ void parse_args(args_t *args, int argc, char *argv[]) {
     bool has_mc_dst, has_loopback, has_bier, has_sender;
     args->nb_packets_to_send = 1;
     args->bift_id = 1;
+    args->bitstring_length = BIER_MIN_BITSTRING_LENGTH;
     args->verbose = false;
 
-    while ((opt = getopt(argc, argv, "d:l:b:s:n:i:v")) != -1) {
+    while ((opt = getopt(argc, argv, "d:l:b:s:n:i:L:S:v")) != -1) {
         switch (opt) {
             case 'v': {
                 args->verbose = true;
@@ -149,6 +160,21 @@ void parse_args(args_t *args, int argc, char *argv[]) {
                 }
                 break;
             }
+            case 'L': {
+                uint32_t length = atoi(optarg);
+                if (length < BIER_MIN_BITSTRING_LENGTH ||
+                    length > BIER_MAX_BITSTRING_LENGTH ||
+                    (length & (length - 1)) != 0) {
+                    fprintf(stderr, "Invalid bitstring length: %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                args->bitstring_length = length;
+                break;
+            }
+            case 'S': {
+                args->shm_nb_slots = atoi(optarg);
+                break;
+            }
             case '?': {
                 usage(argv[0]);
                 exit(EXIT_SUCCESS);
@@ -174,12 +200,14 @@ void parse_args(args_t *args, int argc, char *argv[]) {
  *
  * @param packet Packet payload.
  * @param packet_length Length of the packet.
- * @param bitstring Current bitstring of the sender.
+ * @param bitstring Current bitstring of the sender, of *bitstring_length*
+ * bits. The element 0 holds the BFR-IDs 1 to 64.
+ * @param bitstring_length Length of the bitstring in bits.
  * @param nb_receivers_ptr Number of receivers (i.e., BFER) in the channel.
  * @return int error code.
  */
 int receive_mc_join(uint8_t *packet, ssize_t packet_length, uint64_t *bitstring,
-                    int *nb_receivers_ptr) {
+                    uint32_t bitstring_length, int *nb_receivers_ptr) {
     // Packet is: IPv6 + UDP
     // We know the bitstring length because we have a bitstring to set here
     // We do not care about the source of the packet
@@ -187,21 +215,25 @@ int receive_mc_join(uint8_t *packet, ssize_t packet_length, uint64_t *bitstring,
         (uint32_t *)&packet[sizeof(struct ip6_hdr) + sizeof(struct udphdr)];
     uint32_t join = payload[0];  // 1 if it is a join, 0 otherwise
     uint32_t bfr_id = payload[1];
+    if (bfr_id < 1 || bfr_id > bitstring_length) {
+        syslog(LOG_ERR, "BFR-ID %u does not fit in the bitstring\n", bfr_id);
+        return -1;
+    }
+    uint64_t bit = 1UL << ((bfr_id - 1) % 64);
     if (join == 1) {
         syslog(LOG_DEBUG, "Received a JOIN with BFR-ID: %d\n", bfr_id);
-        *bitstring |= 1UL << (bfr_id - 1);
+        bitstring[(bfr_id - 1) / 64] |= bit;
         ++(*nb_receivers_ptr);
     } else {
         syslog(LOG_DEBUG, "Received a LEAVE with BFR-ID: %d\n", bfr_id);
-        *bitstring &= ~(1UL << (bfr_id - 1));
+        bitstring[(bfr_id - 1) / 64] &= ~bit;
         --(*nb_receivers_ptr);
     }
-
-    syslog(LOG_DEBUG, "The bitstring is now: %lx\n", *bitstring);
+    return 0;
 }
 
 int read_packets(uint8_t *packet, ssize_t packet_length, uint64_t *bitstring,
-                 int *nb_receivers_ptr) {
+                 uint32_t bitstring_length, int *nb_receivers_ptr) {
     ssize_t read_bytes = 0;
     // Received packets are only IPv6
     while (read_bytes < packet_length) {
@@ -213,7 +245,7 @@ int read_packets(uint8_t *packet, ssize_t packet_length, uint64_t *bitstring,
 
         // Read packet
         if (receive_mc_join(packet, local_packet_length, bitstring,
-                            nb_receivers_ptr) < 0) {
+                            bitstring_length, nb_receivers_ptr) < 0) {
             return -1;
         }
 
@@ -224,16 +256,14 @@ int read_packets(uint8_t *packet, ssize_t packet_length, uint64_t *bitstring,
 }
 
 int main(int argc, char *argv[]) {
-    // Enable logs by default.
-    openlog(NULL, LOG_DEBUG | LOG_PID | LOG_PERROR, LOG_USER);
-
     args_t args;
     parse_args(&args, argc, argv);
     verbose = args.verbose;
+    // Enable logs by default, including the ones of the library.
+    bier_log_init(verbose ? LOG_DEBUG : BIER_LOG_DEFAULT_LEVEL);
 
-    // We limit the bitstring to 64 bits
     // Initially, nobody is interested in the multicast flow.
-    uint64_t bitstring = 0;
+    uint64_t bitstring[BIER_MAX_BITSTRING_LENGTH / 64] = {};
 
     // Socket for communication with the BIER daemon.
     int socket_fd = socket(AF_UNIX, SOCK_DGRAM, 0);
@@ -292,13 +322,24 @@ int main(int argc, char *argv[]) {
     }
     syslog(LOG_DEBUG, "Bound address %s to BIER daemon\n", args.loopback);
 
+    // The packets may go through shared memory, the UNIX socket remains used
+    // for the control messages
+    bier_shm_t *shm = NULL;
+    if (args.shm_nb_slots > 0) {
+        shm = bier_shm_open(socket_to_bier, &to_bier, args.sender_path,
+                            args.shm_nb_slots);
+        if (!shm) {
+            goto error1;
+        }
+    }
+
     // Start "asynchronous" procedure.
     // Receives: BFER joining the Multicast group.
     // Sends: Multicast data.
     // TODO: clean by using two pollfd because now the socket may be closed...
     int nfds = 1;
     struct pollfd pfds = {};
-    pfds.fd = socket_fd;
+    pfds.fd = shm ? bier_shm_get_fd(shm) : socket_fd;
     pfds.events = POLLIN;    // Receive
     pfds.events |= POLLOUT;  // Send
 
@@ -307,8 +348,8 @@ int main(int argc, char *argv[]) {
     int nb_receivers = 0;
     bier_info_t bier_info_out = {};
     bier_info_out.send_info.bift_id = args.bift_id;
-    bier_info_out.send_info.bitstring_length = 8;
-    bier_info_out.send_info.bitstring = (uint8_t *)&bitstring;  // Aliasing :(
+    bier_info_out.send_info.bitstring_length = args.bitstring_length / 8;
+    bier_info_out.send_info.bitstring = (uint8_t *)bitstring;
     my_packet_t *my_packet = dummy_packet(args.mc_dst);
     if (!my_packet) {
         goto error1;
@@ -316,6 +357,9 @@ int main(int argc, char *argv[]) {
 
     // Receiving information.
     uint8_t packet[2000];
+    // Several notifications may be packed in a message of the daemon
+    static bier_recv_ctx_t recv_ctx;
+    bier_recv_ctx_init(&recv_ctx, socket_fd);
     bier_info_t _bier_info_in;
     socklen_t addrlen;
     struct sockaddr_in6 _src_received = {};
@@ -340,27 +384,48 @@ int main(int argc, char *argv[]) {
                 syslog(LOG_DEBUG, "Received a join notification\n");
             }
 
-            ssize_t received = recvfrom_bier(socket_fd, packet, sizeof(packet),
-                                             (struct sockaddr *)&_src_received,
-                                             &addrlen, &_bier_info_in);
-            if (received < 0) {
-                goto error2;
-            }
-            if (read_packets(packet, received, &bitstring, &nb_receivers) < 0) {
-                syslog(LOG_DEBUG, "Error when handling the packets confirmed\n");
-                goto error2;
-            }
+            // The shared memory channel is drained until it is empty, so
+            // that its file descriptor is notified again. The packets kept
+            // in the receive context do not make the socket readable
+            do {
+                ssize_t received =
+                    shm ? bier_shm_recv(shm, packet, sizeof(packet),
+                                        (struct sockaddr *)&_src_received,
+                                        &addrlen, &_bier_info_in, MSG_DONTWAIT)
+                        : recvfrom_bier(&recv_ctx, packet, sizeof(packet),
+                                        (struct sockaddr *)&_src_received,
+                                        &addrlen, &_bier_info_in);
+                if (received < 0) {
+                    if (shm && errno == EAGAIN) {
+                        break;
+                    }
+                    goto error2;
+                }
+                if (read_packets(packet, received, bitstring,
+                                 args.bitstring_length, &nb_receivers) < 0) {
+                    syslog(LOG_DEBUG,
+                           "Error when handling the packets confirmed\n");
+                    goto error2;
+                }
+            } while (shm || bier_recv_pending(&recv_ctx));
 
             pfds.events |= POLLOUT;
         } else if (pfds.revents & POLLOUT) {
             if (nb_receivers) {
                 syslog(LOG_DEBUG, "Send out a packet\n");
 
-                ssize_t nb_sent = sendto_bier(
-                    socket_to_bier, my_packet->packet, my_packet->packet_length,
-                    (struct sockaddr *)&to_bier, sizeof(to_bier), 6,
-                    &bier_info_out);
+                ssize_t nb_sent =
+                    shm ? bier_shm_send(shm, my_packet->packet,
+                                        my_packet->packet_length, 6,
+                                        &bier_info_out)
+                        : sendto_bier(socket_to_bier, my_packet->packet,
+                                      my_packet->packet_length,
+                                      (struct sockaddr *)&to_bier,
+                                      sizeof(to_bier), 6, &bier_info_out);
                 if (nb_sent < 0) {
+                    if (shm && errno == EAGAIN) {
+                        continue;  // The daemon is late, retry
+                    }
                     goto error2;
                 }
 
@@ -388,13 +453,16 @@ int main(int argc, char *argv[]) {
     syslog(LOG_DEBUG, "Sent %d packets... Closing\n", args.nb_packets_to_send);
 
     // Close and quit.
+    if (shm) {
+        bier_shm_close(shm);
+    }
     close(socket_fd);
     close(socket_to_bier);
-    free(my_packet);
+    release_ipv6_packet(my_packet);
     exit(EXIT_SUCCESS);
 
 error2:
-    free(my_packet);
+    release_ipv6_packet(my_packet);
 error1:
     close(socket_fd);
     exit(EXIT_FAILURE);
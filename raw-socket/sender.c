@@ -6,6 +6,7 @@
 #include <sys/un.h>
 #include <unistd.h>
 
+#include "include/bier-log.h"
 #include "include/public/bier.h"
 #include "include/public/multicast.h"
 
@@ -43,6 +44,35 @@ my_packet_t *dummy_packet(char *mc_dst_addr) {
     return packet;
 }
 
+/**
+ * @brief Parses the hexadecimal bitstring *str* of at most
+ * BIER_MAX_BITSTRING_LENGTH bits. The last digit holds the BFR-IDs 1 to 4
+ *
+ * @param bitstring set to the bitstring in the format of sendto_bier
+ * @return size_t the length of the bitstring in bytes, 0 on error or if no
+ * bit is set
+ */
+size_t parse_bitstring(const char *str, uint64_t *bitstring) {
+    size_t nb_digits = strlen(str);
+    if (nb_digits == 0 || nb_digits > BIER_MAX_BITSTRING_LENGTH / 4) {
+        return 0;
+    }
+    memset(bitstring, 0, BIER_MAX_BITSTRING_LENGTH / 8);
+    bool has_bit = false;
+    for (size_t i = 0; i < nb_digits; ++i) {
+        char digit[2] = {str[nb_digits - 1 - i], '\0'};
+        char *end;
+        uint64_t value = strtoul(digit, &end, 16);
+        if (*end != '\0') {
+            return 0;
+        }
+        bitstring[i / 16] |= value << (4 * (i % 16));
+        has_bit |= value != 0;
+    }
+    // Whole 64 bits words, the daemon adapts it to the BSL of the BIFT
+    return has_bit ? (nb_digits + 15) / 16 * 8 : 0;
+}
+
 int main(int argc, char *argv[]) {
     if (argc < 8) {
         fprintf(stderr,
@@ -51,6 +81,8 @@ int main(int argc, char *argv[]) {
                 argv[0]);
         exit(EXIT_SUCCESS);
     }
+    // Print the errors of the library on stderr
+    bier_log_init(BIER_LOG_DEFAULT_LEVEL);
     int socket_fd = socket(AF_UNIX, SOCK_DGRAM, 0);
     if (socket_fd == -1) {
         perror("socket");
@@ -108,8 +140,9 @@ int main(int argc, char *argv[]) {
         exit(EXIT_FAILURE);
     }
 
-    uint64_t bitstring_arg = (uint64_t)strtoull(argv[3], NULL, 16);
-    if (bitstring_arg == 0) {
+    uint64_t bitstring[BIER_MAX_BITSTRING_LENGTH / 64];
+    size_t bitstring_length = parse_bitstring(argv[3], bitstring);
+    if (bitstring_length == 0) {
         fprintf(stderr,
                 "Cannot convert forwarding bitmask or no receiver is marked! "
                 "Given: %s\n",
@@ -117,7 +150,7 @@ int main(int argc, char *argv[]) {
         close(socket_fd);
         exit(EXIT_FAILURE);
     }
-    printf("Bitstring: %lx\n", bitstring_arg);
+    printf("Bitstring: %s\n", argv[3]);
 
     int bift_id = atoi(argv[4]);
     if (bift_id == 0) {
@@ -130,12 +163,12 @@ int main(int argc, char *argv[]) {
     if (!packet) {
         exit(EXIT_FAILURE);
     }
-    printf("First byte of payload: %x (%lu bytes long)\n", packet->packet[0],
+    printf("First byte of payload: %x (%u bytes long)\n", packet->packet[0],
            packet->packet_length);
 
     bier_info_t bier_info = {};
-    bier_info.send_info.bitstring = (uint8_t *)&bitstring_arg;
-    bier_info.send_info.bitstring_length = 8;
+    bier_info.send_info.bitstring = (uint8_t *)bitstring;
+    bier_info.send_info.bitstring_length = bitstring_length;
     bier_info.send_info.bift_id = bift_id;
     fprintf(stderr, "The BIFT-ID is %lu\n", bier_info.send_info.bift_id);
 
@@ -158,6 +191,7 @@ int main(int argc, char *argv[]) {
         sleep(1);
     }
 
+    release_ipv6_packet(packet);
     close(socket_fd);
     exit(EXIT_SUCCESS);
 }
\ No newline at end of file
@@ -0,0 +1,40 @@
+#include "../include/bier-log.h"
+
+#include <stdio.h>
+#include <string.h>
+
+volatile sig_atomic_t bier_log_level = BIER_LOG_DEFAULT_LEVEL;
+
+static void bier_log_signal_handler(int sig) {
+    if (sig == SIGUSR1 && bier_log_level < LOG_DEBUG) {
+        ++bier_log_level;
+    } else if (sig == SIGUSR2 && bier_log_level > LOG_EMERG) {
+        --bier_log_level;
+    }
+}
+
+void bier_log_init(int level) {
+    openlog(NULL, LOG_PID | LOG_PERROR, LOG_USER);
+    bier_log_level = level;
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = bier_log_signal_handler;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(SIGUSR1, &sa, NULL) < 0 ||
+        sigaction(SIGUSR2, &sa, NULL) < 0) {
+        log_perror("sigaction log level");
+    }
+}
+
+void bier_log_hexdump(int level, const char *message, const uint8_t *data,
+                      size_t length) {
+    // Long dumps are truncated
+    char hex[2 * 256 + 1] = {};
+    size_t nb_bytes = length < 256 ? length : 256;
+    for (size_t i = 0; i < nb_bytes; ++i) {
+        snprintf(&hex[2 * i], 3, "%02x", data[i]);
+    }
+    syslog(level, "%s %s%s", message, hex, nb_bytes < length ? "..." : "");
+}
@@ -1,36 +1,55 @@
 #include "../include/bier-sender.h"
 
+#include "../include/bier-log.h"
 #include "../include/bier.h"
+#include "../include/bitstring.h"
+#include "../include/pktbuf.h"
+
+_Static_assert(sizeof(bier_header_t) <= BIER_PKTBUF_PRIV_SIZE &&
+                   sizeof(my_packet_t) <= BIER_PKTBUF_PRIV_SIZE,
+               "The descriptors live in the private area of their buffer");
+
+/**
+ * @brief Takes a buffer from the pool of the calling thread
+ */
+static bier_pktbuf_t *alloc_pktbuf(void) {
+    bier_pktbuf_pool_t *pool = bier_pktbuf_thread_pool();
+    if (!pool) {
+        return NULL;
+    }
+    bier_pktbuf_t *buf = bier_pktbuf_alloc(pool);
+    if (!buf) {
+        log_err("The %u packet buffers of the thread are in use",
+                pool->nb_bufs);
+    }
+    return buf;
+}
 
 bier_header_t *init_bier_header(const uint64_t *bitstring,
                                 const uint32_t bitstring_length,
                                 uint8_t bier_proto, int bift_id) {
-    bier_header_t *bh = (bier_header_t *)malloc(sizeof(bier_header_t));
-    if (!bh) {
-        perror("malloc bh");
+    const int bier_bsl = bier_bsl_encode(bitstring_length);
+    if (bier_bsl < 0) {
+        log_err("Invalid bitstring length: %u", bitstring_length);
+        return NULL;
+    }
+    bier_pktbuf_t *buf = alloc_pktbuf();
+    if (!buf) {
         return NULL;
     }
-    memset(bh, 0, sizeof(bier_header_t));
+    bier_header_t *bh = (bier_header_t *)buf->priv;
 
     const uint32_t bier_header_length = 12;
     const uint32_t bitstring_length_bytes = bitstring_length / 8;
-    // const uint32_t bier_bsl = 1; //log2(bitstring_length) - 5;
-    const uint32_t bier_bsl = (log(bitstring_length) / log(2)) - 5;
     bh->header_length = bier_header_length + bitstring_length_bytes;
 
-    bh->_header = (uint8_t *)malloc(sizeof(uint8_t) * bh->header_length);
-    if (!bh->_header) {
-        perror("bh header");
-        free(bh);
-        return NULL;
-    }
+    bh->_header = bier_pktbuf_append(buf, bh->header_length);
     memset(bh->_header, 0, sizeof(uint8_t) * bh->header_length);
 
     set_bier_proto(bh->_header, bier_proto);
 
-    for (uint16_t i = 0; i < bitstring_length_bytes / 8; ++i) {
-        set_bitstring(bh->_header, i, bitstring[i]);
-    }
+    bitstring_store((uint8_t *)get_bitstring_ptr(bh->_header), bitstring,
+                    bitstring_length / 64);
     set_bier_bsl(bh->_header, bier_bsl);
 
     set_bier_bift_id(bh->_header, bift_id);
@@ -39,8 +58,7 @@ bier_header_t *init_bier_header(const uint64_t *bitstring,
 }
 
 void release_bier_header(bier_header_t *bh) {
-    free(bh->_header);
-    free(bh);
+    bier_pktbuf_release(bier_pktbuf_from_priv(bh));
 }
 
 void set_bh_proto(bier_header_t *bh, uint8_t proto) {
@@ -49,46 +67,126 @@ void set_bh_proto(bier_header_t *bh, uint8_t proto) {
 
 void update_bh_bitstring(bier_header_t *bh, const uint32_t bitstring_length,
                          uint64_t *bitstring) {
-    for (uint16_t i = 0; i < bitstring_length / 8; ++i) {
-        set_bitstring(bh->_header, i, bitstring[i]);
-    }
+    bitstring_store((uint8_t *)get_bitstring_ptr(bh->_header), bitstring,
+                    bitstring_length / 64);
 }
 
 void my_packet_free(my_packet_t *my_packet) {
-    free(my_packet->packet);
-    free(my_packet);
+    bier_pktbuf_release_my_packet(my_packet);
+}
+
+my_packet_t *my_packet_alloc(const uint32_t length) {
+    bier_pktbuf_t *buf = alloc_pktbuf();
+    if (!buf) {
+        return NULL;
+    }
+    if (!bier_pktbuf_append(buf, length)) {
+        log_err("Packet of %u bytes longer than a packet buffer", length);
+        bier_pktbuf_release(buf);
+        return NULL;
+    }
+    return bier_pktbuf_my_packet(buf);
+}
+
+my_packet_t *encap_bier_packet_in_place(const bier_header_t *bh,
+                                        my_packet_t *my_packet) {
+    bier_pktbuf_t *buf = bier_pktbuf_from_priv(my_packet);
+    uint8_t *bier_header = bier_pktbuf_prepend(buf, bh->header_length);
+    if (!bier_header) {
+        log_err("Not enough headroom for the BIER header of %u bytes",
+                bh->header_length);
+        return NULL;
+    }
+    memcpy(bier_header, bh->_header, bh->header_length);
+    return bier_pktbuf_my_packet(buf);
 }
 
 my_packet_t *encap_bier_packet(bier_header_t *bh, const uint32_t payload_length,
                                uint8_t *payload) {
-    printf("Payload here: %u\n", payload_length);
-    const uint32_t packet_total_length = bh->header_length + payload_length;
-
-    my_packet_t *my_packet = (my_packet_t *)malloc(sizeof(my_packet_t));
+    log_debug("Payload here: %u", payload_length);
+    my_packet_t *my_packet = my_packet_alloc(payload_length);
     if (!my_packet) {
-        perror("malloc my_packet");
         return NULL;
     }
-    memset(my_packet, 0, sizeof(my_packet_t));
-
-    my_packet->packet_length = packet_total_length;
-    my_packet->packet =
-        (uint8_t *)malloc(sizeof(uint8_t) * packet_total_length);
-    if (!my_packet->packet) {
-        perror("malloc packet");
-        free(my_packet);
+    // Copy the payload of the packet inside the packet buffer
+    memcpy(my_packet->packet, payload, sizeof(uint8_t) * payload_length);
+    if (!encap_bier_packet_in_place(bh, my_packet)) {
+        my_packet_free(my_packet);
         return NULL;
     }
-    memset(my_packet->packet, 0, sizeof(uint8_t) * packet_total_length);
+    return my_packet;
+}
 
-    uint8_t *bier_header = my_packet->packet;
-    memcpy(bier_header, bh->_header, bh->header_length);
+uint8_t *encap_bier_packet_in_headroom(uint8_t *buffer, uint8_t *payload,
+                                       const uint8_t *bitstring,
+                                       uint32_t bitstring_length,
+                                       uint8_t bier_proto, int bift_id) {
+    const int bier_bsl = bier_bsl_encode(bitstring_length);
+    if (bier_bsl < 0) {
+        log_err("Invalid bitstring length: %u", bitstring_length);
+        return NULL;
+    }
+    const uint32_t header_length = 12 + bitstring_length / 8;
+    if (payload - buffer < header_length) {
+        log_err("Not enough headroom for the BIER header: %ld < %u",
+                payload - buffer, header_length);
+        return NULL;
+    }
+    // The bitstring may be overwritten by the header
+    uint64_t bitstring_words[bitstring_length / 64];
+    memcpy(bitstring_words, bitstring, bitstring_length / 8);
+
+    uint8_t *header = payload - header_length;
+    memset(header, 0, 12);
+    set_bier_proto(header, bier_proto);
+    bitstring_store((uint8_t *)get_bitstring_ptr(header), bitstring_words,
+                    bitstring_length / 64);
+    set_bier_bsl(header, bier_bsl);
+    set_bier_bift_id(header, bift_id);
+    return header;
+}
 
-    // Copy the payload of the packet inside the packet buffer
-    uint8_t *packet_payload = (uint8_t *)&my_packet->packet[bh->header_length];
-    memcpy(packet_payload, payload, sizeof(uint8_t) * payload_length);
+/**
+ * @brief FNV-1a hash of *length* bytes of *data*, continuing from *hash*
+ */
+static uint32_t fnv1a(uint32_t hash, const uint8_t *data, size_t length) {
+    for (size_t i = 0; i < length; ++i) {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
 
-    return my_packet;
+uint32_t bier_flow_entropy(const uint8_t *payload, size_t payload_length,
+                           uint8_t bier_proto) {
+    uint32_t hash = 2166136261u;
+    size_t l4_offset;
+    uint8_t l4_proto;
+    if (bier_proto == BIERPROTO_IPV6 && payload_length >= 40) {
+        // Flow label, next header and addresses
+        uint8_t flow_label[3] = {payload[1] & 0x0f, payload[2], payload[3]};
+        hash = fnv1a(hash, flow_label, sizeof(flow_label));
+        hash = fnv1a(hash, &payload[6], 1);
+        hash = fnv1a(hash, &payload[8], 32);
+        l4_proto = payload[6];
+        l4_offset = 40;
+    } else if (bier_proto == BIERPROTO_IPV4 && payload_length >= 20) {
+        // Protocol and addresses. The ports are only in the first fragment
+        hash = fnv1a(hash, &payload[9], 1);
+        hash = fnv1a(hash, &payload[12], 8);
+        l4_proto = payload[9];
+        l4_offset = (payload[6] & 0x1f) || payload[7]
+                        ? payload_length
+                        : (size_t)(payload[0] & 0x0f) * 4;
+    } else {
+        return 0;
+    }
+    if ((l4_proto == IPPROTO_UDP || l4_proto == IPPROTO_TCP ||
+         l4_proto == IPPROTO_SCTP) &&
+        l4_offset + 4 <= payload_length) {
+        hash = fnv1a(hash, &payload[l4_offset], 4);
+    }
+    // Fold the 32 bits hash on the 20 bits of the entropy
+    return (hash ^ (hash >> 20)) & 0xfffff;
 }
 
 my_packet_t *create_bier_ipv6_from_payload(bier_header_t *bh,
@@ -96,22 +194,19 @@ my_packet_t *create_bier_ipv6_from_payload(bier_header_t *bh,
                                            struct in6_addr *mc_dst,
                                            const uint32_t payload_length,
                                            const uint8_t *payload) {
-    fprintf(stderr, "dummy_packet %p %u\t", payload, payload_length);
-    for (int i = 0; i < payload_length; i++) {
-        fprintf(stderr, "%x", *(payload + i));
-    }
-    fprintf(stderr, "\n");
+    log_hex(LOG_DEBUG, "dummy_packet", payload, payload_length);
 
     const uint32_t ipv6_header_length = 40;
     const uint32_t udp_header_length = 8;
-    const uint32_t packet_total_length =
-        ipv6_header_length + udp_header_length + payload_length;
-    uint8_t *packet = (uint8_t *)malloc(sizeof(uint8_t) * packet_total_length);
-    if (!packet) {
-        perror("packet");
+    // The IPv6 packet is built once, the BIER header is written in front of
+    // it
+    my_packet_t *my_packet = my_packet_alloc(
+        ipv6_header_length + udp_header_length + payload_length);
+    if (!my_packet) {
         return NULL;
     }
-    memset(packet, 0, sizeof(uint8_t) * packet_total_length);
+    uint8_t *packet = my_packet->packet;
+    memset(packet, 0, ipv6_header_length + udp_header_length);
     // Encapsulated IPv6 Header
     struct ip6_hdr *ipv6_header = (struct ip6_hdr *)packet;
     ipv6_header->ip6_flow = htonl((6 << 28) | (0 << 20) | 0);
@@ -137,11 +232,9 @@ my_packet_t *create_bier_ipv6_from_payload(bier_header_t *bh,
         udp_checksum(udp_header, sizeof(struct udphdr) + payload_length,
                      &ipv6_header->ip6_src, &ipv6_header->ip6_dst);
 
-    my_packet_t *my_packet = encap_bier_packet(bh, packet_total_length, packet);
-    if (!my_packet) {
+    if (!encap_bier_packet_in_place(bh, my_packet)) {
+        my_packet_free(my_packet);
         return NULL;
     }
-
-    free(packet);
     return my_packet;
 }
\ No newline at end of file
@@ -1,5 +1,15 @@
+#define _GNU_SOURCE  // sendmmsg
+
 #include "../include/bier.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "../include/bier-log.h"
+#include "../include/bitstring.h"
 #include "../include/qcbor-encoding.h"
 #include "../include/public/common.h"
 
@@ -15,39 +25,56 @@ void clean_line_break(char *line) {
     }
 }
 
+// Long enough for a BSL of 4096
+#define BITSTRING_STR_SIZE (17 * 64 + 1)
+
+/**
+ * @brief Format the words of a host byte order bitstring, most significant
+ * first, in *str* of BITSTRING_STR_SIZE bytes
+ */
+static char *format_bitstring(char *str, const uint64_t *bitstring_ptr,
+                              uint32_t bitstring_max_idx) {
+    size_t offset = 0;
+    str[0] = '\0';
+    for (int i = bitstring_max_idx - 1; i >= 0 && offset < BITSTRING_STR_SIZE;
+         --i) {
+        offset += snprintf(&str[offset], BITSTRING_STR_SIZE - offset, "%lx ",
+                           bitstring_ptr[i]);
+    }
+    return str;
+}
+
 void print_bitstring_message(char *message, uint64_t *bitstring_ptr,
                              uint32_t bitstring_max_idx) {
-    printf("%s ", message);
-    for (int i = bitstring_max_idx - 1; i >= 0; --i) {
-        printf("%lx ", bitstring_ptr[i]);
+    if (!bier_log_enabled(LOG_DEBUG)) {
+        return;
     }
-    printf("\n");
+    char str[BITSTRING_STR_SIZE];
+    log_debug("%s %s", message,
+              format_bitstring(str, bitstring_ptr, bitstring_max_idx));
 }
 
 void print_bft(bier_internal_t *bft) {
-    printf("=== Summary ===\n");
-    printf("Local BFR ID: %d\n", bft->local_bfr_id);
-    printf("Bitstring length: %d\n", bft->bitstring_length);
-    printf("BFT:\n");
+    if (!bier_log_enabled(LOG_INFO)) {
+        return;
+    }
+    log_info("=== Summary ===");
+    log_info("Local BFR ID: %d", bft->local_bfr_id);
+    log_info("Bitstring length: %d", bft->bitstring_length);
+    log_info("BFT:");
     uint32_t bitstring_max_idx = bft->bitstring_length / 64;
     for (int i = 0; i < bft->nb_bft_entry; ++i) {
         bier_bft_entry_t *bft_entry = bft->bft[i];
-        printf("    #%u: ID=%u", i + 1, bft_entry->bfr_id);
-        if (bft_entry->nb_ecmp_entries > 1) {
-            printf(" (ECMP=%u)", bft_entry->nb_ecmp_entries);
-        }
-        printf(": ");
         for (int ecmp_entry = 0; ecmp_entry < bft_entry->nb_ecmp_entries;
              ++ecmp_entry) {
             bier_bft_entry_ecmp_t *ecmp_map = bft_entry->ecmp_entry[ecmp_entry];
-            for (uint32_t j = 0; j < bitstring_max_idx; ++j) {
-                printf("%lx ", ecmp_map->forwarding_bitmask[j]);
-            }
-            if (ecmp_entry < bft_entry->nb_ecmp_entries - 1) {
-                printf(", ");
-            }
+            char str[BITSTRING_STR_SIZE];
+            log_info("    #%u: ID=%u (ECMP %d/%u): %s", i + 1,
+                     bft_entry->bfr_id, ecmp_entry + 1,
+                     bft_entry->nb_ecmp_entries,
+                     format_bitstring(str, ecmp_map->forwarding_bitmask,
+                     bitstring_max_idx));
         }
-        printf("\n");
     }
 }
 
@@ -57,8 +84,8 @@ bier_bft_entry_t *parse_line(char *line_config, uint32_t bitstring_length, bool
 
     bier_bft_entry_t *bier_entry = malloc(sizeof(bier_bft_entry_t));
     if (!bier_entry) {
-        fprintf(stderr, "Cannot allocate memory for the bier entry\n");
-        perror("malloc");
+        log_err("Cannot allocate memory for the bier entry");
+        log_perror("malloc");
         return NULL;
     }
     memset(bier_entry, 0, sizeof(bier_bft_entry_t));
@@ -70,7 +97,7 @@ bier_bft_entry_t *parse_line(char *line_config, uint32_t bitstring_length, bool
     }
     int bfr_id = atoi(ptr);
     if (bfr_id == 0) {
-        fprintf(stderr, "Cannot convert BFR ID: %s\n", ptr);
+        log_err("Cannot convert BFR ID: %s", ptr);
         return NULL;
     }
 
@@ -81,14 +108,14 @@ bier_bft_entry_t *parse_line(char *line_config, uint32_t bitstring_length, bool
     }
     int nb_ecmp = atoi(ptr);
     if (nb_ecmp == 0) {
-        fprintf(stderr, "Cannot convert the number of ECMP paths: %s\n", ptr);
+        log_err("Cannot convert the number of ECMP paths: %s", ptr);
         return NULL;
     }
     bier_entry->nb_ecmp_entries = nb_ecmp;
     bier_entry->ecmp_entry = (bier_bft_entry_ecmp_t **)malloc(
         sizeof(bier_bft_entry_ecmp_t *) * nb_ecmp);
     if (!bier_entry->ecmp_entry) {
-        perror("malloc ecmp entry");
+        log_perror("malloc ecmp entry");
         return NULL;
     }
 
@@ -97,18 +124,18 @@ bier_bft_entry_t *parse_line(char *line_config, uint32_t bitstring_length, bool
         bier_bft_entry_ecmp_t *entry_ecmp =
             (bier_bft_entry_ecmp_t *)malloc(sizeof(bier_bft_entry_ecmp_t));
         if (!entry_ecmp) {
-            fprintf(stderr, "Cannot allocate memory for the entry\n");
+            log_err("Cannot allocate memory for the entry");
             return NULL;
         }
         memset(entry_ecmp, 0, sizeof(bier_bft_entry_ecmp_t));
 
         entry_ecmp->forwarding_bitmask = (uint64_t *)malloc(bitstring_length);
         if (!entry_ecmp->forwarding_bitmask) {
-            perror("malloc forwarding bitmask");
+            log_perror("malloc forwarding bitmask");
             // TODO: free allocated memory
             return NULL;
         }
-        memset(entry_ecmp->forwarding_bitmask, 0, sizeof(bitstring_length));
+        memset(entry_ecmp->forwarding_bitmask, 0, bitstring_length / 8);
 
         ptr = strtok(NULL, delim);
         if (ptr == NULL) {
@@ -127,8 +154,8 @@ bier_bft_entry_t *parse_line(char *line_config, uint32_t bitstring_length, bool
             }
             char c = ptr[i];
             if (c == '1') {
-                entry_ecmp->forwarding_bitmask[bitstring_word_iter] +=
-                    1 << bitstring_iter;
+                entry_ecmp->forwarding_bitmask[bitstring_word_iter] |=
+                    (uint64_t)1 << bitstring_iter;
             }
             ++bitstring_iter;
         }
@@ -143,14 +170,14 @@ bier_bft_entry_t *parse_line(char *line_config, uint32_t bitstring_length, bool
         if (use_ipv4) {
             entry_ecmp->bfr_nei_addr.v4.sin_family = AF_INET;
             err = inet_pton(AF_INET, ptr, &entry_ecmp->bfr_nei_addr.v4.sin_addr.s_addr);
-            fprintf(stderr, "Gonna parse this address: %s\n", ptr);
+            log_debug("Gonna parse this address: %s", ptr);
         } else {
             entry_ecmp->bfr_nei_addr.v6.sin6_family = AF_INET6;
             err = inet_pton(AF_INET6, ptr, entry_ecmp->bfr_nei_addr.v6.sin6_addr.s6_addr);
         }
         if (err != 1) {
-            fprintf(stderr, "Cannot convert neighbour address: %s (err is %d)\n", ptr, err);
-            perror("inet_ntop bfr_nei_addr 2");
+            log_err("Cannot convert neighbour address: %s (err is %d)", ptr, err);
+            log_perror("inet_ntop bfr_nei_addr 2");
             return NULL;
         }
 
@@ -162,7 +189,7 @@ bier_bft_entry_t *parse_line(char *line_config, uint32_t bitstring_length, bool
 
 empty_string:
     // TODO: adapt and clean that
-    fprintf(stderr, "Empty string: not complete line\n");
+    log_err("Empty string: not complete line");
     /*if (bier_entry)
     {
         if (bier_entry->forwarding_bitmask)
@@ -174,68 +201,365 @@ empty_string:
     return NULL;
 }
 
-void free_bier_bft(bier_bift_t *bift) {
-    for (int bift_id = 0; bift_id < bift->nb_bift; ++bift_id) {
-        bier_internal_t *bft = bift->b[bift_id].bier;  // bier_bift[bift_id];
-        for (int i = 0; i < bft->nb_bft_entry; ++i) {
-            if (bft->bft[i]) {
-                for (int j = 0; j < bft->bft[i]->nb_ecmp_entries; ++j) {
-                    if (bft->bft[i]->ecmp_entry[j]) {
-                        free(bft->bft[i]->ecmp_entry[j]);
-                    }
-                }
-                free(bft->bft[i]);
-            }
+static void free_bft_entry(void *ptr) {
+    bier_bft_entry_t *entry = (bier_bft_entry_t *)ptr;
+    for (int j = 0; j < entry->nb_ecmp_entries; ++j) {
+        if (entry->ecmp_entry[j]) {
+            free(entry->ecmp_entry[j]->forwarding_bitmask);
+            free(entry->ecmp_entry[j]);
         }
-        free(bft->bft);
-        free(bft);
     }
+    free(entry->ecmp_entry);
+    free(entry);
+}
+
+void free_bier_internal_bier(bier_internal_t *bft) {
+    for (int i = 0; i < bft->nb_bft_entry; ++i) {
+        if (bft->bft[i]) {
+            free_bft_entry(bft->bft[i]);
+        }
+    }
+    free_compiled_bft(bft->compiled);
+    free(bft->bft);
+    free(bft);
+}
+
+void free_bier_internal_bier_te(bier_te_internal_t *bft) {
+    free(bft->global_bitstring);
+    free(bft->bfr_nei_addr);
+    free(bft->adj_to_bp);
+    free(bft->nei_stats);
+    free(bft->adj_bitmask);
+    free(bft->bp_adj_start);
+    free(bft->bp_adj);
+    free(bft);
+}
+
+void free_bier_bft(bier_bift_t *bift) {
+    bier_bift_table_t *table = atomic_load(&bift->table);
+    if (table) {
+        free_bier_bift_table(table);
+    }
+    free(bift->stats);
+    free(bift->workers);
+    free_tx_queue(bift->tx);
     if (bift->socket >= 0) {
         close(bift->socket);
     }
     free(bift);
 }
 
+static bool same_neighbour(const bier_nei_addr_t *a, const bier_nei_addr_t *b,
+                           bool use_ipv4) {
+    if (use_ipv4) {
+        return a->v4.sin_addr.s_addr == b->v4.sin_addr.s_addr &&
+               a->v4.sin_port == b->v4.sin_port;
+    }
+    return memcmp(a->v6.sin6_addr.s6_addr, b->v6.sin6_addr.s6_addr,
+                  sizeof(a->v6.sin6_addr.s6_addr)) == 0 &&
+           a->v6.sin6_port == b->v6.sin6_port;
+}
+
+#define CACHE_LINE_SIZE 64
+
+/**
+ * @brief Reserve `size` bytes in the slab pointed by `cursor`, keeping every
+ * array on its own cache line.
+ */
+static void *slab_carve(uint8_t **cursor, size_t size) {
+    void *ptr = *cursor;
+    *cursor += (size + CACHE_LINE_SIZE - 1) & ~(size_t)(CACHE_LINE_SIZE - 1);
+    return ptr;
+}
+
+/**
+ * @brief Jump consistent hash (Lamping and Veach): bucket of *key* among
+ * *nb_buckets*. Adding a bucket only moves the keys that go to the new one
+ */
+static int32_t jump_consistent_hash(uint64_t key, int32_t nb_buckets) {
+    int64_t b = -1, j = 0;
+    while (j < nb_buckets) {
+        b = j;
+        key = key * 2862933555777941757ULL + 1;
+        j = (b + 1) * ((double)(1LL << 31) / (double)((key >> 33) + 1));
+    }
+    return b;
+}
+
+void free_compiled_bft(bier_bft_compiled_t *compiled) {
+    if (!compiled) {
+        return;
+    }
+    free(compiled->slab);
+    free(compiled->nei_stats);
+    free(compiled);
+}
+
+bier_bft_compiled_t *compile_bier_bft(bier_internal_t *bier_bft,
+                                      bool use_ipv4) {
+    uint32_t bitstring_max_idx = bier_bft->bitstring_length / 64;
+    uint32_t nb_bfr = bier_bft->nb_bft_entry;
+    uint32_t ecmp_stride = 1;
+    uint32_t nb_ecmp_total = 0;
+    for (uint32_t i = 0; i < nb_bfr; ++i) {
+        if (bier_bft->bft[i]) {
+            if ((uint32_t)bier_bft->bft[i]->nb_ecmp_entries > ecmp_stride) {
+                ecmp_stride = bier_bft->bft[i]->nb_ecmp_entries;
+            }
+            nb_ecmp_total += bier_bft->bft[i]->nb_ecmp_entries;
+        }
+    }
+    if (ecmp_stride > UINT8_MAX) {
+        log_err("Too many ECMP entries: %u", ecmp_stride);
+        return NULL;
+    }
+
+    // Find the distinct neighbours first to size the slab
+    uint32_t nb_neighbours = 0;
+    uint32_t ecmp_nei[nb_bfr * ecmp_stride];
+    bier_nei_addr_t nei_addr[nb_ecmp_total > 0 ? nb_ecmp_total : 1];
+    memset(ecmp_nei, 0, sizeof(ecmp_nei));
+    for (uint32_t i = 0; i < nb_bfr; ++i) {
+        bier_bft_entry_t *bft_entry = bier_bft->bft[i];
+        for (int j = 0; bft_entry && j < bft_entry->nb_ecmp_entries; ++j) {
+            bier_nei_addr_t *addr =
+                (bier_nei_addr_t *)&bft_entry->ecmp_entry[j]->bfr_nei_addr;
+            uint32_t nei_idx;
+            for (nei_idx = 0; nei_idx < nb_neighbours; ++nei_idx) {
+                if (same_neighbour(&nei_addr[nei_idx], addr, use_ipv4)) {
+                    break;
+                }
+            }
+            if (nei_idx == nb_neighbours) {
+                memcpy(&nei_addr[nei_idx], addr, sizeof(bier_nei_addr_t));
+                ++nb_neighbours;
+            }
+            ecmp_nei[i * ecmp_stride + j] = nei_idx;
+        }
+    }
+
+    bier_bft_compiled_t *compiled =
+        (bier_bft_compiled_t *)malloc(sizeof(bier_bft_compiled_t));
+    if (!compiled) {
+        log_perror("Malloc compiled BFT");
+        return NULL;
+    }
+    memset(compiled, 0, sizeof(bier_bft_compiled_t));
+    compiled->bitstring_max_idx = bitstring_max_idx;
+    compiled->nb_bfr = nb_bfr;
+    compiled->ecmp_stride = ecmp_stride;
+    compiled->nb_neighbours = nb_neighbours;
+    // Outside of the bitstring if the router is in another set
+    compiled->local_idx = bier_bft->local_bfr_id - 1 -
+                          (int)(bier_bft->si * bier_bft->bitstring_length);
+
+    size_t bitstring_size = sizeof(uint64_t) * bitstring_max_idx;
+    size_t sizes[] = {
+        bitstring_size,                                // known_bitmask
+        bitstring_size,                                // ecmp_bitmask
+        bitstring_size,                                // local_bitmask
+        bitstring_size * nb_neighbours,                // nei_bitmask
+        sizeof(bier_nei_addr_t) * nb_neighbours,       // nei_addr
+        sizeof(uint8_t) * nb_bfr,                      // nb_ecmp
+        sizeof(uint32_t) * nb_bfr * ecmp_stride,       // ecmp_nei
+        bitstring_size * nb_bfr * ecmp_stride,         // ecmp_fbm
+        (ecmp_stride + 1) * BIER_ECMP_SELECT_SIZE,     // ecmp_select
+    };
+    size_t slab_size = 0;
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+        slab_size += (sizes[i] + CACHE_LINE_SIZE - 1) &
+                     ~(size_t)(CACHE_LINE_SIZE - 1);
+    }
+    if (posix_memalign(&compiled->slab, CACHE_LINE_SIZE, slab_size) != 0) {
+        log_perror("Malloc compiled BFT slab");
+        free(compiled);
+        return NULL;
+    }
+    memset(compiled->slab, 0, slab_size);
+    compiled->nei_stats = (bier_nei_stats_t *)calloc(
+        nb_neighbours > 0 ? nb_neighbours : 1, sizeof(bier_nei_stats_t));
+    if (!compiled->nei_stats) {
+        log_perror("Malloc compiled BFT neighbour stats");
+        free_compiled_bft(compiled);
+        return NULL;
+    }
+    uint8_t *cursor = (uint8_t *)compiled->slab;
+    compiled->known_bitmask = slab_carve(&cursor, sizes[0]);
+    compiled->ecmp_bitmask = slab_carve(&cursor, sizes[1]);
+    compiled->local_bitmask = slab_carve(&cursor, sizes[2]);
+    compiled->nei_bitmask = slab_carve(&cursor, sizes[3]);
+    compiled->nei_addr = slab_carve(&cursor, sizes[4]);
+    compiled->nb_ecmp = slab_carve(&cursor, sizes[5]);
+    compiled->ecmp_nei = slab_carve(&cursor, sizes[6]);
+    compiled->ecmp_fbm = slab_carve(&cursor, sizes[7]);
+    compiled->ecmp_select = slab_carve(&cursor, sizes[8]);
+
+    memcpy(compiled->nei_addr, nei_addr,
+           sizeof(bier_nei_addr_t) * nb_neighbours);
+    memcpy(compiled->ecmp_nei, ecmp_nei, sizeof(ecmp_nei));
+    // Adding an ECMP entry at the end only moves the flows of the slots it
+    // takes over
+    for (uint32_t n = 1; n <= ecmp_stride; ++n) {
+        for (uint32_t slot = 0; slot < BIER_ECMP_SELECT_SIZE; ++slot) {
+            compiled->ecmp_select[n * BIER_ECMP_SELECT_SIZE + slot] =
+                jump_consistent_hash(slot, n);
+        }
+    }
+
+    for (uint32_t i = 0; i < nb_bfr; ++i) {
+        bier_bft_entry_t *bft_entry = bier_bft->bft[i];
+        if (!bft_entry) {
+            continue;
+        }
+        compiled->known_bitmask[i / 64] |= (uint64_t)1 << (i % 64);
+        if (bft_entry->nb_ecmp_entries > 1) {
+            compiled->ecmp_bitmask[i / 64] |= (uint64_t)1 << (i % 64);
+        }
+        compiled->nb_ecmp[i] = bft_entry->nb_ecmp_entries;
+        for (int j = 0; j < bft_entry->nb_ecmp_entries; ++j) {
+            memcpy(&compiled->ecmp_fbm[(i * ecmp_stride + j) *
+                                       bitstring_max_idx],
+                   bft_entry->ecmp_entry[j]->forwarding_bitmask,
+                   bitstring_size);
+        }
+    }
+
+    // The local BFR-ID is delivered locally and BFR-IDs with ECMP entries
+    // are resolved per packet: both are left out of the combined bitmasks
+    int local_idx = compiled->local_idx;
+    bool has_local = local_idx >= 0 && (uint32_t)local_idx < nb_bfr &&
+                     bier_bft->bft[local_idx];
+    for (uint32_t i = 0; i < nb_bfr; ++i) {
+        bier_bft_entry_t *bft_entry = bier_bft->bft[i];
+        if (!bft_entry || bft_entry->nb_ecmp_entries != 1 ||
+            (has_local && i == (uint32_t)local_idx)) {
+            continue;
+        }
+        uint64_t *nei_bitmask =
+            &compiled->nei_bitmask[ecmp_nei[i * ecmp_stride] *
+                                   bitstring_max_idx];
+        for (uint32_t w = 0; w < bitstring_max_idx; ++w) {
+            nei_bitmask[w] |= bft_entry->ecmp_entry[0]->forwarding_bitmask[w] &
+                              ~compiled->ecmp_bitmask[w];
+        }
+    }
+    if (has_local) {
+        memcpy(compiled->local_bitmask,
+               bier_bft->bft[local_idx]->ecmp_entry[0]->forwarding_bitmask,
+               bitstring_size);
+        compiled->local_bitmask[local_idx / 64] |= (uint64_t)1
+                                                   << (local_idx % 64);
+        for (uint32_t n = 0; n < nb_neighbours; ++n) {
+            compiled->nei_bitmask[n * bitstring_max_idx + local_idx / 64] &=
+                ~((uint64_t)1 << (local_idx % 64));
+        }
+    }
+    return compiled;
+}
+
+int index_bier_te(bier_te_internal_t *bft) {
+    uint32_t bitstring_length = bft->bitstring_length;
+    uint64_t *adj_bitmask =
+        (uint64_t *)calloc(bitstring_length / 64, sizeof(uint64_t));
+    uint32_t *bp_adj_start =
+        (uint32_t *)calloc(bitstring_length + 1, sizeof(uint32_t));
+    uint32_t *bp_adj = (uint32_t *)malloc(
+        sizeof(uint32_t) * (bft->nb_adjacencies > 0 ? bft->nb_adjacencies : 1));
+    if (!adj_bitmask || !bp_adj_start || !bp_adj) {
+        log_perror("Malloc bier te index");
+        goto index_bier_te_error;
+    }
+
+    // Counting sort of the adjacencies by BP
+    for (int i = 0; i < bft->nb_adjacencies; ++i) {
+        int bp = bft->adj_to_bp[i] - 1;
+        if (bp < 0 || (uint32_t)bp >= bitstring_length) {
+            log_err("BP %d of an adjacency is out of the bitstring", bp + 1);
+            goto index_bier_te_error;
+        }
+        ++bp_adj_start[bp + 1];
+        adj_bitmask[bp / 64] |= (uint64_t)1 << (bp % 64);
+    }
+    for (uint32_t bp = 0; bp < bitstring_length; ++bp) {
+        bp_adj_start[bp + 1] += bp_adj_start[bp];
+    }
+    // Each start is moved to the next one while placing, then shifted back
+    for (int i = 0; i < bft->nb_adjacencies; ++i) {
+        bp_adj[bp_adj_start[bft->adj_to_bp[i] - 1]++] = i;
+    }
+    memmove(&bp_adj_start[1], bp_adj_start,
+            sizeof(uint32_t) * bitstring_length);
+    bp_adj_start[0] = 0;
+
+    free(bft->adj_bitmask);
+    free(bft->bp_adj_start);
+    free(bft->bp_adj);
+    bft->adj_bitmask = adj_bitmask;
+    bft->bp_adj_start = bp_adj_start;
+    bft->bp_adj = bp_adj;
+    return 0;
+
+index_bier_te_error:
+    free(adj_bitmask);
+    free(bp_adj_start);
+    free(bp_adj);
+    return -1;
+}
+
+/**
+ * @brief Parses the line "<nb bits> [bitstring length]" giving the size of a
+ * BIFT. Without a bitstring length, the shortest one holding the bits is used
+ *
+ * @param bitstring_length set to the length of the bitstrings in bits
+ * @return int the number of bits, 0 on error
+ */
+static int parse_bift_size(const char *line, uint32_t *bitstring_length) {
+    int nb_bits = 0;
+    uint32_t length = 0;
+    int nb_fields = sscanf(line, "%d %u", &nb_bits, &length);
+    if (nb_fields < 1 || nb_bits <= 0) {
+        log_err("Cannot convert the size of the BIFT: %s", line);
+        return 0;
+    }
+    if (nb_fields < 2) {
+        length = BIER_MIN_BITSTRING_LENGTH;
+        while (length < (uint32_t)nb_bits &&
+               length <= BIER_MAX_BITSTRING_LENGTH) {
+            length <<= 1;
+        }
+    }
+    if (bier_bsl_encode(length) < 0 || length < (uint32_t)nb_bits) {
+        log_err("Invalid bitstring length %u for %d bits", length, nb_bits);
+        return 0;
+    }
+    *bitstring_length = length;
+    return nb_bits;
+}
+
 int fill_bier_internal_bier(FILE *file, bier_internal_t *bier_bft, bool use_ipv4) {
     char *line = NULL;
     ssize_t readed = 0;
     size_t len = 0;
 
     if ((readed = getline(&line, &len, file)) == -1) {
-        fprintf(stderr, "Cannot get number of entries line\n");
-        free(bier_bft);
-        return -1;
+        log_err("Cannot get number of entries line");
+        goto fill_bier_internal_bier_error;
     }
-    int nb_bft_entry = atoi(line);
+    uint32_t bitstring_length;
+    int nb_bft_entry = parse_bift_size(line, &bitstring_length);
     if (nb_bft_entry == 0) {
-        fprintf(stderr, "Cannot convert to nb bft entry: %s\n", line);
-        free(bier_bft);
-        return -1;
+        goto fill_bier_internal_bier_error;
     }
 
-    bier_bft->nb_bft_entry = nb_bft_entry;
-
     // We can create the array of entries for the BFT
     bier_bft->bft = malloc(sizeof(bier_bft_entry_t *) * nb_bft_entry);
     if (!bier_bft->bft) {
-        fprintf(stderr, "Cannot malloc the bft!\n");
-        free(bier_bft);
-        return -1;
+        log_err("Cannot malloc the bft!");
+        goto fill_bier_internal_bier_error;
     }
     memset(bier_bft->bft, 0, sizeof(bier_bft_entry_t *) * nb_bft_entry);
+    bier_bft->nb_bft_entry = nb_bft_entry;
 
-    // Make room for the bitstring
-    // According to RFC8296, it can be up to 4096 bits
-    uint32_t bitstring_length = 64;
-    while (bitstring_length < nb_bft_entry) {
-        bitstring_length <<= 1;
-        if (bitstring_length > 4096) {
-            fprintf(stderr, "Too long bitstring length\n");
-            free(bier_bft->bft);
-            free(bier_bft);
-            return -1;
-        }
-    }
     bier_bft->bitstring_length = bitstring_length;
 
     //free(line);
@@ -243,17 +567,13 @@ int fill_bier_internal_bier(FILE *file, bier_internal_t *bier_bft, bool use_ipv4
 
     // The BFR ID of the local router
     if ((readed = getline(&line, &len, file)) == -1) {
-        fprintf(stderr, "Cannot get the local BFR ID\n");
-        free(bier_bft->bft);
-        free(bier_bft);
-        return -1;
+        log_err("Cannot get the local BFR ID");
+        goto fill_bier_internal_bier_error;
     }
     int local_bfr_id = atoi(line);
     if (local_bfr_id == 0) {
-        fprintf(stderr, "Cannot convert to local BFR ID: %s\n", line);
-        free(bier_bft->bft);
-        free(bier_bft);
-        return -1;
+        log_err("Cannot convert to local BFR ID: %s", line);
+        goto fill_bier_internal_bier_error;
     }
     bier_bft->local_bfr_id = local_bfr_id;
 
@@ -263,15 +583,19 @@ int fill_bier_internal_bier(FILE *file, bier_internal_t *bier_bft, bool use_ipv4
     // Fill in the BFT
     for (int i = 0; i < nb_bft_entry; ++i) {
         if ((readed = getline(&line, &len, file)) == -1) {
-            fprintf(stderr, "Cannot get line configuration\n");
-            free(bier_bft->bft);
-            free(bier_bft);
-            return -1;
+            log_err("Cannot get line configuration");
+            goto fill_bier_internal_bier_error;
         }
         bier_bft_entry_t *bft_entry = parse_line(line, bitstring_length, use_ipv4);
         if (!bft_entry) {
-            fprintf(stderr, "Cannot parse line: %s\n", line);
-            return -1;
+            log_err("Cannot parse line: %s", line);
+            goto fill_bier_internal_bier_error;
+        }
+        if (bft_entry->bfr_id > (uint32_t)nb_bft_entry) {
+            log_err("BFR-ID %u is past the %d entries of the BFT",
+                    bft_entry->bfr_id, nb_bft_entry);
+            free_bft_entry(bft_entry);
+            goto fill_bier_internal_bier_error;
         }
         bier_bft->bft[bft_entry->bfr_id - 1] =
             bft_entry;  // bfr_id is one_indexed
@@ -279,7 +603,17 @@ int fill_bier_internal_bier(FILE *file, bier_internal_t *bier_bft, bool use_ipv4
         //free(line);
         //line = NULL;
     }
+    // Read again on each reload
+    free(line);
+    bier_bft->compiled = compile_bier_bft(bier_bft, use_ipv4);
+    if (!bier_bft->compiled) {
+        return -1;
+    }
     return 0;
+
+fill_bier_internal_bier_error:
+    free(line);
+    return -1;
 }
 
 int fill_bier_internal_bier_te(FILE *file, bier_te_internal_t *bier_internal, bool use_ipv4) {
@@ -288,29 +622,19 @@ int fill_bier_internal_bier_te(FILE *file, bier_te_internal_t *bier_internal, bo
     size_t len = 0;
 
     if ((readed = getline(&line, &len, file)) == -1) {
-        fprintf(stderr, "Cannot get number of BP\n");
-        return -1;
+        log_err("Cannot get number of BP");
+        goto fill_bier_internal_bier_te_error;
     }
-    int nb_bp = atoi(line);
-    if (nb_bp == 0) {
-        fprintf(stderr, "Cannot convert to nb bp: %s\n", line);
-        return -1;
-    }
-
-    uint32_t bitstring_length = 64;
-    while (bitstring_length < nb_bp) {
-        bitstring_length <<= 1;
-        if (bitstring_length > 4096) {
-            fprintf(stderr, "Too long bitstring length\n");
-            return -1;
-        }
+    uint32_t bitstring_length;
+    if (parse_bift_size(line, &bitstring_length) == 0) {
+        goto fill_bier_internal_bier_te_error;
     }
     bier_internal->bitstring_length = bitstring_length;
     bier_internal->global_bitstring =
         (uint64_t *)malloc(sizeof(uint64_t) * (bitstring_length / 64));
     if (!bier_internal->global_bitstring) {
-        perror("Malloc bier internal global bitstring");
-        return -1;
+        log_perror("Malloc bier internal global bitstring");
+        goto fill_bier_internal_bier_te_error;
     }
     memset(bier_internal->global_bitstring, 0,
            sizeof(uint64_t) * (bitstring_length / 64));
@@ -319,13 +643,13 @@ int fill_bier_internal_bier_te(FILE *file, bier_te_internal_t *bier_internal, bo
     //line = NULL;
 
     if ((readed = getline(&line, &len, file)) == -1) {
-        fprintf(stderr, "Cannot get node bp id\n");
-        return -1;
+        log_err("Cannot get node bp id");
+        goto fill_bier_internal_bier_te_error;
     }
     int node_bp_id = atoi(line);
     if (node_bp_id == 0) {
-        fprintf(stderr, "Cannot convert to node bp id: %s\n", line);
-        return -1;
+        log_err("Cannot convert to node bp id: %s", line);
+        goto fill_bier_internal_bier_te_error;
     }
 
     bier_internal->local_bfr_id = node_bp_id;
@@ -335,8 +659,8 @@ int fill_bier_internal_bier_te(FILE *file, bier_te_internal_t *bier_internal, bo
 
     // Global bitstring
     if ((readed = getline(&line, &len, file)) == -1) {
-        fprintf(stderr, "Cannot get global bitstring\n");
-        return -1;
+        log_err("Cannot get global bitstring");
+        goto fill_bier_internal_bier_te_error;
     }
     // Parse the string line a bit at a time because it may be too long to hold
     // in a single number
@@ -351,8 +675,8 @@ int fill_bier_internal_bier_te(FILE *file, bier_te_internal_t *bier_internal, bo
         }
         char c = line[i];
         if (c == '1') {
-            bier_internal->global_bitstring[bitstring_word_iter] +=
-                1 << bitstring_iter;
+            bier_internal->global_bitstring[bitstring_word_iter] |=
+                (uint64_t)1 << bitstring_iter;
         }
         ++bitstring_iter;
     }
@@ -361,13 +685,13 @@ int fill_bier_internal_bier_te(FILE *file, bier_te_internal_t *bier_internal, bo
     //line = NULL;
 
     if ((readed = getline(&line, &len, file)) == -1) {
-        fprintf(stderr, "Cannot get nb entries in the map\n");
-        return -1;
+        log_err("Cannot get nb entries in the map");
+        goto fill_bier_internal_bier_te_error;
     }
     int nb_entries = atoi(line);
     if (nb_entries == 0) {
-        fprintf(stderr, "Cannot convert to nb entries in the map: %s\n", line);
-        return -1;
+        log_err("Cannot convert to nb entries in the map: %s", line);
+        goto fill_bier_internal_bier_te_error;
     }
     bier_internal->nb_adjacencies = nb_entries;
 
@@ -377,51 +701,58 @@ int fill_bier_internal_bier_te(FILE *file, bier_te_internal_t *bier_internal, bo
     // Use sockaddr_in6 because longer than sockaddr_in
     bier_internal->bfr_nei_addr = (sockaddr_uniform_t *)malloc(sizeof(sockaddr_uniform_t) * nb_entries);
     if (!bier_internal->bfr_nei_addr) {
-        perror("Malloc bier te bfr nei addr");
-        return -1;
+        log_perror("Malloc bier te bfr nei addr");
+        goto fill_bier_internal_bier_te_error;
     }
     memset(bier_internal->bfr_nei_addr, 0,
            sizeof(struct sockaddr_in6) * nb_entries);
 
     bier_internal->adj_to_bp = (int *)malloc(sizeof(int) * nb_entries);
     if (!bier_internal->adj_to_bp) {
-        perror("Malloc bier te adj to bp");
-        return -1;
+        log_perror("Malloc bier te adj to bp");
+        goto fill_bier_internal_bier_te_error;
     }
     memset(bier_internal->adj_to_bp, 0, sizeof(int) * nb_entries);
 
+    bier_internal->nei_stats =
+        (bier_nei_stats_t *)calloc(nb_entries, sizeof(bier_nei_stats_t));
+    if (!bier_internal->nei_stats) {
+        log_perror("Malloc bier te nei stats");
+        goto fill_bier_internal_bier_te_error;
+    }
+
     //free(line);
     //line = NULL;
 
     char delim[] = " ";
     for (int i = 0; i < nb_entries; ++i) {
         if ((readed = getline(&line, &len, file)) == -1) {
-            fprintf(stderr, "Cannot get line\n");
-            return -1;
+            log_err("Cannot get line");
+            goto fill_bier_internal_bier_te_error;
         }
         char *ptr = strtok(line, delim);
         if (ptr == NULL) {
-            fprintf(stderr, "Cannot get bier te idx\n");
-            return -1;
+            log_err("Cannot get bier te idx");
+            goto fill_bier_internal_bier_te_error;
         }
         int idx = atoi(ptr);
         if (idx == 0) {
-            fprintf(stderr, "Cannot convert to idx bier te\n");
-            return -1;
+            log_err("Cannot convert to idx bier te");
+            goto fill_bier_internal_bier_te_error;
         }
         bier_internal->adj_to_bp[i] = idx;
 
         ptr = strtok(NULL, delim);
         if (ptr == NULL) {
-            fprintf(stderr, "Cannot get bier te ECMP nb\n");
-            return -1;
+            log_err("Cannot get bier te ECMP nb");
+            goto fill_bier_internal_bier_te_error;
         }
 
         // No ECMP for now
         ptr = strtok(NULL, delim);
         if (ptr == NULL) {
-            fprintf(stderr, "Cannot get neigh address bier te\n");
-            return -1;
+            log_err("Cannot get neigh address bier te");
+            goto fill_bier_internal_bier_te_error;
         }
 
         int err;
@@ -433,34 +764,66 @@ int fill_bier_internal_bier_te(FILE *file, bier_te_internal_t *bier_internal, bo
             err = inet_pton(AF_INET6, ptr, bier_internal->bfr_nei_addr[i].v6.sin6_addr.s6_addr);
         }
         if (err != 1) {
-            fprintf(stderr, "Cannot convert neighbour address bier te: %s\n", ptr);
-            perror("inet_ntop bfr_nei_addr");
-            return -1;
+            log_err("Cannot convert neighbour address bier te: %s", ptr);
+            log_perror("inet_ntop bfr_nei_addr");
+            goto fill_bier_internal_bier_te_error;
         }
     }
-    return 0;
+    free(line);
+    return index_bier_te(bier_internal);
+
+fill_bier_internal_bier_te_error:
+    free(line);
+    return -1;
 }
 
 // TODO: multiple checks:
 //   * do we read exactly once each entry?
 //   * do we have all entries?
-bier_bift_t *read_config_file(char *config_filepath, bool use_ipv4) {
+/**
+ * @brief Builds the index of the BIFTs of *table* by BIFT-ID, see
+ * bier_bift_table_t. The leaves of a previous index are not freed
+ *
+ * @return int 0 on success, -1 on error or if a BIFT-ID is used twice
+ */
+static int index_bier_bift_table(bier_bift_table_t *table) {
+    memset(table->bift_idx, 0, sizeof(table->bift_idx));
+    for (int i = 0; i < table->nb_bift; ++i) {
+        uint32_t bift_id = table->b[i].bift_id;
+        uint8_t **leaf = &table->bift_idx[bift_id >> BIER_BIFT_RADIX_BITS];
+        if (!*leaf) {
+            *leaf = (uint8_t *)calloc(BIER_BIFT_RADIX_SIZE, sizeof(uint8_t));
+            if (!*leaf) {
+                log_perror("calloc BIFT index");
+                return -1;
+            }
+        }
+        uint8_t *slot = &(*leaf)[bift_id & (BIER_BIFT_RADIX_SIZE - 1)];
+        if (*slot) {
+            log_err("BIFT-ID %u is used by two BIFTs", bift_id);
+            return -1;
+        }
+        *slot = i + 1;
+    }
+    return 0;
+}
+
+bier_bift_table_t *read_bift_table(char *config_filepath, bool use_ipv4,
+                                   sockaddr_uniform_t *local) {
     FILE *file = fopen(config_filepath, "r");
     if (!file) {
-        fprintf(stderr, "Impossible to open the config file: %s\n",
-                config_filepath);
-        perror("open");
+        log_err("Impossible to open the config file: %s", config_filepath);
+        log_perror("open");
         return NULL;
     }
 
-    bier_bift_t *bier_bift = malloc(sizeof(bier_bift_t));
-    if (!bier_bift) {
-        fprintf(stderr, "Cannot malloc\n");
-        perror("malloc-config");
+    bier_bift_table_t *table =
+        (bier_bift_table_t *)calloc(1, sizeof(bier_bift_table_t));
+    if (!table) {
+        log_perror("calloc BIFT table");
+        fclose(file);
         return NULL;
     }
-    memset(bier_bift, 0, sizeof(bier_bift_t));
-    bier_bift->socket = -1;
 
     ssize_t readed = 0;
     char *line = NULL;
@@ -468,490 +831,2073 @@ bier_bift_t *read_config_file(char *config_filepath, bool use_ipv4) {
 
     // First line is the local address
     if ((readed = getline(&line, &len, file)) == -1) {
-        fprintf(stderr, "Cannot get local address line\n");
-        free(bier_bift);
-        return NULL;
+        log_err("Cannot get local address line");
+        goto read_bift_table_error;
     }
 
     // The last byte is the '\n' => must erase it by inserting a 0
     line[readed - 1] = '\0';
-    char local_addr_str[INET6_ADDRSTRLEN];
-    strcpy(local_addr_str, line);
-
-    //free(line);
-    //line = NULL;
+    memset(local, 0, sizeof(sockaddr_uniform_t));
+    int err;
+    if (use_ipv4) {
+        local->v4.sin_family = AF_INET;
+        err = inet_pton(AF_INET, line, &local->v4.sin_addr.s_addr);
+    } else {
+        local->v6.sin6_family = AF_INET6;
+        err = inet_pton(AF_INET6, line, local->v6.sin6_addr.s6_addr);
+    }
+    if (err != 1) {
+        log_err("Cannot convert the local address: %s", line);
+        goto read_bift_table_error;
+    }
 
     if ((readed = getline(&line, &len, file)) == -1) {
-        fprintf(stderr, "Cannot get number of BIFTs line\n");
-        free(bier_bift);
-        return NULL;
+        log_err("Cannot get number of BIFTs line");
+        goto read_bift_table_error;
     }
     // Number of different BIFT (each with an increasing ID for now)
     // TODO: generalize this
     int nb_bifts = atoi(line);
-    fprintf(stderr, "NB BIFT=%d ()\n", nb_bifts);
-    if (nb_bifts == 0) {
-        fprintf(stderr, "Cannot convert to nb bifts: %s\n", line);
-    }
-    bier_bift->nb_bift = nb_bifts;
-    bier_bift->b =
-        (bier_bift_type_t *)malloc(sizeof(bier_bift_type_t) * nb_bifts);
-    if (!bier_bift->b) {
-        perror("Malloc BIFTs");
-        free(bier_bift);
-        return NULL;
+    log_debug("NB BIFT=%d ()", nb_bifts);
+    if (nb_bifts <= 0 || nb_bifts > BIER_MAX_BIFT) {
+        log_err("Cannot convert to nb bifts: %s", line);
+        goto read_bift_table_error;
+    }
+    table->b = (bier_bift_type_t *)calloc(nb_bifts, sizeof(bier_bift_type_t));
+    if (!table->b) {
+        log_perror("Malloc BIFTs");
+        goto read_bift_table_error;
     }
 
-    //free(line);
-    //line = NULL;
-
+    // Only the BIFTs filled so far are freed on error
     for (int bift_id = 0; bift_id < nb_bifts; ++bift_id) {
         if ((readed = getline(&line, &len, file)) == -1) {
-            fprintf(stderr, "Cannot BIFT type line\n");
-            free(bier_bift);
-            return NULL;
+            log_err("Cannot BIFT type line");
+            goto read_bift_table_error;
         }
-        int bift_type = atoi(line);
-        if (bift_type == 0) {
-            fprintf(stderr, "Cannot convert to BIFT type: %s\n", line);
-            free(bier_bift->b);
-            free(bier_bift);
-            return NULL;
+        // The BIFT-ID, sub-domain and SI are optional
+        int bift_type = 0;
+        uint32_t bift_id_field = bift_id + 1, sd = 0, si = 0;
+        int nb_fields = sscanf(line, "%d %u %u %u", &bift_type, &bift_id_field,
+                               &sd, &si);
+        if (nb_fields < 1 || bift_type == 0) {
+            log_err("Cannot convert to BIFT type: %s", line);
+            goto read_bift_table_error;
+        }
+        if ((nb_fields != 1 && nb_fields != 4) || bift_id_field == 0 ||
+            bift_id_field >> BIER_BIFT_ID_BITS || sd > UINT8_MAX ||
+            si > UINT8_MAX || (bift_type == BIER_TE && si != 0)) {
+            log_err("Invalid BIFT-ID, sub-domain or SI: %s", line);
+            goto read_bift_table_error;
         }
+        table->b[bift_id].bift_id = bift_id_field;
+        table->b[bift_id].sd = sd;
+        table->b[bift_id].si = si;
+        table->b[bift_id].stats_idx = bift_id;
 
         // TODO: continue process
         if (bift_type == BIER) {
             bier_internal_t *bier_internal =
                 (bier_internal_t *)malloc(sizeof(bier_internal_t));
             if (!bier_internal) {
-                perror("Malloc bier_internal");
-                // TODO: free memory
-                return NULL;
+                log_perror("Malloc bier_internal");
+                goto read_bift_table_error;
             }
             memset(bier_internal, 0, sizeof(bier_internal_t));
-            bier_internal->bift_id =
-                bift_id;  // TODO: this must be more general (include an ID in
-                          // the configuration?)
-            bier_bift->b[bift_id].bier = bier_internal;
-            bier_bift->b[bift_id].t = BIER;
+            bier_internal->bift_id = bift_id_field;
+            bier_internal->si = si;
             if (fill_bier_internal_bier(file, bier_internal, use_ipv4) != 0) {
-                return NULL;
+                free_bier_internal_bier(bier_internal);
+                goto read_bift_table_error;
             }
+            table->b[bift_id].bier = bier_internal;
+            table->b[bift_id].t = BIER;
         } else if (bift_type == BIER_TE) {
             bier_te_internal_t *bier_internal =
                 (bier_te_internal_t *)malloc(sizeof(bier_te_internal_t));
             if (!bier_internal) {
-                perror("Malloc bier_internal");
-                // TODO: free memory
-                return NULL;
+                log_perror("Malloc bier_internal");
+                goto read_bift_table_error;
             }
             memset(bier_internal, 0, sizeof(bier_te_internal_t));
-            bier_internal->bift_id =
-                bift_id;  // TODO: this must be more general (include an ID in
-                          // the configuration?)
-            bier_bift->b[bift_id].bier_te = bier_internal;
-            bier_bift->b[bift_id].t = BIER_TE;
+            bier_internal->bift_id = bift_id_field;
             if (fill_bier_internal_bier_te(file, bier_internal, use_ipv4) != 0) {
-                return NULL;
+                free_bier_internal_bier_te(bier_internal);
+                goto read_bift_table_error;
             }
-            printf("Test %d\n", bier_internal->adj_to_bp[0]);
+            table->b[bift_id].bier_te = bier_internal;
+            table->b[bift_id].t = BIER_TE;
+            log_debug("Test %d", bier_internal->adj_to_bp[0]);
         } else {
-            fprintf(stderr, "Unknown BIFT type: %d\n", bift_type);
-            return NULL;
+            log_err("Unknown BIFT type: %d", bift_type);
+            goto read_bift_table_error;
         }
-
-        //free(line);
-        //line = NULL;
+        table->nb_bift = bift_id + 1;
     }
-
-    // Open raw socket to forward the packets
-    int af_family = use_ipv4 ? AF_INET : AF_INET6;
-    bier_bift->socket = socket(af_family, SOCK_RAW, 253);
-    if (bier_bift->socket < 0) {
-        perror("socket BFT");
-        free_bier_bft(bier_bift);
-        return NULL;
+    if (index_bier_bift_table(table) < 0) {
+        goto read_bift_table_error;
     }
 
-    int err;
-    if (use_ipv4) {
-        bier_bift->local.v4.sin_family = AF_INET;
-        err = inet_pton(AF_INET, local_addr_str, &bier_bift->local.v4.sin_addr.s_addr);
-    } else {
-        bier_bift->local.v6.sin6_family = AF_INET6;
-        err = inet_pton(AF_INET6, local_addr_str, bier_bift->local.v6.sin6_addr.s6_addr);
-    }
-    if (err != 1) {
-        fprintf(stderr, "Cannot convert the local address: %s\n", local_addr_str);
-        free(bier_bift);
-        return NULL;
-    }
+    free(line);
+    fclose(file);
+    return table;
 
-    if (use_ipv4) {
-        err = bind(bier_bift->socket, (struct sockaddr *)&bier_bift->local.v4, sizeof(bier_bift->local.v4));
-    } else {
-        err = bind(bier_bift->socket, (struct sockaddr *)&bier_bift->local.v6, sizeof(bier_bift->local.v6));
+read_bift_table_error:
+    free(line);
+    fclose(file);
+    free_bier_bift_table(table);
+    return NULL;
+}
+
+/**
+ * @brief Frees the index and the table, but not the BIFTs
+ */
+static void free_bier_bift_table_index(void *ptr) {
+    bier_bift_table_t *table = (bier_bift_table_t *)ptr;
+    for (int i = 0; i < BIER_BIFT_RADIX_SIZE; ++i) {
+        free(table->bift_idx[i]);
     }
-    if (err < 0) {
-        perror("Bind local router");
-        fprintf(stderr, "The addfress was: %s\n", local_addr_str);
-        free_bier_bft(bier_bift);
-        return NULL;
+    free(table);
+}
+
+void free_bier_bift_table(void *ptr) {
+    bier_bift_table_t *table = (bier_bift_table_t *)ptr;
+    for (int bift_id = 0; bift_id < table->nb_bift; ++bift_id) {
+        if (table->b[bift_id].t == BIER && table->b[bift_id].bier) {
+            free_bier_internal_bier(table->b[bift_id].bier);
+        } else if (table->b[bift_id].t == BIER_TE &&
+                   table->b[bift_id].bier_te) {
+            free_bier_internal_bier_te(table->b[bift_id].bier_te);
+        }
     }
-    fprintf(stderr, "Bind to local address on router:  %s\n", local_addr_str);
+    free(table->b);
+    free_bier_bift_table_index(table);
+}
 
-    return bier_bift;
+uint32_t bier_bift_bitstring_length(const bier_bift_table_t *table,
+                                    uint32_t bift_id) {
+    int idx = bier_bift_find(table, bift_id);
+    if (idx < 0) {
+        return 0;
+    }
+    const bier_bift_type_t *bift = &table->b[idx];
+    return bift->t == BIER ? bift->bier->bitstring_length
+                           : bift->bier_te->bitstring_length;
 }
 
-void update_bitstring(uint64_t *bitstring_ptr, uint64_t *forwarding_bitmask,
-                      bitstring_operation op, uint32_t bitstring_max_idx) {
-    for (uint32_t i = 0; i < bitstring_max_idx; ++i) {
-        uint64_t bitstring = be64toh(bitstring_ptr[i]);
-        uint64_t bitmask = forwarding_bitmask[i];
-        switch (op) {
-            case bitwise_u64_and:
-                bitstring &= bitmask;
-                break;
-            case bitwise_u64_and_not:
-                bitstring &= ~bitmask;
-                break;
+int bier_bift_find_set(const bier_bift_table_t *table, uint8_t sd, uint32_t si,
+                       uint32_t bitstring_length) {
+    // Few BIFTs, and only looked up by the BFIR
+    for (int i = 0; i < table->nb_bift; ++i) {
+        const bier_bift_type_t *bift = &table->b[i];
+        if (bift->t == BIER && bift->sd == sd && bift->si == si &&
+            bift->bier->bitstring_length == bitstring_length) {
+            return i;
         }
-        bitstring_ptr[i] = htobe64(bitstring);
     }
+    return -1;
 }
 
-/**
- * @brief Currently only supports IPV6!
- * 
- * @param all_apps 
- * @param dst_addr 
- * @param bier_proto 
- * @return int 
- */
-int find_correct_unix_destination(bier_all_apps_t *all_apps, uint8_t *payload, uint16_t bier_proto) {
-    // TODO: currently only supports RAW and IPv6
-    if (bier_proto != BIERPROTO_IPV6 && bier_proto != BIERPROTO_RESERVED_RAW) {
-        fprintf(stderr, "Not supported protocol\n");
-        return -1;
+bier_bift_table_t *bier_bift_publish(bier_bift_t *bier,
+                                     bier_bift_table_t *table) {
+    return atomic_exchange(&bier->table, table);
+}
+
+static void reset_bift_stats(bier_bift_stats_t *stats) {
+    atomic_store(&stats->packets_in, 0);
+    atomic_store(&stats->replicas_out, 0);
+    atomic_store(&stats->local_deliveries, 0);
+    for (int i = 0; i < BIER_DROP_MAX; ++i) {
+        atomic_store(&stats->drops[i], 0);
     }
-    struct in6_addr packet_ipv6_dst = {};
-    memcpy(&packet_ipv6_dst.s6_addr, &payload[24], sizeof(packet_ipv6_dst.s6_addr));
+}
 
-    for (int i = 0; i < BIER_MAX_APPS; ++i) {
-        if (!all_apps->apps[i].is_active) {
-            continue;
+void bier_bift_keep_stats(bier_bift_t *bier, bier_bift_table_t *table) {
+    const bier_bift_table_t *current = bier_bift_table(bier);
+    bool used[BIER_MAX_BIFT] = {};  // By a current BIFT
+    bool taken[BIER_MAX_BIFT] = {};  // By a BIFT of *table*
+    bool kept[BIER_MAX_BIFT] = {};
+    for (int i = 0; current && i < current->nb_bift; ++i) {
+        used[current->b[i].stats_idx] = true;
+    }
+    for (int i = 0; i < table->nb_bift; ++i) {
+        int idx = current ? bier_bift_find(current, table->b[i].bift_id) : -1;
+        if (idx >= 0) {
+            table->b[i].stats_idx = current->b[idx].stats_idx;
+            taken[table->b[i].stats_idx] = true;
+            kept[i] = true;
         }
-        if (all_apps->apps[i].proto != bier_proto) {
+    }
+    // The counters of a removed BIFT may still be updated with the previous
+    // table, they are only reused if there is no other choice
+    for (int i = 0; i < table->nb_bift; ++i) {
+        if (kept[i]) {
             continue;
-        } else if (bier_proto == BIERPROTO_RESERVED_RAW) {
-            return i; // Raw proto means that we do not care about the sockaddr
         }
-        
-        // Hence must be IPv6 here
-        if (all_apps->apps[i].mc_addr_family != AF_INET6) {
-            fprintf(stderr, "Err: the sockaddr family should be AF_INET6\n");
-            return -1;
+        uint32_t free_idx = BIER_MAX_BIFT;
+        for (uint32_t s = 0; s < BIER_MAX_BIFT; ++s) {
+            if (!taken[s] && (!used[s] || free_idx == BIER_MAX_BIFT)) {
+                free_idx = s;
+                if (!used[s]) {
+                    break;
+                }
+            }
         }
-        fprintf(stderr, "The received packet: ");
-        for (int j = 0; j < 16; ++j) {
-            fprintf(stderr, "%x ", packet_ipv6_dst.s6_addr[j]);
+        // At most BIER_MAX_BIFT BIFTs, so a slot is always found
+        table->b[i].stats_idx = free_idx;
+        taken[free_idx] = true;
+        for (int w = -1; w < bier->nb_workers; ++w) {
+            bier_bift_t *view = w < 0 ? bier : bier->workers[w];
+            reset_bift_stats(&view->stats[free_idx]);
         }
-        fprintf(stderr, "Bound to: ");
-        for (int j = 0; j < 16; ++j) {
-            fprintf(stderr, "%x ", all_apps->apps[i].mc_addr.mc_ipv6.s6_addr[j]);
+    }
+}
+
+struct bier_delta_garbage {
+    int nb;
+    int capacity;
+    struct {
+        void *ptr;
+        void (*free_fn)(void *);
+    } *items;
+};
+
+/**
+ * @brief Adds *ptr* to the structures freed with *garbage*, allocated on
+ * first use
+ *
+ * @return int 0 on success, -1 otherwise
+ */
+static int delta_garbage_add(bier_delta_garbage_t **garbage, void *ptr,
+                             void (*free_fn)(void *)) {
+    if (!*garbage) {
+        *garbage = (bier_delta_garbage_t *)calloc(1, sizeof(**garbage));
+        if (!*garbage) {
+            log_perror("calloc delta garbage");
+            return -1;
         }
-        fprintf(stderr, "\n");
-        if (memcmp(all_apps->apps[i].mc_addr.mc_ipv6.s6_addr, packet_ipv6_dst.s6_addr, sizeof(packet_ipv6_dst.s6_addr)) == 0) {
-            return i;
+    }
+    bier_delta_garbage_t *g = *garbage;
+    if (g->nb == g->capacity) {
+        int capacity = g->capacity ? g->capacity * 2 : 8;
+        void *items = realloc(g->items, sizeof(g->items[0]) * capacity);
+        if (!items) {
+            log_perror("realloc delta garbage");
+            return -1;
         }
-        
+        g->items = items;
+        g->capacity = capacity;
     }
-    return -1; // Not found
+    g->items[g->nb].ptr = ptr;
+    g->items[g->nb].free_fn = free_fn;
+    ++g->nb;
+    return 0;
 }
 
-static inline uint16_t get_bier_proto(uint8_t *bier_header) {
-    return bier_header[9] & 0x3f;
+/**
+ * @brief Releases *garbage* without freeing the structures it holds, which
+ * are still used
+ */
+static void delta_garbage_drop(bier_delta_garbage_t *garbage) {
+    if (garbage) {
+        free(garbage->items);
+        free(garbage);
+    }
 }
 
-int send_packet_to_application(uint8_t *payload, size_t payload_length,
-                               size_t bier_header_length,
-                               bier_all_apps_t *all_apps, bool use_ipv4) {
-    size_t packet_length = payload_length - bier_header_length;
-    uint8_t *packet = &payload[bier_header_length];
-    bier_received_packet_t bier_received_packet = {};
-    if (use_ipv4) {
-        memcpy(&bier_received_packet.ip6_encap_src.v4.s_addr, &all_apps->src.v4.sin_addr.s_addr, sizeof(all_apps->src.v4.sin_addr.s_addr));
-    } else {
-        memcpy(bier_received_packet.ip6_encap_src.v6.s6_addr, all_apps->src.v6.sin6_addr.s6_addr, sizeof(all_apps->src.v6.sin6_addr.s6_addr));
+void free_bier_delta_garbage(void *ptr) {
+    bier_delta_garbage_t *garbage = (bier_delta_garbage_t *)ptr;
+    for (int i = 0; i < garbage->nb; ++i) {
+        garbage->items[i].free_fn(garbage->items[i].ptr);
     }
-    bier_received_packet.payload = packet;
+    delta_garbage_drop(garbage);
+}
+
+static void free_compiled_bft_garbage(void *ptr) { free_compiled_bft(ptr); }
+
+static void free_bier_te_garbage(void *ptr) { free_bier_internal_bier_te(ptr); }
+
+/**
+ * @brief Sets *addr* to the neighbour of *op*
+ *
+ * @return int 0 on success, -1 if *op* has no neighbour of the right family
+ */
+static int delta_nei_addr(const bier_delta_op_t *op, bool use_ipv4,
+                          bier_nei_addr_t *addr) {
+    memset(addr, 0, sizeof(bier_nei_addr_t));
+    if (use_ipv4 && op->nei_family == AF_INET) {
+        addr->v4.sin_family = AF_INET;
+        memcpy(&addr->v4.sin_addr, op->nei, sizeof(struct in_addr));
+    } else if (!use_ipv4 && op->nei_family == AF_INET6) {
+        addr->v6.sin6_family = AF_INET6;
+        memcpy(&addr->v6.sin6_addr, op->nei, sizeof(struct in6_addr));
+    } else {
+        log_err("Delta of BFR %u without a valid neighbour", op->bfr_id);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Copies *entry* so that it can be changed while the forwarding path
+ * reads the original
+ *
+ * @return bier_bft_entry_t* the copy, NULL on error
+ */
+static bier_bft_entry_t *copy_bft_entry(const bier_bft_entry_t *entry,
+                                        uint32_t bitstring_length) {
+    bier_bft_entry_t *copy =
+        (bier_bft_entry_t *)calloc(1, sizeof(bier_bft_entry_t));
+    if (!copy) {
+        log_perror("calloc copy bft entry");
+        return NULL;
+    }
+    copy->bfr_id = entry->bfr_id;
+    copy->ecmp_entry = (bier_bft_entry_ecmp_t **)calloc(
+        entry->nb_ecmp_entries + 1, sizeof(bier_bft_entry_ecmp_t *));
+    if (!copy->ecmp_entry) {
+        log_perror("calloc copy ecmp entries");
+        free(copy);
+        return NULL;
+    }
+    for (int j = 0; j < entry->nb_ecmp_entries; ++j) {
+        bier_bft_entry_ecmp_t *ecmp =
+            (bier_bft_entry_ecmp_t *)malloc(sizeof(bier_bft_entry_ecmp_t));
+        if (!ecmp) {
+            log_perror("malloc copy ecmp entry");
+            free_bft_entry(copy);
+            return NULL;
+        }
+        memcpy(ecmp, entry->ecmp_entry[j], sizeof(bier_bft_entry_ecmp_t));
+        ecmp->forwarding_bitmask = (uint64_t *)malloc(bitstring_length / 8);
+        if (!ecmp->forwarding_bitmask) {
+            log_perror("malloc copy forwarding bitmask");
+            free(ecmp);
+            free_bft_entry(copy);
+            return NULL;
+        }
+        memcpy(ecmp->forwarding_bitmask,
+               entry->ecmp_entry[j]->forwarding_bitmask, bitstring_length / 8);
+        copy->ecmp_entry[j] = ecmp;
+        ++copy->nb_ecmp_entries;
+    }
+    return copy;
+}
+
+/**
+ * @brief Index of the ECMP member of *entry* through *addr*, -1 if none
+ */
+static int find_ecmp_member(const bier_bft_entry_t *entry,
+                            const bier_nei_addr_t *addr, bool use_ipv4) {
+    for (int j = 0; entry && j < entry->nb_ecmp_entries; ++j) {
+        if (same_neighbour(
+                (const bier_nei_addr_t *)&entry->ecmp_entry[j]->bfr_nei_addr,
+                addr, use_ipv4)) {
+            return j;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Applies *op* on the private copy *entry* of the BIFT entry of
+ * `op->bfr_id`, NULL if the BFR-ID has no entry
+ *
+ * @return bier_bft_entry_t* the entry after the change, NULL if it is deleted
+ * or on error (*err* is then set to -1)
+ */
+static bier_bft_entry_t *apply_delta_op_bier(bier_bft_entry_t *entry,
+                                             const bier_delta_op_t *op,
+                                             uint32_t bitstring_length,
+                                             bool use_ipv4, int *err) {
+    bier_nei_addr_t addr;
+    bool has_nei = op->nei_family != AF_UNSPEC;
+    if ((op->op != BIER_DELTA_DELETE || has_nei) &&
+        delta_nei_addr(op, use_ipv4, &addr) < 0) {
+        goto apply_delta_op_bier_error;
+    }
+    if (op->op != BIER_DELTA_DELETE &&
+        (!op->fbm || op->fbm_length != bitstring_length / 8)) {
+        log_err("Delta of BFR %u without a valid F-BM", op->bfr_id);
+        goto apply_delta_op_bier_error;
+    }
+    int member = has_nei ? find_ecmp_member(entry, &addr, use_ipv4) : -1;
+
+    switch (op->op) {
+        case BIER_DELTA_ADD: {
+            if (member >= 0) {
+                log_err("BFR %u already has this ECMP member", op->bfr_id);
+                goto apply_delta_op_bier_error;
+            }
+            if (!entry) {
+                entry = (bier_bft_entry_t *)calloc(1, sizeof(bier_bft_entry_t));
+                if (!entry) {
+                    log_perror("calloc delta bft entry");
+                    goto apply_delta_op_bier_error;
+                }
+                entry->bfr_id = op->bfr_id;
+            }
+            bier_bft_entry_ecmp_t **ecmp_entry = realloc(
+                entry->ecmp_entry,
+                sizeof(bier_bft_entry_ecmp_t *) * (entry->nb_ecmp_entries + 1));
+            if (!ecmp_entry) {
+                log_perror("realloc delta ecmp entries");
+                goto apply_delta_op_bier_error;
+            }
+            entry->ecmp_entry = ecmp_entry;
+            bier_bft_entry_ecmp_t *ecmp = (bier_bft_entry_ecmp_t *)calloc(
+                1, sizeof(bier_bft_entry_ecmp_t));
+            if (!ecmp) {
+                log_perror("calloc delta ecmp entry");
+                goto apply_delta_op_bier_error;
+            }
+            ecmp->forwarding_bitmask = (uint64_t *)malloc(bitstring_length / 8);
+            if (!ecmp->forwarding_bitmask) {
+                log_perror("malloc delta forwarding bitmask");
+                free(ecmp);
+                goto apply_delta_op_bier_error;
+            }
+            ecmp->bitstring_length = bitstring_length;
+            memcpy(&ecmp->bfr_nei_addr, &addr, sizeof(addr));
+            bitstring_load(ecmp->forwarding_bitmask, op->fbm,
+                           bitstring_length / 64);
+            entry->ecmp_entry[entry->nb_ecmp_entries++] = ecmp;
+            return entry;
+        }
+        case BIER_DELTA_MODIFY: {
+            if (member < 0) {
+                log_err("BFR %u has no ECMP member to modify", op->bfr_id);
+                goto apply_delta_op_bier_error;
+            }
+            bitstring_load(entry->ecmp_entry[member]->forwarding_bitmask,
+                           op->fbm, bitstring_length / 64);
+            return entry;
+        }
+        case BIER_DELTA_DELETE: {
+            if (!entry || (has_nei && member < 0)) {
+                log_err("BFR %u has no entry to delete", op->bfr_id);
+                goto apply_delta_op_bier_error;
+            }
+            if (has_nei && entry->nb_ecmp_entries > 1) {
+                free(entry->ecmp_entry[member]->forwarding_bitmask);
+                free(entry->ecmp_entry[member]);
+                entry->ecmp_entry[member] =
+                    entry->ecmp_entry[--entry->nb_ecmp_entries];
+                return entry;
+            }
+            // Without a member left, the BFR-ID is unknown
+            free_bft_entry(entry);
+            return NULL;
+        }
+    }
+
+apply_delta_op_bier_error:
+    *err = -1;
+    return entry;
+}
+
+/**
+ * @brief Applies the changes of *delta* to a copy of the BIER BIFT *old*. The
+ * copy shares the entries left untouched and the replaced structures of *old*
+ * are added to *garbage*. Linear in the number of entries, not in the number
+ * of operations: the entry pointers are copied and the whole compiled table
+ * is built again (see bier_bift_apply_delta)
+ *
+ * @return bier_internal_t* the new BIFT, NULL on error
+ */
+static bier_internal_t *apply_delta_bier(const bier_internal_t *old,
+                                         const bier_delta_t *delta,
+                                         bool use_ipv4,
+                                         bier_delta_garbage_t **garbage) {
+    uint32_t nb_bft_entry = old->nb_bft_entry;
+    for (int i = 0; i < delta->nb_ops; ++i) {
+        if (delta->ops[i].bfr_id > old->bitstring_length) {
+            log_err("BFR %u is out of the bitstring of the BIFT",
+                    delta->ops[i].bfr_id);
+            return NULL;
+        }
+        if (delta->ops[i].bfr_id > nb_bft_entry) {
+            nb_bft_entry = delta->ops[i].bfr_id;
+        }
+    }
+
+    bier_internal_t *new = (bier_internal_t *)malloc(sizeof(bier_internal_t));
+    bool *owned = (bool *)calloc(nb_bft_entry, sizeof(bool));
+    if (!new || !owned) {
+        log_perror("malloc delta bier internal");
+        free(new);
+        free(owned);
+        return NULL;
+    }
+    memcpy(new, old, sizeof(bier_internal_t));
+    new->nb_bft_entry = nb_bft_entry;
+    new->compiled = NULL;
+    new->bft = (bier_bft_entry_t **)calloc(nb_bft_entry,
+                                           sizeof(bier_bft_entry_t *));
+    if (!new->bft) {
+        log_perror("calloc delta bft");
+        goto apply_delta_bier_error;
+    }
+    memcpy(new->bft, old->bft, sizeof(bier_bft_entry_t *) * old->nb_bft_entry);
+
+    // An entry is copied the first time it is changed, and the copy is then
+    // changed in place by the next operations of the delta
+    for (int i = 0; i < delta->nb_ops; ++i) {
+        uint32_t idx = delta->ops[i].bfr_id - 1;
+        if (!owned[idx] && new->bft[idx]) {
+            new->bft[idx] =
+                copy_bft_entry(new->bft[idx], old->bitstring_length);
+            if (!new->bft[idx]) {
+                goto apply_delta_bier_error;
+            }
+        }
+        owned[idx] = true;
+        int err = 0;
+        new->bft[idx] = apply_delta_op_bier(new->bft[idx], &delta->ops[i],
+                                            old->bitstring_length, use_ipv4,
+                                            &err);
+        if (err < 0) {
+            goto apply_delta_bier_error;
+        }
+    }
+
+    new->compiled = compile_bier_bft(new, use_ipv4);
+    if (!new->compiled) {
+        goto apply_delta_bier_error;
+    }
+    // Keep the counters of the neighbours still in the BIFT. The replicas
+    // sent with the old BIFT until it is retired are not counted
+    const bier_bft_compiled_t *old_compiled = old->compiled;
+    for (uint32_t n = 0; n < new->compiled->nb_neighbours; ++n) {
+        for (uint32_t o = 0; o < old_compiled->nb_neighbours; ++o) {
+            if (same_neighbour(&new->compiled->nei_addr[n],
+                               &old_compiled->nei_addr[o], use_ipv4)) {
+                atomic_store(
+                    &new->compiled->nei_stats[n].tx_packets,
+                    bier_stats_read(old_compiled->nei_stats[o].tx_packets));
+                atomic_store(
+                    &new->compiled->nei_stats[n].tx_bytes,
+                    bier_stats_read(old_compiled->nei_stats[o].tx_bytes));
+                break;
+            }
+        }
+    }
+
+    for (int idx = 0; idx < old->nb_bft_entry; ++idx) {
+        if (owned[idx] && old->bft[idx] &&
+            delta_garbage_add(garbage, old->bft[idx], free_bft_entry) < 0) {
+            goto apply_delta_bier_error;
+        }
+    }
+    if (delta_garbage_add(garbage, old->compiled, free_compiled_bft_garbage) <
+            0 ||
+        delta_garbage_add(garbage, old->bft, free) < 0 ||
+        delta_garbage_add(garbage, (void *)old, free) < 0) {
+        goto apply_delta_bier_error;
+    }
+    free(owned);
+    return new;
+
+apply_delta_bier_error:
+    for (uint32_t idx = 0; new->bft && idx < nb_bft_entry; ++idx) {
+        if (owned[idx] && new->bft[idx]) {
+            free_bft_entry(new->bft[idx]);
+        }
+    }
+    free_compiled_bft(new->compiled);
+    free(new->bft);
+    free(new);
+    free(owned);
+    return NULL;
+}
+
+/**
+ * @brief Index of the adjacency of *bift* for the BP *bp* through *addr*, or
+ * through any neighbour if *addr* is NULL. -1 if none
+ */
+static int find_te_adjacency(const bier_te_internal_t *bift, uint32_t bp,
+                             const bier_nei_addr_t *addr, bool use_ipv4) {
+    for (int i = 0; i < bift->nb_adjacencies; ++i) {
+        if ((uint32_t)bift->adj_to_bp[i] == bp &&
+            (!addr ||
+             same_neighbour((const bier_nei_addr_t *)&bift->bfr_nei_addr[i],
+                            addr, use_ipv4))) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Applies *op* on the adjacencies of *bift*, which have room for one
+ * more adjacency
+ *
+ * @return int 0 on success, -1 otherwise
+ */
+static int apply_delta_op_bier_te(bier_te_internal_t *bift,
+                                  const bier_delta_op_t *op, bool use_ipv4) {
+    bier_nei_addr_t addr;
+    bool has_nei = op->nei_family != AF_UNSPEC;
+    if ((op->op != BIER_DELTA_DELETE || has_nei) &&
+        delta_nei_addr(op, use_ipv4, &addr) < 0) {
+        return -1;
+    }
+    uint32_t bp_idx = op->bfr_id - 1;
+    switch (op->op) {
+        case BIER_DELTA_ADD: {
+            if (find_te_adjacency(bift, op->bfr_id, &addr, use_ipv4) >= 0) {
+                log_err("BP %u already has this adjacency", op->bfr_id);
+                return -1;
+            }
+            int i = bift->nb_adjacencies++;
+            bift->adj_to_bp[i] = op->bfr_id;
+            memset(&bift->bfr_nei_addr[i], 0, sizeof(sockaddr_uniform_t));
+            memcpy(&bift->bfr_nei_addr[i], &addr, sizeof(addr));
+            atomic_init(&bift->nei_stats[i].tx_packets, 0);
+            atomic_init(&bift->nei_stats[i].tx_bytes, 0);
+            bift->global_bitstring[bp_idx / 64] |= (uint64_t)1 << (bp_idx % 64);
+            return 0;
+        }
+        case BIER_DELTA_MODIFY: {
+            int i = find_te_adjacency(bift, op->bfr_id, NULL, use_ipv4);
+            if (i < 0) {
+                log_err("BP %u has no adjacency to modify", op->bfr_id);
+                return -1;
+            }
+            memset(&bift->bfr_nei_addr[i], 0, sizeof(sockaddr_uniform_t));
+            memcpy(&bift->bfr_nei_addr[i], &addr, sizeof(addr));
+            atomic_store(&bift->nei_stats[i].tx_packets, 0);
+            atomic_store(&bift->nei_stats[i].tx_bytes, 0);
+            return 0;
+        }
+        case BIER_DELTA_DELETE: {
+            int i = find_te_adjacency(bift, op->bfr_id, has_nei ? &addr : NULL,
+                                      use_ipv4);
+            if (i < 0) {
+                log_err("BP %u has no adjacency to delete", op->bfr_id);
+                return -1;
+            }
+            // The order of the adjacencies does not matter
+            do {
+                int last = --bift->nb_adjacencies;
+                bift->adj_to_bp[i] = bift->adj_to_bp[last];
+                memcpy(&bift->bfr_nei_addr[i], &bift->bfr_nei_addr[last],
+                       sizeof(sockaddr_uniform_t));
+                atomic_store(&bift->nei_stats[i].tx_packets,
+                             atomic_load(&bift->nei_stats[last].tx_packets));
+                atomic_store(&bift->nei_stats[i].tx_bytes,
+                             atomic_load(&bift->nei_stats[last].tx_bytes));
+                i = has_nei ? -1
+                            : find_te_adjacency(bift, op->bfr_id, NULL,
+                                                use_ipv4);
+            } while (i >= 0);
+            if (find_te_adjacency(bift, op->bfr_id, NULL, use_ipv4) < 0) {
+                bift->global_bitstring[bp_idx / 64] &=
+                    ~((uint64_t)1 << (bp_idx % 64));
+            }
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Applies the changes of *delta* to a copy of the BIER-TE BIFT *old*,
+ * which is added to *garbage*
+ *
+ * @return bier_te_internal_t* the new BIFT, NULL on error
+ */
+static bier_te_internal_t *apply_delta_bier_te(
+    const bier_te_internal_t *old, const bier_delta_t *delta, bool use_ipv4,
+    bier_delta_garbage_t **garbage) {
+    int capacity = old->nb_adjacencies;
+    for (int i = 0; i < delta->nb_ops; ++i) {
+        if (delta->ops[i].bfr_id > old->bitstring_length) {
+            log_err("BP %u is out of the bitstring of the BIFT",
+                    delta->ops[i].bfr_id);
+            return NULL;
+        }
+        if (delta->ops[i].op == BIER_DELTA_ADD) {
+            ++capacity;
+        }
+    }
+    capacity = capacity > 0 ? capacity : 1;
+
+    bier_te_internal_t *new =
+        (bier_te_internal_t *)calloc(1, sizeof(bier_te_internal_t));
+    if (!new) {
+        log_perror("calloc delta bier te internal");
+        return NULL;
+    }
+    new->bift_id = old->bift_id;
+    new->local_bfr_id = old->local_bfr_id;
+    new->bitstring_length = old->bitstring_length;
+    new->nb_adjacencies = old->nb_adjacencies;
+    size_t bitstring_size = sizeof(uint64_t) * (old->bitstring_length / 64);
+    new->global_bitstring = (uint64_t *)malloc(bitstring_size);
+    new->bfr_nei_addr =
+        (sockaddr_uniform_t *)calloc(capacity, sizeof(sockaddr_uniform_t));
+    new->adj_to_bp = (int *)calloc(capacity, sizeof(int));
+    new->nei_stats =
+        (bier_nei_stats_t *)calloc(capacity, sizeof(bier_nei_stats_t));
+    if (!new->global_bitstring || !new->bfr_nei_addr || !new->adj_to_bp ||
+        !new->nei_stats) {
+        log_perror("malloc delta bier te");
+        goto apply_delta_bier_te_error;
+    }
+    memcpy(new->global_bitstring, old->global_bitstring, bitstring_size);
+    memcpy(new->bfr_nei_addr, old->bfr_nei_addr,
+           sizeof(sockaddr_uniform_t) * old->nb_adjacencies);
+    memcpy(new->adj_to_bp, old->adj_to_bp, sizeof(int) * old->nb_adjacencies);
+    for (int i = 0; i < old->nb_adjacencies; ++i) {
+        atomic_init(&new->nei_stats[i].tx_packets,
+                    bier_stats_read(old->nei_stats[i].tx_packets));
+        atomic_init(&new->nei_stats[i].tx_bytes,
+                    bier_stats_read(old->nei_stats[i].tx_bytes));
+    }
+
+    for (int i = 0; i < delta->nb_ops; ++i) {
+        if (apply_delta_op_bier_te(new, &delta->ops[i], use_ipv4) < 0) {
+            goto apply_delta_bier_te_error;
+        }
+    }
+    if (index_bier_te(new) < 0) {
+        goto apply_delta_bier_te_error;
+    }
+    if (delta_garbage_add(garbage, (void *)old, free_bier_te_garbage) < 0) {
+        goto apply_delta_bier_te_error;
+    }
+    return new;
+
+apply_delta_bier_te_error:
+    free_bier_internal_bier_te(new);
+    return NULL;
+}
+
+bier_bift_table_t *bier_bift_apply_delta(const bier_bift_table_t *table,
+                                         const bier_delta_t *delta,
+                                         bool use_ipv4,
+                                         bier_delta_garbage_t **garbage) {
+    *garbage = NULL;
+    int bift_id = bier_bift_find(table, delta->bift_id);
+    if (bift_id < 0) {
+        log_err("Delta of an unknown BIFT: %u", delta->bift_id);
+        return NULL;
+    }
+
+    bier_bift_table_t *new =
+        (bier_bift_table_t *)calloc(1, sizeof(bier_bift_table_t));
+    if (!new) {
+        log_perror("calloc delta BIFT table");
+        return NULL;
+    }
+    new->nb_bift = table->nb_bift;
+    new->b = (bier_bift_type_t *)malloc(sizeof(bier_bift_type_t) *
+                                        table->nb_bift);
+    if (!new->b) {
+        log_perror("malloc delta BIFTs");
+        free(new);
+        return NULL;
+    }
+    // The other BIFTs are shared with the current table. The index is small
+    // enough to be built again
+    memcpy(new->b, table->b, sizeof(bier_bift_type_t) * table->nb_bift);
+    if (index_bier_bift_table(new) < 0 ||
+        delta_garbage_add(garbage, table->b, free) < 0 ||
+        delta_garbage_add(garbage, (void *)table,
+                          free_bier_bift_table_index) < 0) {
+        goto bier_bift_apply_delta_error;
+    }
+
+    // The union members share the same pointer
+    bier_bift_type_t *bift = &new->b[bift_id];
+    if (bift->t == BIER) {
+        bift->bier = apply_delta_bier(bift->bier, delta, use_ipv4, garbage);
+    } else {
+        bift->bier_te =
+            apply_delta_bier_te(bift->bier_te, delta, use_ipv4, garbage);
+    }
+    if (!bift->bier) {
+        goto bier_bift_apply_delta_error;
+    }
+    return new;
+
+bier_bift_apply_delta_error:
+    // The current table is left untouched
+    delta_garbage_drop(*garbage);
+    *garbage = NULL;
+    free(new->b);
+    free_bier_bift_table_index(new);
+    return NULL;
+}
+
+bier_bift_t *read_config_file(char *config_filepath, bool use_ipv4) {
+    sockaddr_uniform_t local;
+    bier_bift_table_t *table =
+        read_bift_table(config_filepath, use_ipv4, &local);
+    if (!table) {
+        return NULL;
+    }
+
+    bier_bift_t *bier_bift = (bier_bift_t *)calloc(1, sizeof(bier_bift_t));
+    if (!bier_bift) {
+        log_perror("malloc-config");
+        free_bier_bift_table(table);
+        return NULL;
+    }
+    bier_bift->socket = -1;
+    bier_bift->origin = bier_bift;
+    atomic_init(&bier_bift->table, table);
+    memcpy(&bier_bift->local, &local, sizeof(bier_bift->local));
+    // Allocated for any configuration loaded later
+    bier_bift->stats =
+        (bier_bift_stats_t *)calloc(BIER_MAX_BIFT, sizeof(bier_bift_stats_t));
+    if (!bier_bift->stats) {
+        log_perror("Malloc BIFT stats");
+        free_bier_bft(bier_bift);
+        return NULL;
+    }
+
+    char local_addr_str[INET6_ADDRSTRLEN] = {};
+    if (use_ipv4) {
+        inet_ntop(AF_INET, &local.v4.sin_addr, local_addr_str,
+                  sizeof(local_addr_str));
+    } else {
+        inet_ntop(AF_INET6, &local.v6.sin6_addr, local_addr_str,
+                  sizeof(local_addr_str));
+    }
+
+    // Open raw socket to forward the packets
+    bier_bift->socket = bier_open_socket(bier_bift);
+    if (bier_bift->socket < 0) {
+        log_err("The address was: %s", local_addr_str);
+        free_bier_bft(bier_bift);
+        return NULL;
+    }
+    log_info("Bind to local address on router: %s", local_addr_str);
+    bier_bift->tx = init_tx_queue(bier_bift->socket, BIER_TX_QUEUE_SIZE);
+    if (!bier_bift->tx) {
+        free_bier_bft(bier_bift);
+        return NULL;
+    }
+
+    return bier_bift;
+}
+
+int bier_open_socket(const bier_bift_t *bier) {
+    bool use_ipv4 = bier->local.v4.sin_family == AF_INET;
+    int sfd = socket(use_ipv4 ? AF_INET : AF_INET6, SOCK_RAW, 253);
+    if (sfd < 0) {
+        log_perror("socket BFT");
+        return -1;
+    }
+    int err;
+    if (use_ipv4) {
+        err = bind(sfd, (struct sockaddr *)&bier->local.v4, sizeof(bier->local.v4));
+    } else {
+        err = bind(sfd, (struct sockaddr *)&bier->local.v6, sizeof(bier->local.v6));
+    }
+    if (err < 0) {
+        log_perror("Bind local router");
+        close(sfd);
+        return -1;
+    }
+    return sfd;
+}
+
+bier_bift_t *bier_bift_worker_view(bier_bift_t *bier, int socket) {
+    bier_bift_t **workers = (bier_bift_t **)realloc(
+        bier->workers, sizeof(bier_bift_t *) * (bier->nb_workers + 1));
+    if (!workers) {
+        log_perror("realloc workers");
+        close(socket);
+        return NULL;
+    }
+    bier->workers = workers;
+    bier_bift_t *view = (bier_bift_t *)calloc(1, sizeof(bier_bift_t));
+    if (!view) {
+        log_perror("calloc view");
+        close(socket);
+        return NULL;
+    }
+    memcpy(&view->local, &bier->local, sizeof(view->local));
+    view->origin = bier;
+    view->socket = socket;
+    view->stats =
+        (bier_bift_stats_t *)calloc(BIER_MAX_BIFT, sizeof(bier_bift_stats_t));
+    view->tx = init_tx_queue(socket, BIER_TX_QUEUE_SIZE);
+    if (!view->stats || !view->tx) {
+        log_perror("calloc view stats");
+        free_bier_bift_view(view);
+        return NULL;
+    }
+    bier->workers[bier->nb_workers++] = view;
+    return view;
+}
+
+void free_bier_bift_view(bier_bift_t *view) {
+    free(view->stats);
+    free_tx_queue(view->tx);
+    close(view->socket);
+    free(view);
+}
+
+#define BIER_DEMUX_MIN_BUCKETS 16
+
+/**
+ * @brief Normalized key of the demux table: raw packets ignore the group
+ */
+static void bier_demux_key(uint16_t proto, int *family, const void *group,
+                           uint8_t key_group[16]) {
+    memset(key_group, 0, 16);
+    if (proto == BIERPROTO_RESERVED_RAW) {
+        *family = 0;
+    } else if (*family == AF_INET) {
+        memcpy(key_group, group, sizeof(struct in_addr));
+    } else {
+        memcpy(key_group, group, sizeof(struct in6_addr));
+    }
+}
+
+// FNV-1a
+static uint32_t bier_demux_hash(uint16_t proto, int family,
+                                const uint8_t group[16]) {
+    uint32_t hash = 2166136261u;
+    hash = (hash ^ proto) * 16777619u;
+    hash = (hash ^ (uint32_t)family) * 16777619u;
+    for (int i = 0; i < 16; ++i) {
+        hash = (hash ^ group[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * @brief Bucket holding the key, or the empty bucket where it would be
+ * inserted. The table must have at least one empty bucket
+ */
+static uint32_t bier_demux_find(const bier_demux_t *demux, uint16_t proto,
+                                int family, const uint8_t group[16]) {
+    uint32_t mask = demux->nb_buckets - 1;
+    uint32_t i = bier_demux_hash(proto, family, group) & mask;
+    while (demux->buckets[i].nb_apps > 0) {
+        const bier_demux_entry_t *entry = &demux->buckets[i];
+        if (entry->proto == proto && entry->family == family &&
+            memcmp(entry->group, group, 16) == 0) {
+            break;
+        }
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+static int bier_demux_resize(bier_demux_t *demux, uint32_t nb_buckets) {
+    bier_demux_entry_t *buckets =
+        (bier_demux_entry_t *)calloc(nb_buckets, sizeof(bier_demux_entry_t));
+    if (!buckets) {
+        log_perror("calloc demux buckets");
+        return -1;
+    }
+    bier_demux_t resized = {nb_buckets, demux->nb_entries, buckets};
+    for (uint32_t i = 0; i < demux->nb_buckets; ++i) {
+        bier_demux_entry_t *entry = &demux->buckets[i];
+        if (entry->nb_apps > 0) {
+            uint32_t idx = bier_demux_find(&resized, entry->proto,
+                                           entry->family, entry->group);
+            buckets[idx] = *entry;
+        }
+    }
+    free(demux->buckets);
+    *demux = resized;
+    return 0;
+}
+
+int bier_demux_add(bier_demux_t *demux, uint16_t proto, int family,
+                   const void *group, bier_app_handle_t app) {
+    // Keep the load factor below 1/2 for short probe sequences
+    if (2 * (demux->nb_entries + 1) > demux->nb_buckets) {
+        uint32_t nb_buckets = demux->nb_buckets ? 2 * demux->nb_buckets
+                                                : BIER_DEMUX_MIN_BUCKETS;
+        if (bier_demux_resize(demux, nb_buckets) < 0) {
+            return -1;
+        }
+    }
+    uint8_t key_group[16];
+    bier_demux_key(proto, &family, group, key_group);
+    bier_demux_entry_t *entry =
+        &demux->buckets[bier_demux_find(demux, proto, family, key_group)];
+    for (int i = 0; i < entry->nb_apps; ++i) {
+        if (entry->apps[i] == app) {
+            return 0;  // Already subscribed
+        }
+    }
+    if (entry->nb_apps == entry->capacity) {
+        int capacity = entry->capacity ? 2 * entry->capacity : 2;
+        bier_app_handle_t *apps = (bier_app_handle_t *)realloc(
+            entry->apps, sizeof(bier_app_handle_t) * capacity);
+        if (!apps) {
+            log_perror("realloc demux apps");
+            return -1;
+        }
+        entry->apps = apps;
+        entry->capacity = capacity;
+    }
+    if (entry->nb_apps == 0) {
+        entry->proto = proto;
+        entry->family = family;
+        memcpy(entry->group, key_group, 16);
+        ++demux->nb_entries;
+    }
+    entry->apps[entry->nb_apps++] = app;
+    return 0;
+}
+
+int bier_demux_remove(bier_demux_t *demux, uint16_t proto, int family,
+                      const void *group, bier_app_handle_t app) {
+    if (demux->nb_entries == 0) {
+        return -1;
+    }
+    uint8_t key_group[16];
+    bier_demux_key(proto, &family, group, key_group);
+    uint32_t i = bier_demux_find(demux, proto, family, key_group);
+    bier_demux_entry_t *entry = &demux->buckets[i];
+    int j;
+    for (j = 0; j < entry->nb_apps && entry->apps[j] != app; ++j) {
+    }
+    if (j == entry->nb_apps) {
+        return -1;
+    }
+    entry->apps[j] = entry->apps[--entry->nb_apps];
+    if (entry->nb_apps > 0) {
+        return 0;
+    }
+
+    // Last subscriber: empty the bucket and shift back the following entries
+    // of the probe sequence to keep them reachable
+    free(entry->apps);
+    memset(entry, 0, sizeof(bier_demux_entry_t));
+    --demux->nb_entries;
+    uint32_t mask = demux->nb_buckets - 1;
+    for (uint32_t next = (i + 1) & mask; demux->buckets[next].nb_apps > 0;
+         next = (next + 1) & mask) {
+        bier_demux_entry_t *moved = &demux->buckets[next];
+        uint32_t home =
+            bier_demux_hash(moved->proto, moved->family, moved->group) & mask;
+        // Move it only if the empty bucket is between its home and itself
+        if (((next - home) & mask) >= ((next - i) & mask)) {
+            demux->buckets[i] = *moved;
+            memset(moved, 0, sizeof(bier_demux_entry_t));
+            i = next;
+        }
+    }
+    return 0;
+}
+
+const bier_demux_entry_t *bier_demux_lookup(const bier_demux_t *demux,
+                                            uint16_t proto, int family,
+                                            const void *group) {
+    if (demux->nb_entries == 0) {
+        return NULL;
+    }
+    uint8_t key_group[16];
+    bier_demux_key(proto, &family, group, key_group);
+    const bier_demux_entry_t *entry =
+        &demux->buckets[bier_demux_find(demux, proto, family, key_group)];
+    return entry->nb_apps > 0 ? entry : NULL;
+}
+
+void bier_demux_free(bier_demux_t *demux) {
+    for (uint32_t i = 0; i < demux->nb_buckets; ++i) {
+        free(demux->buckets[i].apps);
+    }
+    free(demux->buckets);
+    memset(demux, 0, sizeof(bier_demux_t));
+}
+
+#define BIER_APPS_MIN_CAPACITY 16
+
+bier_app_handle_t bier_app_register(bier_all_apps_t *all_apps,
+                                    bier_application_t **app) {
+    if (all_apps->free_head == 0) {
+        // All slots are used: double the registry and chain the new slots
+        uint32_t capacity = all_apps->capacity ? 2 * all_apps->capacity
+                                               : BIER_APPS_MIN_CAPACITY;
+        bier_application_t *apps = (bier_application_t *)realloc(
+            all_apps->apps, sizeof(bier_application_t) * capacity);
+        if (!apps) {
+            log_perror("realloc applications");
+            return BIER_APP_INVALID_HANDLE;
+        }
+        memset(&apps[all_apps->capacity], 0,
+               sizeof(bier_application_t) * (capacity - all_apps->capacity));
+        for (uint32_t i = all_apps->capacity; i < capacity - 1; ++i) {
+            apps[i].next_free = i + 2;
+        }
+        all_apps->free_head = all_apps->capacity + 1;
+        all_apps->apps = apps;
+        all_apps->capacity = capacity;
+    }
+    uint32_t idx = all_apps->free_head - 1;
+    bier_application_t *slot = &all_apps->apps[idx];
+    all_apps->free_head = slot->next_free;
+    uint32_t generation = slot->generation;
+    memset(slot, 0, sizeof(bier_application_t));
+    slot->generation = generation;
+    slot->is_active = true;
+    ++all_apps->nb_apps;
+    *app = slot;
+    return bier_app_handle(idx, generation);
+}
+
+int bier_app_unregister(bier_all_apps_t *all_apps, bier_app_handle_t handle) {
+    bier_application_t *app = bier_app_get(all_apps, handle);
+    if (!app) {
+        return -1;
+    }
+    uint32_t idx = bier_app_handle_idx(handle);
+    app->is_active = false;
+    ++app->generation;
+    app->next_free = all_apps->free_head;
+    all_apps->free_head = idx + 1;
+    --all_apps->nb_apps;
+    return 0;
+}
+
+bier_shm_channel_t *bier_shm_find(bier_all_apps_t *all_apps,
+                                  const char *unix_path) {
+    for (int i = 0; i < all_apps->nb_shm_channels; ++i) {
+        if (strcmp(all_apps->shm_channels[i]->unix_path, unix_path) == 0) {
+            return all_apps->shm_channels[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Sets the shared memory channel of all applications bound to
+ * *unix_path*
+ */
+static void bier_shm_set_apps(bier_all_apps_t *all_apps, const char *unix_path,
+                              bier_shm_channel_t *channel) {
+    for (uint32_t i = 0; i < all_apps->capacity; ++i) {
+        bier_application_t *app = &all_apps->apps[i];
+        if (app->is_active && strcmp(app->app_addr.sun_path, unix_path) == 0) {
+            app->shm = channel;
+        }
+    }
+}
+
+static void bier_shm_channel_free(bier_shm_channel_t *channel) {
+    munmap(channel->mem, channel->mem_size);
+    close(channel->rx.efd);
+    close(channel->tx.efd);
+    free(channel);
+}
+
+bier_shm_channel_t *bier_shm_attach(bier_all_apps_t *all_apps,
+                                    const bier_shm_request_t *request,
+                                    int memfd, int efd_rx, int efd_tx) {
+    bier_shm_channel_t *channel = NULL;
+    if (bier_shm_find(all_apps, request->unix_path)) {
+        log_err("A shared memory channel is already attached for %s",
+                request->unix_path);
+        goto attach_error;
+    }
+    // The size is checked against the memfd, which cannot shrink, so that the
+    // daemon never reads outside of the mapping
+    struct stat st;
+    if (fstat(memfd, &st) < 0) {
+        log_perror("fstat shared memory");
+        goto attach_error;
+    }
+    int seals = fcntl(memfd, F_GET_SEALS);
+    if (seals < 0 || !(seals & F_SEAL_SHRINK)) {
+        log_err("The shared memory of %s is not sealed", request->unix_path);
+        goto attach_error;
+    }
+    bier_shm_channel_t **channels = (bier_shm_channel_t **)realloc(
+        all_apps->shm_channels,
+        sizeof(bier_shm_channel_t *) * (all_apps->nb_shm_channels + 1));
+    if (!channels) {
+        log_perror("realloc shared memory channels");
+        goto attach_error;
+    }
+    all_apps->shm_channels = channels;
+    channel = (bier_shm_channel_t *)calloc(1, sizeof(bier_shm_channel_t));
+    if (!channel) {
+        log_perror("calloc shared memory channel");
+        goto attach_error;
+    }
+    channel->mem = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                        memfd, 0);
+    if (channel->mem == MAP_FAILED) {
+        log_perror("mmap shared memory");
+        goto attach_error;
+    }
+    channel->mem_size = st.st_size;
+    bier_shm_ring_t rings[2];
+    if (bier_shm_map_rings(channel->mem, channel->mem_size, request->nb_slots,
+                           rings) < 0) {
+        log_err("Invalid shared memory of %lu bytes for %u slots",
+                channel->mem_size, request->nb_slots);
+        munmap(channel->mem, channel->mem_size);
+        goto attach_error;
+    }
+    channel->rx = rings[0];
+    channel->rx.efd = efd_rx;
+    channel->tx = rings[1];
+    channel->tx.efd = efd_tx;
+    close(memfd);
+    strcpy(channel->unix_path, request->unix_path);
+
+    all_apps->shm_channels[all_apps->nb_shm_channels++] = channel;
+    bier_shm_set_apps(all_apps, channel->unix_path, channel);
+    log_info("Shared memory channel attached for %s", channel->unix_path);
+    return channel;
+
+attach_error:
+    free(channel);
+    close(memfd);
+    close(efd_rx);
+    close(efd_tx);
+    return NULL;
+}
+
+int bier_shm_detach(bier_all_apps_t *all_apps, const char *unix_path) {
+    for (int i = 0; i < all_apps->nb_shm_channels; ++i) {
+        bier_shm_channel_t *channel = all_apps->shm_channels[i];
+        if (strcmp(channel->unix_path, unix_path) == 0) {
+            // *unix_path* may be the one of the channel
+            log_info("Shared memory channel detached for %s", unix_path);
+            bier_shm_set_apps(all_apps, unix_path, NULL);
+            all_apps->shm_channels[i] =
+                all_apps->shm_channels[--all_apps->nb_shm_channels];
+            bier_shm_channel_free(channel);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+void bier_apps_free(bier_all_apps_t *all_apps) {
+    for (int i = 0; i < all_apps->nb_shm_channels; ++i) {
+        bier_shm_channel_free(all_apps->shm_channels[i]);
+    }
+    free(all_apps->shm_channels);
+    all_apps->shm_channels = NULL;
+    all_apps->nb_shm_channels = 0;
+    bier_demux_free(&all_apps->demux);
+    free(all_apps->deliveries);
+    all_apps->deliveries = NULL;
+    all_apps->nb_deliveries = 0;
+    free(all_apps->apps);
+    all_apps->apps = NULL;
+    all_apps->capacity = 0;
+    all_apps->free_head = 0;
+    all_apps->nb_apps = 0;
+}
+
+bier_all_apps_t *bier_apps_snapshot(const bier_all_apps_t *all_apps) {
+    bier_all_apps_t *snapshot =
+        (bier_all_apps_t *)calloc(1, sizeof(bier_all_apps_t));
+    if (!snapshot) {
+        log_perror("calloc apps snapshot");
+        return NULL;
+    }
+    snapshot->application_socket = all_apps->application_socket;
+    snapshot->nb_apps = all_apps->nb_apps;
+    if (all_apps->capacity > 0) {
+        snapshot->apps = (bier_application_t *)malloc(
+            sizeof(bier_application_t) * all_apps->capacity);
+        if (!snapshot->apps) {
+            log_perror("malloc apps snapshot");
+            bier_apps_snapshot_free(snapshot);
+            return NULL;
+        }
+        memcpy(snapshot->apps, all_apps->apps,
+               sizeof(bier_application_t) * all_apps->capacity);
+        snapshot->capacity = all_apps->capacity;
+        for (uint32_t i = 0; i < snapshot->capacity; ++i) {
+            snapshot->apps[i].shm = NULL;
+        }
+    }
+    const bier_demux_t *demux = &all_apps->demux;
+    if (demux->nb_buckets > 0) {
+        snapshot->demux.buckets = (bier_demux_entry_t *)calloc(
+            demux->nb_buckets, sizeof(bier_demux_entry_t));
+        if (!snapshot->demux.buckets) {
+            log_perror("calloc demux snapshot");
+            bier_apps_snapshot_free(snapshot);
+            return NULL;
+        }
+        snapshot->demux.nb_buckets = demux->nb_buckets;
+        snapshot->demux.nb_entries = demux->nb_entries;
+        for (uint32_t i = 0; i < demux->nb_buckets; ++i) {
+            const bier_demux_entry_t *entry = &demux->buckets[i];
+            if (entry->nb_apps == 0) {
+                continue;
+            }
+            bier_demux_entry_t *copy = &snapshot->demux.buckets[i];
+            *copy = *entry;
+            copy->capacity = entry->nb_apps;
+            copy->apps = (bier_app_handle_t *)malloc(
+                sizeof(bier_app_handle_t) * entry->nb_apps);
+            if (!copy->apps) {
+                log_perror("malloc demux snapshot entry");
+                copy->nb_apps = 0;
+                bier_apps_snapshot_free(snapshot);
+                return NULL;
+            }
+            memcpy(copy->apps, entry->apps,
+                   sizeof(bier_app_handle_t) * entry->nb_apps);
+        }
+    }
+    return snapshot;
+}
+
+void bier_apps_snapshot_free(void *snapshot) {
+    bier_apps_free((bier_all_apps_t *)snapshot);
+    free(snapshot);
+}
+
+/**
+ * @brief Applications subscribed to the destination of the packet following
+ * the BIER header
+ *
+ * @param all_apps the applications
+ * @param payload the packet following the BIER header
+ * @param payload_length length of *payload*
+ * @param bier_proto the BIER proto of the packet
+ * @return const bier_demux_entry_t* the subscribers, NULL if none
+ */
+static const bier_demux_entry_t *find_unix_destinations(
+    bier_all_apps_t *all_apps, uint8_t *payload, size_t payload_length,
+    uint16_t bier_proto) {
+    switch (bier_proto) {
+        case BIERPROTO_RESERVED_RAW:
+            // Raw proto means that we do not care about the destination
+            return bier_demux_lookup(&all_apps->demux, bier_proto, 0, NULL);
+        case BIERPROTO_IPV6:
+            if (payload_length < sizeof(struct ip6_hdr)) {
+                return NULL;
+            }
+            log_hex(LOG_DEBUG, "The received packet:", &payload[24], 16);
+            return bier_demux_lookup(&all_apps->demux, bier_proto, AF_INET6,
+                                     &payload[24]);
+        default:
+            log_err("Not supported protocol");
+            return NULL;
+    }
+}
+
+static inline uint16_t get_bier_proto(uint8_t *bier_header) {
+    return bier_header[9] & 0x3f;
+}
+
+void free_tx_queue(bier_tx_queue_t *tx) {
+    if (!tx) {
+        return;
+    }
+    free(tx->msgs);
+    free(tx->iovecs);
+    free(tx->dsts);
+    free(tx->nei_stats);
+    free(tx->bift_stats);
+    free(tx->headers);
+    free(tx);
+}
+
+bier_tx_queue_t *init_tx_queue(int socket, unsigned int capacity) {
+    bier_tx_queue_t *tx = (bier_tx_queue_t *)calloc(1, sizeof(bier_tx_queue_t));
+    if (!tx) {
+        log_perror("calloc tx queue");
+        return NULL;
+    }
+    tx->socket = socket;
+    tx->capacity = capacity;
+    tx->msgs = (struct mmsghdr *)calloc(capacity, sizeof(struct mmsghdr));
+    tx->iovecs = (struct iovec *)calloc(2 * capacity, sizeof(struct iovec));
+    tx->dsts = (bier_nei_addr_t *)calloc(capacity, sizeof(bier_nei_addr_t));
+    tx->nei_stats =
+        (bier_nei_stats_t **)calloc(capacity, sizeof(bier_nei_stats_t *));
+    tx->bift_stats =
+        (bier_bift_stats_t **)calloc(capacity, sizeof(bier_bift_stats_t *));
+    tx->headers =
+        (uint8_t *)malloc(sizeof(uint8_t) * BIER_TX_HEADER_SIZE * capacity);
+    if (!tx->msgs || !tx->iovecs || !tx->dsts || !tx->nei_stats ||
+        !tx->bift_stats || !tx->headers) {
+        log_perror("malloc tx queue");
+        free_tx_queue(tx);
+        return NULL;
+    }
+
+    for (unsigned int i = 0; i < capacity; ++i) {
+        tx->iovecs[2 * i].iov_base = &tx->headers[i * BIER_TX_HEADER_SIZE];
+        tx->msgs[i].msg_hdr.msg_iov = &tx->iovecs[2 * i];
+        tx->msgs[i].msg_hdr.msg_name = &tx->dsts[i];
+    }
+    return tx;
+}
+
+uint8_t *bier_tx_queue_slot(bier_tx_queue_t *tx, size_t header_length) {
+    if (header_length > BIER_TX_HEADER_SIZE) {
+        log_err("BIER header of %lu bytes is too long", header_length);
+        return NULL;
+    }
+    if (tx->nb_queued == tx->capacity) {
+        bier_tx_queue_flush(tx);
+    }
+    return tx->iovecs[2 * tx->nb_queued].iov_base;
+}
+
+void bier_tx_queue_commit(bier_tx_queue_t *tx, size_t header_length,
+                          const uint8_t *payload, size_t payload_length,
+                          const struct sockaddr *dst, socklen_t dst_len,
+                          bier_nei_stats_t *nei_stats,
+                          bier_bift_stats_t *bift_stats) {
+    unsigned int idx = tx->nb_queued++;
+    struct iovec *iov = &tx->iovecs[2 * idx];
+    iov[0].iov_len = header_length;
+    iov[1].iov_base = (void *)payload;
+    iov[1].iov_len = payload_length;
+    tx->msgs[idx].msg_hdr.msg_iovlen = payload_length > 0 ? 2 : 1;
+    memcpy(&tx->dsts[idx], dst, dst_len);
+    tx->msgs[idx].msg_hdr.msg_namelen = dst_len;
+    tx->nei_stats[idx] = nei_stats;
+    tx->bift_stats[idx] = bift_stats;
+}
+
+/**
+ * @brief Account the replicas [first, last) of the queue as sent
+ */
+static void bier_tx_queue_count_sent(bier_tx_queue_t *tx, unsigned int first,
+                                     unsigned int last) {
+    for (unsigned int i = first; i < last; ++i) {
+        if (tx->nei_stats[i]) {
+            bier_stats_inc(tx->nei_stats[i]->tx_packets);
+            bier_stats_add(tx->nei_stats[i]->tx_bytes, tx->msgs[i].msg_len);
+        }
+        if (tx->bift_stats[i]) {
+            bier_stats_inc(tx->bift_stats[i]->replicas_out);
+        }
+    }
+}
+
+int bier_tx_queue_flush(bier_tx_queue_t *tx) {
+    int nb_errors = 0;
+    unsigned int sent = 0;
+    while (sent < tx->nb_queued) {
+        int err = sendmmsg(tx->socket, &tx->msgs[sent], tx->nb_queued - sent,
+                           0);
+        if (err >= 0) {
+            bier_tx_queue_count_sent(tx, sent, sent + err);
+            sent += err;
+            continue;
+        } else if (errno == EINTR) {
+            continue;
+        }
+        // The error is the one of the first message not sent, which is
+        // dropped. The following ones are retried
+        char addr_str[INET6_ADDRSTRLEN] = {};
+        bier_nei_addr_t *dst = &tx->dsts[sent];
+        if (dst->v4.sin_family == AF_INET) {
+            inet_ntop(AF_INET, &dst->v4.sin_addr, addr_str, sizeof(addr_str));
+        } else {
+            inet_ntop(AF_INET6, &dst->v6.sin6_addr, addr_str,
+                      sizeof(addr_str));
+        }
+        log_err("Cannot send replica to %s: %s", addr_str, strerror(errno));
+        if (tx->bift_stats[sent]) {
+            bier_stats_inc(tx->bift_stats[sent]->drops[BIER_DROP_SEND_FAILURE]);
+        }
+        ++nb_errors;
+        ++sent;
+    }
+    tx->nb_queued = 0;
+    return nb_errors;
+}
+
+// Maximum number of applications with pending deliveries. The deliveries are
+// flushed when another application receives a frame
+#define BIER_DELIVERY_MAX_APPS 8
+// Maximum number of frames in a message to an application
+#define BIER_DELIVERY_MAX_FRAMES 64
+
+struct bier_app_delivery {
+    bier_app_handle_t app;
+    unsigned int nb_frames;
+    size_t length;  // Length of the message
+    bier_frame_header_t frames[BIER_DELIVERY_MAX_FRAMES];
+    struct iovec iov[2 * BIER_DELIVERY_MAX_FRAMES];  // Header and payload
+    bier_bift_stats_t *stats[BIER_DELIVERY_MAX_FRAMES];
+};
+
+/**
+ * @brief Sends the frames of *delivery* in a single message and empties it
+ *
+ * @return int 0 on success, -1 otherwise
+ */
+static int bier_app_delivery_send(bier_all_apps_t *all_apps,
+                                  bier_app_delivery_t *delivery) {
+    unsigned int nb_frames = delivery->nb_frames;
+    delivery->nb_frames = 0;
+    delivery->length = 0;
+    bier_application_t *app = bier_app_get(all_apps, delivery->app);
+    if (nb_frames == 0 || !app) {
+        return 0;
+    }
+    struct msghdr msg = {};
+    msg.msg_name = &app->app_addr;
+    msg.msg_namelen = app->addrlen;
+    msg.msg_iov = delivery->iov;
+    msg.msg_iovlen = 2 * nb_frames;
+    if (sendmsg(all_apps->application_socket, &msg, 0) < 0) {
+        log_perror("Send packets to application");
+        for (unsigned int i = 0; i < nb_frames; ++i) {
+            if (delivery->stats[i]) {
+                bier_stats_inc(
+                    delivery->stats[i]->drops[BIER_DROP_SEND_FAILURE]);
+            }
+        }
+        return -1;
+    }
+    for (unsigned int i = 0; i < nb_frames; ++i) {
+        if (delivery->stats[i]) {
+            bier_stats_inc(delivery->stats[i]->local_deliveries);
+        }
+    }
+    return 0;
+}
+
+int bier_app_deliveries_flush(bier_all_apps_t *all_apps) {
+    int err = 0;
+    for (int i = 0; i < all_apps->nb_deliveries; ++i) {
+        if (bier_app_delivery_send(all_apps, &all_apps->deliveries[i]) < 0) {
+            err = -1;
+        }
+    }
+    all_apps->nb_deliveries = 0;
+    return err;
+}
+
+/**
+ * @brief Queues the frame delivering *bier_received_packet* to the application
+ * *handle*. The payload is not copied
+ *
+ * @return int 0 on success, -1 if the frame cannot be queued and must be sent
+ * on its own
+ */
+static int bier_app_delivery_add(
+    bier_all_apps_t *all_apps, bier_app_handle_t handle,
+    const bier_received_packet_t *bier_received_packet,
+    bier_bift_stats_t *stats) {
+    size_t frame_length =
+        sizeof(bier_frame_header_t) + bier_received_packet->payload_length;
+    if (frame_length > BIER_UNIX_MAX_MESSAGE_SIZE) {
+        return -1;
+    }
+    if (!all_apps->deliveries) {
+        all_apps->deliveries = (bier_app_delivery_t *)malloc(
+            sizeof(bier_app_delivery_t) * BIER_DELIVERY_MAX_APPS);
+        if (!all_apps->deliveries) {
+            log_perror("malloc deliveries");
+            return -1;
+        }
+    }
+    bier_app_delivery_t *delivery = NULL;
+    for (int i = 0; i < all_apps->nb_deliveries; ++i) {
+        if (all_apps->deliveries[i].app == handle) {
+            delivery = &all_apps->deliveries[i];
+            break;
+        }
+    }
+    if (!delivery) {
+        if (all_apps->nb_deliveries == BIER_DELIVERY_MAX_APPS) {
+            bier_app_deliveries_flush(all_apps);
+        }
+        delivery = &all_apps->deliveries[all_apps->nb_deliveries++];
+        delivery->app = handle;
+        delivery->nb_frames = 0;
+        delivery->length = 0;
+    } else if (delivery->nb_frames == BIER_DELIVERY_MAX_FRAMES ||
+               delivery->length + frame_length > BIER_UNIX_MAX_MESSAGE_SIZE) {
+        bier_app_delivery_send(all_apps, delivery);
+    }
+    unsigned int n = delivery->nb_frames++;
+    fill_local_bier_frame_header(&delivery->frames[n], bier_received_packet);
+    delivery->iov[2 * n].iov_base = &delivery->frames[n];
+    delivery->iov[2 * n].iov_len = sizeof(bier_frame_header_t);
+    delivery->iov[2 * n + 1].iov_base = bier_received_packet->payload;
+    delivery->iov[2 * n + 1].iov_len = bier_received_packet->payload_length;
+    delivery->stats[n] = stats;
+    delivery->length += frame_length;
+    return 0;
+}
+
+int send_packet_to_application(uint8_t *payload, size_t payload_length,
+                               size_t bier_header_length,
+                               bier_bift_stats_t *stats,
+                               bier_all_apps_t *all_apps, bool use_ipv4) {
+    size_t packet_length = payload_length - bier_header_length;
+    uint8_t *packet = &payload[bier_header_length];
+    bier_received_packet_t bier_received_packet = {};
+    if (use_ipv4) {
+        memcpy(&bier_received_packet.ip6_encap_src.v4.s_addr, &all_apps->src.v4.sin_addr.s_addr, sizeof(all_apps->src.v4.sin_addr.s_addr));
+    } else {
+        memcpy(bier_received_packet.ip6_encap_src.v6.s6_addr, all_apps->src.v6.sin6_addr.s6_addr, sizeof(all_apps->src.v6.sin6_addr.s6_addr));
+    }
+    bier_received_packet.payload = packet;
     bier_received_packet.payload_length = packet_length;
     bier_received_packet.upstream_router_bfr_id = all_apps->src_bfr_id;
     
-    int app_idx = find_correct_unix_destination(all_apps, &payload[bier_header_length], get_bier_proto(payload));
-    if (app_idx < 0) {
-        fprintf(stderr, "Cannot find the application destination of the packet\n");
+    const bier_demux_entry_t *dsts = find_unix_destinations(
+        all_apps, packet, packet_length, get_bier_proto(payload));
+    if (!dsts) {
+        log_err("Cannot find the application destination of the packet");
+        if (stats) {
+            bier_stats_inc(stats->drops[BIER_DROP_NO_APP]);
+        }
         return -1;
     }
-    bier_application_t *app = &all_apps->apps[app_idx];
-    int err = encode_local_bier_payload(all_apps->application_socket,
-                                        &bier_received_packet,
-                                        &app->app_addr, app->addrlen);
-    if (err < 0) {
-        perror("MAIS");
+    // Each application subscribed to the group receives a copy
+    int err = 0;
+    for (int i = 0; i < dsts->nb_apps; ++i) {
+        bier_application_t *app = bier_app_get(all_apps, dsts->apps[i]);
+        if (!app) {
+            continue;  // Unregistered without leaving the group
+        }
+        if (app->use_frames && !app->shm &&
+            bier_app_delivery_add(all_apps, dsts->apps[i],
+                                  &bier_received_packet, stats) == 0) {
+            continue;  // Counted once sent
+        }
+        int nb_sent;
+        if (app->shm) {
+            nb_sent = encode_local_bier_frame_shm(&app->shm->tx,
+                                                  &bier_received_packet);
+        } else if (app->use_frames) {
+            nb_sent = encode_local_bier_frame(all_apps->application_socket,
+                                              &bier_received_packet,
+                                              &app->app_addr, app->addrlen);
+        } else {
+            nb_sent = encode_local_bier_payload(all_apps->application_socket,
+                                                &bier_received_packet,
+                                                &app->app_addr, app->addrlen);
+        }
+        if (nb_sent < 0) {
+            log_perror("Send packet to application");
+            if (stats) {
+                bier_stats_inc(stats->drops[BIER_DROP_SEND_FAILURE]);
+            }
+            err = -1;
+        } else if (stats) {
+            bier_stats_inc(stats->local_deliveries);
+        }
+        log_debug("Sent to the application %u",
+                  bier_app_handle_idx(dsts->apps[i]));
     }
-    fprintf(stderr, "DEBUG: combien enoyes a l'idx %d: %d\n", app_idx, err);
     return err;
 }
 
 int bier_non_te_processing(uint8_t *buffer, size_t buffer_length,
-                           bier_internal_t *bft, int socket,
-                           bier_all_apps_t *all_apps, bool use_ipv4) {
-    // Remain as general as possible: handle all bitstring length
-    uint32_t bitstring_max_idx =
-        bft->bitstring_length / 64;                         // In 64 bits words
-    uint32_t bitstring_length = bft->bitstring_length / 8;  // In bytes
-
-    // RFC 8279
-    uint32_t idx_bfr = 0;
-    uint64_t *bitstring_ptr = get_bitstring_ptr(buffer);
-    for (int bitstring_idx = bitstring_max_idx - 1; bitstring_idx >= 0;
-         --bitstring_idx) {
-        if (idx_bfr >= bft->nb_bft_entry) {
-            fprintf(stderr,
-                    "There seems to be an error. The packet bitstring contains "
-                    "a bit set to true that is not mapped to a known BFR in "
-                    "the BFT. The given bitstring is ");
-            for (int i = 0; i < bitstring_max_idx; ++i) {
-                fprintf(stderr, "%lx ", bitstring_ptr[i]);
-            }
-            fprintf(stderr, "\n");
+                           bier_internal_t *bft, bier_tx_queue_t *tx,
+                           bier_bift_stats_t *stats, bier_all_apps_t *all_apps,
+                           bool use_ipv4) {
+    // Only the compiled table is read on the forwarding path
+    const bier_bft_compiled_t *fib = bft->compiled;
+    uint32_t bitstring_max_idx = fib->bitstring_max_idx;  // In 64 bits words
+    int err = 0;
+    if (buffer_length < 12 + bitstring_max_idx * 8) {
+        log_err("Packet too short for the bitstring length");
+        return -1;
+    }
+
+    // RFC 8279. The bitstring is converted once in host byte order. Bits
+    // without entry in the BFT cannot be forwarded
+    uint8_t *bitstring_ptr = (uint8_t *)get_bitstring_ptr(buffer);
+    uint64_t bitstring[bitstring_max_idx];
+    if (!bitstring_load_and(bitstring, bitstring_ptr, fib->known_bitmask,
+                            bitstring_max_idx)) {
+        log_err(
+            "There seems to be an error. The packet bitstring contains a bit "
+            "set to true that is not mapped to a known BFR in the BFT");
+        log_hex(LOG_ERR, "The given bitstring is", bitstring_ptr,
+                bitstring_max_idx * 8);
+        bier_stats_inc(stats->drops[BIER_DROP_UNKNOWN_BFR]);
+        err = -1;
+    }
+
+    int local_idx = fib->local_idx;
+    if (local_idx >= 0 && (uint32_t)local_idx < fib->nb_bfr &&
+        (bitstring[local_idx / 64] >> (local_idx % 64)) & 1) {
+        log_debug("Received a packet for local router %d!", local_idx + 1);
+        send_packet_to_application(buffer, buffer_length,
+                                   12 + bitstring_max_idx * 8, stats,
+                                   all_apps, use_ipv4);
+        bitstring_and_not(bitstring, fib->local_bitmask, bitstring_max_idx);
+    }
+
+    // BFR-IDs with ECMP entries are assigned to the neighbour chosen for
+    // this packet. Those bits are not part of the combined bitmasks
+    uint64_t ecmp_copies[fib->nb_neighbours + 1][bitstring_max_idx];
+    bool has_ecmp_bits = false;
+    const uint8_t *ecmp_select =
+        &fib->ecmp_select[bier_ecmp_slot(get_entropy(buffer))];
+    for (uint32_t word_idx = 0; word_idx < bitstring_max_idx; ++word_idx) {
+        uint64_t word;
+        while ((word = bitstring[word_idx] & fib->ecmp_bitmask[word_idx]) !=
+               0) {
+            if (!has_ecmp_bits) {
+                memset(ecmp_copies, 0, sizeof(ecmp_copies));
+                has_ecmp_bits = true;
+            }
+            uint32_t idx_bfr = word_idx * 64 + __builtin_ctzll(word);
+            uint32_t ecmp_idx =
+                idx_bfr * fib->ecmp_stride +
+                ecmp_select[fib->nb_ecmp[idx_bfr] * BIER_ECMP_SELECT_SIZE];
+            const uint64_t *fbm = &fib->ecmp_fbm[ecmp_idx * bitstring_max_idx];
+            uint64_t *copy = ecmp_copies[fib->ecmp_nei[ecmp_idx]];
+            // The bit itself always leaves with this copy
+            copy[word_idx] |= word & -word;
+            bitstring[word_idx] &= ~(word & -word);
+            for (uint32_t i = 0; i < bitstring_max_idx; ++i) {
+                uint64_t ecmp_fbm = fbm[i] & fib->ecmp_bitmask[i];
+                copy[i] |= bitstring[i] & ecmp_fbm;
+                bitstring[i] &= ~ecmp_fbm;
+            }
+        }
+    }
+
+    // All copies share the same payload, only the bitstring of the header
+    // differs. The payload is sent from the received buffer
+    size_t header_length = 12 + bitstring_max_idx * 8;
+    const uint8_t *payload = &buffer[header_length];
+    size_t payload_length = buffer_length - header_length;
+    socklen_t socklen =
+        use_ipv4 ? sizeof(struct sockaddr_in) : sizeof(struct sockaddr_in6);
+
+    // One copy per neighbour with at least one BFER in the bitstring
+    for (uint32_t nei_idx = 0; nei_idx < fib->nb_neighbours; ++nei_idx) {
+        uint8_t *header_copy = bier_tx_queue_slot(tx, header_length);
+        if (!header_copy) {
             return -1;
         }
-        uint64_t bitstring = be64toh(bitstring_ptr[bitstring_idx]);
-
-        // Use modulo operation for non-zero uint64_t words
-        uint32_t idx_bfr_word = idx_bfr % 64;
-        while ((bitstring >> idx_bfr_word) > 0) {
-            if (idx_bfr >= bft->nb_bft_entry) {
-                fprintf(stderr,
-                        "There seems to be an error. The packet bitstring "
-                        "contains a bit set to true that is not mapped to a "
-                        "known BFR in the BFT. The given bitstring is ");
-                for (int i = 0; i < bitstring_max_idx; ++i) {
-                    fprintf(stderr, "%lx ", bitstring_ptr[i]);
-                }
-                fprintf(stderr, "\n");
-                return -1;
+        uint8_t *bitstring_copy_ptr = (uint8_t *)get_bitstring_ptr(header_copy);
+        const uint64_t *nei_bitmask =
+            &fib->nei_bitmask[nei_idx * bitstring_max_idx];
+        if (has_ecmp_bits) {
+            uint64_t *copy = ecmp_copies[nei_idx];
+            for (uint32_t i = 0; i < bitstring_max_idx; ++i) {
+                copy[i] |= bitstring[i] & nei_bitmask[i];
             }
-            if ((bitstring >> idx_bfr_word) &
-                1)  // The current lowest-order bit is set: this BFER must
-                    // receive a copy
-            {
-                // Here we use tje true idx_bfr because we do not use it as
-                // index for a table
-                if (idx_bfr == bft->local_bfr_id - 1) {
-                    fprintf(stderr, "Received a packet for local router %d!\n",
-                            bft->local_bfr_id);
-                    fprintf(stderr, "Calling local processing function\n");
-                    // bier_local_processing->local_processing_function(buffer,
-                    // buffer_length, 12 + bitstring_length,
-                    // bier_local_processing->args);
-                    send_packet_to_application(buffer, buffer_length,
-                                               12 + bft->bitstring_length / 8,
-                                               all_apps, use_ipv4);
-                    update_bitstring(
-                        bitstring_ptr,
-                        bft->bft[idx_bfr]->ecmp_entry[0]->forwarding_bitmask,
-                        bitwise_u64_and_not, bitstring_max_idx);
-                    bitstring = be64toh(bitstring_ptr[bitstring_idx]);
-                    ++idx_bfr;
-                    idx_bfr_word = idx_bfr % 64;
-                    continue;
-                }
-                fprintf(stderr, "Send a copy to %u (router %u)\n", idx_bfr + 1,
-                        bft->local_bfr_id);
-
-                uint8_t packet_copy[buffer_length];  // Room for the IPv6 header
-                memset(packet_copy, 0, sizeof(packet_copy));
-
-                uint8_t *bier_header = &packet_copy[0];
-                memcpy(bier_header, buffer, buffer_length);
-
-                uint64_t bitstring_copy[bitstring_max_idx];
-                memcpy(bitstring_copy, bitstring_ptr,
-                       sizeof(uint64_t) * bitstring_max_idx);
-
-                // ECMP may be possible
-                int ecmp_entry_idx = 0;
-                if (bft->bft[idx_bfr]->nb_ecmp_entries > 1) {
-                    printf("Multiple paths for node %u\n", idx_bfr);
-                    uint16_t entropy = get_entropy(bier_header);
-                    ecmp_entry_idx = entropy % 2;
-                    // Choose an ECMP entry
-                    // TODO: for now, always choose the last entry but we need
-                    // to compute a function of the entropy
-                }
-                // print_bitstring_message("Bitstring value copy is",
-                // bitstring_copy, bitstring_max_idx);
-                update_bitstring(bitstring_copy,
-                                 bft->bft[idx_bfr]
-                                     ->ecmp_entry[ecmp_entry_idx]
-                                     ->forwarding_bitmask,
-                                 bitwise_u64_and, bitstring_max_idx);
-                set_bitstring_ptr(packet_copy, bitstring_copy,
-                                  bitstring_max_idx);
-                // print_bitstring_message("Bitstring value copy is now",
-                // bitstring_copy, bitstring_max_idx);
-
-                // Send copy
-                bier_bft_entry_t *bft_entry = bft->bft[idx_bfr];
-                char buff[400] = {};
-                socklen_t socklen;
-                if (use_ipv4) {
-                    inet_ntop(AF_INET, &bft_entry->ecmp_entry[ecmp_entry_idx]->bfr_nei_addr.v4.sin_addr.s_addr, buff, sizeof(buff));
-                    socklen = sizeof(struct sockaddr_in);
-                    uint32_t ad = bft_entry->ecmp_entry[ecmp_entry_idx]->bfr_nei_addr.v4.sin_addr.s_addr;
-                    fprintf(stderr, "l'adresse est: %u %u %u %u", ad >> 24, (ad >> 16) & 0xff, (ad >> 8) & 0xff, ad & 0xff);
-                } else {
-                    inet_ntop(AF_INET6, bft_entry->ecmp_entry[ecmp_entry_idx]->bfr_nei_addr.v6.sin6_addr.s6_addr, buff, sizeof(buff));
-                    socklen = sizeof(struct sockaddr_in6);
-                }
-                printf("Should send to %s\n", buff);
-                printf("The bitstirng is %lx\n", bitstring_copy[0]);
-                int err = sendto(
-                    socket, packet_copy, sizeof(packet_copy), 0,
-                    (struct sockaddr *)&bft_entry->ecmp_entry[ecmp_entry_idx]
-                        ->bfr_nei_addr.v6, socklen);
-                if (err < 0) {
-                    perror("sendto");
-                    return -1;
-                }
-                fprintf(stderr, "Sent packet\n");
-                update_bitstring(bitstring_ptr,
-                                 bft->bft[idx_bfr]
-                                     ->ecmp_entry[ecmp_entry_idx]
-                                     ->forwarding_bitmask,
-                                 bitwise_u64_and_not, bitstring_max_idx);
-                bitstring = be64toh(bitstring_ptr[bitstring_idx]);
+            if (!bitstring_store_and(bitstring_copy_ptr, copy, NULL,
+                                     bitstring_max_idx)) {
+                continue;
             }
-            ++idx_bfr;  // Keep track of the index of the BFER to get the
-                        // correct entry of the BFT
-            idx_bfr_word = idx_bfr % 64;
+        } else if (!bitstring_store_and(bitstring_copy_ptr, bitstring,
+                                        nei_bitmask, bitstring_max_idx)) {
+            continue;
         }
-    }
-    fprintf(stderr, "Go out\n");
-    return 0;
-}
 
-// TODO: inline
-bool get_bit_from_bitstring(uint64_t *bitstring, int bit_offset,
-                            int bitstring_length) {
-    printf("The bitstring is still %lx\n", bitstring[0]);
-    printf("Wanting %d, and result is %lx\n", bit_offset,
-           be64toh(bitstring[bit_offset / 64]) &
-               ((uint64_t)1 << (uint64_t)bit_offset));
-    return be64toh(bitstring[bit_offset / 64]) &
-           ((uint64_t)1 << (uint64_t)bit_offset);
+        memcpy(header_copy, buffer, 12);
+        bier_tx_queue_commit(tx, header_length, payload, payload_length,
+                             (struct sockaddr *)&fib->nei_addr[nei_idx],
+                             socklen, &fib->nei_stats[nei_idx], stats);
+        // RFC 8279: the BFERs of this copy are not served again by the next
+        // neighbours, whose forwarding bitmasks may overlap with this one
+        bitstring_and_not(bitstring, nei_bitmask, bitstring_max_idx);
+        log_debug("Queued a copy to neighbour %u (router %d)",
+                  nei_idx, local_idx + 1);
+    }
+    return err;
 }
 
 int bier_te_processing(uint8_t *buffer, size_t buffer_length,
-                       bier_te_internal_t *bft, int socket,
-                       bier_all_apps_t *all_apps, bool use_ipv4) {
+                       bier_te_internal_t *bft, bier_tx_queue_t *tx,
+                       bier_bift_stats_t *stats, bier_all_apps_t *all_apps,
+                       bool use_ipv4) {
     uint32_t bitstring_length_in_64 =
         bft->bitstring_length / 64;  // In 64 bits words
     // For BIER-TE the processing is slightly different
     // See https://datatracker.ietf.org/doc/draft-ietf-bier-te-arch/ for more
     // information
-    uint64_t *bitstring_ptr = get_bitstring_ptr(buffer);
-    // We only iterate over the adjacency BP and the local BFR-BP
-    // As we will clear those bits in the packet, we make a local copy
-    uint64_t local_bitstring[bitstring_length_in_64];
-    memset(local_bitstring, 0, sizeof(local_bitstring));
-    // TODO: possible segmentation fault? If the packet respects the bitstring
-    // length, should not happen
-    memcpy(local_bitstring, bitstring_ptr, sizeof(local_bitstring));
-    printf("the bitstring is %lx vs %lx\n", local_bitstring[0],
-           bft->global_bitstring[0]);
+    size_t header_length = 12 + bitstring_length_in_64 * 8;
+    if (buffer_length < header_length) {
+        log_err("Packet too short for the bitstring length");
+        return -1;
+    }
+    uint8_t *bitstring_ptr = (uint8_t *)get_bitstring_ptr(buffer);
+    // Only the BPs with an adjacency are kept, so that the cost depends on the
+    // adjacencies used by the packet and not on all the adjacencies
+    uint64_t adj_bitstring[bitstring_length_in_64];
+    uint64_t packet_bitstring[bitstring_length_in_64];
+    bitstring_load_and(adj_bitstring, bitstring_ptr, bft->adj_bitmask,
+                       bitstring_length_in_64);
+    bitstring_load(packet_bitstring, bitstring_ptr, bitstring_length_in_64);
 
-    // Clear adjacent bits in the packet header to avoid loops
-    update_bitstring(bitstring_ptr, bft->global_bitstring, bitwise_u64_and_not,
-                     bitstring_length_in_64);
     // Local delivery?
-    printf("Du coup apres update: %lx %d %d\n", local_bitstring[0],
-           (1 << bft->local_bfr_id),
-           get_bit_from_bitstring(local_bitstring, bft->local_bfr_id,
-                                  bft->bitstring_length));
-    if (get_bit_from_bitstring(local_bitstring, bft->local_bfr_id,
-                               bft->bitstring_length)) {
-        fprintf(stderr,
-                "BIER TE received a packet for local delivery on router %d",
-                bft->local_bfr_id);
-        // bier_local_processing->local_processing_function(buffer,
-        // buffer_length, 12 + bft->bitstring_length / 8,
-        // bier_local_processing->args);
-        send_packet_to_application(buffer, buffer_length,
-                                   12 + bft->bitstring_length / 8, all_apps, use_ipv4);
+    int local_bp = bft->local_bfr_id - 1;
+    bool is_local = local_bp >= 0 &&
+                    (uint32_t)local_bp < bft->bitstring_length &&
+                    (packet_bitstring[local_bp / 64] >> (local_bp % 64)) & 1;
+
+    // Clear adjacent bits in the packet header to avoid loops
+    bitstring_and_not(packet_bitstring, bft->global_bitstring,
+                      bitstring_length_in_64);
+    bitstring_store(bitstring_ptr, packet_bitstring, bitstring_length_in_64);
+    if (is_local) {
+        log_debug("BIER TE received a packet for local delivery on router %d",
+                  bft->local_bfr_id);
+        send_packet_to_application(buffer, buffer_length, header_length,
+                                   stats, all_apps, use_ipv4);
     }
 
-    // Iterate over all adjacency BP instead of all bits in the bitstring
-    for (int i = 0; i < bft->nb_adjacencies; ++i) {
-        int bp_this_adj = bft->adj_to_bp[i];
-        printf("Look if must send to bp this adj=%d\n", bp_this_adj);
-        if (get_bit_from_bitstring(local_bitstring, bp_this_adj - 1,
-                                   bft->bitstring_length)) {
-            // Forward to this interface
-            // TODO: DNC bit?
-            // uint8_t packet_copy[buffer_length];
-            // memcpy(packet_copy, buffer, buffer_length);
-            // TODO: other things to modify?
-
-            struct sockaddr *nei = (struct sockaddr *)&bft->bfr_nei_addr[i].v6;
-            socklen_t socklen;
-            char buff[400] = {};
-            if (use_ipv4) {
-                inet_ntop(AF_INET, &bft->bfr_nei_addr[i].v4.sin_addr.s_addr, buff, sizeof(buff));
-                socklen = sizeof(struct sockaddr_in);
-            } else {
-                inet_ntop(AF_INET6, bft->bfr_nei_addr[i].v6.sin6_addr.s6_addr, buff, sizeof(buff));
-                socklen = sizeof(struct sockaddr_in6);
-            }
-            fprintf(stderr, "Should send from %d to %s\n", bft->local_bfr_id, buff);
-            int err = sendto(socket, buffer, buffer_length, 0,
-                             (struct sockaddr *)&bft->bfr_nei_addr->v6, socklen);
-            if (err < 0) {
-                perror("Cannot send packet");
-                return -1;
+    socklen_t socklen =
+        use_ipv4 ? sizeof(struct sockaddr_in) : sizeof(struct sockaddr_in6);
+    for (uint32_t word_idx = 0; word_idx < bitstring_length_in_64;
+         ++word_idx) {
+        uint64_t word = adj_bitstring[word_idx];
+        while (word) {
+            uint32_t bp = word_idx * 64 + __builtin_ctzll(word);
+            word &= word - 1;
+            for (uint32_t j = bft->bp_adj_start[bp];
+                 j < bft->bp_adj_start[bp + 1]; ++j) {
+                // TODO: DNC bit?
+                uint32_t adj = bft->bp_adj[j];
+                uint8_t *header_copy = bier_tx_queue_slot(tx, header_length);
+                if (!header_copy) {
+                    return -1;
+                }
+                memcpy(header_copy, buffer, header_length);
+                bier_tx_queue_commit(tx, header_length, &buffer[header_length],
+                                     buffer_length - header_length,
+                                     (struct sockaddr *)&bft->bfr_nei_addr[adj],
+                                     socklen, &bft->nei_stats[adj], stats);
+                log_debug("Queued a copy of BP %u to adjacency %u", bp + 1,
+                          adj);
             }
-            fprintf(stderr, "Sent packet TE\n");
         }
     }
     return 0;
 }
 
-int bier_processing(uint8_t *buffer, size_t buffer_length, bier_bift_t *bier,
-                    bier_all_apps_t *all_apps, bool use_ipv4) {
-    // In the packet: 1-indexed, here 0-indexed
-    int bift_id = get_bift_id(buffer) - 1;
-    fprintf(stderr, "The given BIFT-ID is %d\n", bift_id);
-    fprintf(stderr, "NB BIFT=%d\n", bier->nb_bift);
+/**
+ * @brief Process a packet and queue its replicas without sending them
+ */
+static int bier_processing_enqueue(uint8_t *buffer, size_t buffer_length,
+                                   bier_bift_t *bier,
+                                   bier_all_apps_t *all_apps, bool use_ipv4) {
     if (buffer_length < 20) {
         return -1;
     }
-    if (bift_id >= bier->nb_bift) {
-        fprintf(stderr, "BIFT-ID not supported, error state: %u (max %u)\n", bift_id, bier->nb_bift);
+    uint32_t bift_id = get_bift_id(buffer);
+    const bier_bift_table_t *table = bier_bift_table(bier);
+    log_debug("The given BIFT-ID is %u", bift_id);
+    int bift_idx = bier_bift_find(table, bift_id);
+    if (bift_idx < 0) {
+        // Counted in the drops, not logged at a level seen on every packet
+        log_debug("BIFT-ID not supported: %u", bift_id);
+        bier_stats_inc(bier->unknown_bift_stats.packets_in);
+        bier_stats_inc(
+            bier->unknown_bift_stats.drops[BIER_DROP_UNKNOWN_BIFT_ID]);
+        return -1;
+    }
+    bier_bift_type_t bift = table->b[bift_idx];
+    bier_bift_stats_t *stats = &bier->stats[bift.stats_idx];
+    bier_stats_inc(stats->packets_in);
+    // The bitstring is only read with the length of the BIFT
+    uint32_t bitstring_length = bier_bift_bitstring_length(table, bift_id);
+    if (bier_bsl_decode(get_bier_bsl(buffer)) != bitstring_length) {
+        log_debug("BSL %u of the packet does not match the bitstring length "
+                  "%u of BIFT %u", get_bier_bsl(buffer), bitstring_length,
+                  bift_id);
+        bier_stats_inc(stats->drops[BIER_DROP_BSL_MISMATCH]);
         return -1;
     }
-    bier_bift_type_t bift = bier->b[bift_id];
     if (bift.t == BIER) {
-        fprintf(stderr, "at router %d\n", bift.bier->local_bfr_id);
+        log_debug("at router %d", bift.bier->local_bfr_id);
         return bier_non_te_processing(buffer, buffer_length, bift.bier,
-                                      bier->socket, all_apps, use_ipv4);
+                                      bier->tx, stats, all_apps, use_ipv4);
     } else if (bift.t == BIER_TE) {
         return bier_te_processing(buffer, buffer_length, bift.bier_te,
-                                  bier->socket, all_apps, use_ipv4);
+                                  bier->tx, stats, all_apps, use_ipv4);
     } else {
-        fprintf(stderr, "Should not happen: %d\n", bift.t);
+        log_err("Should not happen: %d", bift.t);
     }
     return 0;
 }
+
+int bier_processing(uint8_t *buffer, size_t buffer_length, bier_bift_t *bier,
+                    bier_all_apps_t *all_apps, bool use_ipv4) {
+    int err = bier_processing_enqueue(buffer, buffer_length, bier, all_apps,
+                                      use_ipv4);
+    // A replica or a delivery which cannot be sent is counted in the drops
+    // of its BIFT, it is not a failure of the processing
+    bier_tx_queue_flush(bier->tx);
+    bier_app_deliveries_flush(all_apps);
+    return err;
+}
+
+int bier_processing_batch(bier_rx_packet_t *packets, unsigned int nb_packets,
+                          bier_bift_t *bier, bier_all_apps_t *all_apps,
+                          bool use_ipv4) {
+    int err = 0;
+    for (unsigned int i = 0; i < nb_packets; ++i) {
+        bier_rx_packet_t *packet = &packets[i];
+        memcpy(&all_apps->src, &packet->src, sizeof(sockaddr_uniform_t));
+        all_apps->src_bfr_id = packet->src_bfr_id;
+        if (bier_processing_enqueue(packet->buffer, packet->length, bier,
+                                    all_apps, use_ipv4) < 0) {
+            err = -1;
+        }
+    }
+    // All the replicas of the batch are sent together, and each application
+    // receives its packets of the batch together. Those which cannot be sent
+    // are counted in the drops of their BIFT
+    bier_tx_queue_flush(bier->tx);
+    bier_app_deliveries_flush(all_apps);
+    return err;
+}
+
+/**
+ * @brief Counters of a BIFT summed over the daemon and its forwarding threads
+ */
+typedef struct {
+    uint64_t packets_in;
+    uint64_t replicas_out;
+    uint64_t local_deliveries;
+    uint64_t drops[BIER_DROP_MAX];
+} bier_bift_stats_sum_t;
+
+static void add_bift_stats(bier_bift_stats_sum_t *sum,
+                           const bier_bift_stats_t *stats) {
+    sum->packets_in += bier_stats_read(stats->packets_in);
+    sum->replicas_out += bier_stats_read(stats->replicas_out);
+    sum->local_deliveries += bier_stats_read(stats->local_deliveries);
+    for (int i = 0; i < BIER_DROP_MAX; ++i) {
+        sum->drops[i] += bier_stats_read(stats->drops[i]);
+    }
+}
+
+/**
+ * @brief Sums the counters *stats_idx* of *bier* and of its views, or those of
+ * the unknown BIFT-IDs if *stats_idx* is -1
+ */
+static void sum_bift_stats(bier_bift_stats_sum_t *sum, const bier_bift_t *bier,
+                           int stats_idx) {
+    memset(sum, 0, sizeof(bier_bift_stats_sum_t));
+    for (int i = -1; i < bier->nb_workers; ++i) {
+        const bier_bift_t *view = i < 0 ? bier : bier->workers[i];
+        add_bift_stats(sum, stats_idx < 0 ? &view->unknown_bift_stats
+                                          : &view->stats[stats_idx]);
+    }
+}
+
+static void encode_bift_stats(QCBOREncodeContext *ctx,
+                              const bier_bift_stats_sum_t *stats) {
+    static const char *drop_names[BIER_DROP_MAX] = {
+        [BIER_DROP_UNKNOWN_BIFT_ID] = "drop_unknown_bift_id",
+        [BIER_DROP_UNKNOWN_BFR] = "drop_unknown_bfr",
+        [BIER_DROP_SEND_FAILURE] = "drop_send_failure",
+        [BIER_DROP_NO_APP] = "drop_no_app",
+        [BIER_DROP_BSL_MISMATCH] = "drop_bsl_mismatch",
+    };
+    QCBOREncode_AddUInt64ToMap(ctx, "packets_in", stats->packets_in);
+    QCBOREncode_AddUInt64ToMap(ctx, "replicas_out", stats->replicas_out);
+    QCBOREncode_AddUInt64ToMap(ctx, "local_deliveries",
+                               stats->local_deliveries);
+    for (int i = 0; i < BIER_DROP_MAX; ++i) {
+        QCBOREncode_AddUInt64ToMap(ctx, drop_names[i], stats->drops[i]);
+    }
+}
+
+static void encode_nei_stats(QCBOREncodeContext *ctx, const void *addr,
+                             size_t addr_len, const bier_nei_stats_t *stats) {
+    QCBOREncode_OpenMap(ctx);
+    UsefulBufC addr_buf = {addr, addr_len};
+    QCBOREncode_AddBytesToMap(ctx, "addr", addr_buf);
+    QCBOREncode_AddUInt64ToMap(ctx, "tx_packets",
+                               bier_stats_read(stats->tx_packets));
+    QCBOREncode_AddUInt64ToMap(ctx, "tx_bytes",
+                               bier_stats_read(stats->tx_bytes));
+    QCBOREncode_CloseMap(ctx);
+}
+
+int send_bier_stats(int socket, const bier_bift_t *bier,
+                    const struct sockaddr_un *dest_addr, socklen_t addrlen) {
+    bool use_ipv4 = bier->local.v4.sin_family == AF_INET;
+    // Only the main thread replaces the BIFTs
+    const bier_bift_table_t *table = bier_bift_table(bier);
+    size_t addr_len =
+        use_ipv4 ? sizeof(struct in_addr) : sizeof(struct in6_addr);
+    // Large enough for all the counters and the neighbour addresses
+    size_t qcbor_length = 256;
+    for (int i = 0; i < table->nb_bift; ++i) {
+        qcbor_length += 256;
+        if (table->b[i].t == BIER) {
+            qcbor_length += table->b[i].bier->compiled->nb_neighbours * 64;
+        } else if (table->b[i].t == BIER_TE) {
+            qcbor_length += table->b[i].bier_te->nb_adjacencies * 64;
+        }
+    }
+    uint8_t *buffer = (uint8_t *)malloc(qcbor_length);
+    if (!buffer) {
+        log_perror("malloc stats");
+        return -1;
+    }
+    UsefulBuf Buffer = {buffer, qcbor_length};
+
+    QCBOREncodeContext ctx;
+    QCBOREncode_Init(&ctx, Buffer);
+    QCBOREncode_OpenMap(&ctx);
+    bier_bift_stats_sum_t sum;
+    sum_bift_stats(&sum, bier, -1);
+    QCBOREncode_AddUInt64ToMap(&ctx, "unknown_bift_id",
+                               sum.drops[BIER_DROP_UNKNOWN_BIFT_ID]);
+    QCBOREncode_OpenArrayInMap(&ctx, "bifts");
+    for (int i = 0; i < table->nb_bift; ++i) {
+        QCBOREncode_OpenMap(&ctx);
+        QCBOREncode_AddInt64ToMap(&ctx, "bift_id", table->b[i].bift_id);
+        QCBOREncode_AddInt64ToMap(&ctx, "sd", table->b[i].sd);
+        QCBOREncode_AddInt64ToMap(&ctx, "si", table->b[i].si);
+        sum_bift_stats(&sum, bier, table->b[i].stats_idx);
+        encode_bift_stats(&ctx, &sum);
+        QCBOREncode_OpenArrayInMap(&ctx, "neighbours");
+        if (table->b[i].t == BIER) {
+            const bier_bft_compiled_t *fib = table->b[i].bier->compiled;
+            for (uint32_t n = 0; n < fib->nb_neighbours; ++n) {
+                const void *addr =
+                    use_ipv4 ? (const void *)&fib->nei_addr[n].v4.sin_addr
+                             : (const void *)&fib->nei_addr[n].v6.sin6_addr;
+                encode_nei_stats(&ctx, addr, addr_len, &fib->nei_stats[n]);
+            }
+        } else if (table->b[i].t == BIER_TE) {
+            const bier_te_internal_t *bft = table->b[i].bier_te;
+            for (int n = 0; n < bft->nb_adjacencies; ++n) {
+                const void *addr =
+                    use_ipv4
+                        ? (const void *)&bft->bfr_nei_addr[n].v4.sin_addr
+                        : (const void *)&bft->bfr_nei_addr[n].v6.sin6_addr;
+                encode_nei_stats(&ctx, addr, addr_len, &bft->nei_stats[n]);
+            }
+        }
+        QCBOREncode_CloseArray(&ctx);
+        QCBOREncode_CloseMap(&ctx);
+    }
+    QCBOREncode_CloseArray(&ctx);
+    QCBOREncode_CloseMap(&ctx);
+
+    UsefulBufC EncodedCBOR;
+    if (QCBOREncode_Finish(&ctx, &EncodedCBOR) != QCBOR_SUCCESS) {
+        log_err("Cannot encode the BIER statistics");
+        free(buffer);
+        return -1;
+    }
+    ssize_t nb_sent = sendto(socket, EncodedCBOR.ptr, EncodedCBOR.len,
+                             MSG_DONTWAIT, (struct sockaddr *)dest_addr,
+                             addrlen);
+    if (nb_sent < 0) {
+        log_perror("send_bier_stats sendto");
+    }
+    free(buffer);
+    return nb_sent < 0 ? -1 : 0;
+}
@@ -0,0 +1,366 @@
+#include "../include/bitstring.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BITSTRING_X86
+#include <immintrin.h>
+#endif
+
+/* Scalar fallback */
+
+static bool load_and_scalar(uint64_t *dst, const uint8_t *src,
+                            const uint64_t *mask, uint32_t nb_words) {
+    uint64_t dropped = 0;
+    for (uint32_t i = 0; i < nb_words; ++i) {
+        uint64_t word = bitstring_read_be64(&src[(nb_words - 1 - i) * 8]);
+        dst[i] = mask ? word & mask[i] : word;
+        dropped |= word ^ dst[i];
+    }
+    return dropped == 0;
+}
+
+static bool store_and_scalar(uint8_t *dst, const uint64_t *a,
+                             const uint64_t *b, uint32_t nb_words) {
+    uint64_t any = 0;
+    for (uint32_t i = 0; i < nb_words; ++i) {
+        uint64_t word = b ? a[i] & b[i] : a[i];
+        bitstring_write_be64(&dst[(nb_words - 1 - i) * 8], word);
+        any |= word;
+    }
+    return any != 0;
+}
+
+static void and_not_scalar(uint64_t *dst, const uint64_t *mask,
+                           uint32_t nb_words) {
+    for (uint32_t i = 0; i < nb_words; ++i) {
+        dst[i] &= ~mask[i];
+    }
+}
+
+static bool is_zero_scalar(const uint64_t *bitstring, uint32_t nb_words) {
+    uint64_t any = 0;
+    for (uint32_t i = 0; i < nb_words; ++i) {
+        any |= bitstring[i];
+    }
+    return any == 0;
+}
+
+static uint32_t popcount_scalar(const uint64_t *bitstring, uint32_t nb_words) {
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < nb_words; ++i) {
+        count += __builtin_popcountll(bitstring[i]);
+    }
+    return count;
+}
+
+#ifdef BITSTRING_X86
+
+/* SSE2: 2 words per iteration. The bitstring of a packet is a big-endian
+ * integer, so converting it is a byte reversal of the whole bitstring: each
+ * vector is reversed and the order of the vectors is reversed. */
+
+__attribute__((target("sse2"))) static inline __m128i bswap128_sse2(
+    __m128i v) {
+    v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+    v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+    v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+    return _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2));
+}
+
+__attribute__((target("sse2"))) static bool load_and_sse2(
+    uint64_t *dst, const uint8_t *src, const uint64_t *mask,
+    uint32_t nb_words) {
+    const uint8_t *src_end = &src[nb_words * 8];
+    __m128i dropped = _mm_setzero_si128();
+    uint32_t i = 0;
+    for (; i + 2 <= nb_words; i += 2) {
+        __m128i v = bswap128_sse2(
+            _mm_loadu_si128((const __m128i *)(src_end - (i + 2) * 8)));
+        if (mask) {
+            __m128i m = _mm_loadu_si128((const __m128i *)&mask[i]);
+            dropped = _mm_or_si128(dropped, _mm_andnot_si128(m, v));
+            v = _mm_and_si128(v, m);
+        }
+        _mm_storeu_si128((__m128i *)&dst[i], v);
+    }
+    bool no_drop = _mm_movemask_epi8(_mm_cmpeq_epi8(
+                       dropped, _mm_setzero_si128())) == 0xffff;
+    if (i < nb_words) {
+        no_drop &= load_and_scalar(&dst[i], src, mask ? &mask[i] : NULL,
+                                   nb_words - i);
+    }
+    return no_drop;
+}
+
+__attribute__((target("sse2"))) static bool store_and_sse2(
+    uint8_t *dst, const uint64_t *a, const uint64_t *b, uint32_t nb_words) {
+    uint8_t *dst_end = &dst[nb_words * 8];
+    __m128i any = _mm_setzero_si128();
+    uint32_t i = 0;
+    for (; i + 2 <= nb_words; i += 2) {
+        __m128i v = _mm_loadu_si128((const __m128i *)&a[i]);
+        if (b) {
+            v = _mm_and_si128(v, _mm_loadu_si128((const __m128i *)&b[i]));
+        }
+        any = _mm_or_si128(any, v);
+        _mm_storeu_si128((__m128i *)(dst_end - (i + 2) * 8), bswap128_sse2(v));
+    }
+    bool is_set = _mm_movemask_epi8(_mm_cmpeq_epi8(
+                      any, _mm_setzero_si128())) != 0xffff;
+    if (i < nb_words) {
+        is_set |= store_and_scalar(dst, &a[i], b ? &b[i] : NULL, nb_words - i);
+    }
+    return is_set;
+}
+
+__attribute__((target("sse2"))) static void and_not_sse2(
+    uint64_t *dst, const uint64_t *mask, uint32_t nb_words) {
+    uint32_t i = 0;
+    for (; i + 2 <= nb_words; i += 2) {
+        __m128i v = _mm_loadu_si128((const __m128i *)&dst[i]);
+        __m128i m = _mm_loadu_si128((const __m128i *)&mask[i]);
+        _mm_storeu_si128((__m128i *)&dst[i], _mm_andnot_si128(m, v));
+    }
+    and_not_scalar(&dst[i], &mask[i], nb_words - i);
+}
+
+__attribute__((target("sse2"))) static bool is_zero_sse2(
+    const uint64_t *bitstring, uint32_t nb_words) {
+    __m128i any = _mm_setzero_si128();
+    uint32_t i = 0;
+    for (; i + 2 <= nb_words; i += 2) {
+        any = _mm_or_si128(any,
+                           _mm_loadu_si128((const __m128i *)&bitstring[i]));
+    }
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(any, _mm_setzero_si128())) ==
+               0xffff &&
+           is_zero_scalar(&bitstring[i], nb_words - i);
+}
+
+/* AVX2: 4 words per iteration */
+
+__attribute__((target("avx2"))) static inline __m256i bswap256_avx2(
+    __m256i v) {
+    const __m256i reverse = _mm256_setr_epi8(
+        15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12,
+        11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    v = _mm256_shuffle_epi8(v, reverse);
+    return _mm256_permute4x64_epi64(v, _MM_SHUFFLE(1, 0, 3, 2));
+}
+
+__attribute__((target("avx2"))) static bool load_and_avx2(
+    uint64_t *dst, const uint8_t *src, const uint64_t *mask,
+    uint32_t nb_words) {
+    const uint8_t *src_end = &src[nb_words * 8];
+    __m256i dropped = _mm256_setzero_si256();
+    uint32_t i = 0;
+    for (; i + 4 <= nb_words; i += 4) {
+        __m256i v = bswap256_avx2(
+            _mm256_loadu_si256((const __m256i *)(src_end - (i + 4) * 8)));
+        if (mask) {
+            __m256i m = _mm256_loadu_si256((const __m256i *)&mask[i]);
+            dropped = _mm256_or_si256(dropped, _mm256_andnot_si256(m, v));
+            v = _mm256_and_si256(v, m);
+        }
+        _mm256_storeu_si256((__m256i *)&dst[i], v);
+    }
+    bool no_drop = _mm256_testz_si256(dropped, dropped);
+    if (i < nb_words) {
+        no_drop &= load_and_sse2(&dst[i], src, mask ? &mask[i] : NULL,
+                                 nb_words - i);
+    }
+    return no_drop;
+}
+
+__attribute__((target("avx2"))) static bool store_and_avx2(
+    uint8_t *dst, const uint64_t *a, const uint64_t *b, uint32_t nb_words) {
+    uint8_t *dst_end = &dst[nb_words * 8];
+    __m256i any = _mm256_setzero_si256();
+    uint32_t i = 0;
+    for (; i + 4 <= nb_words; i += 4) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)&a[i]);
+        if (b) {
+            v = _mm256_and_si256(v,
+                                 _mm256_loadu_si256((const __m256i *)&b[i]));
+        }
+        any = _mm256_or_si256(any, v);
+        _mm256_storeu_si256((__m256i *)(dst_end - (i + 4) * 8),
+                            bswap256_avx2(v));
+    }
+    bool is_set = !_mm256_testz_si256(any, any);
+    if (i < nb_words) {
+        is_set |= store_and_sse2(dst, &a[i], b ? &b[i] : NULL, nb_words - i);
+    }
+    return is_set;
+}
+
+__attribute__((target("avx2"))) static void and_not_avx2(
+    uint64_t *dst, const uint64_t *mask, uint32_t nb_words) {
+    uint32_t i = 0;
+    for (; i + 4 <= nb_words; i += 4) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)&dst[i]);
+        __m256i m = _mm256_loadu_si256((const __m256i *)&mask[i]);
+        _mm256_storeu_si256((__m256i *)&dst[i], _mm256_andnot_si256(m, v));
+    }
+    and_not_scalar(&dst[i], &mask[i], nb_words - i);
+}
+
+__attribute__((target("avx2"))) static bool is_zero_avx2(
+    const uint64_t *bitstring, uint32_t nb_words) {
+    __m256i any = _mm256_setzero_si256();
+    uint32_t i = 0;
+    for (; i + 4 <= nb_words; i += 4) {
+        any = _mm256_or_si256(
+            any, _mm256_loadu_si256((const __m256i *)&bitstring[i]));
+    }
+    return _mm256_testz_si256(any, any) &&
+           is_zero_scalar(&bitstring[i], nb_words - i);
+}
+
+__attribute__((target("popcnt"))) static uint32_t popcount_popcnt(
+    const uint64_t *bitstring, uint32_t nb_words) {
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < nb_words; ++i) {
+        count += __builtin_popcountll(bitstring[i]);
+    }
+    return count;
+}
+
+/* AVX-512: 8 words per iteration */
+
+__attribute__((target("avx512f,avx512bw"))) static inline __m512i
+bswap512_avx512(__m512i v) {
+    const __m512i reverse = _mm512_broadcast_i32x4(_mm_setr_epi8(
+        15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0));
+    v = _mm512_shuffle_epi8(v, reverse);
+    return _mm512_shuffle_i64x2(v, v, _MM_SHUFFLE(0, 1, 2, 3));
+}
+
+__attribute__((target("avx512f,avx512bw"))) static bool load_and_avx512(
+    uint64_t *dst, const uint8_t *src, const uint64_t *mask,
+    uint32_t nb_words) {
+    const uint8_t *src_end = &src[nb_words * 8];
+    __m512i dropped = _mm512_setzero_si512();
+    uint32_t i = 0;
+    for (; i + 8 <= nb_words; i += 8) {
+        __m512i v = bswap512_avx512(_mm512_loadu_si512(src_end - (i + 8) * 8));
+        if (mask) {
+            __m512i m = _mm512_loadu_si512(&mask[i]);
+            dropped = _mm512_or_si512(dropped, _mm512_andnot_si512(m, v));
+            v = _mm512_and_si512(v, m);
+        }
+        _mm512_storeu_si512(&dst[i], v);
+    }
+    bool no_drop = _mm512_test_epi64_mask(dropped, dropped) == 0;
+    if (i < nb_words) {
+        no_drop &= load_and_avx2(&dst[i], src, mask ? &mask[i] : NULL,
+                                 nb_words - i);
+    }
+    return no_drop;
+}
+
+__attribute__((target("avx512f,avx512bw"))) static bool store_and_avx512(
+    uint8_t *dst, const uint64_t *a, const uint64_t *b, uint32_t nb_words) {
+    uint8_t *dst_end = &dst[nb_words * 8];
+    __m512i any = _mm512_setzero_si512();
+    uint32_t i = 0;
+    for (; i + 8 <= nb_words; i += 8) {
+        __m512i v = _mm512_loadu_si512(&a[i]);
+        if (b) {
+            v = _mm512_and_si512(v, _mm512_loadu_si512(&b[i]));
+        }
+        any = _mm512_or_si512(any, v);
+        _mm512_storeu_si512(dst_end - (i + 8) * 8, bswap512_avx512(v));
+    }
+    bool is_set = _mm512_test_epi64_mask(any, any) != 0;
+    if (i < nb_words) {
+        is_set |= store_and_avx2(dst, &a[i], b ? &b[i] : NULL, nb_words - i);
+    }
+    return is_set;
+}
+
+__attribute__((target("avx512f"))) static void and_not_avx512(
+    uint64_t *dst, const uint64_t *mask, uint32_t nb_words) {
+    uint32_t i = 0;
+    for (; i + 8 <= nb_words; i += 8) {
+        __m512i v = _mm512_loadu_si512(&dst[i]);
+        __m512i m = _mm512_loadu_si512(&mask[i]);
+        _mm512_storeu_si512(&dst[i], _mm512_andnot_si512(m, v));
+    }
+    and_not_avx2(&dst[i], &mask[i], nb_words - i);
+}
+
+__attribute__((target("avx512f"))) static bool is_zero_avx512(
+    const uint64_t *bitstring, uint32_t nb_words) {
+    __m512i any = _mm512_setzero_si512();
+    uint32_t i = 0;
+    for (; i + 8 <= nb_words; i += 8) {
+        any = _mm512_or_si512(any, _mm512_loadu_si512(&bitstring[i]));
+    }
+    return _mm512_test_epi64_mask(any, any) == 0 &&
+           is_zero_avx2(&bitstring[i], nb_words - i);
+}
+
+#endif  // BITSTRING_X86
+
+static const bitstring_ops_t bitstring_impls[BITSTRING_IMPL_MAX] = {
+    [BITSTRING_IMPL_SCALAR] = {BITSTRING_IMPL_SCALAR, "scalar",
+                               load_and_scalar, store_and_scalar,
+                               and_not_scalar, is_zero_scalar,
+                               popcount_scalar},
+#ifdef BITSTRING_X86
+    [BITSTRING_IMPL_SSE2] = {BITSTRING_IMPL_SSE2, "sse2", load_and_sse2,
+                             store_and_sse2, and_not_sse2, is_zero_sse2,
+                             popcount_scalar},
+    [BITSTRING_IMPL_AVX2] = {BITSTRING_IMPL_AVX2, "avx2", load_and_avx2,
+                             store_and_avx2, and_not_avx2, is_zero_avx2,
+                             popcount_popcnt},
+    [BITSTRING_IMPL_AVX512] = {BITSTRING_IMPL_AVX512, "avx512",
+                               load_and_avx512, store_and_avx512,
+                               and_not_avx512, is_zero_avx512,
+                               popcount_popcnt},
+#endif
+};
+
+bitstring_ops_t bitstring_ops = {
+    BITSTRING_IMPL_SCALAR, "scalar", load_and_scalar, store_and_scalar,
+    and_not_scalar,        is_zero_scalar, popcount_scalar};
+
+static bool cpu_supports(bitstring_impl_t impl) {
+    switch (impl) {
+        case BITSTRING_IMPL_SCALAR:
+            return true;
+#ifdef BITSTRING_X86
+        case BITSTRING_IMPL_SSE2:
+            return __builtin_cpu_supports("sse2");
+        case BITSTRING_IMPL_AVX2:
+            return __builtin_cpu_supports("avx2") &&
+                   __builtin_cpu_supports("popcnt");
+        case BITSTRING_IMPL_AVX512:
+            return __builtin_cpu_supports("avx512f") &&
+                   __builtin_cpu_supports("avx512bw") &&
+                   __builtin_cpu_supports("avx2") &&
+                   __builtin_cpu_supports("popcnt");
+#endif
+        default:
+            return false;
+    }
+}
+
+int bitstring_select(bitstring_impl_t impl) {
+    if (impl >= BITSTRING_IMPL_MAX || !cpu_supports(impl)) {
+        return -1;
+    }
+    bitstring_ops = bitstring_impls[impl];
+    return 0;
+}
+
+__attribute__((constructor)) static void bitstring_init(void) {
+#ifdef BITSTRING_X86
+    __builtin_cpu_init();
+#endif
+    for (int impl = BITSTRING_IMPL_MAX - 1; impl >= 0; --impl) {
+        if (bitstring_select(impl) == 0) {
+            return;
+        }
+    }
+}
@@ -1,19 +1,36 @@
 #include "../include/public/multicast.h"
 
+#include "../include/bier-log.h"
+#include "../include/pktbuf.h"
+
 my_packet_t *create_ipv6_from_payload(struct sockaddr_in6 *mc_src,
                                       struct sockaddr_in6 *mc_dst,
                                       const uint32_t payload_length,
                                       const uint8_t *payload) {
     const uint32_t ipv6_header_length = 40;
     const uint32_t udp_header_length = 8;
-    const uint32_t packet_total_length =
-        ipv6_header_length + udp_header_length + payload_length;
-    uint8_t *packet = (uint8_t *)malloc(sizeof(uint8_t) * packet_total_length);
+    bier_pktbuf_pool_t *pool = bier_pktbuf_thread_pool();
+    bier_pktbuf_t *buf = pool ? bier_pktbuf_alloc(pool) : NULL;
+    if (!buf) {
+        log_err("No packet buffer left");
+        return NULL;
+    }
+    // The headers are prepended in front of the payload, without copy
+    uint8_t *packet_payload = bier_pktbuf_append(buf, payload_length);
+    if (!packet_payload) {
+        log_err("Payload of %u bytes is too long", payload_length);
+        bier_pktbuf_release(buf);
+        return NULL;
+    }
+    memcpy(packet_payload, payload, sizeof(uint8_t) * payload_length);
+    uint8_t *packet =
+        bier_pktbuf_prepend(buf, ipv6_header_length + udp_header_length);
     if (!packet) {
-        perror("packet");
+        log_err("No headroom for the IPv6 and UDP headers");
+        bier_pktbuf_release(buf);
         return NULL;
     }
-    memset(packet, 0, sizeof(uint8_t) * packet_total_length);
+    memset(packet, 0, ipv6_header_length + udp_header_length);
     // Encapsulated IPv6 Header
     struct ip6_hdr *ipv6_header = (struct ip6_hdr *)packet;
     ipv6_header->ip6_flow = htonl((6 << 28) | (0 << 20) | 0);
@@ -30,21 +47,14 @@ my_packet_t *create_ipv6_from_payload(struct sockaddr_in6 *mc_src,
     udp_header->uh_sport = htons(53983);
     udp_header->uh_ulen = htons(udp_header_length + payload_length);
 
-    // Payload
-    uint8_t *packet_payload = &packet[ipv6_header_length + udp_header_length];
-    memcpy(packet_payload, payload, sizeof(uint8_t) * payload_length);
-
     // Compute UDP checksum
     udp_header->uh_sum =
         udp_checksum(udp_header, sizeof(struct udphdr) + payload_length,
                      &ipv6_header->ip6_src, &ipv6_header->ip6_dst);
 
-    my_packet_t *my_packet = (my_packet_t *)malloc(sizeof(my_packet_t));
-    my_packet->packet = packet;
-    my_packet->packet_length = packet_total_length;
-    if (!my_packet) {
-        return NULL;
-    }
+    return bier_pktbuf_my_packet(buf);
+}
 
-    return my_packet;
-}
\ No newline at end of file
+void release_ipv6_packet(my_packet_t *packet) {
+    bier_pktbuf_release_my_packet(packet);
+}
@@ -0,0 +1,62 @@
+#include "../include/pktbuf.h"
+
+#include <stdlib.h>
+
+#include "../include/bier-log.h"
+
+int bier_pktbuf_pool_init(bier_pktbuf_pool_t *pool, uint32_t nb_bufs) {
+    pool->bufs = (bier_pktbuf_t *)aligned_alloc(_Alignof(bier_pktbuf_t),
+                                                sizeof(bier_pktbuf_t) * nb_bufs);
+    if (!pool->bufs) {
+        log_perror("aligned_alloc packet buffers");
+        return -1;
+    }
+    pool->nb_bufs = nb_bufs;
+    pool->nb_free = nb_bufs;
+    pool->free_list = NULL;
+    // The first buffers are taken first
+    for (uint32_t i = nb_bufs; i > 0; --i) {
+        bier_pktbuf_t *buf = &pool->bufs[i - 1];
+        buf->pool = pool;
+        buf->next = pool->free_list;
+        pool->free_list = buf;
+    }
+    return 0;
+}
+
+void bier_pktbuf_pool_destroy(bier_pktbuf_pool_t *pool) {
+    free(pool->bufs);
+    pool->bufs = NULL;
+    pool->free_list = NULL;
+    pool->nb_bufs = 0;
+    pool->nb_free = 0;
+}
+
+static __thread bier_pktbuf_pool_t *thread_pool = NULL;
+
+bier_pktbuf_pool_t *bier_pktbuf_thread_pool(void) {
+    if (thread_pool) {
+        return thread_pool;
+    }
+    bier_pktbuf_pool_t *pool =
+        (bier_pktbuf_pool_t *)malloc(sizeof(bier_pktbuf_pool_t));
+    if (!pool) {
+        log_perror("malloc packet buffer pool");
+        return NULL;
+    }
+    if (bier_pktbuf_pool_init(pool, BIER_PKTBUF_POOL_SIZE) < 0) {
+        free(pool);
+        return NULL;
+    }
+    thread_pool = pool;
+    return pool;
+}
+
+void bier_pktbuf_thread_pool_free(void) {
+    if (!thread_pool) {
+        return;
+    }
+    bier_pktbuf_pool_destroy(thread_pool);
+    free(thread_pool);
+    thread_pool = NULL;
+}
@@ -1,24 +1,77 @@
+#define _GNU_SOURCE  // memfd_create
+
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <unistd.h>
 
+#include "../include/bier-log.h"
 #include "../include/public/bier.h"
+#include "../include/public/shm.h"
 #include "qcbor/qcbor.h"
 #include "qcbor/qcbor_decode.h"
 #include "qcbor/qcbor_encode.h"
 #include "qcbor/qcbor_spiffy_decode.h"
 
+/**
+ * @brief Fills the header of the frame sending *len* bytes with *bier_info*
+ */
+static void fill_bier_frame_header(bier_frame_header_t *frame, size_t len,
+                                   uint16_t proto,
+                                   const bier_info_t *bier_info) {
+    memset(frame, 0, sizeof(bier_frame_header_t));
+    frame->magic = BIER_FRAME_MAGIC;
+    frame->version = BIER_FRAME_VERSION;
+    frame->type = PACKET;
+    frame->proto = proto;
+    frame->bitstring_length = bier_info->send_info.bitstring_length;
+    frame->bift_id = bier_info->send_info.bift_id;
+    frame->payload_length = len;
+}
+
+/**
+ * @brief sendto_bier with a binary frame. The bitstring and the payload are
+ * sent from the buffers of the caller
+ */
+static ssize_t sendto_bier_frame(int socket, const void *buf, size_t len,
+                                 const struct sockaddr *dest_addr,
+                                 socklen_t addrlen, uint16_t proto,
+                                 bier_info_t *bier_info) {
+    bier_frame_header_t frame;
+    fill_bier_frame_header(&frame, len, proto, bier_info);
+
+    struct iovec iov[3] = {
+        {&frame, sizeof(frame)},
+        {bier_info->send_info.bitstring, frame.bitstring_length},
+        {(void *)buf, len},
+    };
+    struct msghdr msg = {};
+    msg.msg_name = (void *)dest_addr;
+    msg.msg_namelen = addrlen;
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 3;
+    return sendmsg(socket, &msg, 0);
+}
+
 ssize_t sendto_bier(int socket, const void *buf, size_t len,
                     const struct sockaddr *dest_addr, socklen_t addrlen,
                     uint16_t proto, bier_info_t *bier_info) {
+    if (bier_info->send_info.use_frames) {
+        return sendto_bier_frame(socket, buf, len, dest_addr, addrlen, proto,
+                                 bier_info);
+    }
     size_t qcbor_length = len + bier_info->send_info.bitstring_length +
                           200;  // Make room for other information encoding
     UsefulBuf_MAKE_STACK_UB(Buffer, qcbor_length);
 
     QCBOREncodeContext ctx;
-    fprintf(stderr, "First few bytes of bitstring: %x %x %x\n",
-            bier_info->send_info.bitstring[0],
-            bier_info->send_info.bitstring[1],
-            bier_info->send_info.bitstring[2]);
+    log_hex(LOG_DEBUG, "Bitstring:", bier_info->send_info.bitstring,
+            bier_info->send_info.bitstring_length);
     QCBOREncode_Init(&ctx, Buffer);
     QCBOREncode_OpenMap(&ctx);
     QCBOREncode_AddInt64ToMap(&ctx, "type", PACKET);
@@ -35,7 +88,7 @@ ssize_t sendto_bier(int socket, const void *buf, size_t len,
     QCBORError uErr;
     uErr = QCBOREncode_Finish(&ctx, &EncodedCBOR);
     if (uErr != QCBOR_SUCCESS) {
-        fprintf(stderr, "sendto_bier QCBOR error\n");
+        log_err("sendto_bier QCBOR error");
         return -1;
     }
 
@@ -44,25 +97,106 @@ ssize_t sendto_bier(int socket, const void *buf, size_t len,
     return nb_sent;
 }
 
-ssize_t recvfrom_bier(int socket, void *buf, size_t len,
-                      struct sockaddr *src_addr, socklen_t *addrlen,
-                      bier_info_t *bier_info) {
-    memset(bier_info, 0, sizeof(bier_info_t));
-    ssize_t nb_read_return = 0;
+// Maximum number of frames packed in a message, each frame holds a header
+#define BIER_MMSG_MAX_FRAMES \
+    (BIER_UNIX_MAX_MESSAGE_SIZE / sizeof(bier_frame_header_t))
+
+int sendmmsg_bier(int socket, const bier_mmsghdr_t *msgs, unsigned int vlen,
+                  const struct sockaddr *dest_addr, socklen_t addrlen) {
+    // The bitstrings and payloads are sent from the buffers of the caller
+    bier_frame_header_t frames[BIER_MMSG_MAX_FRAMES];
+    struct iovec iov[3 * BIER_MMSG_MAX_FRAMES];
+    unsigned int nb_sent = 0;
+    while (nb_sent < vlen) {
+        unsigned int nb_frames = 0;
+        size_t msg_length = 0;
+        while (nb_sent + nb_frames < vlen &&
+               nb_frames < BIER_MMSG_MAX_FRAMES) {
+            const bier_mmsghdr_t *m = &msgs[nb_sent + nb_frames];
+            size_t frame_length = sizeof(bier_frame_header_t) +
+                                  m->bier_info->send_info.bitstring_length +
+                                  m->len;
+            if (msg_length + frame_length > BIER_UNIX_MAX_MESSAGE_SIZE) {
+                break;
+            }
+            fill_bier_frame_header(&frames[nb_frames], m->len, m->proto,
+                                   m->bier_info);
+            iov[3 * nb_frames] =
+                (struct iovec){&frames[nb_frames], sizeof(bier_frame_header_t)};
+            iov[3 * nb_frames + 1] =
+                (struct iovec){m->bier_info->send_info.bitstring,
+                               m->bier_info->send_info.bitstring_length};
+            iov[3 * nb_frames + 2] = (struct iovec){(void *)m->buf, m->len};
+            msg_length += frame_length;
+            ++nb_frames;
+        }
+        if (nb_frames == 0) {
+            errno = EMSGSIZE;
+            break;
+        }
+        struct msghdr msg = {};
+        msg.msg_name = (void *)dest_addr;
+        msg.msg_namelen = addrlen;
+        msg.msg_iov = iov;
+        msg.msg_iovlen = 3 * nb_frames;
+        if (sendmsg(socket, &msg, 0) < 0) {
+            log_perror("sendmmsg_bier sendmsg");
+            break;
+        }
+        nb_sent += nb_frames;
+    }
+    return nb_sent > 0 ? (int)nb_sent : -1;
+}
 
-    // Read the QCBOR content from the UNIX socket from the BIER daemon
-    // TODO: quid if `buf` is longer than `tm_buf`: should not send "too small
-    // buffer"
-    uint8_t tmp_buf[4096];
-    ssize_t nb_read = recv(socket, tmp_buf, sizeof(tmp_buf), 0);
-    if (nb_read < 0) {
-        perror("read unix socket bier");
-        return nb_read;
+/**
+ * @brief Copies the payload of the frame *frame_buf* in *buf* and fills the
+ * information of recvfrom_bier
+ *
+ * @param frame_size set to the size of the frame in *frame_buf*, which may be
+ * followed by other frames
+ * @return ssize_t length of the payload, -1 if it does not fit in *buf* or
+ * if the frame is truncated
+ */
+static ssize_t recv_bier_frame(const uint8_t *frame_buf, size_t frame_len,
+                               void *buf, size_t len, struct sockaddr *src_addr,
+                               socklen_t *addrlen, bier_info_t *bier_info,
+                               size_t *frame_size) {
+    bier_frame_header_t frame;
+    memcpy(&frame, frame_buf, sizeof(bier_frame_header_t));
+    const uint8_t *payload =
+        &frame_buf[sizeof(bier_frame_header_t) + frame.bitstring_length];
+    if (payload + frame.payload_length > frame_buf + frame_len) {
+        log_err("Truncated BIER frame");
+        *frame_size = frame_len;
+        errno = EBADMSG;
+        return -1;
+    }
+    *frame_size = payload + frame.payload_length - frame_buf;
+    if (frame.payload_length > len) {
+        errno = EMSGSIZE;
+        return -1;
     }
-    fprintf(stderr, "local received: %ld\n", nb_read);
+    memcpy(buf, payload, frame.payload_length);
+    if (src_addr) {
+        struct sockaddr_in6 *src_addr6 = (struct sockaddr_in6 *)src_addr;
+        memcpy(&src_addr6->sin6_addr, frame.source_addr,
+               sizeof(frame.source_addr));
+        *addrlen = sizeof(frame.source_addr);
+    }
+    bier_info->recv_info.upstream_router_bfr_id = frame.upstream_router_bfr_id;
+    return frame.payload_length;
+}
+
+/**
+ * @brief Decodes a CBOR message of the daemon, see recvfrom_bier
+ */
+static ssize_t recv_bier_cbor(const uint8_t *cbor_buf, size_t cbor_len,
+                              void *buf, size_t len, struct sockaddr *src_addr,
+                              socklen_t *addrlen, bier_info_t *bier_info) {
+    ssize_t nb_read_return = 0;
 
     // QCBOR decoding the data to make it "recvfrom" compatible
-    UsefulBufC cbor = {tmp_buf, nb_read};
+    UsefulBufC cbor = {cbor_buf, cbor_len};
     QCBORDecodeContext ctx;
     QCBORError uErr;
     QCBORItem item;
@@ -75,7 +209,7 @@ ssize_t recvfrom_bier(int socket, void *buf, size_t len,
     if (item.uDataType == QCBOR_TYPE_BYTE_STRING) {
         UsefulBufC payload_buf = item.val.string;
         if (payload_buf.len > len) {
-            // TODO: update errno
+            errno = EMSGSIZE;
             return -1;
         }
         memcpy(buf, payload_buf.ptr, payload_buf.len);
@@ -85,7 +219,7 @@ ssize_t recvfrom_bier(int socket, void *buf, size_t len,
     // Source address of the neighbor sending the packet
     QCBORDecode_GetItemInMapSZ(&ctx, "source_addr", QCBOR_TYPE_BYTE_STRING,
                                &item);
-    if (item.uDataType == QCBOR_TYPE_BYTE_STRING) {
+    if (item.uDataType == QCBOR_TYPE_BYTE_STRING && src_addr) {
         UsefulBufC addr_buf = item.val.string;
         // TODO: check that it is not too long
         struct sockaddr_in6 *src_addr6 = (struct sockaddr_in6 *)src_addr;
@@ -96,14 +230,95 @@ ssize_t recvfrom_bier(int socket, void *buf, size_t len,
     // BIER-ID of the upstream router of the packet
     QCBORDecode_GetInt64InMapSZ(&ctx, "upstream_bifr",
                                 &bier_info->recv_info.upstream_router_bfr_id);
-    // fprintf(stderr, "------ AU DECODAGE on a %lu\n",
-    // bier_info->recv_info.upstream_router_bfr_id);
 
     QCBORDecode_ExitMap(&ctx);
 
     return nb_read_return;
 }
 
+void bier_recv_ctx_init(bier_recv_ctx_t *ctx, int socket) {
+    ctx->socket = socket;
+    ctx->length = 0;
+    ctx->offset = 0;
+}
+
+bool bier_recv_pending(const bier_recv_ctx_t *ctx) {
+    return ctx->offset < ctx->length;
+}
+
+int recvmmsg_bier(bier_recv_ctx_t *ctx, bier_recv_mmsghdr_t *msgs,
+                  unsigned int vlen, int flags) {
+    unsigned int nb_received = 0;
+    while (nb_received < vlen) {
+        if (!bier_recv_pending(ctx)) {
+            // Never blocks once a packet is received
+            ssize_t nb_read =
+                recv(ctx->socket, ctx->buffer, sizeof(ctx->buffer),
+                     nb_received > 0 ? flags | MSG_DONTWAIT : flags);
+            if (nb_read < 0) {
+                ctx->length = 0;
+                ctx->offset = 0;
+                if (errno != EAGAIN) {
+                    log_perror("read unix socket bier");
+                }
+                return nb_received > 0 ? (int)nb_received : -1;
+            }
+            log_debug("local received: %ld", nb_read);
+            ctx->length = nb_read;
+            ctx->offset = 0;
+        }
+
+        bier_recv_mmsghdr_t *m = &msgs[nb_received];
+        memset(&m->bier_info, 0, sizeof(bier_info_t));
+        uint8_t *msg = &ctx->buffer[ctx->offset];
+        size_t msg_len = ctx->length - ctx->offset;
+        ssize_t payload_length;
+        if (is_bier_frame(msg, msg_len)) {
+            size_t frame_size;
+            payload_length =
+                recv_bier_frame(msg, msg_len, m->buf, m->len, m->src_addr,
+                                &m->addrlen, &m->bier_info, &frame_size);
+            ctx->offset += frame_size;
+        } else {
+            // A CBOR message holds a single packet
+            payload_length =
+                recv_bier_cbor(msg, msg_len, m->buf, m->len, m->src_addr,
+                               &m->addrlen, &m->bier_info);
+            ctx->offset = ctx->length;
+        }
+        if (payload_length < 0) {
+            if (nb_received == 0) {
+                return -1;
+            }
+            continue;  // Only this packet is dropped
+        }
+        m->msg_len = payload_length;
+        ++nb_received;
+    }
+    return nb_received;
+}
+
+ssize_t recvfrom_bier(bier_recv_ctx_t *ctx, void *buf, size_t len,
+                      struct sockaddr *src_addr, socklen_t *addrlen,
+                      bier_info_t *bier_info) {
+    bier_recv_mmsghdr_t msg = {};
+    msg.buf = buf;
+    msg.len = len;
+    msg.src_addr = src_addr;
+    if (addrlen) {
+        msg.addrlen = *addrlen;
+    }
+    int nb_received = recvmmsg_bier(ctx, &msg, 1, 0);
+    memcpy(bier_info, &msg.bier_info, sizeof(bier_info_t));
+    if (nb_received < 0) {
+        return -1;
+    }
+    if (addrlen) {
+        *addrlen = msg.addrlen;
+    }
+    return msg.msg_len;
+}
+
 int bind_bier_generic(int socket, const struct sockaddr_un *bier_sock_path,
                       bier_bind_t *bind_to, int is_listener, int is_join) {
     size_t qcbor_length =
@@ -123,13 +338,12 @@ int bind_bier_generic(int socket, const struct sockaddr_un *bier_sock_path,
     UsefulBufC mc_sockaddr_buf = {&bind_to->mc_sockaddr,
                                   sizeof(struct sockaddr_in6)};
     struct sockaddr_in6 *addr = (struct sockaddr_in6 *)&bind_to->mc_sockaddr;
-    fprintf(stderr, "Bound to2: ");
-    for (int j = 0; j < 16; ++j) {
-        fprintf(stderr, "%x ", addr->sin6_addr.s6_addr[j]);
-    }
+    log_hex(LOG_DEBUG, "Bound to:", addr->sin6_addr.s6_addr,
+            sizeof(addr->sin6_addr.s6_addr));
     QCBOREncode_AddBytesToMap(&ctx, "mc_sockaddr", mc_sockaddr_buf);
     QCBOREncode_AddInt64ToMap(&ctx, "is_listener", is_listener);
     QCBOREncode_AddInt64ToMap(&ctx, "is_bind", is_join);
+    QCBOREncode_AddInt64ToMap(&ctx, "use_frames", bind_to->use_frames);
     QCBOREncode_CloseMap(&ctx);
 
     UsefulBufC EncodedCBOR;
@@ -143,7 +357,7 @@ int bind_bier_generic(int socket, const struct sockaddr_un *bier_sock_path,
         sendto(socket, EncodedCBOR.ptr, EncodedCBOR.len, 0,
                (struct sockaddr *)bier_sock_path, sizeof(struct sockaddr_un));
     if (nb_sent < 0) {
-        perror("Cannot send bind information to BIER:");
+        log_perror("Cannot send bind information to BIER");
         return -1;
     }
     return 0;
@@ -160,4 +374,233 @@ int bind_bier(int socket, const struct sockaddr_un *bier_sock_path, bier_bind_t
 
 int unbind_bier(int socket, const struct sockaddr_un *bier_sock_path, bier_bind_t *bind_to) {
     return bind_bier_generic(socket, bier_sock_path, bind_to, 1, 0);
-}
\ No newline at end of file
+}
+
+struct bier_shm {
+    int socket;  // Control socket towards the BIER daemon
+    struct sockaddr_un bier_sock_path;
+    char unix_path[NAME_MAX];
+    int memfd;
+    void *mem;
+    size_t mem_size;
+    bier_shm_ring_t tx;  // To the BIER daemon
+    bier_shm_ring_t rx;  // From the BIER daemon
+};
+
+/**
+ * @brief Sends the SHM message attaching or detaching the channel. The
+ * descriptors of the channel are passed with the attach message
+ */
+static int send_bier_shm_request(bier_shm_t *shm, bool attach) {
+    UsefulBuf_MAKE_STACK_UB(Buffer, NAME_MAX + 100);
+    QCBOREncodeContext ctx;
+    QCBOREncode_Init(&ctx, Buffer);
+    QCBOREncode_OpenMap(&ctx);
+    QCBOREncode_AddInt64ToMap(&ctx, "type", SHM);
+    UsefulBufC unix_path_buf = {shm->unix_path, strlen(shm->unix_path)};
+    QCBOREncode_AddBytesToMap(&ctx, "unix_path", unix_path_buf);
+    QCBOREncode_AddInt64ToMap(&ctx, "nb_slots", shm->tx.nb_slots);
+    QCBOREncode_AddInt64ToMap(&ctx, "attach", attach);
+    QCBOREncode_CloseMap(&ctx);
+
+    UsefulBufC EncodedCBOR;
+    if (QCBOREncode_Finish(&ctx, &EncodedCBOR) != QCBOR_SUCCESS) {
+        log_err("Cannot encode the shared memory request");
+        return -1;
+    }
+
+    struct iovec iov = {(void *)EncodedCBOR.ptr, EncodedCBOR.len};
+    struct msghdr msg = {};
+    msg.msg_name = &shm->bier_sock_path;
+    msg.msg_namelen = sizeof(struct sockaddr_un);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    union {
+        char buf[CMSG_SPACE(3 * sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    if (attach) {
+        int fds[3] = {shm->memfd, shm->tx.efd, shm->rx.efd};
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+        memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+    }
+    if (sendmsg(shm->socket, &msg, 0) < 0) {
+        log_perror("Cannot send the shared memory request to BIER");
+        return -1;
+    }
+    return 0;
+}
+
+bier_shm_t *bier_shm_open(int socket, const struct sockaddr_un *bier_sock_path,
+                          const char *unix_path, uint32_t nb_slots) {
+    if (strlen(unix_path) >= NAME_MAX) {
+        errno = ENAMETOOLONG;
+        return NULL;
+    }
+    bier_shm_t *shm = (bier_shm_t *)calloc(1, sizeof(bier_shm_t));
+    if (!shm) {
+        log_perror("calloc shared memory");
+        return NULL;
+    }
+    shm->socket = socket;
+    memcpy(&shm->bier_sock_path, bier_sock_path, sizeof(struct sockaddr_un));
+    strcpy(shm->unix_path, unix_path);
+    shm->tx.efd = -1;
+    shm->rx.efd = -1;
+    shm->mem = MAP_FAILED;
+    shm->mem_size = bier_shm_size(nb_slots);
+
+    // The memory is sealed so that the daemon can trust its size
+    shm->memfd = memfd_create("bier-shm", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (shm->memfd < 0) {
+        log_perror("memfd_create");
+        goto shm_open_error;
+    }
+    if (ftruncate(shm->memfd, shm->mem_size) < 0 ||
+        fcntl(shm->memfd, F_ADD_SEALS,
+              F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0) {
+        log_perror("Cannot size the shared memory");
+        goto shm_open_error;
+    }
+    shm->mem = mmap(NULL, shm->mem_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                    shm->memfd, 0);
+    if (shm->mem == MAP_FAILED) {
+        log_perror("mmap shared memory");
+        goto shm_open_error;
+    }
+    bier_shm_ring_t rings[2];
+    if (bier_shm_map_rings(shm->mem, shm->mem_size, nb_slots, rings) < 0) {
+        log_err("Invalid number of slots: %u", nb_slots);
+        errno = EINVAL;
+        goto shm_open_error;
+    }
+    shm->tx = rings[0];
+    shm->rx = rings[1];
+    shm->tx.efd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    shm->rx.efd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (shm->tx.efd < 0 || shm->rx.efd < 0) {
+        log_perror("eventfd");
+        goto shm_open_error;
+    }
+    // Nothing was received yet: the first packet must notify the descriptor
+    atomic_store(&shm->rx.hdr->consumer_waiting, 1);
+    if (send_bier_shm_request(shm, true) < 0) {
+        goto shm_open_error;
+    }
+    return shm;
+
+shm_open_error:
+    if (shm->mem != MAP_FAILED) {
+        munmap(shm->mem, shm->mem_size);
+    }
+    close(shm->memfd);
+    close(shm->tx.efd);
+    close(shm->rx.efd);
+    free(shm);
+    return NULL;
+}
+
+int bier_shm_sendmmsg(bier_shm_t *shm, const bier_mmsghdr_t *msgs,
+                      unsigned int vlen) {
+    unsigned int nb_sent = 0;
+    while (nb_sent < vlen) {
+        uint8_t *slot = bier_shm_ring_reserve(&shm->tx);
+        if (!slot) {
+            errno = EAGAIN;
+            break;
+        }
+        // The slot is only published if at least one frame fits
+        size_t slot_length = 0;
+        unsigned int nb_frames = 0;
+        for (; nb_sent + nb_frames < vlen; ++nb_frames) {
+            const bier_mmsghdr_t *m = &msgs[nb_sent + nb_frames];
+            size_t bitstring_length = m->bier_info->send_info.bitstring_length;
+            size_t frame_length =
+                sizeof(bier_frame_header_t) + bitstring_length + m->len;
+            if (slot_length + frame_length > BIER_SHM_MAX_MSG_SIZE) {
+                break;
+            }
+            // Frames after the first one may not be aligned
+            bier_frame_header_t header;
+            fill_bier_frame_header(&header, m->len, m->proto, m->bier_info);
+            uint8_t *frame = &slot[slot_length];
+            memcpy(frame, &header, sizeof(bier_frame_header_t));
+            uint8_t *bitstring = frame + sizeof(bier_frame_header_t);
+            memcpy(bitstring, m->bier_info->send_info.bitstring,
+                   bitstring_length);
+            memcpy(bitstring + bitstring_length, m->buf, m->len);
+            slot_length += frame_length;
+        }
+        if (nb_frames == 0) {
+            errno = EMSGSIZE;
+            break;
+        }
+        bier_shm_ring_publish(&shm->tx, slot_length);
+        nb_sent += nb_frames;
+    }
+    return nb_sent > 0 ? (int)nb_sent : -1;
+}
+
+ssize_t bier_shm_send(bier_shm_t *shm, const void *buf, size_t len,
+                      uint16_t proto, bier_info_t *bier_info) {
+    bier_mmsghdr_t msg = {buf, len, proto, bier_info};
+    if (bier_shm_sendmmsg(shm, &msg, 1) < 0) {
+        return -1;
+    }
+    return len;
+}
+
+ssize_t bier_shm_recv(bier_shm_t *shm, void *buf, size_t len,
+                      struct sockaddr *src_addr, socklen_t *addrlen,
+                      bier_info_t *bier_info, int flags) {
+    memset(bier_info, 0, sizeof(bier_info_t));
+    while (1) {
+        uint32_t frame_length;
+        uint8_t *frame = bier_shm_ring_peek(&shm->rx, &frame_length);
+        if (frame) {
+            ssize_t nb_read = -1;
+            size_t frame_size;
+            if (is_bier_frame(frame, frame_length)) {
+                nb_read = recv_bier_frame(frame, frame_length, buf, len,
+                                          src_addr, addrlen, bier_info,
+                                          &frame_size);
+            }
+            bier_shm_ring_release(&shm->rx);
+            return nb_read;
+        }
+        // Consumes the previous wakeups before announcing that we sleep
+        eventfd_t value;
+        eventfd_read(shm->rx.efd, &value);
+        if (!bier_shm_ring_prepare_sleep(&shm->rx)) {
+            continue;
+        }
+        if (flags & MSG_DONTWAIT) {
+            errno = EAGAIN;
+            return -1;
+        }
+        struct pollfd pfd = {shm->rx.efd, POLLIN, 0};
+        if (poll(&pfd, 1, -1) < 0) {
+            log_perror("poll shared memory");
+            return -1;
+        }
+    }
+}
+
+int bier_shm_get_fd(const bier_shm_t *shm) {
+    return shm->rx.efd;
+}
+
+int bier_shm_close(bier_shm_t *shm) {
+    int err = send_bier_shm_request(shm, false);
+    munmap(shm->mem, shm->mem_size);
+    close(shm->memfd);
+    close(shm->tx.efd);
+    close(shm->rx.efd);
+    free(shm);
+    return err;
+}
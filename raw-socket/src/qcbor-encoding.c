@@ -3,6 +3,9 @@
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/uio.h>
+
+#include "../include/bier-log.h"
 
 UsefulBufC encode_bier_payload(UsefulBuf Buffer,
                                const bier_payload_t *bier_payload) {
@@ -29,56 +32,42 @@ UsefulBufC encode_bier_payload(UsefulBuf Buffer,
     }
 }
 
-bier_payload_t *decode_bier_payload(QCBORDecodeContext ctx) {
-    QCBORError uErr;
-    QCBORItem item;
+/**
+ * @brief Decodes the fields of a PACKET message from the map entered in *ctx*.
+ * The bitstring and the payload are views in the decoded buffer
+ */
+static void decode_bier_payload_in_map(QCBORDecodeContext *ctx,
+                                       bier_payload_t *bier_payload) {
+    memset(bier_payload, 0, sizeof(bier_payload_t));
+    QCBORDecode_GetInt64InMapSZ(ctx, "bift_id", &bier_payload->use_bier_te);
 
-    bier_payload_t *bier_payload =
-        (bier_payload_t *)malloc(sizeof(bier_payload_t));
-    if (!bier_payload) {
-        perror("malloc decode payload");
-        return NULL;
+    // Optional, encode_bier_payload does not add it
+    int64_t proto = BIERPROTO_RESERVED;
+    QCBORDecode_GetInt64InMapSZ(ctx, "proto", &proto);
+    if (QCBORDecode_GetError(ctx) == QCBOR_ERR_LABEL_NOT_FOUND) {
+        QCBORDecode_GetAndResetError(ctx);
+        proto = BIERPROTO_RESERVED;
     }
+    bier_payload->proto = proto;
 
-    QCBORDecode_GetInt64InMapSZ(&ctx, "bift_id", &(bier_payload->use_bier_te));
-    QCBORDecode_GetInt64InMapSZ(&ctx, "proto", (uint64_t *)&bier_payload->proto);
+    UsefulBufC bitstring_buf;
+    QCBORDecode_GetByteStringInMapSZ(ctx, "bitstring", &bitstring_buf);
+    bier_payload->bitstring = (uint8_t *)bitstring_buf.ptr;
+    bier_payload->bitstring_length = bitstring_buf.len;
 
-    QCBORDecode_GetItemInMapSZ(&ctx, "bitstring", QCBOR_TYPE_BYTE_STRING,
-                               &item);
-    if (item.uDataType == QCBOR_TYPE_BYTE_STRING) {
-        UsefulBufC bitstring_buf = item.val.string;
-        bier_payload->bitstring_length = bitstring_buf.len;
-        bier_payload->bitstring =
-            (uint8_t *)malloc(sizeof(uint8_t) * bier_payload->bitstring_length);
-        if (!bier_payload->bitstring) {
-            perror("malloc");
-        } else {
-            memcpy(bier_payload->bitstring, bitstring_buf.ptr,
-                   bitstring_buf.len);
-        }
-    }
-
-    QCBORDecode_GetItemInMapSZ(&ctx, "payload", QCBOR_TYPE_BYTE_STRING, &item);
-    if (item.uDataType == QCBOR_TYPE_BYTE_STRING) {
-        UsefulBufC payload_buf = item.val.string;
-        bier_payload->payload_length = payload_buf.len;
-        bier_payload->payload =
-            (uint8_t *)malloc(sizeof(uint8_t) * bier_payload->payload_length);
-        if (0 && !bier_payload->payload) {
-            perror("malloc");
-        } else {
-            memcpy(bier_payload->payload, payload_buf.ptr, payload_buf.len);
-        }
-    }
-
-    uErr = QCBORDecode_GetError(&ctx);
-    if (uErr != QCBOR_SUCCESS) {
-        free(bier_payload);
-        perror("decode message qcbor geterror");
-        return NULL;
-    }
+    UsefulBufC payload_buf;
+    QCBORDecode_GetByteStringInMapSZ(ctx, "payload", &payload_buf);
+    bier_payload->payload = (uint8_t *)payload_buf.ptr;
+    bier_payload->payload_length = payload_buf.len;
+}
 
-    return bier_payload;
+QCBORError decode_bier_payload(UsefulBufC cbor, bier_payload_t *bier_payload) {
+    QCBORDecodeContext ctx;
+    QCBORDecode_Init(&ctx, cbor, QCBOR_DECODE_MODE_NORMAL);
+    QCBORDecode_EnterMap(&ctx, NULL);
+    decode_bier_payload_in_map(&ctx, bier_payload);
+    QCBORDecode_ExitMap(&ctx);
+    return QCBORDecode_Finish(&ctx);
 }
 
 int encode_local_bier_payload(
@@ -111,25 +100,113 @@ int encode_local_bier_payload(
     uErr = QCBOREncode_Finish(&ctx, &EncodedCBOR);
     if (uErr != QCBOR_SUCCESS) {
         // TODO: update errno
-        fprintf(stderr, "L'erreur vient d'ici........\n");
+        log_err("Cannot encode the local BIER payload");
         return -1;
     }
 
     size_t nb_sent = sendto(socket, EncodedCBOR.ptr, EncodedCBOR.len, 0,
                             (struct sockaddr *)dest_addr, addrlen);
     if (nb_sent < 0) {
-        perror("encode_local_bier_payload sendto");
+        log_perror("encode_local_bier_payload sendto");
+    }
+    return nb_sent;
+}
+
+void fill_local_bier_frame_header(
+    bier_frame_header_t *frame,
+    const bier_received_packet_t *bier_received_packet) {
+    memset(frame, 0, sizeof(bier_frame_header_t));
+    frame->magic = BIER_FRAME_MAGIC;
+    frame->version = BIER_FRAME_VERSION;
+    frame->type = PACKET;
+    frame->payload_length = bier_received_packet->payload_length;
+    frame->upstream_router_bfr_id =
+        bier_received_packet->upstream_router_bfr_id;
+    memcpy(frame->source_addr, &bier_received_packet->ip6_encap_src,
+           sizeof(bier_received_packet->ip6_encap_src));
+}
+
+int encode_local_bier_frame(int socket,
+                            const bier_received_packet_t *bier_received_packet,
+                            const struct sockaddr_un *dest_addr,
+                            socklen_t addrlen) {
+    bier_frame_header_t frame;
+    fill_local_bier_frame_header(&frame, bier_received_packet);
+
+    struct iovec iov[2] = {
+        {&frame, sizeof(frame)},
+        {bier_received_packet->payload, bier_received_packet->payload_length},
+    };
+    struct msghdr msg = {};
+    msg.msg_name = (void *)dest_addr;
+    msg.msg_namelen = addrlen;
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 2;
+    ssize_t nb_sent = sendmsg(socket, &msg, 0);
+    if (nb_sent < 0) {
+        log_perror("encode_local_bier_frame sendmsg");
     }
     return nb_sent;
 }
 
+int encode_local_bier_frame_shm(
+    bier_shm_ring_t *ring, const bier_received_packet_t *bier_received_packet) {
+    size_t frame_length =
+        sizeof(bier_frame_header_t) + bier_received_packet->payload_length;
+    if (frame_length > BIER_SHM_MAX_MSG_SIZE) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    uint8_t *slot = bier_shm_ring_reserve(ring);
+    if (!slot) {
+        errno = EAGAIN;
+        return -1;
+    }
+    fill_local_bier_frame_header((bier_frame_header_t *)slot,
+                                 bier_received_packet);
+    memcpy(slot + sizeof(bier_frame_header_t), bier_received_packet->payload,
+           bier_received_packet->payload_length);
+    bier_shm_ring_publish(ring, frame_length);
+    return frame_length;
+}
+
+int decode_bier_frame(void *app_buf, ssize_t len,
+                      bier_payload_t *bier_payload) {
+    if (len < 0 || !is_bier_frame(app_buf, len)) {
+        log_err("Unsupported BIER frame");
+        return -1;
+    }
+    // Fields are read once: the frame may be in memory shared with the
+    // application
+    bier_frame_header_t frame;
+    memcpy(&frame, app_buf, sizeof(bier_frame_header_t));
+    if (frame.type != PACKET) {
+        log_err("Unsupported BIER frame");
+        return -1;
+    }
+    if (sizeof(bier_frame_header_t) + frame.bitstring_length +
+            frame.payload_length > (size_t)len) {
+        log_err("Truncated BIER frame");
+        return -1;
+    }
+    memset(bier_payload, 0, sizeof(bier_payload_t));
+    bier_payload->use_bier_te = frame.bift_id;
+    bier_payload->proto = frame.proto;
+    bier_payload->bitstring_length = frame.bitstring_length;
+    bier_payload->bitstring = (uint8_t *)app_buf + sizeof(bier_frame_header_t);
+    bier_payload->payload_length = frame.payload_length;
+    bier_payload->payload =
+        bier_payload->bitstring + bier_payload->bitstring_length;
+    return 0;
+}
+
 bier_bind_t *decode_bier_bind(QCBORDecodeContext *ctx) {
     QCBORError uErr;
     QCBORItem item;
 
     bier_bind_t *bind = (bier_bind_t *)malloc(sizeof(bier_bind_t));
     if (!bind) {
-        perror("malloc decode bind");
+        log_perror("malloc decode bind");
         return NULL;
     }
     memset(bind, 0, sizeof(bier_bind_t));
@@ -141,6 +218,14 @@ bier_bind_t *decode_bier_bind(QCBORDecodeContext *ctx) {
     uint64_t is_join;
     QCBORDecode_GetInt64InMapSZ(ctx, "is_bind", &is_join);
     bind->is_join = is_join == 1;
+    // Optional: applications not aware of the binary frames receive CBOR
+    int64_t use_frames = 0;
+    QCBORDecode_GetInt64InMapSZ(ctx, "use_frames", &use_frames);
+    if (QCBORDecode_GetError(ctx) == QCBOR_ERR_LABEL_NOT_FOUND) {
+        QCBORDecode_GetAndResetError(ctx);
+        use_frames = 0;
+    }
+    bind->use_frames = use_frames == 1;
 
     QCBORDecode_GetItemInMapSZ(ctx, "unix_path", QCBOR_TYPE_BYTE_STRING, &item);
     if (item.uDataType == QCBOR_TYPE_BYTE_STRING) {
@@ -154,24 +239,160 @@ bier_bind_t *decode_bier_bind(QCBORDecodeContext *ctx) {
         memcpy(&bind->mc_sockaddr, mc_sockaddr_buf.ptr, mc_sockaddr_buf.len);
     }
     struct sockaddr_in6 *addr = (struct sockaddr_in6 *)&bind->mc_sockaddr;
-    fprintf(stderr, "Bound to2: ");
-    for (int j = 0; j < 16; ++j) {
-        fprintf(stderr, "%x ", addr->sin6_addr.s6_addr[j]);
-    }
-    fprintf(stderr, "\n");
+    log_hex(LOG_DEBUG, "Bound to:", addr->sin6_addr.s6_addr,
+            sizeof(addr->sin6_addr.s6_addr));
 
     uErr = QCBORDecode_GetError(ctx);
     if (uErr != QCBOR_SUCCESS) {
         free(bind);
-        perror("decode message qcbor geterror");
+        log_perror("decode message qcbor geterror");
         return NULL;
     }
 
     return bind;
 }
 
+bier_shm_request_t *decode_bier_shm_request(QCBORDecodeContext *ctx) {
+    bier_shm_request_t *request =
+        (bier_shm_request_t *)malloc(sizeof(bier_shm_request_t));
+    if (!request) {
+        log_perror("malloc decode shm request");
+        return NULL;
+    }
+    memset(request, 0, sizeof(bier_shm_request_t));
+
+    int64_t attach;
+    QCBORDecode_GetInt64InMapSZ(ctx, "attach", &attach);
+    request->attach = attach == 1;
+    int64_t nb_slots = 0;
+    QCBORDecode_GetInt64InMapSZ(ctx, "nb_slots", &nb_slots);
+    request->nb_slots = nb_slots;
+
+    UsefulBufC unix_path_buf;
+    QCBORDecode_GetByteStringInMapSZ(ctx, "unix_path", &unix_path_buf);
+
+    if (QCBORDecode_GetError(ctx) != QCBOR_SUCCESS ||
+        unix_path_buf.len >= sizeof(request->unix_path) || nb_slots < 0 ||
+        nb_slots > UINT32_MAX) {
+        log_err("Cannot decode the shared memory request");
+        free(request);
+        return NULL;
+    }
+    memcpy(request->unix_path, unix_path_buf.ptr, unix_path_buf.len);
+    return request;
+}
+
+bier_reload_request_t *decode_bier_reload_request(QCBORDecodeContext *ctx) {
+    bier_reload_request_t *request =
+        (bier_reload_request_t *)calloc(1, sizeof(bier_reload_request_t));
+    if (!request) {
+        log_perror("malloc decode reload request");
+        return NULL;
+    }
+
+    // The path is optional
+    UsefulBufC config_path_buf;
+    QCBORDecode_GetByteStringInMapSZ(ctx, "config_path", &config_path_buf);
+    QCBORError err = QCBORDecode_GetAndResetError(ctx);
+    if (err == QCBOR_ERR_LABEL_NOT_FOUND) {
+        return request;
+    }
+    if (err != QCBOR_SUCCESS ||
+        config_path_buf.len >= sizeof(request->config_path)) {
+        log_err("Cannot decode the reload request");
+        free(request);
+        return NULL;
+    }
+    memcpy(request->config_path, config_path_buf.ptr, config_path_buf.len);
+    return request;
+}
+
+/**
+ * @brief Decodes the operation of the map entered in *ctx*
+ *
+ * @return int 0 on success, -1 otherwise
+ */
+static int decode_bier_delta_op(QCBORDecodeContext *ctx, bier_delta_op_t *op) {
+    int64_t type, bfr_id;
+    QCBORDecode_GetInt64InMapSZ(ctx, "op", &type);
+    QCBORDecode_GetInt64InMapSZ(ctx, "bfr_id", &bfr_id);
+    if (QCBORDecode_GetError(ctx) != QCBOR_SUCCESS || type < BIER_DELTA_ADD ||
+        type > BIER_DELTA_DELETE || bfr_id <= 0 || bfr_id > UINT32_MAX) {
+        return -1;
+    }
+    op->op = type;
+    op->bfr_id = bfr_id;
+
+    // The neighbour and the forwarding bitmask are optional
+    UsefulBufC nei, fbm;
+    QCBORDecode_GetByteStringInMapSZ(ctx, "nei", &nei);
+    QCBORError err = QCBORDecode_GetAndResetError(ctx);
+    if (err == QCBOR_SUCCESS && nei.len == sizeof(struct in_addr)) {
+        op->nei_family = AF_INET;
+        memcpy(op->nei, nei.ptr, nei.len);
+    } else if (err == QCBOR_SUCCESS && nei.len == sizeof(struct in6_addr)) {
+        op->nei_family = AF_INET6;
+        memcpy(op->nei, nei.ptr, nei.len);
+    } else if (err == QCBOR_ERR_LABEL_NOT_FOUND) {
+        op->nei_family = AF_UNSPEC;
+    } else {
+        return -1;
+    }
+    QCBORDecode_GetByteStringInMapSZ(ctx, "fbm", &fbm);
+    err = QCBORDecode_GetAndResetError(ctx);
+    if (err == QCBOR_SUCCESS) {
+        op->fbm = fbm.ptr;
+        op->fbm_length = fbm.len;
+    } else if (err != QCBOR_ERR_LABEL_NOT_FOUND) {
+        return -1;
+    }
+    return 0;
+}
+
+bier_delta_t *decode_bier_delta(QCBORDecodeContext *ctx) {
+    bier_delta_t *delta = (bier_delta_t *)calloc(1, sizeof(bier_delta_t));
+    if (!delta) {
+        log_perror("malloc decode delta");
+        return NULL;
+    }
+
+    int64_t bift_id;
+    QCBORDecode_GetInt64InMapSZ(ctx, "bift_id", &bift_id);
+    QCBORDecode_EnterArrayFromMapSZ(ctx, "ops");
+    if (QCBORDecode_GetError(ctx) != QCBOR_SUCCESS || bift_id <= 0 ||
+        bift_id > UINT32_MAX) {
+        goto decode_bier_delta_error;
+    }
+    delta->bift_id = bift_id;
+    while (1) {
+        QCBORDecode_EnterMap(ctx, NULL);
+        if (QCBORDecode_GetError(ctx) == QCBOR_ERR_NO_MORE_ITEMS) {
+            QCBORDecode_GetAndResetError(ctx);
+            break;
+        }
+        if (QCBORDecode_GetError(ctx) != QCBOR_SUCCESS ||
+            delta->nb_ops == BIER_DELTA_MAX_OPS ||
+            decode_bier_delta_op(ctx, &delta->ops[delta->nb_ops]) < 0) {
+            goto decode_bier_delta_error;
+        }
+        ++delta->nb_ops;
+        QCBORDecode_ExitMap(ctx);
+    }
+    QCBORDecode_ExitArray(ctx);
+    if (QCBORDecode_GetError(ctx) != QCBOR_SUCCESS) {
+        goto decode_bier_delta_error;
+    }
+    return delta;
+
+decode_bier_delta_error:
+    log_err("Cannot decode the BIFT delta");
+    free(delta);
+    return NULL;
+}
+
 void *decode_application_message(void *app_buf, ssize_t len,
-                                 bier_message_type *msg) {
+                                 bier_message_type *msg,
+                                 bier_payload_t *bier_payload) {
     UsefulBufC buffer = {app_buf, len};
     QCBORDecodeContext ctx;
     QCBORError uErr;
@@ -186,24 +407,19 @@ void *decode_application_message(void *app_buf, ssize_t len,
 
     switch (type) {
         case PACKET: {
-            fprintf(stderr, "Will call PACKET decode\n");
-            bier_payload_t *payload = decode_bier_payload(ctx);
-            if (!payload) {
-                return NULL;
-            }
-            fprintf(stderr, "Payload BIER information: %lu %lu\n",
-                    payload->bitstring_length, payload->payload_length);
+            log_debug("Will call PACKET decode");
+            decode_bier_payload_in_map(&ctx, bier_payload);
+            log_debug("Payload BIER information: %lu %lu",
+                      bier_payload->bitstring_length,
+                      bier_payload->payload_length);
 
             QCBORDecode_ExitMap(&ctx);
             if (QCBORDecode_Finish(&ctx) != QCBOR_SUCCESS) {
-                fprintf(stderr, "ERROR HERE\n");
-                free(payload->bitstring);
-                free(payload->payload);
-                free(payload);
+                log_err("Cannot finish decoding the BIER payload");
                 return NULL;
             }
 
-            return (void *)payload;
+            return (void *)bier_payload;
         }
         case BIND: {
             bier_bind_t *bind = decode_bier_bind(&ctx);
@@ -217,8 +433,44 @@ void *decode_application_message(void *app_buf, ssize_t len,
             }
             return (void *)bind;
         }
+        case SHM: {
+            bier_shm_request_t *request = decode_bier_shm_request(&ctx);
+            if (!request) {
+                return NULL;
+            }
+            QCBORDecode_ExitMap(&ctx);
+            if (QCBORDecode_Finish(&ctx) != QCBOR_SUCCESS) {
+                free(request);
+                return NULL;
+            }
+            return (void *)request;
+        }
+        case DELTA: {
+            bier_delta_t *delta = decode_bier_delta(&ctx);
+            if (!delta) {
+                return NULL;
+            }
+            QCBORDecode_ExitMap(&ctx);
+            if (QCBORDecode_Finish(&ctx) != QCBOR_SUCCESS) {
+                free(delta);
+                return NULL;
+            }
+            return (void *)delta;
+        }
+        case RELOAD: {
+            bier_reload_request_t *request = decode_bier_reload_request(&ctx);
+            if (!request) {
+                return NULL;
+            }
+            QCBORDecode_ExitMap(&ctx);
+            if (QCBORDecode_Finish(&ctx) != QCBOR_SUCCESS) {
+                free(request);
+                return NULL;
+            }
+            return (void *)request;
+        }
         default:
-            fprintf(stderr, "Unsupported UNIX message type: %ld\n", type);
+            log_err("Unsupported UNIX message type: %ld", type);
             QCBORDecode_ExitMap(&ctx);
             QCBORDecode_Finish(&ctx);
             return NULL;
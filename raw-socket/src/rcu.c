@@ -0,0 +1,88 @@
+#include "../include/rcu.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/bier-log.h"
+
+struct bier_rcu_deferred {
+    void *ptr;
+    void (*free_fn)(void *);
+    uint64_t epoch;  // Safe once every online reader saw this epoch
+    struct bier_rcu_deferred *next;
+};
+
+int bier_rcu_init(bier_rcu_t *rcu, int nb_readers) {
+    memset(rcu, 0, sizeof(bier_rcu_t));
+    atomic_init(&rcu->epoch, 1);
+    rcu->nb_readers = nb_readers;
+    if (nb_readers == 0) {
+        return 0;
+    }
+    rcu->readers = (bier_rcu_reader_t *)aligned_alloc(
+        _Alignof(bier_rcu_reader_t), sizeof(bier_rcu_reader_t) * nb_readers);
+    if (!rcu->readers) {
+        log_perror("aligned_alloc rcu readers");
+        return -1;
+    }
+    for (int i = 0; i < nb_readers; ++i) {
+        atomic_init(&rcu->readers[i].epoch, 0);
+    }
+    return 0;
+}
+
+void bier_rcu_destroy(bier_rcu_t *rcu) {
+    while (rcu->retired) {
+        bier_rcu_deferred_t *deferred = rcu->retired;
+        rcu->retired = deferred->next;
+        deferred->free_fn(deferred->ptr);
+        free(deferred);
+    }
+    free(rcu->readers);
+    rcu->readers = NULL;
+    rcu->nb_readers = 0;
+}
+
+int bier_rcu_retire(bier_rcu_t *rcu, void *ptr, void (*free_fn)(void *)) {
+    if (!ptr) {
+        return 0;
+    }
+    bier_rcu_deferred_t *deferred =
+        (bier_rcu_deferred_t *)malloc(sizeof(bier_rcu_deferred_t));
+    if (!deferred) {
+        log_perror("malloc rcu deferred");
+        return -1;
+    }
+    // A reader that saw the new epoch loaded the pointer after the swap
+    deferred->epoch = atomic_fetch_add(&rcu->epoch, 1) + 1;
+    deferred->ptr = ptr;
+    deferred->free_fn = free_fn;
+    deferred->next = rcu->retired;
+    rcu->retired = deferred;
+    return 0;
+}
+
+bool bier_rcu_reclaim(bier_rcu_t *rcu) {
+    if (!rcu->retired) {
+        return false;
+    }
+    uint64_t min_epoch = atomic_load(&rcu->epoch);
+    for (int i = 0; i < rcu->nb_readers; ++i) {
+        uint64_t epoch = atomic_load(&rcu->readers[i].epoch);
+        if (epoch != 0 && epoch < min_epoch) {
+            min_epoch = epoch;
+        }
+    }
+    bier_rcu_deferred_t **prev = &rcu->retired;
+    while (*prev) {
+        bier_rcu_deferred_t *deferred = *prev;
+        if (deferred->epoch <= min_epoch) {
+            *prev = deferred->next;
+            deferred->free_fn(deferred->ptr);
+            free(deferred);
+        } else {
+            prev = &deferred->next;
+        }
+    }
+    return rcu->retired != NULL;
+}
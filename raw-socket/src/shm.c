@@ -0,0 +1,106 @@
+#include "../include/public/shm.h"
+
+#include <stdint.h>
+#include <sys/eventfd.h>
+
+#define BIER_SHM_RING_SIZE(nb_slots) \
+    (sizeof(bier_shm_ring_hdr_t) + (size_t)(nb_slots)*BIER_SHM_SLOT_SIZE)
+
+size_t bier_shm_size(uint32_t nb_slots) {
+    return 2 * BIER_SHM_RING_SIZE(nb_slots);
+}
+
+int bier_shm_map_rings(void *mem, size_t mem_size, uint32_t nb_slots,
+                       bier_shm_ring_t rings[2]) {
+    if (nb_slots == 0 || nb_slots > BIER_SHM_MAX_SLOTS ||
+        (nb_slots & (nb_slots - 1)) != 0 || mem_size != bier_shm_size(nb_slots)) {
+        return -1;
+    }
+    for (int i = 0; i < 2; ++i) {
+        uint8_t *ring_mem = (uint8_t *)mem + i * BIER_SHM_RING_SIZE(nb_slots);
+        rings[i].hdr = (bier_shm_ring_hdr_t *)ring_mem;
+        rings[i].slots = ring_mem + sizeof(bier_shm_ring_hdr_t);
+        rings[i].nb_slots = nb_slots;
+        rings[i].efd = -1;
+    }
+    return 0;
+}
+
+static inline uint8_t *bier_shm_slot(bier_shm_ring_t *ring, uint32_t idx) {
+    return &ring->slots[(size_t)(idx & (ring->nb_slots - 1)) *
+                        BIER_SHM_SLOT_SIZE];
+}
+
+uint8_t *bier_shm_ring_reserve(bier_shm_ring_t *ring) {
+    uint32_t head =
+        atomic_load_explicit(&ring->hdr->head, memory_order_relaxed);
+    uint32_t tail =
+        atomic_load_explicit(&ring->hdr->tail, memory_order_acquire);
+    if (head - tail >= ring->nb_slots) {
+        return NULL;
+    }
+    return bier_shm_slot(ring, head) + BIER_SHM_MSG_OFFSET;
+}
+
+void bier_shm_ring_publish(bier_shm_ring_t *ring, uint32_t length) {
+    uint32_t head =
+        atomic_load_explicit(&ring->hdr->head, memory_order_relaxed);
+    *(uint32_t *)bier_shm_slot(ring, head) = length;
+    atomic_store_explicit(&ring->hdr->head, head + 1, memory_order_release);
+    // Pairs with the fence of bier_shm_ring_prepare_sleep: either the consumer
+    // sees the new head, or the producer sees that it waits
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&ring->hdr->consumer_waiting,
+                             memory_order_relaxed) &&
+        atomic_exchange_explicit(&ring->hdr->consumer_waiting, 0,
+                                 memory_order_relaxed)) {
+        eventfd_write(ring->efd, 1);
+    }
+}
+
+uint8_t *bier_shm_ring_peek(bier_shm_ring_t *ring, uint32_t *length) {
+    uint32_t tail =
+        atomic_load_explicit(&ring->hdr->tail, memory_order_relaxed);
+    uint32_t head =
+        atomic_load_explicit(&ring->hdr->head, memory_order_acquire);
+    if (head == tail) {
+        return NULL;
+    }
+    uint8_t *slot = bier_shm_slot(ring, tail);
+    // The other side may be malicious or buggy
+    *length = *(volatile uint32_t *)slot;
+    if (*length > BIER_SHM_MAX_MSG_SIZE) {
+        *length = 0;
+    }
+    return slot + BIER_SHM_MSG_OFFSET;
+}
+
+void bier_shm_ring_release(bier_shm_ring_t *ring) {
+    uint32_t tail =
+        atomic_load_explicit(&ring->hdr->tail, memory_order_relaxed);
+    atomic_store_explicit(&ring->hdr->tail, tail + 1, memory_order_release);
+}
+
+bool bier_shm_ring_prepare_sleep(bier_shm_ring_t *ring) {
+    atomic_store_explicit(&ring->hdr->consumer_waiting, 1,
+                          memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    uint32_t tail =
+        atomic_load_explicit(&ring->hdr->tail, memory_order_relaxed);
+    uint32_t head =
+        atomic_load_explicit(&ring->hdr->head, memory_order_acquire);
+    if (head != tail) {
+        atomic_store_explicit(&ring->hdr->consumer_waiting, 0,
+                              memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+bool bier_shm_ring_is_valid(bier_shm_ring_t *ring) {
+    uint32_t tail =
+        atomic_load_explicit(&ring->hdr->tail, memory_order_relaxed);
+    uint32_t head =
+        atomic_load_explicit(&ring->hdr->head, memory_order_relaxed);
+    return head - tail <= ring->nb_slots;
+}
@@ -1,6 +1,18 @@
+#define _GNU_SOURCE  // memfd_create
+
+#include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
 #include "CUnit/Basic.h"
 #include "../include/bier.h"
+#include "../include/bier-sender.h"
+#include "../include/bitstring.h"
+#include "../include/pktbuf.h"
+#include "../include/public/bier.h"
+#include "../include/qcbor-encoding.h"
+#include "../include/rcu.h"
 
 void test_set_bier_bsl()
 {
@@ -36,6 +48,26 @@ void test_set_bier_proto()
     }
 }
 
+void test_set_entropy()
+{
+    uint8_t buffer[20] = {};
+    set_bier_bsl(buffer, 0xb);
+    set_entropy(buffer, 0xabcde);
+    CU_ASSERT_EQUAL(buffer[5], 0xba);
+    CU_ASSERT_EQUAL(buffer[6], 0xbc);
+    CU_ASSERT_EQUAL(buffer[7], 0xde);
+    CU_ASSERT_EQUAL(get_entropy(buffer), 0xabcde);
+    set_bier_bsl(buffer, 0x1);
+    CU_ASSERT_EQUAL(get_entropy(buffer), 0xabcde);
+    for (int i = 0; i < 20; ++i)
+    {
+        if (i < 5 || i > 7)
+        {
+            CU_ASSERT_EQUAL(buffer[i], 0);
+        }
+    }
+}
+
 void test_set_bitstring_ptr()
 {
     uint8_t buffer[20] = {};
@@ -99,10 +131,1319 @@ void test_get_bitstring()
     bitstring_ptr[0] = htobe64(bitstring);
 
     uint64_t bitstring_test = get_bitstring(buffer, 0);
-    printf("Test %lx et nous %lx\n", bitstring_test, bitstring);
     CU_ASSERT_EQUAL(bitstring_test, bitstring);
 }
 
+#define DIFF_NB_BFR 40
+#define DIFF_NB_NEI 3
+#define DIFF_LOCAL_BFR_ID 5
+#define DIFF_PAYLOAD_LENGTH 64
+
+/**
+ * @brief Reference RFC 8279 loop, as implemented before the count-trailing-zeros
+ * version of bier_non_te_processing. It walks the bitstring one bit at a time
+ * and updates the whole bitstring of the packet after each copy. Local
+ * delivery is left out: only the forwarded copies are compared.
+ */
+static int bier_non_te_processing_rfc8279(uint8_t *buffer,
+                                          size_t buffer_length,
+                                          bier_internal_t *bft, int socket) {
+    uint32_t bitstring_max_idx = bft->bitstring_length / 64;
+    uint32_t idx_bfr = 0;
+    uint64_t *bitstring_ptr = get_bitstring_ptr(buffer);
+    for (int bitstring_idx = bitstring_max_idx - 1; bitstring_idx >= 0;
+         --bitstring_idx) {
+        if (idx_bfr >= bft->nb_bft_entry) {
+            return -1;
+        }
+        uint64_t bitstring = be64toh(bitstring_ptr[bitstring_idx]);
+        uint32_t idx_bfr_word = idx_bfr % 64;
+        while ((bitstring >> idx_bfr_word) > 0) {
+            if (idx_bfr >= bft->nb_bft_entry) {
+                return -1;
+            }
+            if ((bitstring >> idx_bfr_word) & 1) {
+                bier_bft_entry_ecmp_t *ecmp_entry =
+                    bft->bft[idx_bfr]->ecmp_entry[0];
+                if (idx_bfr == bft->local_bfr_id - 1) {
+                    for (uint32_t i = 0; i < bitstring_max_idx; ++i) {
+                        bitstring_ptr[i] = htobe64(
+                            be64toh(bitstring_ptr[i]) &
+                            ~ecmp_entry->forwarding_bitmask[i]);
+                    }
+                    bitstring = be64toh(bitstring_ptr[bitstring_idx]);
+                    ++idx_bfr;
+                    idx_bfr_word = idx_bfr % 64;
+                    continue;
+                }
+                uint8_t packet_copy[buffer_length];
+                memcpy(packet_copy, buffer, buffer_length);
+                uint64_t bitstring_copy[bitstring_max_idx];
+                for (uint32_t i = 0; i < bitstring_max_idx; ++i) {
+                    bitstring_copy[i] =
+                        htobe64(be64toh(bitstring_ptr[i]) &
+                                ecmp_entry->forwarding_bitmask[i]);
+                }
+                set_bitstring_ptr(packet_copy, bitstring_copy,
+                                  bitstring_max_idx);
+                if (sendto(socket, packet_copy, sizeof(packet_copy), 0,
+                           (struct sockaddr *)&ecmp_entry->bfr_nei_addr.v4,
+                           sizeof(struct sockaddr_in)) < 0) {
+                    return -1;
+                }
+                for (uint32_t i = 0; i < bitstring_max_idx; ++i) {
+                    bitstring_ptr[i] =
+                        htobe64(be64toh(bitstring_ptr[i]) &
+                                ~ecmp_entry->forwarding_bitmask[i]);
+                }
+                bitstring = be64toh(bitstring_ptr[bitstring_idx]);
+            }
+            ++idx_bfr;
+            idx_bfr_word = idx_bfr % 64;
+        }
+    }
+    return 0;
+}
+
+typedef struct {
+    int nb_packets;
+    uint8_t packets[8][12 + 8 + DIFF_PAYLOAD_LENGTH];
+} diff_received_t;
+
+static void drain_neighbour(int socket, diff_received_t *received) {
+    memset(received, 0, sizeof(diff_received_t));
+    while (1) {
+        uint8_t buffer[sizeof(received->packets[0])];
+        ssize_t length = recv(socket, buffer, sizeof(buffer), MSG_DONTWAIT);
+        if (length < 0) {
+            break;
+        }
+        if (received->nb_packets < 8) {
+            memcpy(received->packets[received->nb_packets], buffer, length);
+        }
+        ++received->nb_packets;
+    }
+}
+
+void test_non_te_processing_differential()
+{
+    // Each BFR is reached through one of the neighbours, bound on the
+    // loopback. The forwarding bitmask of a BFR contains all BFRs sharing the
+    // same neighbour.
+    int nei_sockets[DIFF_NB_NEI];
+    struct sockaddr_in nei_addrs[DIFF_NB_NEI];
+    for (int i = 0; i < DIFF_NB_NEI; ++i) {
+        nei_sockets[i] = socket(AF_INET, SOCK_DGRAM, 0);
+        CU_ASSERT_FATAL(nei_sockets[i] >= 0);
+        memset(&nei_addrs[i], 0, sizeof(struct sockaddr_in));
+        nei_addrs[i].sin_family = AF_INET;
+        nei_addrs[i].sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t addrlen = sizeof(struct sockaddr_in);
+        CU_ASSERT_FATAL(bind(nei_sockets[i], (struct sockaddr *)&nei_addrs[i],
+                             addrlen) == 0);
+        getsockname(nei_sockets[i], (struct sockaddr *)&nei_addrs[i],
+                    &addrlen);
+    }
+    int sending_socket = socket(AF_INET, SOCK_DGRAM, 0);
+    CU_ASSERT_FATAL(sending_socket >= 0);
+
+    bier_internal_t bft = {};
+    bft.local_bfr_id = DIFF_LOCAL_BFR_ID;
+    bft.nb_bft_entry = DIFF_NB_BFR;
+    bft.bitstring_length = 64;
+    bier_bft_entry_t entries[DIFF_NB_BFR] = {};
+    bier_bft_entry_ecmp_t ecmp_entries[DIFF_NB_BFR] = {};
+    bier_bft_entry_ecmp_t *ecmp_ptrs[DIFF_NB_BFR];
+    bier_bft_entry_t *bft_ptrs[DIFF_NB_BFR];
+    uint64_t forwarding_bitmasks[DIFF_NB_BFR] = {};
+    for (int i = 0; i < DIFF_NB_BFR; ++i) {
+        for (int j = 0; j < DIFF_NB_BFR; ++j) {
+            if (i == DIFF_LOCAL_BFR_ID - 1 || j == DIFF_LOCAL_BFR_ID - 1) {
+                continue;
+            }
+            if ((i * 7) % DIFF_NB_NEI == (j * 7) % DIFF_NB_NEI) {
+                forwarding_bitmasks[i] |= (uint64_t)1 << j;
+            }
+        }
+        if (i == DIFF_LOCAL_BFR_ID - 1) {
+            forwarding_bitmasks[i] = (uint64_t)1 << i;
+        }
+        ecmp_entries[i].forwarding_bitmask = &forwarding_bitmasks[i];
+        ecmp_entries[i].bitstring_length = 64;
+        ecmp_entries[i].bfr_nei_addr.v4 = nei_addrs[(i * 7) % DIFF_NB_NEI];
+        ecmp_ptrs[i] = &ecmp_entries[i];
+        entries[i].bfr_id = i + 1;
+        entries[i].nb_ecmp_entries = 1;
+        entries[i].ecmp_entry = &ecmp_ptrs[i];
+        bft_ptrs[i] = &entries[i];
+    }
+    bft.bft = bft_ptrs;
+    bft.compiled = compile_bier_bft(&bft, true);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(bft.compiled);
+    CU_ASSERT_EQUAL(bft.compiled->nb_neighbours, DIFF_NB_NEI);
+
+    bier_all_apps_t all_apps = {};
+    all_apps.application_socket = -1;
+    // Smaller than the number of neighbours to also flush while replicating
+    bier_tx_queue_t *tx = init_tx_queue(sending_socket, 2);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(tx);
+    bier_bift_stats_t stats = {};
+    uint64_t nb_sent[DIFF_NB_NEI] = {};
+    uint64_t nb_unknown_bfr = 0;
+
+    srand(8279);
+    for (int round = 0; round < 500; ++round) {
+        uint8_t packet[12 + 8 + DIFF_PAYLOAD_LENGTH];
+        for (int i = 0; i < sizeof(packet); ++i) {
+            packet[i] = rand();
+        }
+        set_bier_proto(packet, 0);
+        uint64_t bitstring = ((uint64_t)rand() << 32) | rand();
+        if (round % 10) {
+            // Mostly valid bitstrings, with a few unknown BFRs
+            bitstring &= ((uint64_t)1 << DIFF_NB_BFR) - 1;
+        }
+        if (round % 3 == 0) {
+            // Sparse bitstrings
+            bitstring &= ((uint64_t)rand() << 32) | rand();
+        }
+        set_bitstring(packet, 0, bitstring);
+
+        uint8_t packet_reference[sizeof(packet)];
+        memcpy(packet_reference, packet, sizeof(packet));
+        int err_reference = bier_non_te_processing_rfc8279(
+            packet_reference, sizeof(packet_reference), &bft, sending_socket);
+        diff_received_t received_reference[DIFF_NB_NEI];
+        for (int i = 0; i < DIFF_NB_NEI; ++i) {
+            drain_neighbour(nei_sockets[i], &received_reference[i]);
+        }
+
+        int err = bier_non_te_processing(packet, sizeof(packet), &bft, tx,
+                                         &stats, &all_apps, true);
+        CU_ASSERT_EQUAL(bier_tx_queue_flush(tx), 0);
+        diff_received_t received[DIFF_NB_NEI];
+        for (int i = 0; i < DIFF_NB_NEI; ++i) {
+            drain_neighbour(nei_sockets[i], &received[i]);
+            nb_sent[i] += received[i].nb_packets;
+        }
+        nb_unknown_bfr += (bitstring >> DIFF_NB_BFR) != 0;
+
+        CU_ASSERT_EQUAL(err < 0, err_reference < 0);
+        if (bitstring >> DIFF_NB_BFR) {
+            // Unknown BFRs: the reference loop stops at the first one while
+            // the per-neighbour replication still serves the known BFRs
+            continue;
+        }
+        for (int i = 0; i < DIFF_NB_NEI; ++i) {
+            CU_ASSERT_EQUAL(received[i].nb_packets,
+                            received_reference[i].nb_packets);
+            CU_ASSERT(memcmp(received[i].packets,
+                             received_reference[i].packets,
+                             sizeof(received[i].packets)) == 0);
+        }
+    }
+
+    // The counters match what the neighbours received
+    uint64_t nb_replicas = 0;
+    for (uint32_t n = 0; n < bft.compiled->nb_neighbours; ++n) {
+        for (int i = 0; i < DIFF_NB_NEI; ++i) {
+            if (bft.compiled->nei_addr[n].v4.sin_port ==
+                nei_addrs[i].sin_port) {
+                CU_ASSERT_EQUAL(
+                    bier_stats_read(bft.compiled->nei_stats[n].tx_packets),
+                    nb_sent[i]);
+                CU_ASSERT_EQUAL(
+                    bier_stats_read(bft.compiled->nei_stats[n].tx_bytes),
+                    nb_sent[i] * (12 + 8 + DIFF_PAYLOAD_LENGTH));
+            }
+        }
+        nb_replicas += nb_sent[n];
+    }
+    CU_ASSERT_EQUAL(bier_stats_read(stats.replicas_out), nb_replicas);
+    CU_ASSERT_EQUAL(bier_stats_read(stats.drops[BIER_DROP_UNKNOWN_BFR]),
+                    nb_unknown_bfr);
+
+    // Overlapping forwarding bitmasks: each one also holds the next BFR,
+    // reached through another neighbour. Each BFR still receives a single
+    // copy, even if it may come from another neighbour than with the loop
+    for (int i = 0; i < DIFF_NB_BFR; ++i) {
+        int next = (i + 1) % DIFF_NB_BFR;
+        if (i != DIFF_LOCAL_BFR_ID - 1 && next != DIFF_LOCAL_BFR_ID - 1) {
+            forwarding_bitmasks[i] |= (uint64_t)1 << next;
+        }
+    }
+    free_compiled_bft(bft.compiled);
+    bft.compiled = compile_bier_bft(&bft, true);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(bft.compiled);
+    for (int round = 0; round < 200; ++round) {
+        uint8_t packet[12 + 8 + DIFF_PAYLOAD_LENGTH];
+        for (int i = 0; i < sizeof(packet); ++i) {
+            packet[i] = rand();
+        }
+        set_bier_proto(packet, 0);
+        uint64_t bitstring = (((uint64_t)rand() << 32) | rand()) &
+                             (((uint64_t)1 << DIFF_NB_BFR) - 1);
+        set_bitstring(packet, 0, bitstring);
+        uint64_t expected =
+            bitstring & ~((uint64_t)1 << (DIFF_LOCAL_BFR_ID - 1));
+
+        uint8_t packet_reference[sizeof(packet)];
+        memcpy(packet_reference, packet, sizeof(packet));
+        CU_ASSERT_EQUAL(bier_non_te_processing_rfc8279(
+                            packet_reference, sizeof(packet_reference), &bft,
+                            sending_socket),
+                        0);
+        diff_received_t received_reference[DIFF_NB_NEI];
+        for (int i = 0; i < DIFF_NB_NEI; ++i) {
+            drain_neighbour(nei_sockets[i], &received_reference[i]);
+        }
+        bier_non_te_processing(packet, sizeof(packet), &bft, tx, &stats,
+                               &all_apps, true);
+        CU_ASSERT_EQUAL(bier_tx_queue_flush(tx), 0);
+        diff_received_t received[DIFF_NB_NEI];
+        for (int i = 0; i < DIFF_NB_NEI; ++i) {
+            drain_neighbour(nei_sockets[i], &received[i]);
+        }
+
+        uint64_t served = 0;
+        uint64_t served_reference = 0;
+        for (int i = 0; i < DIFF_NB_NEI; ++i) {
+            CU_ASSERT(received[i].nb_packets <= 1);
+            for (int p = 0; p < received[i].nb_packets && p < 8; ++p) {
+                uint64_t copy = get_bitstring(received[i].packets[p], 0);
+                CU_ASSERT_EQUAL(served & copy, 0);
+                served |= copy;
+            }
+            for (int p = 0; p < received_reference[i].nb_packets && p < 8;
+                 ++p) {
+                uint64_t copy =
+                    get_bitstring(received_reference[i].packets[p], 0);
+                CU_ASSERT_EQUAL(served_reference & copy, 0);
+                served_reference |= copy;
+            }
+        }
+        CU_ASSERT_EQUAL(served, expected);
+        CU_ASSERT_EQUAL(served_reference, expected);
+    }
+
+    free_tx_queue(tx);
+    free_compiled_bft(bft.compiled);
+    for (int i = 0; i < DIFF_NB_NEI; ++i) {
+        close(nei_sockets[i]);
+    }
+    close(sending_socket);
+}
+
+void test_tx_queue_per_message_errors() {
+    int receiver = socket(AF_INET, SOCK_DGRAM, 0);
+    CU_ASSERT_FATAL(receiver >= 0);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addrlen = sizeof(addr);
+    CU_ASSERT_FATAL(bind(receiver, (struct sockaddr *)&addr, addrlen) == 0);
+    getsockname(receiver, (struct sockaddr *)&addr, &addrlen);
+    // Port 0 is not a valid destination
+    struct sockaddr_in invalid = addr;
+    invalid.sin_port = 0;
+
+    int sending_socket = socket(AF_INET, SOCK_DGRAM, 0);
+    CU_ASSERT_FATAL(sending_socket >= 0);
+    bier_tx_queue_t *tx = init_tx_queue(sending_socket, 8);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(tx);
+    bier_bift_stats_t stats = {};
+    bier_nei_stats_t nei_stats = {};
+    // Shared by all replicas
+    uint8_t payload[30];
+    memset(payload, 0xab, sizeof(payload));
+    for (int i = 0; i < 3; ++i) {
+        uint8_t *slot = bier_tx_queue_slot(tx, 20);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(slot);
+        memset(slot, i, 20);
+        bier_tx_queue_commit(tx, 20, payload, sizeof(payload),
+                             (struct sockaddr *)(i == 1 ? &invalid : &addr),
+                             sizeof(addr), &nei_stats, &stats);
+    }
+    // The failing replica does not prevent sending the next one
+    CU_ASSERT_EQUAL(bier_tx_queue_flush(tx), 1);
+    CU_ASSERT_EQUAL(tx->nb_queued, 0);
+    diff_received_t received;
+    drain_neighbour(receiver, &received);
+    CU_ASSERT_EQUAL(received.nb_packets, 2);
+    CU_ASSERT_EQUAL(received.packets[0][0], 0);
+    CU_ASSERT_EQUAL(received.packets[1][0], 2);
+    // The replicas are the header followed by the shared payload
+    CU_ASSERT_EQUAL(received.packets[1][19], 2);
+    CU_ASSERT_EQUAL(received.packets[1][20], 0xab);
+    CU_ASSERT_EQUAL(received.packets[1][49], 0xab);
+    CU_ASSERT_EQUAL(bier_stats_read(stats.replicas_out), 2);
+    CU_ASSERT_EQUAL(bier_stats_read(stats.drops[BIER_DROP_SEND_FAILURE]), 1);
+    CU_ASSERT_EQUAL(bier_stats_read(nei_stats.tx_packets), 2);
+    CU_ASSERT_EQUAL(bier_stats_read(nei_stats.tx_bytes), 2 * 50);
+
+    free_tx_queue(tx);
+    close(sending_socket);
+    close(receiver);
+}
+
+#define DEMUX_NB_GROUPS 1000
+
+void test_demux_lookup() {
+    bier_demux_t demux = {};
+    struct in6_addr group = {};
+    CU_ASSERT_PTR_NULL(
+        bier_demux_lookup(&demux, BIERPROTO_IPV6, AF_INET6, &group));
+
+    // Enough groups to grow the table several times
+    for (uint32_t i = 0; i < DEMUX_NB_GROUPS; ++i) {
+        group.s6_addr[0] = 0xff;
+        memcpy(&group.s6_addr[12], &i, sizeof(i));
+        CU_ASSERT_EQUAL(
+            bier_demux_add(&demux, BIERPROTO_IPV6, AF_INET6, &group, i), 0);
+    }
+    // Every subscriber of a group is returned
+    CU_ASSERT_EQUAL(
+        bier_demux_add(&demux, BIERPROTO_IPV6, AF_INET6, &group, 12345), 0);
+    const bier_demux_entry_t *entry =
+        bier_demux_lookup(&demux, BIERPROTO_IPV6, AF_INET6, &group);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(entry);
+    CU_ASSERT_EQUAL(entry->nb_apps, 2);
+    CU_ASSERT_EQUAL(entry->apps[0], DEMUX_NB_GROUPS - 1);
+    CU_ASSERT_EQUAL(entry->apps[1], 12345);
+    // Same group with another proto
+    CU_ASSERT_PTR_NULL(
+        bier_demux_lookup(&demux, BIERPROTO_IPV4, AF_INET6, &group));
+
+    // Removing half of the groups keeps the others reachable
+    for (uint32_t i = 0; i < DEMUX_NB_GROUPS; i += 2) {
+        memcpy(&group.s6_addr[12], &i, sizeof(i));
+        CU_ASSERT_EQUAL(
+            bier_demux_remove(&demux, BIERPROTO_IPV6, AF_INET6, &group, i),
+            0);
+    }
+    CU_ASSERT_EQUAL(demux.nb_entries, DEMUX_NB_GROUPS / 2);
+    for (uint32_t i = 0; i < DEMUX_NB_GROUPS; ++i) {
+        memcpy(&group.s6_addr[12], &i, sizeof(i));
+        entry = bier_demux_lookup(&demux, BIERPROTO_IPV6, AF_INET6, &group);
+        if (i % 2) {
+            CU_ASSERT_PTR_NOT_NULL_FATAL(entry);
+            CU_ASSERT_EQUAL(entry->apps[0], i);
+        } else {
+            CU_ASSERT_PTR_NULL(entry);
+        }
+    }
+    CU_ASSERT_EQUAL(
+        bier_demux_remove(&demux, BIERPROTO_IPV6, AF_INET6, &group, 0), -1);
+
+    // Raw packets ignore the group
+    CU_ASSERT_EQUAL(
+        bier_demux_add(&demux, BIERPROTO_RESERVED_RAW, AF_INET6, &group, 7),
+        0);
+    entry = bier_demux_lookup(&demux, BIERPROTO_RESERVED_RAW, 0, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(entry);
+    CU_ASSERT_EQUAL(entry->apps[0], 7);
+
+    bier_demux_free(&demux);
+}
+
+#define REGISTRY_NB_APPS 20000
+
+void test_app_registry() {
+    bier_all_apps_t all_apps = {};
+    static bier_app_handle_t handles[REGISTRY_NB_APPS];
+    for (int i = 0; i < REGISTRY_NB_APPS; ++i) {
+        bier_application_t *app;
+        handles[i] = bier_app_register(&all_apps, &app);
+        CU_ASSERT_NOT_EQUAL_FATAL(handles[i], BIER_APP_INVALID_HANDLE);
+        app->proto = i;
+    }
+    CU_ASSERT_EQUAL(all_apps.nb_apps, REGISTRY_NB_APPS);
+    for (int i = 0; i < REGISTRY_NB_APPS; ++i) {
+        bier_application_t *app = bier_app_get(&all_apps, handles[i]);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(app);
+        CU_ASSERT_EQUAL(app->proto, (uint16_t)i);
+    }
+
+    // The released slot is reused and the old handle becomes stale
+    CU_ASSERT_EQUAL(bier_app_unregister(&all_apps, handles[42]), 0);
+    CU_ASSERT_PTR_NULL(bier_app_get(&all_apps, handles[42]));
+    CU_ASSERT_EQUAL(bier_app_unregister(&all_apps, handles[42]), -1);
+    bier_application_t *app;
+    bier_app_handle_t reused = bier_app_register(&all_apps, &app);
+    CU_ASSERT_EQUAL(bier_app_handle_idx(reused),
+                    bier_app_handle_idx(handles[42]));
+    CU_ASSERT_NOT_EQUAL(reused, handles[42]);
+    CU_ASSERT_PTR_NULL(bier_app_get(&all_apps, handles[42]));
+    CU_ASSERT_PTR_EQUAL(bier_app_get(&all_apps, reused), app);
+    CU_ASSERT_EQUAL(all_apps.nb_apps, REGISTRY_NB_APPS);
+    CU_ASSERT_PTR_NULL(
+        bier_app_get(&all_apps, bier_app_handle(all_apps.capacity, 0)));
+
+    bier_apps_free(&all_apps);
+}
+
+static int nb_freed_snapshots = 0;
+
+static void count_snapshot_free(void *snapshot) {
+    bier_apps_snapshot_free(snapshot);
+    ++nb_freed_snapshots;
+}
+
+void test_apps_snapshot_rcu() {
+    bier_all_apps_t all_apps = {};
+    uint8_t group[16] = {0xff, 0x02};
+    bier_application_t *app;
+    bier_app_handle_t handle = bier_app_register(&all_apps, &app);
+    CU_ASSERT_NOT_EQUAL_FATAL(handle, BIER_APP_INVALID_HANDLE);
+    app->proto = BIERPROTO_IPV6;
+    app->shm = (bier_shm_channel_t *)&all_apps;  // Never dereferenced
+    CU_ASSERT_EQUAL(bier_demux_add(&all_apps.demux, BIERPROTO_IPV6, AF_INET6,
+                                   group, handle), 0);
+
+    // The snapshot is not affected by the next changes of the registry
+    bier_all_apps_t *snapshot = bier_apps_snapshot(&all_apps);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(snapshot);
+    bier_demux_remove(&all_apps.demux, BIERPROTO_IPV6, AF_INET6, group, handle);
+    bier_app_unregister(&all_apps, handle);
+    const bier_demux_entry_t *entry = bier_demux_lookup(
+        &snapshot->demux, BIERPROTO_IPV6, AF_INET6, group);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(entry);
+    CU_ASSERT_EQUAL(entry->nb_apps, 1);
+    bier_application_t *copy = bier_app_get(snapshot, entry->apps[0]);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(copy);
+    CU_ASSERT_EQUAL(copy->proto, BIERPROTO_IPV6);
+    CU_ASSERT_PTR_NULL(copy->shm);
+
+    // Freed once every online reader went through a quiescent state
+    bier_rcu_t rcu;
+    CU_ASSERT_EQUAL_FATAL(bier_rcu_init(&rcu, 2), 0);
+    bier_rcu_online(&rcu, 0);
+    CU_ASSERT_EQUAL(bier_rcu_retire(&rcu, snapshot, count_snapshot_free), 0);
+    CU_ASSERT_TRUE(bier_rcu_reclaim(&rcu));
+    bier_rcu_quiescent(&rcu, 0);
+    CU_ASSERT_FALSE(bier_rcu_reclaim(&rcu));
+    CU_ASSERT_EQUAL(nb_freed_snapshots, 1);
+
+    // Retired structures are freed with the readers stopped
+    CU_ASSERT_EQUAL(bier_rcu_retire(&rcu, bier_apps_snapshot(&all_apps),
+                                    count_snapshot_free), 0);
+    bier_rcu_destroy(&rcu);
+    CU_ASSERT_EQUAL(nb_freed_snapshots, 2);
+    bier_apps_free(&all_apps);
+}
+
+static void write_config(const char *path, const char *config) {
+    FILE *file = fopen(path, "w");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(file);
+    fputs(config, file);
+    fclose(file);
+}
+
+void test_bift_reload() {
+    char path[] = "/tmp/test_bier_configXXXXXX";
+    int fd = mkstemp(path);
+    CU_ASSERT_FATAL(fd >= 0);
+    close(fd);
+    write_config(path,
+                 "20ba::1\n1\n1\n2\n1\n1 1 1 20ba::1\n2 1 10 20bb::1\n");
+    sockaddr_uniform_t local;
+    bier_bift_table_t *table = read_bift_table(path, false, &local);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(table);
+    CU_ASSERT_EQUAL(table->nb_bift, 1);
+    CU_ASSERT_EQUAL(local.v6.sin6_family, AF_INET6);
+
+    bier_bift_t bier = {};
+    bier.origin = &bier;
+    bier_bift_publish(&bier, table);
+    bier_bift_t view = {};
+    view.origin = &bier;
+
+    // The views follow the published BIFTs
+    write_config(path,
+                 "20ba::1\n2\n1\n2\n2\n1 1 1 20ba::1\n2 1 10 20bb::1\n"
+                 "1\n2\n1\n1 1 1 20ba::1\n2 1 10 20bb::1\n");
+    bier_bift_table_t *reloaded = read_bift_table(path, false, &local);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(reloaded);
+    CU_ASSERT_PTR_EQUAL(bier_bift_publish(&bier, reloaded), table);
+    CU_ASSERT_PTR_EQUAL(bier_bift_table(&view), reloaded);
+    CU_ASSERT_EQUAL(bier_bift_table(&view)->nb_bift, 2);
+    CU_ASSERT_EQUAL(bier_bift_table(&view)->b[0].bier->local_bfr_id, 2);
+    free_bier_bift_table(table);
+
+    // An invalid configuration is rejected
+    write_config(path, "20ba::1\n2\n1\n2\n2\n1 1 1 20ba::1\n");
+    CU_ASSERT_PTR_NULL(read_bift_table(path, false, &local));
+    write_config(path, "not an address\n1\n");
+    CU_ASSERT_PTR_NULL(read_bift_table(path, false, &local));
+    // The partially filled BIFTs are freed
+    write_config(path, "20ba::1\n1\n1\n2\n1\n1 1 1 20ba::1\n");
+    CU_ASSERT_PTR_NULL(read_bift_table(path, false, &local));
+    write_config(path, "20ba::1\n1\n2\n64\n1\n1\n2\n1 1 20ba::2\n");
+    CU_ASSERT_PTR_NULL(read_bift_table(path, false, &local));
+
+    free_bier_bift_table(bier_bift_table(&bier));
+    unlink(path);
+}
+
+static bier_delta_op_t delta_op(bier_delta_op_type type, uint32_t bfr_id,
+                                const char *nei, const uint8_t *fbm) {
+    bier_delta_op_t op = {};
+    op.op = type;
+    op.bfr_id = bfr_id;
+    op.nei_family = AF_UNSPEC;
+    if (nei) {
+        op.nei_family = AF_INET6;
+        CU_ASSERT_EQUAL(inet_pton(AF_INET6, nei, op.nei), 1);
+    }
+    op.fbm = fbm;
+    op.fbm_length = fbm ? 8 : 0;
+    return op;
+}
+
+void test_bift_delta() {
+    char path[] = "/tmp/test_bier_configXXXXXX";
+    int fd = mkstemp(path);
+    CU_ASSERT_FATAL(fd >= 0);
+    close(fd);
+    // A BIER BIFT and a BIER-TE BIFT with an adjacency for the BP 2
+    write_config(path,
+                 "20ba::1\n2\n1\n2\n1\n1 1 1 20ba::1\n2 1 10 20bb::1\n"
+                 "2\n2\n1\n11\n1\n2 1 20bb::1 \n");
+    sockaddr_uniform_t local;
+    bier_bift_table_t *table = read_bift_table(path, false, &local);
+    unlink(path);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(table);
+    const uint8_t fbm_2[8] = {0, 0, 0, 0, 0, 0, 0, 0x2};
+    const uint8_t fbm_3[8] = {0, 0, 0, 0, 0, 0, 0, 0x4};
+    const uint8_t fbm_23[8] = {0, 0, 0, 0, 0, 0, 0, 0x6};
+
+    // Adds the BFR-ID 3 behind a new neighbour, which also becomes an ECMP
+    // member of the BFR-ID 2
+    bier_delta_t delta = {};
+    delta.bift_id = 1;
+    delta.ops[delta.nb_ops++] =
+        delta_op(BIER_DELTA_ADD, 3, "20bc::1", fbm_3);
+    delta.ops[delta.nb_ops++] =
+        delta_op(BIER_DELTA_ADD, 2, "20bc::1", fbm_2);
+    delta.ops[delta.nb_ops++] =
+        delta_op(BIER_DELTA_MODIFY, 2, "20bb::1", fbm_23);
+    bier_delta_garbage_t *garbage = NULL;
+    bier_bift_table_t *new =
+        bier_bift_apply_delta(table, &delta, false, &garbage);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(new);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(garbage);
+    bier_internal_t *old_bier = table->b[0].bier;
+    bier_internal_t *new_bier = new->b[0].bier;
+    CU_ASSERT_EQUAL(old_bier->nb_bft_entry, 2);
+    CU_ASSERT_EQUAL(old_bier->bft[1]->nb_ecmp_entries, 1);
+    CU_ASSERT_EQUAL(old_bier->bft[1]->ecmp_entry[0]->forwarding_bitmask[0],
+                    0x2);
+    CU_ASSERT_EQUAL_FATAL(new_bier->nb_bft_entry, 3);
+    CU_ASSERT_PTR_EQUAL(new_bier->bft[0], old_bier->bft[0]);
+    CU_ASSERT_EQUAL_FATAL(new_bier->bft[1]->nb_ecmp_entries, 2);
+    CU_ASSERT_EQUAL(new_bier->bft[1]->ecmp_entry[0]->forwarding_bitmask[0],
+                    0x6);
+    CU_ASSERT_EQUAL(new_bier->bft[2]->ecmp_entry[0]->forwarding_bitmask[0],
+                    0x4);
+    CU_ASSERT_EQUAL(new_bier->compiled->known_bitmask[0], 0x7);
+    CU_ASSERT_EQUAL(new_bier->compiled->ecmp_bitmask[0], 0x2);
+    CU_ASSERT_EQUAL(new_bier->compiled->nb_neighbours, 3);
+    CU_ASSERT_PTR_EQUAL(new->b[1].bier_te, table->b[1].bier_te);
+    free_bier_delta_garbage(garbage);
+    table = new;
+
+    // Deletes an ECMP member, then the whole entry of the BFR-ID 3
+    delta.nb_ops = 0;
+    delta.ops[delta.nb_ops++] = delta_op(BIER_DELTA_DELETE, 2, "20bc::1", NULL);
+    delta.ops[delta.nb_ops++] = delta_op(BIER_DELTA_DELETE, 3, NULL, NULL);
+    new = bier_bift_apply_delta(table, &delta, false, &garbage);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(new);
+    free_bier_delta_garbage(garbage);
+    table = new;
+    new_bier = table->b[0].bier;
+    CU_ASSERT_EQUAL(new_bier->bft[1]->nb_ecmp_entries, 1);
+    CU_ASSERT_PTR_NULL(new_bier->bft[2]);
+    CU_ASSERT_EQUAL(new_bier->compiled->known_bitmask[0], 0x3);
+
+    // An invalid change rejects the whole delta
+    delta.nb_ops = 0;
+    delta.ops[delta.nb_ops++] = delta_op(BIER_DELTA_ADD, 3, "20bc::1", fbm_3);
+    delta.ops[delta.nb_ops++] = delta_op(BIER_DELTA_MODIFY, 5, "20bc::1", fbm_3);
+    CU_ASSERT_PTR_NULL(bier_bift_apply_delta(table, &delta, false, &garbage));
+    CU_ASSERT_PTR_NULL(garbage);
+    delta.nb_ops = 0;
+    delta.ops[delta.nb_ops++] = delta_op(BIER_DELTA_ADD, 65, "20bc::1", fbm_3);
+    CU_ASSERT_PTR_NULL(bier_bift_apply_delta(table, &delta, false, &garbage));
+    delta.bift_id = 3;
+    CU_ASSERT_PTR_NULL(bier_bift_apply_delta(table, &delta, false, &garbage));
+
+    // Moves the BP 2 of the BIER-TE BIFT to the BP 3
+    delta.bift_id = 2;
+    delta.nb_ops = 0;
+    delta.ops[delta.nb_ops++] = delta_op(BIER_DELTA_ADD, 3, "20bc::1", NULL);
+    delta.ops[delta.nb_ops++] = delta_op(BIER_DELTA_DELETE, 2, NULL, NULL);
+    new = bier_bift_apply_delta(table, &delta, false, &garbage);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(new);
+    bier_te_internal_t *bier_te = new->b[1].bier_te;
+    CU_ASSERT_EQUAL(table->b[1].bier_te->nb_adjacencies, 1);
+    CU_ASSERT_EQUAL_FATAL(bier_te->nb_adjacencies, 1);
+    CU_ASSERT_EQUAL(bier_te->adj_to_bp[0], 3);
+    CU_ASSERT_EQUAL(bier_te->global_bitstring[0], 0x5);
+    CU_ASSERT_PTR_EQUAL(new->b[0].bier, table->b[0].bier);
+    free_bier_delta_garbage(garbage);
+    free_bier_bift_table(new);
+}
+
+void test_bier_te_processing() {
+    char path[] = "/tmp/test_bier_configXXXXXX";
+    int fd = mkstemp(path);
+    CU_ASSERT_FATAL(fd >= 0);
+    close(fd);
+    // Local BP 1 and an adjacency for the BP 2, with a bitstring of 128 bits
+    write_config(path, "10.0.0.1\n1\n2\n100\n1\n11\n1\n2 1 10.0.0.2 \n");
+    sockaddr_uniform_t local;
+    bier_bift_table_t *table = read_bift_table(path, true, &local);
+    unlink(path);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(table);
+
+    // A second adjacency for the BP 2 and one for the BP 70
+    bier_delta_t delta = {};
+    delta.bift_id = 1;
+    const char *neis[] = {"10.0.0.3", "10.0.0.4"};
+    const uint32_t bps[] = {70, 2};
+    for (int i = 0; i < 2; ++i) {
+        bier_delta_op_t *op = &delta.ops[delta.nb_ops++];
+        op->op = BIER_DELTA_ADD;
+        op->bfr_id = bps[i];
+        op->nei_family = AF_INET;
+        CU_ASSERT_EQUAL(inet_pton(AF_INET, neis[i], op->nei), 1);
+    }
+    bier_delta_garbage_t *garbage = NULL;
+    bier_bift_table_t *new =
+        bier_bift_apply_delta(table, &delta, true, &garbage);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(new);
+    free_bier_delta_garbage(garbage);
+    bier_te_internal_t *bft = new->b[0].bier_te;
+    CU_ASSERT_EQUAL(bft->adj_bitmask[0], 0x2);
+    CU_ASSERT_EQUAL(bft->adj_bitmask[1], (uint64_t)1 << 5);
+
+    // Local BP, both BPs with adjacencies and a BP without adjacency
+    uint8_t packet[12 + 16 + 8] = {};
+    uint64_t bitstring[2] = {0x13, (uint64_t)1 << 5};
+    bitstring_store((uint8_t *)get_bitstring_ptr(packet), bitstring, 2);
+    bier_tx_queue_t *tx = init_tx_queue(-1, 8);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(tx);
+    bier_bift_stats_t stats = {};
+    bier_all_apps_t all_apps = {};
+    all_apps.application_socket = -1;
+    CU_ASSERT_EQUAL(bier_te_processing(packet, sizeof(packet), bft, tx,
+                                       &stats, &all_apps, true),
+                    0);
+    CU_ASSERT_EQUAL(stats.drops[BIER_DROP_NO_APP], 1);
+
+    // One copy per adjacency, sorted by BP, without the BPs of the router
+    const char *expected[] = {"10.0.0.2", "10.0.0.4", "10.0.0.3"};
+    CU_ASSERT_EQUAL_FATAL(tx->nb_queued, 3);
+    for (int i = 0; i < 3; ++i) {
+        struct in_addr addr;
+        inet_pton(AF_INET, expected[i], &addr);
+        CU_ASSERT_EQUAL(tx->dsts[i].v4.sin_addr.s_addr, addr.s_addr);
+        uint64_t copy[2];
+        bitstring_load(copy, tx->iovecs[2 * i].iov_base + 12, 2);
+        CU_ASSERT_EQUAL(copy[0], 0x10);
+        CU_ASSERT_EQUAL(copy[1], 0);
+    }
+    tx->nb_queued = 0;
+    free_tx_queue(tx);
+    free_bier_bift_table(new);
+}
+
+void test_bsl() {
+    CU_ASSERT_EQUAL(bier_bsl_encode(64), 1);
+    CU_ASSERT_EQUAL(bier_bsl_encode(4096), 7);
+    CU_ASSERT_EQUAL(bier_bsl_encode(32), -1);
+    CU_ASSERT_EQUAL(bier_bsl_encode(96), -1);
+    CU_ASSERT_EQUAL(bier_bsl_encode(8192), -1);
+    CU_ASSERT_EQUAL(bier_bsl_decode(2), 128);
+    CU_ASSERT_EQUAL(bier_bsl_decode(0), 0);
+    CU_ASSERT_EQUAL(bier_bsl_decode(8), 0);
+
+    char path[] = "/tmp/test_bier_configXXXXXX";
+    int fd = mkstemp(path);
+    CU_ASSERT_FATAL(fd >= 0);
+    close(fd);
+    sockaddr_uniform_t local;
+    // The bitstring length is given or past the BFR-IDs
+    write_config(path, "20ba::1\n1\n1\n2 100\n1\n1 1 1 20ba::1\n"
+                       "2 1 10 20bb::1\n");
+    CU_ASSERT_PTR_NULL(read_bift_table(path, false, &local));
+    write_config(path, "20ba::1\n1\n1\n3\n1\n1 1 1 20ba::1\n"
+                       "2 1 10 20bb::1\n4 1 1000 20bb::1\n");
+    CU_ASSERT_PTR_NULL(read_bift_table(path, false, &local));
+    write_config(path, "20ba::1\n1\n1\n2 256\n1\n1 1 1 20ba::1\n"
+                       "2 1 10 20bb::1\n");
+    bier_bift_table_t *table = read_bift_table(path, false, &local);
+    unlink(path);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(table);
+    CU_ASSERT_EQUAL(bier_bift_bitstring_length(table, 1), 256);
+    CU_ASSERT_EQUAL(bier_bift_bitstring_length(table, 2), 0);
+
+    bier_bift_t bier = {};
+    bier.origin = &bier;
+    bier_bift_publish(&bier, table);
+    bier.stats = (bier_bift_stats_t *)calloc(BIER_MAX_BIFT,
+                                             sizeof(bier_bift_stats_t));
+    bier.tx = init_tx_queue(-1, 8);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(bier.tx);
+    bier_all_apps_t all_apps = {};
+    all_apps.application_socket = -1;
+
+    // Only for the local BFR, which has no application
+    uint8_t packet[12 + 256 / 8 + 8] = {};
+    set_bier_bift_id(packet, 1);
+    uint64_t bitstring[4] = {1};
+    bitstring_store((uint8_t *)get_bitstring_ptr(packet), bitstring, 4);
+    set_bier_bsl(packet, bier_bsl_encode(64));
+    CU_ASSERT_EQUAL(
+        bier_processing(packet, sizeof(packet), &bier, &all_apps, false), -1);
+    CU_ASSERT_EQUAL(bier.stats[0].drops[BIER_DROP_BSL_MISMATCH], 1);
+    CU_ASSERT_EQUAL(bier.stats[0].drops[BIER_DROP_NO_APP], 0);
+    set_bier_bsl(packet, bier_bsl_encode(256));
+    bier_processing(packet, sizeof(packet), &bier, &all_apps, false);
+    CU_ASSERT_EQUAL(bier.stats[0].drops[BIER_DROP_BSL_MISMATCH], 1);
+    CU_ASSERT_EQUAL(bier.stats[0].drops[BIER_DROP_NO_APP], 1);
+
+    free_tx_queue(bier.tx);
+    free(bier.stats);
+    free_bier_bift_table(table);
+}
+
+void test_bift_sets() {
+    char path[] = "/tmp/test_bier_configXXXXXX";
+    int fd = mkstemp(path);
+    CU_ASSERT_FATAL(fd >= 0);
+    close(fd);
+    sockaddr_uniform_t local;
+    // Duplicate BIFT-ID, BIFT-ID out of 20 bits, SI of a BIER-TE BIFT
+    write_config(path, "20ba::1\n2\n1 7 0 0\n2\n66\n1 1 1 20ba::2\n"
+                       "2 1 10 20ba::3\n1 7 0 1\n2\n66\n1 1 1 20ba::2\n"
+                       "2 1 10 20ba::3\n");
+    CU_ASSERT_PTR_NULL(read_bift_table(path, false, &local));
+    write_config(path, "20ba::1\n1\n1 1048576 0 0\n2\n66\n1 1 1 20ba::2\n"
+                       "2 1 10 20ba::3\n");
+    CU_ASSERT_PTR_NULL(read_bift_table(path, false, &local));
+    write_config(path, "20ba::1\n1\n2 7 0 1\n2\n1\n11\n1\n2 1 20bb::1 \n");
+    CU_ASSERT_PTR_NULL(read_bift_table(path, false, &local));
+
+    // The BFR-ID 66 is the bit 2 of the set 1
+    write_config(path, "20ba::1\n2\n1 100 0 0\n2\n66\n1 1 1 20ba::2\n"
+                       "2 1 10 20ba::3\n1 2049 0 1\n2 64\n66\n"
+                       "1 1 1 20bb::1\n2 1 10 20ba::1\n");
+    bier_bift_table_t *table = read_bift_table(path, false, &local);
+    unlink(path);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(table);
+    CU_ASSERT_EQUAL(bier_bift_find(table, 100), 0);
+    CU_ASSERT_EQUAL(bier_bift_find(table, 2049), 1);
+    CU_ASSERT_EQUAL(bier_bift_find(table, 1), -1);
+    CU_ASSERT_EQUAL(bier_bift_find(table, 2048), -1);
+    CU_ASSERT_EQUAL(bier_bift_find(table, (1 << 20) | 100), -1);
+    CU_ASSERT_EQUAL(bier_bift_find_set(table, 0, 0, 64), 0);
+    CU_ASSERT_EQUAL(bier_bift_find_set(table, 0, 1, 64), 1);
+    CU_ASSERT_EQUAL(bier_bift_find_set(table, 1, 1, 64), -1);
+    CU_ASSERT_EQUAL(bier_bift_find_set(table, 0, 1, 128), -1);
+    CU_ASSERT_EQUAL(table->b[0].bier->compiled->local_idx, 65);
+    CU_ASSERT_EQUAL(table->b[1].bier->compiled->local_idx, 1);
+    CU_ASSERT_EQUAL(table->b[1].bier->compiled->local_bitmask[0], 0x2);
+
+    bier_bift_t bier = {};
+    bier.origin = &bier;
+    bier_bift_publish(&bier, table);
+    bier.stats = (bier_bift_stats_t *)calloc(BIER_MAX_BIFT,
+                                             sizeof(bier_bift_stats_t));
+    bier.tx = init_tx_queue(-1, 8);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(bier.tx);
+    bier_all_apps_t all_apps = {};
+    all_apps.application_socket = -1;
+
+    // Delivered to the local router in the set 1, without application
+    uint8_t packet[12 + 8 + 8] = {};
+    set_bier_bift_id(packet, 2049);
+    set_bier_bsl(packet, bier_bsl_encode(64));
+    uint64_t bitstring = 0x2;
+    bitstring_store((uint8_t *)get_bitstring_ptr(packet), &bitstring, 1);
+    bier_processing(packet, sizeof(packet), &bier, &all_apps, false);
+    CU_ASSERT_EQUAL(bier.stats[1].packets_in, 1);
+    CU_ASSERT_EQUAL(bier.stats[1].drops[BIER_DROP_NO_APP], 1);
+    set_bier_bift_id(packet, 1);
+    CU_ASSERT_EQUAL(
+        bier_processing(packet, sizeof(packet), &bier, &all_apps, false), -1);
+    CU_ASSERT_EQUAL(bier.unknown_bift_stats.drops[BIER_DROP_UNKNOWN_BIFT_ID],
+                    1);
+
+    // A delta finds its BIFT by BIFT-ID
+    bier_delta_t delta = {};
+    delta.bift_id = 2049;
+    delta.ops[delta.nb_ops++] = delta_op(BIER_DELTA_DELETE, 1, NULL, NULL);
+    bier_delta_garbage_t *garbage = NULL;
+    bier_bift_table_t *new =
+        bier_bift_apply_delta(table, &delta, false, &garbage);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(new);
+    free_bier_delta_garbage(garbage);
+    CU_ASSERT_EQUAL(bier_bift_find(new, 2049), 1);
+    CU_ASSERT_EQUAL(bier_bift_find(new, 100), 0);
+    CU_ASSERT_PTR_NULL(new->b[1].bier->bft[0]);
+    delta.bift_id = 2;
+    CU_ASSERT_PTR_NULL(bier_bift_apply_delta(new, &delta, false, &garbage));
+
+    // A reload keeps the counters of a BIFT-ID wherever the BIFT is in the
+    // table, and a new BIFT does not get those of a removed one
+    bier_bift_publish(&bier, new);
+    write_config(path, "20ba::1\n2\n1 2049 0 1\n2 64\n66\n1 1 1 20bb::1\n"
+                       "2 1 10 20ba::1\n1 300 0 0\n2\n66\n1 1 1 20ba::2\n"
+                       "2 1 10 20ba::3\n");
+    bier_bift_table_t *reloaded = read_bift_table(path, false, &local);
+    unlink(path);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(reloaded);
+    bier.stats[0].packets_in = 5;
+    bier_bift_keep_stats(&bier, reloaded);
+    CU_ASSERT_EQUAL(reloaded->b[0].stats_idx, 1);
+    CU_ASSERT(reloaded->b[1].stats_idx > 1);
+    CU_ASSERT_EQUAL(bier.stats[reloaded->b[1].stats_idx].packets_in, 0);
+    free_bier_bift_table(bier_bift_publish(&bier, reloaded));
+    set_bier_bift_id(packet, 2049);
+    bier_processing(packet, sizeof(packet), &bier, &all_apps, false);
+    CU_ASSERT_EQUAL(bier.stats[1].packets_in, 2);
+
+    free_tx_queue(bier.tx);
+    free(bier.stats);
+    free_bier_bift_table(reloaded);
+}
+
+#define SHM_NB_SLOTS 8
+
+void test_shm_ring() {
+    size_t size = bier_shm_size(SHM_NB_SLOTS);
+    void *mem = calloc(1, size);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(mem);
+    bier_shm_ring_t rings[2];
+    CU_ASSERT_EQUAL(bier_shm_map_rings(mem, size - 1, SHM_NB_SLOTS, rings), -1);
+    CU_ASSERT_EQUAL(bier_shm_map_rings(mem, size, 6, rings), -1);
+    CU_ASSERT_EQUAL_FATAL(bier_shm_map_rings(mem, size, SHM_NB_SLOTS, rings), 0);
+    bier_shm_ring_t *ring = &rings[0];
+    ring->efd = eventfd(0, EFD_NONBLOCK);
+    CU_ASSERT_FATAL(ring->efd >= 0);
+    uint32_t length;
+    CU_ASSERT_PTR_NULL(bier_shm_ring_peek(ring, &length));
+
+    // Wraps around the ring several times, filling it each time
+    for (int round = 0; round < 3; ++round) {
+        for (int i = 0; i < SHM_NB_SLOTS; ++i) {
+            uint8_t *slot = bier_shm_ring_reserve(ring);
+            CU_ASSERT_PTR_NOT_NULL_FATAL(slot);
+            memset(slot, round * SHM_NB_SLOTS + i, i + 1);
+            bier_shm_ring_publish(ring, i + 1);
+        }
+        CU_ASSERT_PTR_NULL(bier_shm_ring_reserve(ring));
+        for (int i = 0; i < SHM_NB_SLOTS; ++i) {
+            uint8_t *msg = bier_shm_ring_peek(ring, &length);
+            CU_ASSERT_PTR_NOT_NULL_FATAL(msg);
+            CU_ASSERT_EQUAL(length, i + 1);
+            CU_ASSERT_EQUAL(msg[i], round * SHM_NB_SLOTS + i);
+            bier_shm_ring_release(ring);
+        }
+        CU_ASSERT_PTR_NULL(bier_shm_ring_peek(ring, &length));
+    }
+    // No wakeup while the consumer does not wait
+    eventfd_t value;
+    CU_ASSERT_EQUAL(eventfd_read(ring->efd, &value), -1);
+
+    // The consumer cannot sleep on a non-empty ring
+    bier_shm_ring_publish(ring, 1);
+    CU_ASSERT_FALSE(bier_shm_ring_prepare_sleep(ring));
+    CU_ASSERT_PTR_NOT_NULL(bier_shm_ring_peek(ring, &length));
+    bier_shm_ring_release(ring);
+    // A single wakeup once the consumer waits
+    CU_ASSERT_TRUE(bier_shm_ring_prepare_sleep(ring));
+    bier_shm_ring_publish(ring, 1);
+    bier_shm_ring_publish(ring, 1);
+    CU_ASSERT_EQUAL(eventfd_read(ring->efd, &value), 0);
+    CU_ASSERT_EQUAL(value, 1);
+
+    // A length larger than a slot is never trusted
+    bier_shm_ring_release(ring);
+    bier_shm_ring_reserve(ring);
+    bier_shm_ring_publish(ring, BIER_SHM_SLOT_SIZE);
+    bier_shm_ring_release(ring);
+    CU_ASSERT_PTR_NOT_NULL(bier_shm_ring_peek(ring, &length));
+    CU_ASSERT_EQUAL(length, 0);
+
+    // Nor a head beyond the slots the producer could have filled
+    CU_ASSERT_TRUE(bier_shm_ring_is_valid(ring));
+    atomic_fetch_add(&ring->hdr->head, SHM_NB_SLOTS);
+    CU_ASSERT_FALSE(bier_shm_ring_is_valid(ring));
+
+    close(ring->efd);
+    free(mem);
+}
+
+/**
+ * @brief Creates the memfd of a channel as an application would
+ */
+static int create_shm_memfd(size_t size, bool seal) {
+    int memfd = memfd_create("test-shm", MFD_ALLOW_SEALING);
+    if (memfd < 0 || ftruncate(memfd, size) < 0) {
+        return -1;
+    }
+    if (seal && fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW) < 0) {
+        return -1;
+    }
+    return memfd;
+}
+
+void test_shm_attach() {
+    bier_all_apps_t all_apps = {};
+    bier_application_t *app;
+    bier_app_handle_t handle = bier_app_register(&all_apps, &app);
+    CU_ASSERT_NOT_EQUAL_FATAL(handle, BIER_APP_INVALID_HANDLE);
+    strcpy(app->app_addr.sun_path, "/tmp/test-app");
+    bier_shm_request_t request = {"/tmp/test-app", SHM_NB_SLOTS, true};
+    size_t size = bier_shm_size(SHM_NB_SLOTS);
+
+    // The size of the memory must be sealed and match the number of slots
+    CU_ASSERT_PTR_NULL(bier_shm_attach(&all_apps, &request,
+                                       create_shm_memfd(size, false),
+                                       eventfd(0, 0), eventfd(0, 0)));
+    CU_ASSERT_PTR_NULL(bier_shm_attach(&all_apps, &request,
+                                       create_shm_memfd(size / 2, true),
+                                       eventfd(0, 0), eventfd(0, 0)));
+    CU_ASSERT_EQUAL(all_apps.nb_shm_channels, 0);
+
+    int memfd = create_shm_memfd(size, true);
+    CU_ASSERT_FATAL(memfd >= 0);
+    void *mem =
+        mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    CU_ASSERT_FATAL(mem != MAP_FAILED);
+    bier_shm_channel_t *channel = bier_shm_attach(
+        &all_apps, &request, memfd, eventfd(0, 0), eventfd(0, 0));
+    CU_ASSERT_PTR_NOT_NULL_FATAL(channel);
+    CU_ASSERT_PTR_EQUAL(app->shm, channel);
+    CU_ASSERT_PTR_EQUAL(bier_shm_find(&all_apps, "/tmp/test-app"), channel);
+
+    // Deliveries are visible in the mapping of the application
+    uint8_t payload[100];
+    memset(payload, 0x2a, sizeof(payload));
+    bier_received_packet_t packet = {};
+    packet.payload = payload;
+    packet.payload_length = sizeof(payload);
+    packet.upstream_router_bfr_id = 3;
+    CU_ASSERT_EQUAL(encode_local_bier_frame_shm(&channel->tx, &packet),
+                    sizeof(bier_frame_header_t) + sizeof(payload));
+    bier_shm_ring_t rings[2];
+    CU_ASSERT_EQUAL_FATAL(bier_shm_map_rings(mem, size, SHM_NB_SLOTS, rings), 0);
+    uint32_t length;
+    uint8_t *msg = bier_shm_ring_peek(&rings[1], &length);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(msg);
+    CU_ASSERT_TRUE(is_bier_frame(msg, length));
+    bier_frame_header_t *frame = (bier_frame_header_t *)msg;
+    CU_ASSERT_EQUAL(frame->payload_length, sizeof(payload));
+    CU_ASSERT_EQUAL(frame->upstream_router_bfr_id, 3);
+    CU_ASSERT_EQUAL(memcmp(msg + sizeof(bier_frame_header_t), payload,
+                           sizeof(payload)), 0);
+
+    // Detaching brings the application back to the UNIX socket
+    CU_ASSERT_EQUAL(bier_shm_detach(&all_apps, "/tmp/test-app"), 0);
+    CU_ASSERT_PTR_NULL(app->shm);
+    CU_ASSERT_EQUAL(bier_shm_detach(&all_apps, "/tmp/test-app"), -1);
+    munmap(mem, size);
+    bier_apps_free(&all_apps);
+}
+
+void test_coalesced_deliveries() {
+    // The local BFR is the only entry of the BFT
+    bier_internal_t bft = {};
+    bft.local_bfr_id = 1;
+    bft.nb_bft_entry = 1;
+    bft.bitstring_length = 64;
+    uint64_t forwarding_bitmask = 1;
+    bier_bft_entry_ecmp_t ecmp_entry = {};
+    ecmp_entry.forwarding_bitmask = &forwarding_bitmask;
+    ecmp_entry.bitstring_length = 64;
+    ecmp_entry.bfr_nei_addr.v4.sin_family = AF_INET;
+    bier_bft_entry_ecmp_t *ecmp_ptr = &ecmp_entry;
+    bier_bft_entry_t entry = {1, 1, &ecmp_ptr};
+    bier_bft_entry_t *bft_ptr = &entry;
+    bft.bft = &bft_ptr;
+    bft.compiled = compile_bier_bft(&bft, true);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(bft.compiled);
+
+    // Two applications receive raw packets as binary frames
+    bier_all_apps_t all_apps = {};
+    all_apps.application_socket = socket(AF_UNIX, SOCK_DGRAM, 0);
+    CU_ASSERT_FATAL(all_apps.application_socket >= 0);
+    int app_sockets[2];
+    struct sockaddr_un app_addrs[2];
+    for (int i = 0; i < 2; ++i) {
+        app_sockets[i] = socket(AF_UNIX, SOCK_DGRAM, 0);
+        CU_ASSERT_FATAL(app_sockets[i] >= 0);
+        bier_application_t *app;
+        bier_app_handle_t handle = bier_app_register(&all_apps, &app);
+        app->app_addr.sun_family = AF_UNIX;
+        snprintf(app->app_addr.sun_path, sizeof(app->app_addr.sun_path),
+                 "/tmp/test-bier-app-%d-%d", getpid(), i);
+        app->addrlen = sizeof(struct sockaddr_un);
+        app->use_frames = true;
+        memcpy(&app_addrs[i], &app->app_addr, sizeof(struct sockaddr_un));
+        remove(app->app_addr.sun_path);
+        CU_ASSERT_FATAL(bind(app_sockets[i], (struct sockaddr *)&app->app_addr,
+                             app->addrlen) == 0);
+        CU_ASSERT_EQUAL_FATAL(bier_demux_add(&all_apps.demux,
+                                             BIERPROTO_RESERVED_RAW, 0, NULL,
+                                             handle), 0);
+    }
+
+    bier_tx_queue_t *tx = init_tx_queue(-1, 4);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(tx);
+    bier_bift_stats_t stats = {};
+    uint8_t packets[3][12 + 8 + 100];
+    for (int i = 0; i < 3; ++i) {
+        memset(packets[i], i, sizeof(packets[i]));
+        memset(packets[i], 0, 12);
+        set_bier_proto(packets[i], BIERPROTO_RESERVED_RAW);
+        set_bitstring(packets[i], 0, 1);
+        CU_ASSERT_EQUAL(bier_non_te_processing(packets[i], sizeof(packets[i]),
+                                               &bft, tx, &stats, &all_apps,
+                                               true), 0);
+    }
+    // Nothing is sent before the end of the batch
+    CU_ASSERT_EQUAL(bier_stats_read(stats.local_deliveries), 0);
+    CU_ASSERT_EQUAL(bier_app_deliveries_flush(&all_apps), 0);
+    CU_ASSERT_EQUAL(bier_stats_read(stats.local_deliveries), 6);
+
+    // A single message per application, received in several calls
+    // interleaved between the two sockets
+    bier_recv_mmsghdr_t msgs[2] = {};
+    uint8_t buffers[2][200];
+    for (int i = 0; i < 2; ++i) {
+        msgs[i].buf = buffers[i];
+        msgs[i].len = sizeof(buffers[i]);
+    }
+    static bier_recv_ctx_t ctxs[2];
+    for (int i = 0; i < 2; ++i) {
+        bier_recv_ctx_init(&ctxs[i], app_sockets[i]);
+        CU_ASSERT_FALSE(bier_recv_pending(&ctxs[i]));
+    }
+    CU_ASSERT_EQUAL(recvmmsg_bier(&ctxs[0], msgs, 1, MSG_DONTWAIT), 1);
+    CU_ASSERT_EQUAL(msgs[0].msg_len, 100);
+    CU_ASSERT_EQUAL(buffers[0][99], 0);
+    CU_ASSERT_TRUE(bier_recv_pending(&ctxs[0]));
+    CU_ASSERT_EQUAL(recvmmsg_bier(&ctxs[1], msgs, 2, MSG_DONTWAIT), 2);
+    CU_ASSERT_EQUAL(buffers[0][99], 0);
+    CU_ASSERT_EQUAL(buffers[1][99], 1);
+    CU_ASSERT_EQUAL(recvmmsg_bier(&ctxs[0], msgs, 2, MSG_DONTWAIT), 2);
+    CU_ASSERT_EQUAL(msgs[0].msg_len, 100);
+    CU_ASSERT_EQUAL(buffers[0][99], 1);
+    CU_ASSERT_EQUAL(msgs[1].msg_len, 100);
+    CU_ASSERT_EQUAL(buffers[1][99], 2);
+    CU_ASSERT_FALSE(bier_recv_pending(&ctxs[0]));
+    CU_ASSERT_TRUE(bier_recv_pending(&ctxs[1]));
+    CU_ASSERT_EQUAL(recvmmsg_bier(&ctxs[1], msgs, 2, MSG_DONTWAIT), 1);
+    CU_ASSERT_EQUAL(buffers[0][99], 2);
+    for (int i = 0; i < 2; ++i) {
+        CU_ASSERT_EQUAL(recvmmsg_bier(&ctxs[i], msgs, 2, MSG_DONTWAIT), -1);
+        CU_ASSERT_EQUAL(errno, EAGAIN);
+        remove(app_addrs[i].sun_path);
+        close(app_sockets[i]);
+    }
+    close(all_apps.application_socket);
+    free_tx_queue(tx);
+    free_compiled_bft(bft.compiled);
+    bier_apps_free(&all_apps);
+}
+
+void test_encap_in_headroom() {
+    uint64_t bitstring[2] = {0x8000000000000011, 0x3};
+    uint8_t payload[50];
+    memset(payload, 0x2a, sizeof(payload));
+    bier_header_t *bh = init_bier_header(bitstring, 128, BIERPROTO_IPV6, 2);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(bh);
+    my_packet_t *expected = encap_bier_packet(bh, sizeof(payload), payload);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(expected);
+
+    // The bitstring is in the headroom, as in a received message
+    uint8_t buffer[64 + sizeof(payload)];
+    uint8_t *message_payload = &buffer[64];
+    memcpy(message_payload, payload, sizeof(payload));
+    memcpy(&buffer[40], bitstring, sizeof(bitstring));
+    uint8_t *packet = encap_bier_packet_in_headroom(
+        buffer, message_payload, &buffer[40], 128, BIERPROTO_IPV6, 2);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(packet);
+    CU_ASSERT_EQUAL(message_payload + sizeof(payload) - packet,
+                    expected->packet_length);
+    CU_ASSERT_EQUAL(memcmp(packet, expected->packet, expected->packet_length),
+                    0);
+
+    // Not enough headroom or invalid bitstring length
+    CU_ASSERT_PTR_NULL(encap_bier_packet_in_headroom(
+        &buffer[40], message_payload, &buffer[40], 128, BIERPROTO_IPV6, 2));
+    CU_ASSERT_PTR_NULL(encap_bier_packet_in_headroom(
+        buffer, message_payload, &buffer[40], 96, BIERPROTO_IPV6, 2));
+
+    // A packet built by the caller gets its header in front of it
+    my_packet_t *in_place = my_packet_alloc(sizeof(payload));
+    CU_ASSERT_PTR_NOT_NULL_FATAL(in_place);
+    memcpy(in_place->packet, payload, sizeof(payload));
+    uint8_t *in_place_payload = in_place->packet;
+    CU_ASSERT_PTR_EQUAL(encap_bier_packet_in_place(bh, in_place), in_place);
+    CU_ASSERT_PTR_EQUAL(in_place->packet,
+                        in_place_payload - bh->header_length);
+    CU_ASSERT_EQUAL(in_place->packet_length, expected->packet_length);
+    CU_ASSERT_EQUAL(
+        memcmp(in_place->packet, expected->packet, expected->packet_length), 0);
+    my_packet_free(in_place);
+
+    my_packet_free(expected);
+    release_bier_header(bh);
+}
+
+void test_pktbuf_pool() {
+    bier_pktbuf_pool_t pool;
+    CU_ASSERT_EQUAL_FATAL(bier_pktbuf_pool_init(&pool, 2), 0);
+    bier_pktbuf_t *a = bier_pktbuf_alloc(&pool);
+    bier_pktbuf_t *b = bier_pktbuf_alloc(&pool);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(a);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(b);
+    CU_ASSERT_PTR_NULL(bier_pktbuf_alloc(&pool));
+    CU_ASSERT_EQUAL(pool.nb_free, 0);
+
+    // Headers are prepended in the headroom, in front of the payload
+    uint8_t *payload = bier_pktbuf_append(a, 100);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(payload);
+    CU_ASSERT_PTR_EQUAL(bier_pktbuf_prepend(a, 40), payload - 40);
+    CU_ASSERT_EQUAL(a->length, 140);
+    CU_ASSERT_PTR_NULL(bier_pktbuf_prepend(a, BIER_PKTBUF_HEADROOM));
+    CU_ASSERT_PTR_NULL(bier_pktbuf_append(a, BIER_PKTBUF_DATA_ROOM));
+    CU_ASSERT_EQUAL(a->length, 140);
+    CU_ASSERT_PTR_EQUAL(bier_pktbuf_from_priv(a->priv), a);
+
+    bier_pktbuf_release(a);
+    CU_ASSERT_EQUAL(pool.nb_free, 1);
+    // A released buffer starts again right after the headroom
+    bier_pktbuf_t *c = bier_pktbuf_alloc(&pool);
+    CU_ASSERT_PTR_EQUAL(c, a);
+    CU_ASSERT_EQUAL(c->length, 0);
+    CU_ASSERT_PTR_EQUAL(c->data, &c->room[BIER_PKTBUF_HEADROOM]);
+    bier_pktbuf_release(b);
+    bier_pktbuf_release(c);
+    CU_ASSERT_EQUAL(pool.nb_free, 2);
+    bier_pktbuf_pool_destroy(&pool);
+
+    // The packets of the sender functions come from the pool of the thread
+    bier_pktbuf_pool_t *thread_pool = bier_pktbuf_thread_pool();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(thread_pool);
+    uint32_t nb_free = thread_pool->nb_free;
+    uint64_t bitstring = 0x5;
+    bier_header_t *bh = init_bier_header(&bitstring, 64, BIERPROTO_IPV6, 1);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(bh);
+    struct in6_addr src = {}, dst = {};
+    uint8_t data[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+    my_packet_t *packet =
+        create_bier_ipv6_from_payload(bh, &src, &dst, sizeof(data), data);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(packet);
+    CU_ASSERT_EQUAL(thread_pool->nb_free, nb_free - 2);
+    CU_ASSERT_EQUAL(packet->packet_length, 20 + 40 + 8 + sizeof(data));
+    CU_ASSERT_EQUAL(memcmp(packet->packet, bh->_header, bh->header_length), 0);
+    CU_ASSERT_EQUAL(packet->packet[20 + 6], IPPROTO_UDP);
+    CU_ASSERT_EQUAL(memcmp(&packet->packet[20 + 48], data, sizeof(data)), 0);
+    uint8_t too_long[BIER_PKTBUF_DATA_ROOM + 1] = {};
+    CU_ASSERT_PTR_NULL(encap_bier_packet(bh, sizeof(too_long), too_long));
+    CU_ASSERT_EQUAL(thread_pool->nb_free, nb_free - 2);
+    my_packet_free(packet);
+    release_bier_header(bh);
+    CU_ASSERT_EQUAL(thread_pool->nb_free, nb_free);
+    bier_pktbuf_thread_pool_free();
+}
+
+#define ECMP_NB_ENTRIES 4
+
+void test_ecmp_selection() {
+    // A single BFR-ID reached through 4 ECMP entries
+    uint64_t forwarding_bitmask = 1;
+    bier_bft_entry_ecmp_t ecmp_entries[ECMP_NB_ENTRIES] = {};
+    bier_bft_entry_ecmp_t *ecmp_ptrs[ECMP_NB_ENTRIES];
+    for (int i = 0; i < ECMP_NB_ENTRIES; ++i) {
+        ecmp_entries[i].forwarding_bitmask = &forwarding_bitmask;
+        ecmp_entries[i].bitstring_length = 64;
+        ecmp_entries[i].bfr_nei_addr.v4.sin_family = AF_INET;
+        ecmp_entries[i].bfr_nei_addr.v4.sin_addr.s_addr = htonl(i + 1);
+        ecmp_ptrs[i] = &ecmp_entries[i];
+    }
+    bier_bft_entry_t entry = {1, ECMP_NB_ENTRIES, ecmp_ptrs};
+    bier_bft_entry_t *entry_ptr = &entry;
+    bier_internal_t bft = {};
+    bft.local_bfr_id = 2;
+    bft.nb_bft_entry = 1;
+    bft.bitstring_length = 64;
+    bft.bft = &entry_ptr;
+    bier_bft_compiled_t *compiled = compile_bier_bft(&bft, true);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(compiled);
+    CU_ASSERT_EQUAL_FATAL(compiled->ecmp_stride, ECMP_NB_ENTRIES);
+
+    for (int n = 1; n <= ECMP_NB_ENTRIES; ++n) {
+        // Every entry gets its share of the slots
+        const uint8_t *select =
+            &compiled->ecmp_select[n * BIER_ECMP_SELECT_SIZE];
+        int nb_slots[ECMP_NB_ENTRIES] = {};
+        for (int slot = 0; slot < BIER_ECMP_SELECT_SIZE; ++slot) {
+            CU_ASSERT_FATAL(select[slot] < n);
+            ++nb_slots[select[slot]];
+        }
+        for (int i = 0; i < n; ++i) {
+            CU_ASSERT(nb_slots[i] * n > BIER_ECMP_SELECT_SIZE * 2 / 3);
+            CU_ASSERT(nb_slots[i] * n < BIER_ECMP_SELECT_SIZE * 4 / 3);
+        }
+        // A new entry only takes over slots, the others keep their entry
+        for (int slot = 0; n > 1 && slot < BIER_ECMP_SELECT_SIZE; ++slot) {
+            CU_ASSERT(select[slot] == n - 1 ||
+                      select[slot] == select[slot - BIER_ECMP_SELECT_SIZE]);
+        }
+    }
+
+    // Consecutive entropies are spread over the slots
+    int nb_entropies[ECMP_NB_ENTRIES] = {};
+    const uint8_t *select =
+        &compiled->ecmp_select[ECMP_NB_ENTRIES * BIER_ECMP_SELECT_SIZE];
+    for (uint32_t entropy = 0; entropy < 1024; ++entropy) {
+        ++nb_entropies[select[bier_ecmp_slot(entropy)]];
+    }
+    for (int i = 0; i < ECMP_NB_ENTRIES; ++i) {
+        CU_ASSERT(nb_entropies[i] > 1024 / ECMP_NB_ENTRIES * 2 / 3);
+    }
+    free_compiled_bft(compiled);
+}
+
+void test_flow_entropy() {
+    uint8_t packet[40 + 8 + 16] = {};
+    packet[0] = 0x60;
+    packet[6] = IPPROTO_UDP;
+    packet[23] = 1;  // Source address
+    packet[24] = 0xff;  // Destination address
+    packet[40] = 0x12;  // Source port
+    uint32_t entropy =
+        bier_flow_entropy(packet, sizeof(packet), BIERPROTO_IPV6);
+    CU_ASSERT(entropy < (1 << 20));
+
+    // The payload of the flow is not hashed
+    memset(&packet[48], 0x2a, 16);
+    CU_ASSERT_EQUAL(bier_flow_entropy(packet, sizeof(packet), BIERPROTO_IPV6),
+                    entropy);
+    packet[40] = 0x13;
+    CU_ASSERT_NOT_EQUAL(
+        bier_flow_entropy(packet, sizeof(packet), BIERPROTO_IPV6), entropy);
+    CU_ASSERT_EQUAL(bier_flow_entropy(packet, 39, BIERPROTO_IPV6), 0);
+    CU_ASSERT_EQUAL(
+        bier_flow_entropy(packet, sizeof(packet), BIERPROTO_RESERVED_RAW), 0);
+}
+
 int main()
 {
     CU_initialize_registry();
@@ -110,11 +1451,32 @@ int main()
     
     CU_add_test(bier_header_manip, "Set BIER BSL", test_set_bier_bsl);
     CU_add_test(bier_header_manip, "Set BIER proto", test_set_bier_proto);
+    CU_add_test(bier_header_manip, "Set entropy", test_set_entropy);
     CU_add_test(bier_header_manip, "Set BIER Bitstring ptr", test_set_bitstring_ptr);
     CU_add_test(bier_header_manip, "Set bitstring", test_set_bitstring);
     CU_add_test(bier_header_manip, "Get bift", test_get_bift_id);
     CU_add_test(bier_header_manip, "Get bitstring ptr", test_get_bitstring_ptr);
     CU_add_test(bier_header_manip, "Get bitstring", test_get_bitstring);
+    CU_add_test(bier_header_manip, "Encapsulate in headroom", test_encap_in_headroom);
+    CU_add_test(bier_header_manip, "Packet buffer pool", test_pktbuf_pool);
+
+    CU_pSuite bier_forwarding = CU_add_suite("BIER forwarding", 0, 0);
+
+    CU_add_test(bier_forwarding, "Non-TE processing against RFC 8279 loop", test_non_te_processing_differential);
+    CU_add_test(bier_forwarding, "Application demux", test_demux_lookup);
+    CU_add_test(bier_forwarding, "Application registry", test_app_registry);
+    CU_add_test(bier_forwarding, "Applications snapshot", test_apps_snapshot_rcu);
+    CU_add_test(bier_forwarding, "BIFT reload", test_bift_reload);
+    CU_add_test(bier_forwarding, "BIFT delta", test_bift_delta);
+    CU_add_test(bier_forwarding, "ECMP selection", test_ecmp_selection);
+    CU_add_test(bier_forwarding, "BIER-TE processing", test_bier_te_processing);
+    CU_add_test(bier_forwarding, "BSL validation", test_bsl);
+    CU_add_test(bier_forwarding, "BIFT-ID lookup and sets", test_bift_sets);
+    CU_add_test(bier_forwarding, "Flow entropy", test_flow_entropy);
+    CU_add_test(bier_forwarding, "TX queue per-message errors", test_tx_queue_per_message_errors);
+    CU_add_test(bier_forwarding, "Coalesced local deliveries", test_coalesced_deliveries);
+    CU_add_test(bier_forwarding, "Shared memory ring", test_shm_ring);
+    CU_add_test(bier_forwarding, "Shared memory attach", test_shm_attach);
 
     CU_basic_run_tests();
     CU_basic_show_failures(CU_get_failure_list());
@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "CUnit/Basic.h"
+#include "../include/bitstring.h"
+
+#define MAX_WORDS 64  // BSL 4096
+
+static uint64_t random_word() {
+    uint64_t word = 0;
+    for (int i = 0; i < 4; ++i) {
+        word = (word << 16) | (rand() & 0xffff);
+    }
+    // Some sparse words to exercise the zero checks
+    return rand() % 4 == 0 ? word & (word >> 7) & (word >> 13) : word;
+}
+
+void test_load_store_scalar() {
+    CU_ASSERT_EQUAL(bitstring_select(BITSTRING_IMPL_SCALAR), 0);
+    uint8_t packet[16] = {};
+    // BFR-ID 1 is the least significant bit of the bitstring
+    uint64_t bitstring[2] = {1, (uint64_t)1 << 63};
+    CU_ASSERT_TRUE(bitstring_store_and(packet, bitstring, NULL, 2));
+    CU_ASSERT_EQUAL(packet[0], 0x80);
+    CU_ASSERT_EQUAL(packet[15], 0x01);
+
+    uint64_t mask[2] = {1, 0};
+    uint64_t loaded[2];
+    CU_ASSERT_FALSE(bitstring_load_and(loaded, packet, mask, 2));
+    CU_ASSERT_EQUAL(loaded[0], 1);
+    CU_ASSERT_EQUAL(loaded[1], 0);
+    CU_ASSERT_EQUAL(bitstring_popcount(bitstring, 2), 2);
+    bitstring_and_not(bitstring, bitstring, 2);
+    CU_ASSERT_TRUE(bitstring_is_zero(bitstring, 2));
+}
+
+void test_implementations_match_scalar() {
+    uint64_t a[MAX_WORDS], mask[MAX_WORDS];
+    uint8_t packet[MAX_WORDS * 8];
+    bitstring_select(BITSTRING_IMPL_SCALAR);
+    const bitstring_ops_t scalar = bitstring_ops;
+    for (int impl = BITSTRING_IMPL_SCALAR + 1; impl < BITSTRING_IMPL_MAX;
+         ++impl) {
+        if (bitstring_select(impl) != 0) {
+            fprintf(stderr, "Skip unsupported implementation %d\n", impl);
+            continue;
+        }
+        const bitstring_ops_t *ops = &bitstring_ops;
+        for (uint32_t nb_words = 1; nb_words <= MAX_WORDS; ++nb_words) {
+            for (int round = 0; round < 20; ++round) {
+                for (uint32_t i = 0; i < nb_words; ++i) {
+                    a[i] = round % 5 == 0 ? 0 : random_word();
+                    mask[i] = round % 3 == 0 ? ~(uint64_t)0 : random_word();
+                }
+                for (uint32_t i = 0; i < nb_words * 8; ++i) {
+                    packet[i] = rand();
+                }
+
+                uint64_t expected[MAX_WORDS], result[MAX_WORDS];
+                CU_ASSERT_EQUAL(
+                    scalar.load_and(expected, packet, mask, nb_words),
+                    ops->load_and(result, packet, mask, nb_words));
+                CU_ASSERT_EQUAL(
+                    memcmp(expected, result, nb_words * sizeof(uint64_t)), 0);
+                scalar.load_and(expected, packet, NULL, nb_words);
+                ops->load_and(result, packet, NULL, nb_words);
+                CU_ASSERT_EQUAL(
+                    memcmp(expected, result, nb_words * sizeof(uint64_t)), 0);
+
+                uint8_t expected_packet[MAX_WORDS * 8];
+                uint8_t result_packet[MAX_WORDS * 8];
+                CU_ASSERT_EQUAL(
+                    scalar.store_and(expected_packet, a, mask, nb_words),
+                    ops->store_and(result_packet, a, mask, nb_words));
+                CU_ASSERT_EQUAL(
+                    memcmp(expected_packet, result_packet, nb_words * 8), 0);
+
+                memcpy(expected, a, nb_words * sizeof(uint64_t));
+                memcpy(result, a, nb_words * sizeof(uint64_t));
+                scalar.and_not(expected, mask, nb_words);
+                ops->and_not(result, mask, nb_words);
+                CU_ASSERT_EQUAL(
+                    memcmp(expected, result, nb_words * sizeof(uint64_t)), 0);
+
+                CU_ASSERT_EQUAL(scalar.is_zero(a, nb_words),
+                                ops->is_zero(a, nb_words));
+                CU_ASSERT_EQUAL(scalar.popcount(a, nb_words),
+                                ops->popcount(a, nb_words));
+            }
+        }
+    }
+}
+
+int main() {
+    CU_initialize_registry();
+    CU_pSuite bitstring_kernels = CU_add_suite("Bitstring kernels", 0, 0);
+
+    CU_add_test(bitstring_kernels, "Load/store scalar", test_load_store_scalar);
+    CU_add_test(bitstring_kernels, "Implementations match scalar",
+                test_implementations_match_scalar);
+
+    CU_basic_run_tests();
+    CU_basic_show_failures(CU_get_failure_list());
+
+    return 0;
+}
@@ -1,7 +1,10 @@
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include "CUnit/Basic.h"
+#include "../include/public/bier.h"
 #include "../include/qcbor-encoding.h"
+#include <unistd.h>
 
 void test_encoding_decoding() {
     UsefulBuf_MAKE_STACK_UB(Buffer, 300);
@@ -38,11 +41,128 @@ void test_encoding_decoding() {
     }
 }
 
+void test_frame_encoding_decoding() {
+    uint8_t buffer[sizeof(bier_frame_header_t) + 8 + 100];
+    bier_frame_header_t *frame = (bier_frame_header_t *)buffer;
+    memset(buffer, 0, sizeof(buffer));
+    frame->magic = BIER_FRAME_MAGIC;
+    frame->version = BIER_FRAME_VERSION;
+    frame->type = PACKET;
+    frame->proto = BIERPROTO_IPV6;
+    frame->bift_id = 1;
+    frame->bitstring_length = 8;
+    frame->payload_length = 100;
+    memset(&buffer[sizeof(bier_frame_header_t)], 5, 8);
+    memset(&buffer[sizeof(bier_frame_header_t) + 8], 2, 100);
+
+    // Frames are never mistaken for CBOR maps
+    CU_ASSERT_TRUE(is_bier_frame(buffer, sizeof(buffer)));
+    UsefulBuf_MAKE_STACK_UB(Buffer, 10);
+    QCBOREncodeContext ctx;
+    QCBOREncode_Init(&ctx, Buffer);
+    QCBOREncode_OpenMap(&ctx);
+    QCBOREncode_CloseMap(&ctx);
+    UsefulBufC EncodedCBOR;
+    if (QCBOREncode_Finish(&ctx, &EncodedCBOR) == QCBOR_SUCCESS) {
+        CU_ASSERT_FALSE(is_bier_frame(EncodedCBOR.ptr, EncodedCBOR.len));
+    }
+
+    bier_payload_t bier_output;
+    CU_ASSERT_EQUAL(decode_bier_frame(buffer, sizeof(buffer), &bier_output), 0);
+    CU_ASSERT_EQUAL(bier_output.use_bier_te, 1);
+    CU_ASSERT_EQUAL(bier_output.proto, BIERPROTO_IPV6);
+    CU_ASSERT_EQUAL(bier_output.bitstring_length, 8);
+    CU_ASSERT_EQUAL(bier_output.payload_length, 100);
+    CU_ASSERT_EQUAL(bier_output.bitstring[7], 5);
+    CU_ASSERT_EQUAL(bier_output.payload[0], 2);
+    CU_ASSERT_EQUAL(bier_output.payload[99], 2);
+    CU_ASSERT_EQUAL(decode_bier_frame(buffer, sizeof(buffer) - 1, &bier_output),
+                    -1);
+
+    // Delivery to the application
+    int sockets[2];
+    CU_ASSERT_FATAL(socketpair(AF_UNIX, SOCK_DGRAM, 0, sockets) == 0);
+    uint8_t payload[100];
+    memset(payload, 3, sizeof(payload));
+    bier_received_packet_t packet = {};
+    packet.payload = payload;
+    packet.payload_length = sizeof(payload);
+    packet.upstream_router_bfr_id = 7;
+    packet.ip6_encap_src.v6.s6_addr[15] = 1;
+    CU_ASSERT_EQUAL(encode_local_bier_frame(sockets[0], &packet, NULL, 0),
+                    sizeof(bier_frame_header_t) + sizeof(payload));
+    uint8_t received[sizeof(bier_frame_header_t) + sizeof(payload)];
+    CU_ASSERT_EQUAL(recv(sockets[1], received, sizeof(received), 0),
+                    sizeof(received));
+    frame = (bier_frame_header_t *)received;
+    CU_ASSERT_TRUE(is_bier_frame(received, sizeof(received)));
+    CU_ASSERT_EQUAL(frame->bitstring_length, 0);
+    CU_ASSERT_EQUAL(frame->payload_length, sizeof(payload));
+    CU_ASSERT_EQUAL(frame->upstream_router_bfr_id, 7);
+    CU_ASSERT_EQUAL(frame->source_addr[15], 1);
+    CU_ASSERT_EQUAL(received[sizeof(received) - 1], 3);
+    close(sockets[0]);
+    close(sockets[1]);
+}
+
+void test_sendmmsg_bier() {
+    int sockets[2];
+    CU_ASSERT_FATAL(socketpair(AF_UNIX, SOCK_DGRAM, 0, sockets) == 0);
+    uint64_t bitstrings[3] = {0x1, 0x2, 0x4};
+    bier_info_t infos[3] = {};
+    uint8_t payloads[3][1000];
+    bier_mmsghdr_t msgs[5];
+    for (int i = 0; i < 5; ++i) {
+        int j = i % 3;
+        infos[j].send_info.bift_id = j + 1;
+        infos[j].send_info.bitstring = (uint8_t *)&bitstrings[j];
+        infos[j].send_info.bitstring_length = sizeof(uint64_t);
+        memset(payloads[j], j, sizeof(payloads[j]));
+        msgs[i] = (bier_mmsghdr_t){payloads[j], sizeof(payloads[j]),
+                                   BIERPROTO_IPV6 + j, &infos[j]};
+    }
+
+    // Three packets fit in the first message, the two others in the second
+    CU_ASSERT_EQUAL(sendmmsg_bier(sockets[0], msgs, 5, NULL, 0), 5);
+    uint8_t received[BIER_UNIX_MAX_MESSAGE_SIZE];
+    int nb_frames[2] = {3, 2};
+    for (int m = 0, i = 0; m < 2; ++m) {
+        ssize_t length = recv(sockets[1], received, sizeof(received), 0);
+        CU_ASSERT_EQUAL(length,
+                        nb_frames[m] * (sizeof(bier_frame_header_t) + 8 + 1000));
+        size_t offset = 0;
+        for (int f = 0; f < nb_frames[m]; ++f, ++i) {
+            bier_payload_t bier_output;
+            CU_ASSERT_EQUAL_FATAL(decode_bier_frame(&received[offset],
+                                                    length - offset,
+                                                    &bier_output), 0);
+            CU_ASSERT_EQUAL(bier_output.use_bier_te, i % 3 + 1);
+            CU_ASSERT_EQUAL(bier_output.proto, BIERPROTO_IPV6 + i % 3);
+            CU_ASSERT_EQUAL(bier_output.bitstring[0], 1 << (i % 3));
+            CU_ASSERT_EQUAL(bier_output.payload_length, 1000);
+            CU_ASSERT_EQUAL(bier_output.payload[999], i % 3);
+            offset = bier_output.payload + bier_output.payload_length - received;
+        }
+        CU_ASSERT_EQUAL(offset, length);
+    }
+
+    // A packet larger than a message is never sent
+    uint8_t too_large[BIER_UNIX_MAX_MESSAGE_SIZE];
+    msgs[0] = (bier_mmsghdr_t){too_large, sizeof(too_large), BIERPROTO_IPV6,
+                               &infos[0]};
+    CU_ASSERT_EQUAL(sendmmsg_bier(sockets[0], msgs, 2, NULL, 0), -1);
+    CU_ASSERT_EQUAL(errno, EMSGSIZE);
+    close(sockets[0]);
+    close(sockets[1]);
+}
+
 int main() {
     CU_initialize_registry();
     CU_pSuite bier_header_manip = CU_add_suite("QCBOR encoding and decoding", 0, 0);
     
     CU_add_test(bier_header_manip, "Encode/Decode with QCBOR", test_encoding_decoding);
+    CU_add_test(bier_header_manip, "Encode/Decode binary frames", test_frame_encoding_decoding);
+    CU_add_test(bier_header_manip, "Batch send", test_sendmmsg_bier);
 
     CU_basic_run_tests();
     CU_basic_show_failures(CU_get_failure_list());